@@ -40,6 +40,8 @@ Vector Arm::direction() const { return as<HandImplementation>()->armDirection();
 Matrix Arm::basis() const { return as<HandImplementation>()->armBasis(); }
 Vector Arm::elbowPosition() const { return as<HandImplementation>()->elbowPosition(); }
 Vector Arm::wristPosition() const { return as<HandImplementation>()->wristPosition(); }
+Vector Arm::wristVelocity() const { return as<HandImplementation>()->wristVelocity(); }
+Vector Arm::smoothedWristPosition() const { return as<HandImplementation>()->smoothedWristPosition(); }
 Vector Arm::center() const { return as<HandImplementation>()->armCenter(); }
 const Arm& Arm::invalid() { static Arm* s_invalid = new Arm(); return *s_invalid; } // Expected to leak in order to live longer
 bool Arm::isValid() const { return as<HandImplementation>()->isValid(); }
@@ -56,6 +58,8 @@ float Device::verticalViewAngle() const { return as<DeviceImplementation>()->ver
 float Device::range() const { return as<DeviceImplementation>()->range(); }
 float Device::baseline() const { return as<DeviceImplementation>()->baseline(); }
 float Device::distanceToBoundary(const Vector& position) const { return as<DeviceImplementation>()->distanceToBoundary(position); }
+void Device::distanceToBoundary(const Vector* positions, float* distances, size_t count) const { as<DeviceImplementation>()->distanceToBoundary(positions, distances, count); }
+size_t Device::containedInBoundary(const Vector* positions, bool* contained, size_t count) const { return as<DeviceImplementation>()->containedInBoundary(positions, contained, count); }
 bool Device::isStreaming() const { return as<DeviceImplementation>()->isStreaming(); }
 bool Device::isSmudged() const { return as<DeviceImplementation>()->isSmudged(); }
 bool Device::isLightingBad() const { return as<DeviceImplementation>()->isLightingBad(); }
@@ -139,6 +143,12 @@ Finger::Type Finger::type() const { return as<FingerImplementation>()->type(); }
 int32_t Finger::id() const { return as<FingerImplementation>()->id(); }
 Bone Finger::bone(Bone::Type boneIx) const { return as<FingerImplementation>()->bone(boneIx); }
 Vector Finger::tipPosition() const { return as<FingerImplementation>()->tipPosition(); }
+Vector Finger::jointPosition(Joint joint) const { return as<FingerImplementation>()->jointPosition(joint); }
+Vector Finger::jointVelocity(Joint joint) const { return as<FingerImplementation>()->jointVelocity(joint); }
+Vector Finger::jointAcceleration(Joint joint) const { return as<FingerImplementation>()->jointAcceleration(joint); }
+Vector Finger::tipVelocity() const { return as<FingerImplementation>()->jointVelocity(JOINT_TIP); }
+Vector Finger::smoothedJointPosition(Joint joint) const { return as<FingerImplementation>()->smoothedJointPosition(joint); }
+Vector Finger::smoothedTipPosition() const { return as<FingerImplementation>()->smoothedJointPosition(JOINT_TIP); }
 Vector Finger::direction() const { return as<FingerImplementation>()->direction(); }
 float Finger::width() const { return as<FingerImplementation>()->width(); }
 float Finger::length() const { return as<FingerImplementation>()->length(); }
@@ -166,6 +176,10 @@ Finger Hand::finger(int32_t id) const { return as<HandImplementation>()->finger(
 Vector Hand::palmPosition() const { return as<HandImplementation>()->palmPosition(); }
 Vector Hand::stabilizedPalmPosition() const { return as<HandImplementation>()->stabilizedPalmPosition(); }
 Vector Hand::palmVelocity() const { return as<HandImplementation>()->palmVelocity(); }
+Vector Hand::palmAcceleration() const { return as<HandImplementation>()->palmAcceleration(); }
+Vector Hand::smoothedPalmPosition() const { return as<HandImplementation>()->smoothedPalmPosition(); }
+RigidMotion Hand::motionSince(const Hand& since) const { return as<HandImplementation>()->motionSince(*since.as<HandImplementation>()); }
+PoseFeatures Hand::poseFeatures() const { return as<HandImplementation>()->poseFeatures(); }
 Vector Hand::palmNormal() const { return as<HandImplementation>()->palmNormal(); }
 float Hand::palmWidth() const { return as<HandImplementation>()->palmWidth(); }
 Vector Hand::direction() const { return as<HandImplementation>()->direction(); }
@@ -204,6 +218,15 @@ Finger Frame::finger(int32_t id) const { return as<FrameImplementation>()->finge
 ImageList Frame::images() const { return as<FrameImplementation>()->images(); }
 ImageList Frame::rawImages() const { return as<FrameImplementation>()->rawImages(); }
 MapPointList Frame::mapPoints() const { return as<FrameImplementation>()->mapPoints(); }
+HandTransitionList Frame::handTransitions() const { return as<FrameImplementation>()->handTransitions(); }
+RigidMotion Frame::motionSince(const Frame& since) const { return as<FrameImplementation>()->motionSince(*since.as<FrameImplementation>()); }
+size_t Frame::boneInstanceStride(int flags) { return FrameImplementation::boneInstanceStride(flags); }
+size_t Frame::boneInstanceCount(int flags) const { return as<FrameImplementation>()->boneInstanceCount(flags); }
+size_t Frame::writeBoneInstances(void* buffer, size_t bufferSize, int flags) const { return as<FrameImplementation>()->writeBoneInstances(buffer, bufferSize, flags); }
+size_t Frame::handCropCount() const { return as<FrameImplementation>()->handCropCount(); }
+size_t Frame::writeHandCrops(void* buffer, size_t bufferSize, int cropSize, HandCrop* crops, float baseline, float padding, float gain, float offset) const {
+  return as<FrameImplementation>()->writeHandCrops(buffer, bufferSize, cropSize, crops, baseline, padding, gain, offset);
+}
 float Frame::currentFramesPerSecond() const { return as<FrameImplementation>()->currentFramesPerSecond(); }
 bool Frame::isValid() const { return as<FrameImplementation>()->isValid(); }
 const Frame& Frame::invalid() { static Frame* s_invalid = new Frame(); return *s_invalid; } // Expected to leak in order to live longer
@@ -216,6 +239,64 @@ const char* Frame::toCString(size_t& length) const {
   return str.c_str();
 }
 
+// CollisionScene
+
+CollisionScene::CollisionScene() : Interface(std::make_shared<CollisionSceneImplementation>()) {}
+void CollisionScene::setColliders(const Collider* colliders, size_t count) { as<CollisionSceneImplementation>()->setColliders(colliders, count); }
+void CollisionScene::addCollider(const Collider& collider) { as<CollisionSceneImplementation>()->addCollider(collider); }
+void CollisionScene::clear() { as<CollisionSceneImplementation>()->clear(); }
+size_t CollisionScene::count() const { return as<CollisionSceneImplementation>()->count(); }
+ContactList CollisionScene::contacts(const Frame& frame) const { return as<CollisionSceneImplementation>()->contacts(*frame.as<FrameImplementation>()); }
+
+// PoseIndex
+
+PoseIndex::PoseIndex() : Interface(std::make_shared<PoseIndexImplementation>()) {}
+void PoseIndex::add(const PoseFeatures& features, int32_t label) { as<PoseIndexImplementation>()->add(features, label); }
+void PoseIndex::clear() { as<PoseIndexImplementation>()->clear(); }
+size_t PoseIndex::count() const { return as<PoseIndexImplementation>()->count(); }
+int PoseIndex::nearest(const PoseFeatures& features, int k, PoseMatch* matches) const { return as<PoseIndexImplementation>()->nearest(features, k, matches); }
+int32_t PoseIndex::nearestLabel(const PoseFeatures& features) const {
+  PoseMatch match;
+  return nearest(features, 1, &match) == 1 ? match.label : -1;
+}
+bool PoseIndex::save(const char* path) const { return as<PoseIndexImplementation>()->save(path); }
+bool PoseIndex::load(const char* path) { return as<PoseIndexImplementation>()->load(path); }
+
+// MapPointStore
+
+MapPointStore::MapPointStore(float voxelSize, int64_t maxAge) : Interface(std::make_shared<MapPointStoreImplementation>(voxelSize, maxAge)) {}
+void MapPointStore::update(const Frame& frame) { update(frame.mapPoints(), frame.timestamp()); }
+void MapPointStore::update(const MapPointList& points, int64_t timestamp) { as<MapPointStoreImplementation>()->update(points.points(), points.ids(), points.count(), timestamp); }
+void MapPointStore::clear() { as<MapPointStoreImplementation>()->clear(); }
+int MapPointStore::count() const { return as<MapPointStoreImplementation>()->count(); }
+MapPoint MapPointStore::point(uint32_t id) const { return as<MapPointStoreImplementation>()->point(id); }
+MapPointList MapPointStore::within(const Vector& center, float radius) const { return as<MapPointStoreImplementation>()->within(center, radius); }
+MapPointList MapPointStore::nearest(const Vector& position, int k) const { return as<MapPointStoreImplementation>()->nearest(position, k); }
+
+// StereoDepth
+
+StereoDepth::StereoDepth(int width, int height, float maxSlope) : Interface(std::make_shared<StereoDepthImplementation>(width, height, maxSlope)) {}
+int StereoDepth::width() const { return as<StereoDepthImplementation>()->width(); }
+int StereoDepth::height() const { return as<StereoDepthImplementation>()->height(); }
+void StereoDepth::setBlockSize(int size) { as<StereoDepthImplementation>()->setBlockSize(size); }
+int StereoDepth::blockSize() const { return as<StereoDepthImplementation>()->blockSize(); }
+bool StereoDepth::update(const Image& left, const Image& right, float baseline) { return as<StereoDepthImplementation>()->update(left, right, baseline); }
+const unsigned char* StereoDepth::rectifiedImage(int camera) const { return as<StereoDepthImplementation>()->rectifiedImage(camera); }
+StereoRegion StereoDepth::handRegion(const Hand& hand, int margin, float depthMargin) const { return as<StereoDepthImplementation>()->handRegion(hand, margin, depthMargin); }
+int StereoDepth::computeDepth(const StereoRegion& region, float* depth) const { return as<StereoDepthImplementation>()->computeDepth(region, depth); }
+
+// ImageCodec
+
+ImageCodec::ImageCodec(int keyframeInterval) : Interface(std::make_shared<ImageCodecImplementation>(keyframeInterval)) {}
+int ImageCodec::keyframeInterval() const { return as<ImageCodecImplementation>()->keyframeInterval(); }
+void ImageCodec::setKeyframeInterval(int interval) { as<ImageCodecImplementation>()->setKeyframeInterval(interval); }
+void ImageCodec::reset() { as<ImageCodecImplementation>()->reset(); }
+size_t ImageCodec::maxEncodedSize(int width, int height) { return ImageCodecImplementation::maxEncodedSize(width, height); }
+size_t ImageCodec::encode(const Image& left, const Image& right, void* buffer, size_t bufferSize) { return as<ImageCodecImplementation>()->encode(left, right, buffer, bufferSize); }
+size_t ImageCodec::encode(const unsigned char* left, const unsigned char* right, int width, int height, void* buffer, size_t bufferSize) { return as<ImageCodecImplementation>()->encode(left, right, width, height, buffer, bufferSize); }
+bool ImageCodec::frameInfo(const void* data, size_t size, int* width, int* height, bool* isKeyframe) { return ImageCodecImplementation::frameInfo(data, size, width, height, isKeyframe); }
+bool ImageCodec::decode(const void* data, size_t size, unsigned char* left, unsigned char* right) { return as<ImageCodecImplementation>()->decode(data, size, left, right); }
+
 // HeadPose
 
 HeadPose::HeadPose(HeadPoseImplementation* impl) : Interface(impl ? impl->shared_from_this() : std::make_shared<HeadPoseImplementation>()) {}
@@ -244,6 +325,28 @@ float Image::rayScaleX() const { return as<ImageImplementation>()->rayScaleX();
 float Image::rayScaleY() const { return as<ImageImplementation>()->rayScaleY(); }
 Vector Image::rectify(const Vector& uv) const { return as<ImageImplementation>()->rectify(uv); }
 Vector Image::warp(const Vector& xy) const { return as<ImageImplementation>()->warp(xy); }
+uint64_t Image::calibrationHash() const { return as<ImageImplementation>()->calibrationHash(); }
+const float* Image::undistortionMap(int width, int height, float maxSlope) const { return as<ImageImplementation>()->undistortionMap(width, height, maxSlope); }
+size_t Image::convertedSize(OutputFormat format, int downscale) const { return as<ImageImplementation>()->convertedSize(format, downscale); }
+size_t Image::convert(void* buffer, size_t bufferSize, OutputFormat format, int downscale, float gain, float offset) const { return as<ImageImplementation>()->convert(buffer, bufferSize, format, downscale, gain, offset); }
+size_t Image::packStereo(const Image& left, const Image& right, void* buffer, size_t bufferSize, OutputFormat format, int downscale, float gain, float offset) {
+  return ImageImplementation::packStereo(*left.as<ImageImplementation>(), *right.as<ImageImplementation>(), buffer, bufferSize, format, downscale, gain, offset);
+}
+int Image::pyramidLevelCount() const { return as<ImageImplementation>()->pyramid().count; }
+const unsigned char* Image::pyramidLevel(int level) const {
+  const auto& pyramid = as<ImageImplementation>()->pyramid();
+  return level >= 0 && level < pyramid.count ? pyramid.levels[level] : nullptr;
+}
+int Image::pyramidWidth(int level) const {
+  const auto& pyramid = as<ImageImplementation>()->pyramid();
+  return level >= 0 && level < pyramid.count ? pyramid.width[level] : 0;
+}
+int Image::pyramidHeight(int level) const {
+  const auto& pyramid = as<ImageImplementation>()->pyramid();
+  return level >= 0 && level < pyramid.count ? pyramid.height[level] : 0;
+}
+const uint32_t* Image::integralImage() const { return as<ImageImplementation>()->integralImage(); }
+uint32_t Image::integralSum(int x, int y, int width, int height) const { return as<ImageImplementation>()->integralSum(x, y, width, height); }
 int64_t Image::timestamp() const { return as<ImageImplementation>()->timestamp(); }
 bool Image::isValid() const { return as<ImageImplementation>()->isValid(); }
 const Image& Image::invalid() { static Image* s_invalid = new Image(); return *s_invalid; } // Expected to leak in order to live longer
@@ -274,13 +377,42 @@ void Controller::clearPolicy(PolicyFlag policy) const { as<ControllerImplementat
 bool Controller::isPolicySet(PolicyFlag policy) const { return as<ControllerImplementation>()->isPolicySet(policy); }
 bool Controller::addListener(Listener& listener) { return as<ControllerImplementation>()->addListener(listener); }
 bool Controller::removeListener(Listener& listener) { return as<ControllerImplementation>()->removeListener(listener); }
+bool Controller::setImageDelivery(Listener& listener, float maxRate, bool latestOnly) { return as<ControllerImplementation>()->setImageDelivery(listener, maxRate, latestOnly); }
 Frame Controller::frame(int history) const { return as<ControllerImplementation>()->frame(history); }
+Frame Controller::predictFrame(int64_t targetTimestamp) const { return as<ControllerImplementation>()->predictFrame(targetTimestamp); }
+bool Controller::predictFrame(int64_t targetTimestamp, Frame& into) const {
+  // Refill the frame in place only if no other Frame shares it
+  const auto reusable = into.m_impl.use_count() == 1 ? into.as<FrameImplementation>() : nullptr;
+  const auto predicted = as<ControllerImplementation>()->predictFrame(targetTimestamp, reusable);
+  if (!predicted)
+    return false;
+  if (predicted != reusable)
+    into = Frame(predicted.get());
+  return true;
+}
+void Controller::setCompactHistorySize(int frames) { as<ControllerImplementation>()->setCompactHistorySize(frames); }
+int Controller::compactHistorySize() const { return as<ControllerImplementation>()->compactHistorySize(); }
+void Controller::setRetentionLimits(RetentionCategory category, int maxCount, int64_t maxBytes) { as<ControllerImplementation>()->setRetentionLimits(category, maxCount, maxBytes); }
+int Controller::retainedCount(RetentionCategory category) const { return as<ControllerImplementation>()->retainedCount(category); }
+int64_t Controller::retainedBytes(RetentionCategory category) const { return as<ControllerImplementation>()->retainedBytes(category); }
+void Controller::setCalibrationCacheDirectory(const char* directory) { as<ControllerImplementation>()->setCalibrationCacheDirectory(directory); }
+int32_t Controller::addGesture(const GestureDefinition& definition) const { return as<ControllerImplementation>()->addGesture(definition); }
+bool Controller::removeGesture(int32_t gestureId) const { return as<ControllerImplementation>()->removeGesture(gestureId); }
+int32_t Controller::addAggregate(const WindowAggregate& aggregate) const { return as<ControllerImplementation>()->addAggregate(aggregate); }
+bool Controller::removeAggregate(int32_t aggregateId) const { return as<ControllerImplementation>()->removeAggregate(aggregateId); }
+float Controller::aggregate(int32_t aggregateId, int32_t handId) const { return as<ControllerImplementation>()->aggregate(aggregateId, handId); }
 HeadPose Controller::headPose(int64_t timestamp) const { return as<ControllerImplementation>()->headPose(timestamp); }
 ImageList Controller::images() const { return as<ControllerImplementation>()->images(); }
 ImageList Controller::rawImages() const { return as<ControllerImplementation>()->rawImages(); }
 Config Controller::config() const { return as<ControllerImplementation>()->config(); }
 DeviceList Controller::devices() const { return as<ControllerImplementation>()->devices(); }
 FailedDeviceList Controller::failedDevices() const { return as<ControllerImplementation>()->failedDevices(); }
+uint64_t Controller::deviceGeneration() const { return as<ControllerImplementation>()->deviceGeneration(); }
+void Controller::setKinematicsFilter(float velocityTimeConstant, float accelerationTimeConstant) const { as<ControllerImplementation>()->setKinematicsFilter(velocityTimeConstant, accelerationTimeConstant); }
+void Controller::setSmoothingFilter(SmoothingFilter filter) const { as<ControllerImplementation>()->setSmoothingFilter(filter); }
+Controller::SmoothingFilter Controller::smoothingFilter() const { return as<ControllerImplementation>()->smoothingFilter(); }
+void Controller::setOneEuroParameters(float minCutoff, float beta, float derivativeCutoff) const { as<ControllerImplementation>()->setOneEuroParameters(minCutoff, beta, derivativeCutoff); }
+void Controller::setKalmanParameters(float accelerationNoise, float measurementNoise) const { as<ControllerImplementation>()->setKalmanParameters(accelerationNoise, measurementNoise); }
 void Controller::setPaused(bool pause) { as<ControllerImplementation>()->setPaused(pause); }
 bool Controller::isPaused() const { return as<ControllerImplementation>()->isPaused(); }
 int64_t Controller::now() const { return LeapGetNow(); }
@@ -349,7 +481,11 @@ DeviceList::DeviceList() : Interface(std::static_pointer_cast<Implementation>(st
 int DeviceList::count() const { return as<ListBaseImplementation<Device>>()->count(); }
 bool DeviceList::isEmpty() const { return as<ListBaseImplementation<Device>>()->empty(); }
 Device DeviceList::operator[](int index) const { return as<ListBaseImplementation<Device>>()->at(index); }
-DeviceList& DeviceList::append(const DeviceList& rhs) { as<ListBaseImplementation<Device>>()->append(*(rhs.as<ListBaseImplementation<Device>>())); return *this; }
+DeviceList& DeviceList::append(const DeviceList& rhs) {
+  // Lists returned by Controller::devices() share the controller's snapshot; detach before modifying
+  if (m_impl.use_count() > 1)
+    m_impl = std::make_shared<ListBaseImplementation<Device>>(*as<ListBaseImplementation<Device>>());
+  as<ListBaseImplementation<Device>>()->append(*(rhs.as<ListBaseImplementation<Device>>())); return *this; }
 DeviceList::const_iterator DeviceList::begin() const { return const_iterator(*this, 0); }
 DeviceList::const_iterator DeviceList::end() const { return const_iterator(*this, count()); }
 
@@ -360,19 +496,54 @@ FailedDeviceList::FailedDeviceList() : Interface(std::static_pointer_cast<Implem
 int FailedDeviceList::count() const { return as<ListBaseImplementation<FailedDevice>>()->count(); }
 bool FailedDeviceList::isEmpty() const { return as<ListBaseImplementation<FailedDevice>>()->empty(); }
 FailedDevice FailedDeviceList::operator[](int index) const { return as<ListBaseImplementation<FailedDevice>>()->at(index); }
-FailedDeviceList& FailedDeviceList::append(const FailedDeviceList& rhs) { as<ListBaseImplementation<FailedDevice>>()->append(*(rhs.as<ListBaseImplementation<FailedDevice>>())); return *this; }
+FailedDeviceList& FailedDeviceList::append(const FailedDeviceList& rhs) {
+  // Lists returned by Controller::failedDevices() share the controller's snapshot; detach before modifying
+  if (m_impl.use_count() > 1)
+    m_impl = std::make_shared<ListBaseImplementation<FailedDevice>>(*as<ListBaseImplementation<FailedDevice>>());
+  as<ListBaseImplementation<FailedDevice>>()->append(*(rhs.as<ListBaseImplementation<FailedDevice>>())); return *this; }
 FailedDeviceList::const_iterator FailedDeviceList::begin() const { return const_iterator(*this, 0); }
 FailedDeviceList::const_iterator FailedDeviceList::end() const { return const_iterator(*this, count()); }
 
+// GestureDefinition
+
+GestureDefinition GestureDefinition::pinch() { return GestureDefinition{SIGNAL_PINCH_STRENGTH, TYPE_CONTINUOUS, 0.8f, 0.6f, 0, 0}; }
+GestureDefinition GestureDefinition::grab() { return GestureDefinition{SIGNAL_GRAB_STRENGTH, TYPE_CONTINUOUS, 0.9f, 0.7f, 0, 0}; }
+GestureDefinition GestureDefinition::swipe(Signal axis, float speed) { return GestureDefinition{axis, TYPE_DISCRETE, speed, speed*0.4f, 30000, 500000}; }
+GestureDefinition GestureDefinition::tap() { return GestureDefinition{SIGNAL_INDEX_TIP_VELOCITY_Y, TYPE_DISCRETE, -300.0f, -50.0f, 0, 300000}; }
+
 // MapPointList
 
-MapPointList::MapPointList(const std::shared_ptr<ListBaseImplementation<MapPoint>>& rhs) : Interface(rhs) {}
-MapPointList::MapPointList() : Interface(std::static_pointer_cast<Implementation>(std::make_shared<ListBaseImplementation<MapPoint>>())) {}
-int MapPointList::count() const { return as<ListBaseImplementation<MapPoint>>()->count(); }
-bool MapPointList::isEmpty() const { return as<ListBaseImplementation<MapPoint>>()->empty(); }
-MapPoint MapPointList::operator[](int index) const { return as<ListBaseImplementation<MapPoint>>()->at(index); }
-MapPointList& MapPointList::append(const MapPointList& rhs) { as<ListBaseImplementation<MapPoint>>()->append(*(rhs.as<ListBaseImplementation<MapPoint>>())); return *this; }
+MapPointList::MapPointList(const std::shared_ptr<MapPointListImplementation>& rhs) : Interface(rhs) {}
+MapPointList::MapPointList() : Interface(std::static_pointer_cast<Implementation>(std::make_shared<MapPointListImplementation>())) {}
+int MapPointList::count() const { return as<MapPointListImplementation>()->count(); }
+bool MapPointList::isEmpty() const { return as<MapPointListImplementation>()->empty(); }
+MapPoint MapPointList::operator[](int index) const { return as<MapPointListImplementation>()->at(index); }
+MapPointList& MapPointList::append(const MapPointList& rhs) { as<MapPointListImplementation>()->append(*(rhs.as<MapPointListImplementation>())); return *this; }
+const Vector* MapPointList::points() const { return as<MapPointListImplementation>()->points(); }
+const uint32_t* MapPointList::ids() const { return as<MapPointListImplementation>()->ids(); }
 MapPointList::const_iterator MapPointList::begin() const { return const_iterator(*this, 0); }
 MapPointList::const_iterator MapPointList::end() const { return const_iterator(*this, count()); }
 
+// HandTransitionList
+
+HandTransitionList::HandTransitionList(const std::shared_ptr<ListBaseImplementation<HandTransition>>& rhs) : Interface(rhs) {}
+HandTransitionList::HandTransitionList() : Interface(std::static_pointer_cast<Implementation>(std::make_shared<ListBaseImplementation<HandTransition>>())) {}
+int HandTransitionList::count() const { return as<ListBaseImplementation<HandTransition>>()->count(); }
+bool HandTransitionList::isEmpty() const { return as<ListBaseImplementation<HandTransition>>()->empty(); }
+HandTransition HandTransitionList::operator[](int index) const { return as<ListBaseImplementation<HandTransition>>()->at(index); }
+HandTransitionList& HandTransitionList::append(const HandTransitionList& rhs) { as<ListBaseImplementation<HandTransition>>()->append(*(rhs.as<ListBaseImplementation<HandTransition>>())); return *this; }
+HandTransitionList::const_iterator HandTransitionList::begin() const { return const_iterator(*this, 0); }
+HandTransitionList::const_iterator HandTransitionList::end() const { return const_iterator(*this, count()); }
+
+// ContactList
+
+ContactList::ContactList(const std::shared_ptr<ListBaseImplementation<Contact>>& rhs) : Interface(rhs) {}
+ContactList::ContactList() : Interface(std::static_pointer_cast<Implementation>(std::make_shared<ListBaseImplementation<Contact>>())) {}
+int ContactList::count() const { return as<ListBaseImplementation<Contact>>()->count(); }
+bool ContactList::isEmpty() const { return as<ListBaseImplementation<Contact>>()->empty(); }
+Contact ContactList::operator[](int index) const { return as<ListBaseImplementation<Contact>>()->at(index); }
+ContactList& ContactList::append(const ContactList& rhs) { as<ListBaseImplementation<Contact>>()->append(*(rhs.as<ListBaseImplementation<Contact>>())); return *this; }
+ContactList::const_iterator ContactList::begin() const { return const_iterator(*this, 0); }
+ContactList::const_iterator ContactList::end() const { return const_iterator(*this, count()); }
+
 }
@@ -76,6 +76,11 @@ namespace Leap {
   class FrameImplementation;
   class HeadPoseImplementation;
   class ControllerImplementation;
+  class CollisionSceneImplementation;
+  class PoseIndexImplementation;
+  class MapPointListImplementation;
+  class MapPointStoreImplementation;
+  class StereoDepthImplementation;
   template<typename T> class ListBaseImplementation;
 
   // Forward declarations
@@ -83,11 +88,76 @@ namespace Leap {
   class HandList;
   class ImageList;
   class MapPointList;
+  class HandTransitionList;
+  class ContactList;
   class Hand;
   class Frame;
   class HeadPose;
   class Listener;
 
+  /**
+   * The RigidMotion struct describes the similarity transform that best maps
+   * the joints of one hand, or set of hands, onto another in the least-squares
+   * sense.
+   *
+   * Applying the motion to a point p of the earlier pose gives
+   * scale * rotation.transformDirection(p) + translation.
+   *
+   * @since 4.1
+   */
+  struct RigidMotion {
+    RigidMotion() : scale(1.0f), rmsError(0.0f), valid(false) {}
+
+    /** The rotation, as an orthonormal basis with a zero origin. */
+    Matrix rotation;
+    /** The translation, in millimeters, applied after rotation and scaling. */
+    Vector translation;
+    /** The uniform scale factor; close to 1 for a rigid motion. */
+    float scale;
+    /** The root-mean-square distance, in millimeters, between the transformed
+     *  earlier joints and the current joints. */
+    float rmsError;
+    /** Whether enough corresponding joints were available to fit a motion. */
+    bool valid;
+
+    /** The motion as a single transform, including the scale. */
+    Matrix toMatrix() const {
+      return Matrix(rotation.xBasis * scale, rotation.yBasis * scale,
+                    rotation.zBasis * scale, translation);
+    }
+  };
+
+  /**
+   * The PoseFeatures struct is a fixed-length description of the shape of a
+   * hand, for comparing hand poses.
+   *
+   * The features are the positions of the four joints of each finger relative
+   * to the wrist, expressed in the palm basis (see Hand::basis()) and divided
+   * by the distance from the wrist to the knuckle of the middle finger. They
+   * are therefore independent of where the hand is, how it is oriented and
+   * how large it is, and left hands are mirrored to match right hands.
+   *
+   * Get the features of a hand with Hand::poseFeatures() and look up similar
+   * poses with a PoseIndex.
+   * @since 4.1
+   */
+  struct PoseFeatures {
+    static const int LENGTH = 60;
+
+    float values[LENGTH]; /**< x, y, z of each joint, digit by digit, from the knuckle to the tip */
+    bool valid;           /**< False if the hand was invalid or degenerate */
+
+    /** The Euclidean distance between two sets of features. */
+    float distanceTo(const PoseFeatures& other) const {
+      float sum = 0;
+      for (int i = 0; i < LENGTH; i++) {
+        const float d = values[i] - other.values[i];
+        sum += d*d;
+      }
+      return std::sqrt(sum);
+    }
+  };
+
   /**
    * The Arm class represents the forearm.
    *
@@ -183,6 +253,27 @@ namespace Leap {
     */
     LEAP_EXPORT Vector wristPosition() const;
 
+    /**
+    * The rate of change of the wrist position in millimeters/second.
+    *
+    * Only available when the POLICY_JOINT_KINEMATICS policy is set.
+    *
+    * @returns The Vector containing the wrist velocity; a zero vector if no
+    * estimate is available.
+    * @since 4.1
+    */
+    LEAP_EXPORT Vector wristVelocity() const;
+
+    /**
+    * The wrist position after the smoothing stage.
+    *
+    * See Controller::setSmoothingFilter(). If smoothing is disabled, this is
+    * the same as wristPosition().
+    *
+    * @since 4.1
+    */
+    LEAP_EXPORT Vector smoothedWristPosition() const;
+
     /**
     * The center of the forearm.
     *
@@ -523,6 +614,21 @@ namespace Leap {
       TYPE_PINKY  = 4  /**< The pinky or little finger */
     };
 
+    /**
+     * Enumerates the joints of a finger.
+     *
+     * Joints are numbered from the hand outwards. Each joint is the end of the
+     * bone with the same index, so JOINT_MCP is Bone::TYPE_METACARPAL's next joint
+     * and JOINT_TIP is the tip of the distal bone.
+     * @since 4.1
+     */
+    enum Joint {
+      JOINT_MCP = 0, /**< The metacarpophalangeal joint, or knuckle */
+      JOINT_PIP = 1, /**< The proximal interphalangeal joint */
+      JOINT_DIP = 2, /**< The distal interphalangeal joint */
+      JOINT_TIP = 3  /**< The tip of the finger */
+    };
+
     // For internal use only.
     Finger(FingerImplementation*);
 
@@ -606,6 +712,74 @@ namespace Leap {
      */
     LEAP_EXPORT Vector tipPosition() const;
 
+    /**
+     * The position of a joint of this finger in millimeters from the Leap Motion origin.
+     *
+     * @param joint A member of the Finger::Joint enumeration.
+     * @returns The Vector containing the coordinates of the joint.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector jointPosition(Joint joint) const;
+
+    /**
+     * The rate of change of a joint position in millimeters/second.
+     *
+     * Joint velocities are estimated by the client library from consecutive
+     * frames of the same hand, and are only available when the
+     * POLICY_JOINT_KINEMATICS policy is set. The amount of filtering is set
+     * with Controller::setKinematicsFilter().
+     *
+     * @param joint A member of the Finger::Joint enumeration.
+     * @returns The Vector containing the velocity of the joint; a zero vector
+     * if no estimate is available.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector jointVelocity(Joint joint) const;
+
+    /**
+     * The position of a joint after the smoothing stage.
+     *
+     * See Controller::setSmoothingFilter(). If smoothing is disabled, this is
+     * the same as jointPosition().
+     *
+     * @param joint A member of the Finger::Joint enumeration.
+     * @returns The Vector containing the smoothed coordinates of the joint.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector smoothedJointPosition(Joint joint) const;
+
+    /**
+     * The tip position after the smoothing stage.
+     *
+     * Equivalent to smoothedJointPosition(JOINT_TIP).
+     *
+     * @returns The Vector containing the smoothed coordinates of the tip.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector smoothedTipPosition() const;
+
+    /**
+     * The rate of change of a joint velocity in millimeters/second^2.
+     *
+     * Requires the POLICY_JOINT_KINEMATICS policy; see jointVelocity().
+     *
+     * @param joint A member of the Finger::Joint enumeration.
+     * @returns The Vector containing the acceleration of the joint; a zero
+     * vector if no estimate is available.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector jointAcceleration(Joint joint) const;
+
+    /**
+     * The rate of change of the tip position in millimeters/second.
+     *
+     * Equivalent to jointVelocity(JOINT_TIP).
+     *
+     * @returns The Vector containing the velocity of the tip.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector tipVelocity() const;
+
     /**
      * The direction in which this finger is pointing.
      *
@@ -874,6 +1048,52 @@ namespace Leap {
      */
     LEAP_EXPORT Vector palmVelocity() const;
 
+    /**
+     * The rate of change of the palm velocity in millimeters/second^2.
+     *
+     * The acceleration is estimated by the client library from consecutive
+     * frames and is only available when the POLICY_JOINT_KINEMATICS policy
+     * is set.
+     *
+     * @returns The Vector containing the palm acceleration; a zero vector
+     * if no estimate is available.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector palmAcceleration() const;
+
+    /**
+     * The palm position after the smoothing stage.
+     *
+     * See Controller::setSmoothingFilter(). If smoothing is disabled, this is
+     * the same as palmPosition().
+     *
+     * @returns The Vector containing the smoothed coordinates of the palm.
+     * @since 4.1
+     */
+    LEAP_EXPORT Vector smoothedPalmPosition() const;
+
+    /**
+     * The motion of this hand relative to an earlier observation of it.
+     *
+     * The motion is the least-squares fit of the palm, wrist and finger
+     * joints of the earlier hand onto those of this hand, and is cheap enough
+     * to evaluate every frame.
+     *
+     * @param since The same hand in an earlier frame.
+     * @returns A RigidMotion; its valid field is false if either hand is
+     * invalid or the joints are degenerate.
+     * @since 4.1
+     */
+    LEAP_EXPORT RigidMotion motionSince(const Hand& since) const;
+
+    /**
+     * The pose features of this hand, for comparing its pose with others.
+     *
+     * @returns A PoseFeatures; its valid field is false if the hand is invalid.
+     * @since 4.1
+     */
+    LEAP_EXPORT PoseFeatures poseFeatures() const;
+
     /**
      * The normal vector to the palm. If your hand is flat, this vector will
      * point downward, or "out" of the front surface of your palm.
@@ -1134,6 +1354,277 @@ namespace Leap {
     }
   };
 
+  /**
+   * The HandTransition struct describes how a hand changed between a frame and
+   * the frame before it.
+   *
+   * Transitions are computed once when each frame arrives. Read them with
+   * Frame::handTransitions(), or implement Listener::onHandFound() and
+   * Listener::onHandLost().
+   * @since 4.1
+   */
+  struct HandTransition {
+    /**
+     * The kinds of transition.
+     * @since 4.1
+     */
+    enum Type {
+      TYPE_INVALID = -1, /**< An invalid transition */
+      TYPE_FOUND = 0,    /**< The hand was not in the previous frame */
+      TYPE_LOST = 1,     /**< The hand was in the previous frame but is not in this one */
+      TYPE_CHANGED = 2   /**< The hand is in both frames but its chirality or extended fingers changed */
+    };
+
+    int32_t handId;
+    Type type;
+    uint8_t extendedFingers;         /**< Bit n is set if the finger of Finger::Type n is extended in this frame; 0 if lost */
+    uint8_t previousExtendedFingers; /**< As extendedFingers, for the previous frame; 0 if found */
+
+    static const HandTransition& invalid() {
+      static HandTransition s_invalid = {-1, TYPE_INVALID, 0, 0};
+      return s_invalid;
+    }
+  };
+
+  /**
+   * The GestureDefinition struct describes a gesture for the gesture engine.
+   *
+   * A gesture follows one signal of a hand, such as the pinch strength or the
+   * palm velocity along an axis. It starts when the signal passes the start
+   * threshold and ends when it falls back past the end threshold. Keeping the
+   * two thresholds apart gives the gesture hysteresis. If the start threshold
+   * is below the end threshold, the gesture is active while the signal is low,
+   * as with a pinch measured by pinch distance or a swipe to the left.
+   *
+   * Continuous gestures (TYPE_CONTINUOUS) report a start event once the signal
+   * has been held for minDuration, an update event on every frame while it is
+   * held, and a stop event when it is released. Discrete gestures
+   * (TYPE_DISCRETE) report a single stop event when the signal is released
+   * between minDuration and maxDuration after it crossed the start threshold.
+   *
+   * Register gestures with Controller::addGesture() and receive their events in
+   * Listener::onGesture().
+   * @since 4.1
+   */
+  struct GestureDefinition {
+    /**
+     * The hand signals a gesture can follow.
+     * @since 4.1
+     */
+    enum Signal {
+      SIGNAL_PINCH_STRENGTH = 0,  /**< Hand::pinchStrength() */
+      SIGNAL_GRAB_STRENGTH = 1,   /**< Hand::grabStrength() */
+      SIGNAL_PINCH_DISTANCE = 2,  /**< Hand::pinchDistance(), in millimeters */
+      SIGNAL_PALM_SPEED = 3,      /**< The magnitude of Hand::palmVelocity(), in mm/s */
+      SIGNAL_PALM_VELOCITY_X = 4, /**< The x component of Hand::palmVelocity(), in mm/s */
+      SIGNAL_PALM_VELOCITY_Y = 5, /**< The y component of Hand::palmVelocity(), in mm/s */
+      SIGNAL_PALM_VELOCITY_Z = 6, /**< The z component of Hand::palmVelocity(), in mm/s */
+      SIGNAL_INDEX_TIP_VELOCITY_Y = 7, /**< The y component of the index finger's Finger::tipVelocity(); requires POLICY_JOINT_KINEMATICS */
+      SIGNAL_CONFIDENCE = 8       /**< Hand::confidence() */
+    };
+
+    /**
+     * How a gesture reports its events.
+     * @since 4.1
+     */
+    enum Type {
+      TYPE_CONTINUOUS = 0, /**< Start, update and stop events while the signal is held */
+      TYPE_DISCRETE = 1    /**< A single stop event when a short pulse completes */
+    };
+
+    Signal signal;
+    Type type;
+    float startThreshold;
+    float endThreshold;
+    int64_t minDuration; /**< Microseconds the signal must be held before the gesture is recognized */
+    int64_t maxDuration; /**< Microseconds after which a held signal is no longer this gesture; 0 for no limit */
+
+    /**
+     * A pinch, from the pinch strength.
+     * @since 4.1
+     */
+    LEAP_EXPORT static GestureDefinition pinch();
+
+    /**
+     * A grab, from the grab strength.
+     * @since 4.1
+     */
+    LEAP_EXPORT static GestureDefinition grab();
+
+    /**
+     * A quick palm movement along one axis.
+     *
+     * @param axis SIGNAL_PALM_VELOCITY_X, SIGNAL_PALM_VELOCITY_Y or SIGNAL_PALM_VELOCITY_Z.
+     * @param speed The palm speed in mm/s that starts the swipe. Use a negative
+     * value to swipe towards the negative end of the axis.
+     * @since 4.1
+     */
+    LEAP_EXPORT static GestureDefinition swipe(Signal axis, float speed);
+
+    /**
+     * A short downward tap of the index finger. Requires POLICY_JOINT_KINEMATICS.
+     * @since 4.1
+     */
+    LEAP_EXPORT static GestureDefinition tap();
+  };
+
+  /**
+   * The GestureEvent struct reports a change of a gesture on one hand.
+   * @since 4.1
+   */
+  struct GestureEvent {
+    /**
+     * The phase of the gesture.
+     * @since 4.1
+     */
+    enum State {
+      STATE_START = 0,  /**< A continuous gesture has been recognized */
+      STATE_UPDATE = 1, /**< A continuous gesture is still in progress */
+      STATE_STOP = 2    /**< The gesture has completed, or its hand was lost */
+    };
+
+    int32_t gestureId; /**< The id returned by Controller::addGesture() */
+    int32_t handId;    /**< The Hand::id() of the hand making the gesture */
+    State state;
+    float value;       /**< The value of the gesture's signal in this frame */
+    int64_t duration;  /**< Microseconds since the signal crossed the start threshold */
+    int64_t frameId;   /**< The Frame::id() of the frame that produced the event */
+    int64_t timestamp; /**< The Frame::timestamp() of the frame that produced the event */
+  };
+
+  /**
+   * The WindowAggregate struct describes a statistic of a hand signal over a
+   * sliding time window, such as the maximum palm speed over the last 500
+   * milliseconds or the mean confidence over the last second.
+   *
+   * Register aggregates with Controller::addAggregate(). They are updated
+   * incrementally for every tracked hand as frames arrive, and only the signal
+   * values inside the window are kept, so a window can be much longer than the
+   * frame history. Read the current value with Controller::aggregate().
+   * @since 4.1
+   */
+  struct WindowAggregate {
+    /**
+     * The statistics available.
+     * @since 4.1
+     */
+    enum Kind {
+      KIND_MIN = 0,         /**< The minimum over the window */
+      KIND_MAX = 1,         /**< The maximum over the window */
+      KIND_SUM = 2,         /**< The sum over the window */
+      KIND_MEAN = 3,        /**< The mean over the window */
+      KIND_EWMA = 4,        /**< An exponentially weighted moving average with window as its time constant */
+      KIND_HELD_DURATION = 5 /**< Seconds the signal has stayed at or above threshold; 0 while it is below */
+    };
+
+    GestureDefinition::Signal signal;
+    Kind kind;
+    int64_t window;  /**< The window length in microseconds (the time constant for KIND_EWMA) */
+    float threshold; /**< Used by KIND_HELD_DURATION only */
+  };
+
+  /**
+   * The Collider struct describes a primitive of the scene geometry tested by
+   * a CollisionScene.
+   *
+   * Use the sphere(), box() and triangle() factories to create colliders.
+   * @since 4.1
+   */
+  struct Collider {
+    /**
+     * The kinds of primitive.
+     * @since 4.1
+     */
+    enum Type {
+      TYPE_SPHERE = 0,  /**< A sphere with center a */
+      TYPE_BOX = 1,     /**< An axis-aligned box from corner a to corner b */
+      TYPE_TRIANGLE = 2 /**< A triangle with vertices a, b and c */
+    };
+
+    Type type;
+    int32_t id;   /**< A caller-defined id, reported in Contact::colliderId */
+    Vector a;
+    Vector b;
+    Vector c;
+    float radius; /**< The sphere radius, in millimeters; 0 for other types */
+
+    static Collider sphere(const Vector& center, float radius, int32_t id) {
+      Collider collider = {TYPE_SPHERE, id, center, center, center, radius};
+      return collider;
+    }
+    static Collider box(const Vector& minimum, const Vector& maximum, int32_t id) {
+      Collider collider = {TYPE_BOX, id, minimum, maximum, maximum, 0.0f};
+      return collider;
+    }
+    static Collider triangle(const Vector& a, const Vector& b, const Vector& c, int32_t id) {
+      Collider collider = {TYPE_TRIANGLE, id, a, b, c, 0.0f};
+      return collider;
+    }
+  };
+
+  /**
+   * The Contact struct describes a hand capsule touching or penetrating a
+   * scene Collider.
+   *
+   * Each bone is modeled as a capsule between its joints with half the bone
+   * width as radius. The palm is a capsule across the knuckles, and the arm a
+   * capsule from the elbow to the wrist.
+   * @since 4.1
+   */
+  struct Contact {
+    int32_t colliderId; /**< The Collider::id of the collider */
+    int32_t handId;     /**< The Hand::id() of the hand */
+    int32_t part;       /**< digit*4 + Bone::Type for bones, 20 for the palm and 21 for the arm */
+    Vector position;    /**< The deepest point of the hand on the collider surface */
+    Vector normal;      /**< The unit direction in which to move the hand to resolve the contact */
+    float depth;        /**< The penetration depth, in millimeters */
+
+    static const Contact& invalid() {
+      static Contact s_invalid = {-1, -1, -1, Vector(), Vector(), 0.0f};
+      return s_invalid;
+    }
+  };
+
+  /**
+   * The PoseMatch struct describes a reference pose found by PoseIndex::nearest().
+   * @since 4.1
+   */
+  struct PoseMatch {
+    int32_t label;  /**< The label the pose was added with */
+    float distance; /**< The PoseFeatures::distanceTo() the query */
+  };
+
+  /**
+   * The HandCrop struct describes the square of a camera image cropped around
+   * a hand by Frame::writeHandCrops().
+   * @since 4.1
+   */
+  struct HandCrop {
+    int32_t handId; /**< The id of the hand */
+    int32_t camera; /**< The camera: 0 for the left image, 1 for the right */
+    float x;        /**< The left edge of the square, in image pixels */
+    float y;        /**< The top edge of the square, in image pixels */
+    float size;     /**< The side of the square in image pixels; 0 if the hand is not in the image */
+  };
+
+  /**
+   * The StereoRegion struct describes a rectangle of the rectified left image
+   * and the range of depths searched in it by StereoDepth::computeDepth().
+   *
+   * Depths are distances from the device along its y axis, in millimeters.
+   * @since 4.1
+   */
+  struct StereoRegion {
+    int x;          /**< The left column of the rectangle */
+    int y;          /**< The top row of the rectangle */
+    int width;      /**< The width of the rectangle, in pixels */
+    int height;     /**< The height of the rectangle, in pixels */
+    float minDepth; /**< The nearest depth searched */
+    float maxDepth; /**< The farthest depth searched */
+
+    bool isEmpty() const { return width <= 0 || height <= 0; }
+  };
+
   /**
    * The Device class represents a physically connected device.
    *
@@ -1244,6 +1735,37 @@ namespace Leap {
     */
     LEAP_EXPORT float distanceToBoundary(const Vector& position) const;
 
+    /**
+    * Computes Device::distanceToBoundary() for an array of points.
+    *
+    * The view volume geometry is derived once per device, so this overload
+    * costs a few arithmetic operations per point and is suited to grading every
+    * joint of every hand in each frame.
+    *
+    * @param positions The points to use for the distance calculation.
+    * @param distances Receives the distance in millimeters from each point to
+    * the nearest boundary; must hold at least count elements.
+    * @param count The number of points.
+    * @since 4.1
+    */
+    LEAP_EXPORT void distanceToBoundary(const Vector* positions, float* distances, size_t count) const;
+
+    /**
+    * Tests which of the given points lie inside the view volume of this device.
+    *
+    * A point is inside when it is above the device, within the walls described by
+    * horizontalViewAngle and verticalViewAngle, and no farther than range from
+    * the device origin.
+    *
+    * @param positions The points to test.
+    * @param contained Receives true for each point inside the view volume and
+    * false otherwise; must hold at least count elements.
+    * @param count The number of points.
+    * @returns The number of points inside the view volume.
+    * @since 4.1
+    */
+    LEAP_EXPORT size_t containedInBoundary(const Vector* positions, bool* contained, size_t count) const;
+
     /**
      * Reports whether this device is streaming data to your application.
      *
@@ -1795,6 +2317,189 @@ namespace Leap {
      */
     LEAP_EXPORT Vector warp(const Vector& xy) const; // returns vector (u, v, 0). The z-component is ignored
 
+    /**
+     * A hash of the calibration of this image: its distortion map and ray
+     * factors.
+     *
+     * The hash only changes when the device is recalibrated, so it can key
+     * caches of data derived from the calibration.
+     *
+     * @returns The hash; 0 if the image is invalid.
+     * @since 4.1
+     */
+    LEAP_EXPORT uint64_t calibrationHash() const;
+
+    /**
+     * A dense undistortion map: the position in this image of each pixel of
+     * a rectified grid.
+     *
+     * The grid spans ray slopes from -maxSlope to maxSlope in both directions
+     * (see rectify()). For each of its pixels, row by row, the map holds the x
+     * and y coordinates in this image, in pixels, with pixel centers at
+     * integer coordinates; for example to resample the image with bilinear
+     * interpolation. Pixels whose ray does not reach the image are (-1, -1).
+     *
+     * The map is built once per calibration and grid, and shared by all the
+     * images with the same calibrationHash(). If a calibration cache directory
+     * is set (see Controller::setCalibrationCacheDirectory()), it is loaded
+     * from there instead of being built after the application restarts.
+     *
+     * @param width The width of the rectified grid, in pixels.
+     * @param height The height of the rectified grid, in pixels.
+     * @param maxSlope The largest ray slope covered by the grid.
+     * @returns 2*width*height floats, valid as long as this image; null if the
+     * image is invalid or the grid is empty.
+     * @since 4.1
+     */
+    LEAP_EXPORT const float* undistortionMap(int width, int height, float maxSlope = 1.0f) const;
+
+    /**
+     * Pixel formats written by convert() and packStereo().
+     * @since 4.1
+     */
+    enum OutputFormat {
+      /** One byte of brightness per pixel. */
+      OUTPUT_GRAY8,
+      /** One 32-bit float per pixel, brightness*gain + offset. */
+      OUTPUT_FLOAT32,
+      /** One IEEE 754 half-precision float per pixel, brightness*gain + offset. */
+      OUTPUT_FLOAT16,
+      /** Four bytes per pixel: the brightness in red, green and blue, and 255 in alpha. */
+      OUTPUT_RGBA8
+    };
+
+    /**
+     * The number of bytes convert() writes for this image.
+     *
+     * @param format The pixel format to write.
+     * @param downscale The downscale factor: 1, 2 or 4.
+     * @returns The size of the converted image; 0 if the image is invalid, is
+     * not an 8-bit image or the downscale factor is not supported.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t convertedSize(OutputFormat format, int downscale = 1) const;
+
+    /**
+     * Converts the image data into a caller-provided buffer, optionally
+     * downscaling it.
+     *
+     * Downscaling averages each downscale x downscale block of pixels; when the
+     * width or height is not a multiple of the factor, the last columns or
+     * rows are dropped. Rows are written contiguously, top to bottom. The
+     * conversion is vectorized where the processor supports SSE2.
+     *
+     * \code
+     * // A normalized half-resolution input tensor
+     * std::vector<float> tensor(image.convertedSize(Leap::Image::OUTPUT_FLOAT32, 2)/sizeof(float));
+     * image.convert(tensor.data(), tensor.size()*sizeof(float), Leap::Image::OUTPUT_FLOAT32, 2);
+     * \endcode
+     *
+     * @param buffer The destination buffer, aligned to 4 bytes for the float formats.
+     * @param bufferSize The size of the buffer in bytes.
+     * @param format The pixel format to write.
+     * @param downscale The downscale factor: 1, 2 or 4.
+     * @param gain The scale applied to the brightness by the float formats.
+     * @param offset The offset added to the scaled brightness by the float formats.
+     * @returns The number of bytes written; 0 if the buffer is smaller than
+     * convertedSize() or the image cannot be converted.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t convert(void* buffer, size_t bufferSize, OutputFormat format, int downscale = 1,
+                               float gain = 1.0f/255.0f, float offset = 0.0f) const;
+
+    /**
+     * Converts a stereo pair side by side into a caller-provided buffer.
+     *
+     * Each row of the result is the converted row of the left image followed
+     * by the same row of the right image; see convert(). The result needs
+     * twice convertedSize() bytes.
+     *
+     * \code
+     * Leap::ImageList images = frame.images();
+     * std::vector<uint8_t> pair(2*images[0].convertedSize(Leap::Image::OUTPUT_GRAY8));
+     * Leap::Image::packStereo(images[0], images[1], pair.data(), pair.size(), Leap::Image::OUTPUT_GRAY8);
+     * \endcode
+     *
+     * @returns The number of bytes written; 0 if the images differ in size,
+     * the buffer is too small or the images cannot be converted.
+     * @since 4.1
+     */
+    LEAP_EXPORT static size_t packStereo(const Image& left, const Image& right, void* buffer, size_t bufferSize,
+                                         OutputFormat format, int downscale = 1,
+                                         float gain = 1.0f/255.0f, float offset = 0.0f);
+
+    /**
+     * The number of levels of the Gaussian pyramid of this image, including
+     * the image itself.
+     *
+     * Each level is the previous one blurred with a 5-tap binomial filter and
+     * decimated by 2, down to 5 levels or until a level would be smaller than
+     * 16 pixels on a side.
+     *
+     * @returns The number of levels; 0 if the image is invalid or is not an
+     * 8-bit image.
+     * @since 4.1
+     */
+    LEAP_EXPORT int pyramidLevelCount() const;
+
+    /**
+     * The pixels of a level of the Gaussian pyramid of this image.
+     *
+     * Level 0 is data(); level n is pyramidWidth(n) by pyramidHeight(n) bytes,
+     * row by row. The pyramid is computed on the first call for an image, or
+     * when the image arrives if the POLICY_IMAGE_PYRAMIDS policy is set, and
+     * is shared by every copy of this Image. The data stays valid as long as
+     * any copy of this Image exists.
+     *
+     * \code
+     * for (int level = 0; level < image.pyramidLevelCount(); level++) {
+     *   detectCorners(image.pyramidLevel(level), image.pyramidWidth(level), image.pyramidHeight(level));
+     * }
+     * \endcode
+     *
+     * @param level The level, from 0 to pyramidLevelCount() - 1.
+     * @returns The pixels; null for a level that does not exist.
+     * @since 4.1
+     */
+    LEAP_EXPORT const unsigned char* pyramidLevel(int level) const;
+
+    /**
+     * The width of a level of the Gaussian pyramid; 0 for a level that does not exist.
+     * @since 4.1
+     */
+    LEAP_EXPORT int pyramidWidth(int level) const;
+
+    /**
+     * The height of a level of the Gaussian pyramid; 0 for a level that does not exist.
+     * @since 4.1
+     */
+    LEAP_EXPORT int pyramidHeight(int level) const;
+
+    /**
+     * The integral image (summed-area table) of this image.
+     *
+     * The table has (width() + 1) x (height() + 1) entries, row by row; the
+     * entry at (x, y) is the sum of the pixels above and to the left of pixel
+     * (x, y), so the first row and column are 0. Like the pyramid, it is
+     * computed once and shared. Use integralSum() for the sum of a rectangle.
+     *
+     * @returns The table; null if the image is invalid or is not an 8-bit image.
+     * @since 4.1
+     */
+    LEAP_EXPORT const uint32_t* integralImage() const;
+
+    /**
+     * The sum of the pixels of a rectangle, from the integral image.
+     *
+     * @param x The left column of the rectangle.
+     * @param y The top row of the rectangle.
+     * @param width The width of the rectangle.
+     * @param height The height of the rectangle.
+     * @returns The sum, with the rectangle clipped to the image.
+     * @since 4.1
+     */
+    LEAP_EXPORT uint32_t integralSum(int x, int y, int width, int height) const;
+
     /**
      * Returns a timestamp indicating when this frame began being captured on the device.
      *
@@ -2361,7 +3066,7 @@ namespace Leap {
   class MapPointList : public Interface {
   public:
     // For internal use only.
-    MapPointList(const std::shared_ptr< ListBaseImplementation<MapPoint> >&);
+    MapPointList(const std::shared_ptr<MapPointListImplementation>&);
 
     /**
      * Constructs an empty list of images.
@@ -2403,6 +3108,28 @@ namespace Leap {
      */
     LEAP_EXPORT MapPointList& append(const MapPointList& other);
 
+    /**
+     * The positions of all points in the list, as a contiguous array of
+     * count() vectors.
+     *
+     * The list returned by Frame::mapPoints() refers directly to the map point
+     * data received from the service, so no copy is made; the array remains
+     * valid for as long as this list or a copy of it exists.
+     *
+     * @returns A pointer to the first position; nullptr if the list is empty.
+     * @since 4.1
+     */
+    LEAP_EXPORT const Vector* points() const;
+
+    /**
+     * The ids of all points in the list, as a contiguous array of count()
+     * values in the same order as points().
+     *
+     * @returns A pointer to the first id; nullptr if the list is empty.
+     * @since 4.1
+     */
+    LEAP_EXPORT const uint32_t* ids() const;
+
     /**
      * A C++ iterator type for MapPointList objects.
      * @since 4.0
@@ -2422,16 +3149,136 @@ namespace Leap {
     LEAP_EXPORT const_iterator end() const;
   };
 
-  class HeadPose: public Interface {
+  /**
+   * The HandTransitionList class represents a list of HandTransition objects.
+   * @since 4.1
+   */
+  class HandTransitionList : public Interface {
   public:
     // For internal use only.
-    HeadPose(HeadPoseImplementation*);
-
-    LEAP_EXPORT HeadPose();
+    HandTransitionList(const std::shared_ptr< ListBaseImplementation<HandTransition> >&);
 
-    LEAP_EXPORT int64_t timestamp() const;
+    /**
+     * Constructs an empty list of hand transitions.
+     * @since 4.1
+     */
+    LEAP_EXPORT HandTransitionList();
 
-    LEAP_EXPORT Vector position() const;
+    /**
+     * The number of transitions in this list.
+     * @since 4.1
+     */
+    LEAP_EXPORT int count() const;
+
+    /**
+     * Reports whether the list is empty.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool isEmpty() const;
+
+    /**
+     * Access a list member by its position in the list.
+     * @param index The zero-based list position index.
+     * @returns The HandTransition at the specified index.
+     * @since 4.1
+     */
+    LEAP_EXPORT HandTransition operator[](int index) const;
+
+    /**
+     * Appends the members of the specified HandTransitionList to this list.
+     * @since 4.1
+     */
+    LEAP_EXPORT HandTransitionList& append(const HandTransitionList& other);
+
+    /**
+     * A C++ iterator type for HandTransitionList objects.
+     * @since 4.1
+     */
+    typedef ConstListIterator<HandTransitionList, HandTransition> const_iterator;
+
+    /**
+     * The C++ iterator set to the beginning of this HandTransitionList.
+     * @since 4.1
+     */
+    LEAP_EXPORT const_iterator begin() const;
+
+    /**
+     * The C++ iterator set to the end of this HandTransitionList.
+     * @since 4.1
+     */
+    LEAP_EXPORT const_iterator end() const;
+  };
+
+  /**
+   * The ContactList class represents a list of Contact objects.
+   * @since 4.1
+   */
+  class ContactList : public Interface {
+  public:
+    // For internal use only.
+    ContactList(const std::shared_ptr< ListBaseImplementation<Contact> >&);
+
+    /**
+     * Constructs an empty list of contacts.
+     * @since 4.1
+     */
+    LEAP_EXPORT ContactList();
+
+    /**
+     * The number of contacts in this list.
+     * @since 4.1
+     */
+    LEAP_EXPORT int count() const;
+
+    /**
+     * Reports whether the list is empty.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool isEmpty() const;
+
+    /**
+     * Access a list member by its position in the list.
+     * @param index The zero-based list position index.
+     * @returns The Contact at the specified index.
+     * @since 4.1
+     */
+    LEAP_EXPORT Contact operator[](int index) const;
+
+    /**
+     * Appends the members of the specified ContactList to this list.
+     * @since 4.1
+     */
+    LEAP_EXPORT ContactList& append(const ContactList& other);
+
+    /**
+     * A C++ iterator type for ContactList objects.
+     * @since 4.1
+     */
+    typedef ConstListIterator<ContactList, Contact> const_iterator;
+
+    /**
+     * The C++ iterator set to the beginning of this ContactList.
+     * @since 4.1
+     */
+    LEAP_EXPORT const_iterator begin() const;
+
+    /**
+     * The C++ iterator set to the end of this ContactList.
+     * @since 4.1
+     */
+    LEAP_EXPORT const_iterator end() const;
+  };
+
+  class HeadPose: public Interface {
+  public:
+    // For internal use only.
+    HeadPose(HeadPoseImplementation*);
+
+    LEAP_EXPORT HeadPose();
+
+    LEAP_EXPORT int64_t timestamp() const;
+
+    LEAP_EXPORT Vector position() const;
 
     LEAP_EXPORT Quaternion orientation() const;
   };
@@ -2592,6 +3439,152 @@ namespace Leap {
      */
      LEAP_EXPORT MapPointList mapPoints() const;
 
+    /**
+     * The hands that were found, lost or changed since the previous frame.
+     *
+     * The list is computed once, when the frame arrives, by comparing the hand
+     * ids of this frame with those of the previous frame. Use it instead of
+     * comparing the hands of frame(0) and frame(1).
+     *
+     * @returns A HandTransitionList, sorted by hand id. The list is empty for
+     * frames that were not produced by the tracking path, such as those
+     * returned by Controller::predictFrame().
+     * @since 4.1
+     */
+    LEAP_EXPORT HandTransitionList handTransitions() const;
+
+    /**
+     * The overall motion of the hands since an earlier frame.
+     *
+     * The joints of every hand whose id appears in both frames are fitted
+     * together, so the result describes the common motion of those hands.
+     * Use Hand::motionSince() for the motion of a single hand.
+     *
+     * @param since An earlier frame.
+     * @returns A RigidMotion; its valid field is false if the frames share no
+     * hands.
+     * @since 4.1
+     */
+    LEAP_EXPORT RigidMotion motionSince(const Frame& since) const;
+
+    /**
+     * Options for writeBoneInstances().
+     *
+     * @since 4.1
+     */
+    enum BoneInstanceFlag {
+      /**
+       * One 32-bit float instance per bone.
+       * @since 4.1
+       */
+      BONE_INSTANCE_DEFAULT = 0,
+
+      /**
+       * Also write an instance for the palm and one for the arm of each hand.
+       * @since 4.1
+       */
+      BONE_INSTANCE_PALM_AND_ARM = (1 << 0),
+
+      /**
+       * Encode every value as an IEEE 754 half-precision float.
+       * @since 4.1
+       */
+      BONE_INSTANCE_HALF_FLOAT = (1 << 1)
+    };
+
+    /**
+     * The size in bytes of one instance written by writeBoneInstances().
+     *
+     * @param flags A combination of BoneInstanceFlag values.
+     * @returns 64 for 32-bit floats, 32 for half-precision floats.
+     * @since 4.1
+     */
+    LEAP_EXPORT static size_t boneInstanceStride(int flags = BONE_INSTANCE_DEFAULT);
+
+    /**
+     * The number of instances writeBoneInstances() writes for this frame.
+     *
+     * @param flags A combination of BoneInstanceFlag values.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t boneInstanceCount(int flags = BONE_INSTANCE_DEFAULT) const;
+
+    /**
+     * Writes per-bone instance data for every hand in this frame, ready to be
+     * uploaded as a std140 uniform or storage buffer.
+     *
+     * The data is built in a single pass from the tracking data, without
+     * creating Hand, Finger or Bone objects. Each instance is four 4-component
+     * rows: the first three are the rows of a 3x4 transform whose columns are
+     * the bone basis (see Bone::basis()) and the bone center; the fourth is
+     * (radius, length, part, hand index). The part is digit*4 + bone type for
+     * the bones, 20 for the palm and 21 for the arm; the hand index is the
+     * position of the hand in this frame. The palm instance is centered on the
+     * palm position, with the palm basis and a length and radius derived from
+     * the palm width.
+     *
+     * Instances are written hand by hand in the order of Frame::hands(), with
+     * the 20 bones of each hand followed by its palm and arm if requested.
+     * For best upload performance, align the buffer to 16 bytes.
+     *
+     * @param buffer The destination buffer.
+     * @param bufferSize The size of the buffer in bytes.
+     * @param flags A combination of BoneInstanceFlag values.
+     * @returns The number of instances written. Only whole hands are written,
+     * so compare the result with boneInstanceCount() to detect a buffer that
+     * is too small.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t writeBoneInstances(void* buffer, size_t bufferSize, int flags = BONE_INSTANCE_DEFAULT) const;
+
+    /**
+     * The number of crops writeHandCrops() writes for this frame: two per
+     * hand if the frame has a pair of 8-bit default images, 0 otherwise.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t handCropCount() const;
+
+    /**
+     * Crops the camera images around every hand into a batch of fixed-size
+     * images, ready to be used as the input tensor of a neural network.
+     *
+     * The joints of all hands are projected into both images of the frame in
+     * one pass, using the distortion maps of the images. Each crop is the
+     * smallest square holding the projected joints, grown by the padding on
+     * every side, and resampled to cropSize x cropSize pixels from the level
+     * of the image pyramid (see Image::pyramidLevel()) closest to the output
+     * resolution. The batch is laid out NCHW with one channel: crop n = 2*h + c
+     * for the hand at position h in Frame::hands() and camera c, row by row.
+     * Each value is brightness*gain + offset; pixels outside the image have a
+     * brightness of 0.
+     *
+     * \code
+     * const int size = 128;
+     * std::vector<float> batch(frame.handCropCount()*size*size);
+     * std::vector<Leap::HandCrop> crops(frame.handCropCount());
+     * frame.writeHandCrops(batch.data(), batch.size()*sizeof(float), size, crops.data(),
+     *                      controller.devices()[0].baseline());
+     * \endcode
+     *
+     * @param buffer The destination buffer, aligned to 4 bytes.
+     * @param bufferSize The size of the buffer in bytes.
+     * @param cropSize The width and height of each crop, in pixels.
+     * @param crops Receives the source square of each crop; may be null.
+     * @param baseline The distance between the cameras, in millimeters; see
+     * Device::baseline().
+     * @param padding The margin added on each side of the joints, as a fraction
+     * of the size of their bounding box.
+     * @param gain The scale applied to the brightness.
+     * @param offset The offset added to the scaled brightness.
+     * @returns The number of crops written. Only whole hands are written, so
+     * compare the result with handCropCount() to detect a buffer that is too
+     * small.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t writeHandCrops(void* buffer, size_t bufferSize, int cropSize, HandCrop* crops = nullptr,
+                                      float baseline = 40.0f, float padding = 0.15f,
+                                      float gain = 1.0f/255.0f, float offset = 0.0f) const;
+
     /**
      * The instantaneous frame rate.
      *
@@ -2686,9 +3679,490 @@ namespace Leap {
     }
 
   private:
+    friend class CollisionScene;
+    friend class Controller;
     LEAP_EXPORT const char* toCString(size_t& length) const;
   };
 
+  /**
+   * The CollisionScene class finds the contacts between the tracked hands and
+   * a set of scene colliders.
+   *
+   * The colliders are kept in a bounding volume hierarchy, which is rebuilt
+   * on the next query after the set changes, so the scene is meant for static
+   * or slowly changing geometry. Each query first tests the bounds of each
+   * hand, computed when the frame arrives, against the hierarchy, and only
+   * tests the capsules of a hand against the colliders its bounds overlap.
+   *
+   * A CollisionScene can be queried from several threads, but must not be
+   * modified while it is being queried.
+   * @since 4.1
+   */
+  class CollisionScene : public Interface {
+  public:
+    /**
+     * Constructs an empty scene.
+     * @since 4.1
+     */
+    LEAP_EXPORT CollisionScene();
+
+    /**
+     * Replaces the colliders of the scene.
+     *
+     * @param colliders The new colliders.
+     * @param count The number of colliders.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setColliders(const Collider* colliders, size_t count);
+
+    /**
+     * Adds one collider to the scene.
+     * @since 4.1
+     */
+    LEAP_EXPORT void addCollider(const Collider& collider);
+
+    /**
+     * Removes all colliders from the scene.
+     * @since 4.1
+     */
+    LEAP_EXPORT void clear();
+
+    /**
+     * The number of colliders in the scene.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t count() const;
+
+    /**
+     * The contacts between the hands of a frame and the scene.
+     *
+     * @param frame The frame to test.
+     * @returns A ContactList, ordered by hand, then by part, then by the order
+     * in which the colliders were added.
+     * @since 4.1
+     */
+    LEAP_EXPORT ContactList contacts(const Frame& frame) const;
+  };
+
+  /**
+   * The PoseIndex class finds the reference poses closest to a hand pose.
+   *
+   * Add a library of labeled reference poses, then call nearest() with the
+   * PoseFeatures of a tracked hand. The index is a vantage-point tree, built
+   * on the first query after poses are added; queries are exact and take a few
+   * microseconds for libraries of thousands of poses. An index can be saved
+   * to a file and loaded again without rebuilding the tree.
+   *
+   * A PoseIndex can be queried from several threads, but must not be
+   * modified while it is being queried.
+   * @since 4.1
+   */
+  class PoseIndex : public Interface {
+  public:
+    /**
+     * Constructs an empty index.
+     * @since 4.1
+     */
+    LEAP_EXPORT PoseIndex();
+
+    /**
+     * Adds a reference pose.
+     *
+     * @param features The features of the pose. Invalid features are ignored.
+     * @param label A caller-defined label, reported in PoseMatch::label.
+     * @since 4.1
+     */
+    LEAP_EXPORT void add(const PoseFeatures& features, int32_t label);
+
+    /**
+     * Removes all poses.
+     * @since 4.1
+     */
+    LEAP_EXPORT void clear();
+
+    /**
+     * The number of poses in the index.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t count() const;
+
+    /**
+     * Finds the reference poses closest to a pose.
+     *
+     * @param features The features of the pose to look up.
+     * @param k The maximum number of matches to return.
+     * @param matches Receives up to k matches, closest first.
+     * @returns The number of matches written.
+     * @since 4.1
+     */
+    LEAP_EXPORT int nearest(const PoseFeatures& features, int k, PoseMatch* matches) const;
+
+    /**
+     * The label of the reference pose closest to a pose.
+     *
+     * @returns The label, or -1 if the index is empty or the features are invalid.
+     * @since 4.1
+     */
+    LEAP_EXPORT int32_t nearestLabel(const PoseFeatures& features) const;
+
+    /**
+     * Writes the index to a file.
+     *
+     * The file stores the features and the tree in the byte order of this
+     * machine.
+     *
+     * @returns True if the file was written.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool save(const char* path) const;
+
+    /**
+     * Replaces the contents of the index with those of a file written by save().
+     *
+     * @returns True if the file was read. On failure the index is unchanged.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool load(const char* path);
+  };
+
+  /**
+   * The MapPointStore class accumulates map points across frames and finds
+   * them by position.
+   *
+   * Each update merges the map points of a frame by id: the stored position of
+   * an id is the running mean of its recent observations, and ids that have
+   * not been observed for longer than the maximum age are removed. Points are
+   * kept in a hash of voxels, so updates take time proportional to the number
+   * of points in the update, and radius and nearest-neighbor queries only
+   * visit the voxels around the query.
+   *
+   * \code
+   * void onFrame(const Leap::Controller& controller) {
+   *   const Leap::Frame frame = controller.frame();
+   *   store.update(frame);
+   *   for (const Leap::Hand& hand : frame.hands()) {
+   *     Leap::MapPointList near = store.within(hand.palmPosition(), 100.0f);
+   *   }
+   * }
+   * \endcode
+   *
+   * All functions can be called from any thread.
+   * @since 4.1
+   */
+  class MapPointStore : public Interface {
+  public:
+    /**
+     * Constructs an empty store.
+     *
+     * @param voxelSize The edge length of the voxels, in millimeters. Choose a
+     * size close to the typical query radius.
+     * @param maxAge How long an id is kept after it was last observed, in
+     * microseconds.
+     * @since 4.1
+     */
+    LEAP_EXPORT MapPointStore(float voxelSize = 50.0f, int64_t maxAge = 5000000);
+
+    /**
+     * Merges the map points of a frame, stamped with the frame timestamp.
+     * @since 4.1
+     */
+    LEAP_EXPORT void update(const Frame& frame);
+
+    /**
+     * Merges a list of map points observed at the specified time.
+     *
+     * Ids last observed more than the maximum age before the timestamp are
+     * removed.
+     *
+     * @param points The observed points.
+     * @param timestamp The time of the observation, in microseconds.
+     * @since 4.1
+     */
+    LEAP_EXPORT void update(const MapPointList& points, int64_t timestamp);
+
+    /**
+     * Removes all points.
+     * @since 4.1
+     */
+    LEAP_EXPORT void clear();
+
+    /**
+     * The number of ids in the store.
+     * @since 4.1
+     */
+    LEAP_EXPORT int count() const;
+
+    /**
+     * The stored point with the specified id.
+     *
+     * @returns The MapPoint; MapPoint::invalid() if the id is not in the store.
+     * @since 4.1
+     */
+    LEAP_EXPORT MapPoint point(uint32_t id) const;
+
+    /**
+     * The stored points within a distance of a position.
+     *
+     * @returns A MapPointList, in no particular order.
+     * @since 4.1
+     */
+    LEAP_EXPORT MapPointList within(const Vector& center, float radius) const;
+
+    /**
+     * The k stored points closest to a position.
+     *
+     * @returns A MapPointList of up to k points, closest first.
+     * @since 4.1
+     */
+    LEAP_EXPORT MapPointList nearest(const Vector& position, int k) const;
+  };
+
+  /**
+   * The StereoDepth class computes depth from the left and right camera images.
+   *
+   * update() resamples both images of a pair onto a common rectified grid in
+   * which rows of the two images correspond. The grid spans ray slopes from
+   * -maxSlope to maxSlope in both directions (see Image::rectify()). The
+   * resampling maps are built from the distortion maps of the images, and are
+   * rebuilt only when the calibration changes. computeDepth() then matches
+   * blocks of pixels along the rows of a region. It only searches the
+   * disparities of the region's depth range. handRegion() gives the region
+   * covering a tracked hand.
+   *
+   * \code
+   * Leap::StereoDepth stereo;
+   * std::vector<float> depth;
+   * void onImages(const Leap::Controller& controller) {
+   *   const Leap::Frame frame = controller.frame();
+   *   const Leap::ImageList images = frame.images();
+   *   if (!stereo.update(images[0], images[1], controller.devices()[0].baseline()))
+   *     return;
+   *   for (const Leap::Hand& hand : frame.hands()) {
+   *     const Leap::StereoRegion region = stereo.handRegion(hand);
+   *     depth.resize(region.width*region.height);
+   *     stereo.computeDepth(region, depth.data());
+   *   }
+   * }
+   * \endcode
+   *
+   * All functions can be called from any thread.
+   * @since 4.1
+   */
+  class StereoDepth : public Interface {
+  public:
+    /**
+     * Constructs a StereoDepth with the specified rectified grid.
+     *
+     * @param width The width of the rectified images, in pixels.
+     * @param height The height of the rectified images, in pixels.
+     * @param maxSlope The largest ray slope covered by the grid; 1 covers a
+     * field of view of 90 degrees.
+     * @since 4.1
+     */
+    LEAP_EXPORT StereoDepth(int width = 320, int height = 320, float maxSlope = 1.0f);
+
+    /** The width of the rectified images. @since 4.1 */
+    LEAP_EXPORT int width() const;
+
+    /** The height of the rectified images. @since 4.1 */
+    LEAP_EXPORT int height() const;
+
+    /**
+     * Sets the size of the blocks matched by computeDepth().
+     *
+     * Larger blocks match more reliably on weak texture but blur depth edges.
+     *
+     * @param size An odd size from 3 to 15 pixels; the default is 7.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setBlockSize(int size);
+
+    /** The size of the blocks matched by computeDepth(). @since 4.1 */
+    LEAP_EXPORT int blockSize() const;
+
+    /**
+     * Rectifies a new pair of images.
+     *
+     * @param left The image of the left camera (id 0).
+     * @param right The image of the right camera (id 1).
+     * @param baseline The distance between the cameras, in millimeters; see
+     * Device::baseline().
+     * @returns True if the images were rectified; false if they are invalid
+     * or are not 8-bit images.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool update(const Image& left, const Image& right, float baseline);
+
+    /**
+     * The rectified image of a camera from the last update(), width() by
+     * height() bytes. Pixels that no camera ray reaches are 0.
+     *
+     * @param camera 0 for the left camera, 1 for the right camera.
+     * @returns The pixels; null before the first update().
+     * @since 4.1
+     */
+    LEAP_EXPORT const unsigned char* rectifiedImage(int camera) const;
+
+    /**
+     * The region of the rectified left image covering a hand, with the range
+     * of depths of its joints.
+     *
+     * @param hand A hand from the frame of the images.
+     * @param margin The margin added around the joints, in pixels.
+     * @param depthMargin The margin added to the depth range, in millimeters.
+     * @returns The region, clipped to the rectified image; an empty region if
+     * the hand is invalid or outside the image.
+     * @since 4.1
+     */
+    LEAP_EXPORT StereoRegion handRegion(const Hand& hand, int margin = 12, float depthMargin = 40.0f) const;
+
+    /**
+     * Computes the depth of every pixel of a region of the rectified left
+     * image.
+     *
+     * Each pixel is matched with sum-of-absolute-differences block matching
+     * against the right image. The search covers the disparities of the
+     * region's depth range and refines the match to a fraction of a pixel.
+     * A match is rejected when another disparity matches almost as well,
+     * which happens on untextured areas.
+     *
+     * @param region The region of the rectified left image.
+     * @param depth The destination, region.width*region.height floats written
+     * row by row. Rejected pixels and pixels outside the image are 0.
+     * @returns The number of pixels with a depth; 0 before the first update().
+     * @since 4.1
+     */
+    LEAP_EXPORT int computeDepth(const StereoRegion& region, float* depth) const;
+  };
+
+  /**
+   * The ImageCodec class losslessly compresses pairs of 8-bit camera images,
+   * for recordings and for passing images between processes.
+   *
+   * Each row of an image is predicted from the row above, from the same row
+   * of the previous pair, or, in the right image, from the same row of the
+   * left image, whichever leaves the smallest residuals. The residuals are
+   * bit-packed in blocks of 16 pixels, each with just as many bits as its
+   * largest residual needs.
+   *
+   * Frames that are predicted from the previous pair can only be decoded in
+   * sequence. Every keyframeInterval() pairs, and whenever the image size
+   * changes, a keyframe is written that decodes on its own; a recording can
+   * be played back from any keyframe, and a reader that drops a frame
+   * resumes at the next keyframe.
+   *
+   * \code
+   * Leap::ImageCodec encoder;
+   * std::vector<unsigned char> encoded;
+   * void onImages(const Leap::Controller& controller) {
+   *   const Leap::ImageList images = controller.frame().images();
+   *   encoded.resize(Leap::ImageCodec::maxEncodedSize(images[0].width(), images[0].height()));
+   *   const size_t size = encoder.encode(images[0], images[1], encoded.data(), encoded.size());
+   *   if (size)
+   *     file.write(reinterpret_cast<const char*>(encoded.data()), size);
+   * }
+   * \endcode
+   *
+   * An ImageCodec keeps the previous pair it encoded and the previous pair it
+   * decoded; use separate instances for separate streams. All functions can
+   * be called from any thread.
+   * @since 4.1
+   */
+  class ImageCodec : public Interface {
+  public:
+    /**
+     * Constructs an ImageCodec.
+     *
+     * @param keyframeInterval The number of pairs from one keyframe to the
+     * next; 1 makes every pair a keyframe.
+     * @since 4.1
+     */
+    LEAP_EXPORT explicit ImageCodec(int keyframeInterval = 60);
+
+    /** The number of pairs from one keyframe to the next. @since 4.1 */
+    LEAP_EXPORT int keyframeInterval() const;
+
+    /** Sets the number of pairs from one keyframe to the next. @since 4.1 */
+    LEAP_EXPORT void setKeyframeInterval(int interval);
+
+    /**
+     * Forgets the previous pairs, so that the next encoded pair is a keyframe
+     * and the next decoded pair must be one.
+     * @since 4.1
+     */
+    LEAP_EXPORT void reset();
+
+    /**
+     * The largest size of an encoded pair of images.
+     *
+     * @param width The width of the images, in pixels.
+     * @param height The height of the images, in pixels.
+     * @since 4.1
+     */
+    LEAP_EXPORT static size_t maxEncodedSize(int width, int height);
+
+    /**
+     * Encodes a pair of images.
+     *
+     * @param left The image of the left camera (id 0).
+     * @param right The image of the right camera (id 1), the same size as the
+     * left image.
+     * @param buffer The destination.
+     * @param bufferSize The size of the destination, in bytes; a buffer of
+     * maxEncodedSize() bytes always fits the pair.
+     * @returns The size of the encoded pair, in bytes; 0 if the images are
+     * invalid, are not 8-bit images or do not fit the buffer.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t encode(const Image& left, const Image& right, void* buffer, size_t bufferSize);
+
+    /**
+     * Encodes a pair of images held in memory.
+     *
+     * @param left The pixels of the left image, width*height bytes.
+     * @param right The pixels of the right image, width*height bytes.
+     * @param width The width of the images, from 1 to 65535 pixels.
+     * @param height The height of the images, from 1 to 65535 pixels.
+     * @param buffer The destination.
+     * @param bufferSize The size of the destination, in bytes.
+     * @returns The size of the encoded pair, in bytes; 0 if it does not fit
+     * the buffer.
+     * @since 4.1
+     */
+    LEAP_EXPORT size_t encode(const unsigned char* left, const unsigned char* right, int width, int height,
+                              void* buffer, size_t bufferSize);
+
+    /**
+     * Reads the size of the images of an encoded pair.
+     *
+     * @param data The encoded pair.
+     * @param size The size of the encoded pair, in bytes.
+     * @param width Receives the width of the images.
+     * @param height Receives the height of the images.
+     * @param isKeyframe Receives whether the pair decodes on its own.
+     * @returns False if the data is not an encoded pair.
+     * @since 4.1
+     */
+    LEAP_EXPORT static bool frameInfo(const void* data, size_t size, int* width, int* height, bool* isKeyframe = nullptr);
+
+    /**
+     * Decodes a pair of images.
+     *
+     * A pair that is not a keyframe only decodes directly after the pair
+     * encoded before it.
+     *
+     * @param data The encoded pair.
+     * @param size The size of the encoded pair, in bytes.
+     * @param left Receives the pixels of the left image, width*height bytes
+     * (see frameInfo()).
+     * @param right Receives the pixels of the right image, width*height bytes.
+     * @returns False if the data is corrupt or the pair cannot be decoded in
+     * this sequence; the images are then undefined.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool decode(const void* data, size_t size, unsigned char* left, unsigned char* right);
+  };
+
   /**
    * The Config class provides access to Leap Motion system configuration information.
    *
@@ -2944,6 +4418,34 @@ namespace Leap {
      * **POLICY_ALLOW_PAUSE_RESUME** -- request that the application be allowed
      *   to pause and unpause the Leap Motion service.
      *
+     * **POLICY_EAGER_DERIVED_DATA** -- compute the derived hand and bone quantities
+     *   (Hand::basis(), Hand::direction(), Arm::basis(), Arm::direction(),
+     *   Bone::basis(), Bone::direction() and Bone::length()) for every hand as soon
+     *   as a frame arrives, rather than on first access.
+     *
+     *   This policy is handled by the client library and is not sent to the
+     *   Leap Motion service, so it is always granted.
+     *
+     * **POLICY_JOINT_KINEMATICS** -- estimate the velocity and acceleration of
+     *   every joint as frames arrive (Finger::jointVelocity(),
+     *   Finger::jointAcceleration(), Hand::palmAcceleration() and
+     *   Arm::wristVelocity()). Estimates are kept per hand id and restart when a
+     *   hand is lost. Like POLICY_EAGER_DERIVED_DATA, this policy is handled by
+     *   the client library.
+     *
+     * **POLICY_IMAGE_PYRAMIDS** -- compute the Gaussian pyramid and the integral
+     *   image of both images (Image::pyramidLevel() and Image::integralImage())
+     *   as soon as images arrive, rather than on first access. This policy is
+     *   also handled by the client library. The buffers are then counted in
+     *   the image retention budget (see setRetentionLimits()); without the
+     *   policy they are only built for the images an application reads.
+     *
+     * **POLICY_LAZY_IMAGE_RETENTION** -- do not retain image pairs that every
+     *   listener skips (see setImageDelivery()), so that their buffers are
+     *   released as soon as they arrive. Such pairs are not returned by
+     *   images() and are not attached to frames. Images are always retained
+     *   while there are no listeners. Also handled by the client library.
+     *
      * Some policies can be denied if the user has disabled the feature on
      * their Leap Motion control panel.
      *
@@ -2983,6 +4485,30 @@ namespace Leap {
        * Receive map points.
        */
       POLICY_MAP_POINTS = (1 << 7),
+
+      /**
+       * Compute derived hand and bone quantities when each frame arrives.
+       * @since 4.1
+       */
+      POLICY_EAGER_DERIVED_DATA = (1 << 24),
+
+      /**
+       * Estimate joint velocities and accelerations as frames arrive.
+       * @since 4.1
+       */
+      POLICY_JOINT_KINEMATICS = (1 << 25),
+
+      /**
+       * Compute image pyramids and integral images when images arrive.
+       * @since 4.1
+       */
+      POLICY_IMAGE_PYRAMIDS = (1 << 26),
+
+      /**
+       * Only retain the image pairs that some listener receives.
+       * @since 4.1
+       */
+      POLICY_LAZY_IMAGE_RETENTION = (1 << 27),
     };
 
     /**
@@ -3088,6 +4614,41 @@ namespace Leap {
      */
     LEAP_EXPORT bool removeListener(Listener& listener);
 
+    /**
+     * Sets how a listener receives images.
+     *
+     * By default, Listener::onImages() is called for every image pair, on the
+     * thread that dispatches all events, at the frame rate of the cameras.
+     * With a maximum rate, the pairs that arrive within 1/maxRate seconds of
+     * the last pair delivered to the listener are skipped; the interval is
+     * measured between image timestamps, so it follows the frame times of the
+     * cameras rather than the time spent in callbacks.
+     *
+     * With latestOnly, onImages() is called on a thread of its own for this
+     * listener, so that a slow listener holds up neither tracking nor the
+     * other listeners. While the listener is busy, further pairs only leave
+     * one call pending, in which Controller::images() returns the latest pair.
+     * removeListener() waits for a call in progress to return.
+     *
+     * \code
+     * // A recognizer that needs the latest images 15 times per second
+     * controller.addListener(recognizer);
+     * controller.setImageDelivery(recognizer, 15.0f, true);
+     * \endcode
+     *
+     * See POLICY_LAZY_IMAGE_RETENTION to release the pairs that every
+     * listener skips.
+     *
+     * @param listener A listener added with addListener().
+     * @param maxRate The largest number of image pairs per second to deliver;
+     * 0 to deliver every pair.
+     * @param latestOnly Whether to call onImages() on a thread of its own and
+     * skip the pairs that arrive while it is busy.
+     * @returns False if the listener has not been added.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool setImageDelivery(Listener& listener, float maxRate, bool latestOnly = false);
+
     /**
      * Returns a frame of tracking data from the Leap Motion software. Use the optional
      * history parameter to specify which frame to retrieve. Call frame() or
@@ -3103,7 +4664,9 @@ namespace Leap {
      * \include Controller_Listener_onFrame.txt
 
      * @param history The age of the frame to return, counting backwards from
-     * the most recent frame (0) into the past and up to the maximum age (59).
+     * the most recent frame (0) into the past and up to the maximum age (59 by
+     * default, see setRetentionLimits(), plus the compact history size; see
+     * setCompactHistorySize()).
      * @returns The specified frame; or, if no history parameter is specified,
      * the newest frame. If a frame is not available at the specified history
      * position, an invalid Frame is returned.
@@ -3111,6 +4674,235 @@ namespace Leap {
      */
     LEAP_EXPORT Frame frame(int history = 0) const;
 
+    /**
+     * Sets how many frames are kept, in a compact encoding, after they leave
+     * the retained frames (the 60 most recent by default).
+     *
+     * Frames dropped from the retained frames are quantized to roughly a
+     * third of their size and remain available from frame() at the following
+     * ages (60 and up by default). Joint
+     * positions keep a resolution of 0.05 mm within 1.6 m of the palm, and
+     * rotations are accurate to about 0.1 degree. A frame decoded from the
+     * compact history has no images, map points, hand transitions or per-hand
+     * stage data (joint kinematics, smoothing). With two hands, a minute of
+     * frames at 120 frames per second takes about 5 MB.
+     *
+     * \code
+     * controller.setCompactHistorySize(120*60); // Keep the last minute
+     * Leap::Frame old = controller.frame(60 + 120*30);
+     * \endcode
+     *
+     * @param frames The number of frames to keep; 0, the default, disables
+     * the compact history.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setCompactHistorySize(int frames);
+
+    /**
+     * The number of frames kept in the compact history.
+     * @since 4.1
+     */
+    LEAP_EXPORT int compactHistorySize() const;
+
+    /**
+     * The kinds of history retained by the controller.
+     * @since 4.1
+     */
+    enum RetentionCategory {
+      /** Tracking data of the frames returned by frame(). */
+      RETENTION_FRAMES,
+      /** Image pairs, attached to the frames with the same id. */
+      RETENTION_IMAGES,
+      /** Map point buffers, attached to the frames with the same id. */
+      RETENTION_MAP_POINTS
+    };
+
+    /**
+     * Limits how much history of one category the controller retains.
+     *
+     * Each category keeps its most recent entries; the oldest are dropped as
+     * soon as either the count or the byte budget is exceeded. The most recent
+     * entry is kept even if it alone exceeds the byte budget. Dropping an image
+     * pair or map point buffer also detaches it from the retained frame it
+     * belongs to, so that its memory is released unless the application still
+     * holds the images or map points. By default each category keeps 60
+     * entries without a byte budget.
+     *
+     * \code
+     * // Keep 60 frames but only the latest 4 image pairs
+     * controller.setRetentionLimits(Leap::Controller::RETENTION_IMAGES, 4);
+     * // Keep map points for at most 8 MB worth of frames
+     * controller.setRetentionLimits(Leap::Controller::RETENTION_MAP_POINTS, 60, 8 << 20);
+     * \endcode
+     *
+     * @param category The category to limit.
+     * @param maxCount The number of entries to keep; at least 1 for frames.
+     * @param maxBytes The bytes to keep, as reported by retainedBytes(); 0 for
+     * no byte budget.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setRetentionLimits(RetentionCategory category, int maxCount, int64_t maxBytes = 0);
+
+    /**
+     * The number of entries of a category currently retained.
+     * @since 4.1
+     */
+    LEAP_EXPORT int retainedCount(RetentionCategory category) const;
+
+    /**
+     * The memory currently retained for a category, in bytes.
+     *
+     * Frames count their tracking data, image pairs their pixel buffers (with
+     * the pyramids and integral images built when they arrived) and map points
+     * their point mapping buffers. The compact history is not
+     * included; see setCompactHistorySize().
+     * @since 4.1
+     */
+    LEAP_EXPORT int64_t retainedBytes(RetentionCategory category) const;
+
+    /**
+     * Sets the directory where undistortion maps are saved.
+     *
+     * Building an undistortion map (see Image::undistortionMap()) takes
+     * several milliseconds per camera. With a cache directory, each map is
+     * saved to a file named after the serial number of the device, the camera
+     * and the grid, and later loaded from that file if the calibration has
+     * not changed in the meantime.
+     *
+     * \code
+     * controller.setCalibrationCacheDirectory("/var/cache/myapp");
+     * \endcode
+     *
+     * @param directory An existing, writable directory; null or empty to keep
+     * maps in memory only, which is the default.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setCalibrationCacheDirectory(const char* directory);
+
+    /**
+     * Returns the most recent frame extrapolated to the specified time.
+     *
+     * Use this function to compensate for latency, for example by predicting
+     * the hands at the time the next image is displayed. Each hand is moved
+     * with the linear and angular velocity it had between the two most recent
+     * frames: joint positions are extrapolated linearly and bone and palm
+     * orientations by a constant rotation rate. A hand that is not in the
+     * previous frame is translated with its palm velocity.
+     *
+     * \code
+     * Leap::Frame predicted = controller.predictFrame(controller.now() + 20000);
+     * \endcode
+     *
+     * The returned frame has the id of the most recent frame and the target
+     * timestamp. Images and map points are not included. Prediction is limited
+     * to 100 milliseconds past the most recent frame; earlier targets are
+     * clamped to the time of the previous frame.
+     *
+     * @param targetTimestamp The time to predict, in microseconds, on the same
+     * clock as Frame::timestamp() and Controller::now().
+     * @returns The predicted frame; an invalid Frame if no frame has been
+     * received yet.
+     * @since 4.1
+     */
+    LEAP_EXPORT Frame predictFrame(int64_t targetTimestamp) const;
+
+    /**
+     * Extrapolates the most recent frame into an existing Frame object.
+     *
+     * Works like predictFrame(int64_t), but when no other Frame object refers
+     * to the same frame as into, its hands are refilled in place rather than
+     * in a newly allocated frame. A render loop that predicts once per display
+     * refresh can then keep a single Frame and stop allocating after the first
+     * call.
+     *
+     * \code
+     * Leap::Frame predicted;
+     * while (rendering) {
+     *   if (controller.predictFrame(controller.now() + 20000, predicted))
+     *     drawHands(predicted.hands());
+     * }
+     * \endcode
+     *
+     * Hands, fingers and other objects obtained from into before the call
+     * must not be used after it.
+     *
+     * @param targetTimestamp The time to predict, as for predictFrame(int64_t).
+     * @param into The frame to fill.
+     * @returns False, leaving into unchanged, if no frame has been received
+     * yet.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool predictFrame(int64_t targetTimestamp, Frame& into) const;
+
+    /**
+     * Registers a gesture with the gesture engine.
+     *
+     * Registered gestures are evaluated for every tracked hand as frames
+     * arrive, and their events are delivered to Listener::onGesture() before
+     * Listener::onFrame() is called for the same frame. Each gesture costs a
+     * constant amount of work per hand per frame, so many gestures can run at
+     * once.
+     *
+     * \code
+     * const int32_t pinchId = controller.addGesture(Leap::GestureDefinition::pinch());
+     * \endcode
+     *
+     * @param definition The gesture to recognize.
+     * @returns An id identifying the gesture in GestureEvent::gestureId.
+     * @since 4.1
+     */
+    LEAP_EXPORT int32_t addGesture(const GestureDefinition& definition) const;
+
+    /**
+     * Unregisters a gesture. Gestures in progress end without a stop event.
+     *
+     * @param gestureId An id returned by addGesture().
+     * @returns True if the gesture was registered.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool removeGesture(int32_t gestureId) const;
+
+    /**
+     * Registers a sliding-window aggregate.
+     *
+     * \code
+     * Leap::WindowAggregate maxSpeed = { Leap::GestureDefinition::SIGNAL_PALM_SPEED,
+     *                                    Leap::WindowAggregate::KIND_MAX, 500000, 0.0f };
+     * const int32_t maxSpeedId = controller.addAggregate(maxSpeed);
+     * // ...
+     * float speed = controller.aggregate(maxSpeedId, hand.id());
+     * \endcode
+     *
+     * Values are kept per hand id and restart when a hand is lost.
+     *
+     * @param aggregate The aggregate to maintain.
+     * @returns An id to pass to aggregate() and removeAggregate().
+     * @since 4.1
+     */
+    LEAP_EXPORT int32_t addAggregate(const WindowAggregate& aggregate) const;
+
+    /**
+     * Unregisters an aggregate.
+     *
+     * @param aggregateId An id returned by addAggregate().
+     * @returns True if the aggregate was registered.
+     * @since 4.1
+     */
+    LEAP_EXPORT bool removeAggregate(int32_t aggregateId) const;
+
+    /**
+     * The current value of an aggregate for a hand.
+     *
+     * This function takes constant time.
+     *
+     * @param aggregateId An id returned by addAggregate().
+     * @param handId The Hand::id() of a tracked hand.
+     * @returns The value of the aggregate, as of the most recent frame; 0 if the
+     * aggregate is not registered or the hand is not tracked.
+     * @since 4.1
+     */
+    LEAP_EXPORT float aggregate(int32_t aggregateId, int32_t handId) const;
+
     LEAP_EXPORT HeadPose headPose(int64_t timestamp) const;
 
     /**
@@ -3166,6 +4958,119 @@ namespace Leap {
     */
     LEAP_EXPORT FailedDeviceList failedDevices() const;
 
+    /**
+     * A counter that increases every time the set of devices or the status of
+     * any device changes.
+     *
+     * The lists returned by Controller::devices() and Controller::failedDevices()
+     * are immutable snapshots which are only rebuilt when a device event arrives.
+     * Polling code can compare this value against the one it saw last and skip
+     * re-reading the device lists when it has not changed:
+     *
+     * \code
+     * if (controller.deviceGeneration() != lastGeneration) {
+     *   lastGeneration = controller.deviceGeneration();
+     *   Leap::DeviceList devices = controller.devices();
+     *   // ...
+     * }
+     * \endcode
+     *
+     * @returns The generation of the current device snapshot; 0 if no device
+     * event has been received yet.
+     * @since 4.1
+     */
+    LEAP_EXPORT uint64_t deviceGeneration() const;
+
+    /**
+     * Sets the filtering applied to the joint velocity and acceleration
+     * estimates of the POLICY_JOINT_KINEMATICS policy.
+     *
+     * Each estimate is an exponential moving average of the finite differences
+     * between consecutive frames. The time constants are in seconds; larger
+     * values give smoother but more delayed estimates, and 0 disables filtering.
+     * The defaults are 0.02 seconds for velocity and 0.05 seconds for
+     * acceleration.
+     *
+     * @param velocityTimeConstant The time constant of the velocity filter.
+     * @param accelerationTimeConstant The time constant of the acceleration filter.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setKinematicsFilter(float velocityTimeConstant, float accelerationTimeConstant) const;
+
+    /**
+     * The filters available to the smoothing stage.
+     *
+     * @since 4.1
+     */
+    enum SmoothingFilter {
+      /**
+       * No smoothing. The smoothed positions equal the tracked positions.
+       * @since 4.1
+       */
+      SMOOTHING_NONE = 0,
+
+      /**
+       * A One-Euro filter: an adaptive low-pass filter whose cutoff frequency
+       * rises with speed, trading jitter at rest for low lag during fast motion.
+       * @since 4.1
+       */
+      SMOOTHING_ONE_EURO = 1,
+
+      /**
+       * A constant-velocity Kalman filter.
+       * @since 4.1
+       */
+      SMOOTHING_KALMAN = 2,
+    };
+
+    /**
+     * Selects the filter used to smooth joint positions as frames arrive.
+     *
+     * When a filter is selected, every joint of every tracked hand is filtered
+     * and the results are published with each frame. Read them with
+     * Finger::smoothedJointPosition(), Finger::smoothedTipPosition(),
+     * Hand::smoothedPalmPosition() and Arm::smoothedWristPosition(); the
+     * unfiltered positions are still available from the usual functions.
+     * Filter state is kept per hand id and restarts when a hand is lost.
+     *
+     * @param filter A member of the SmoothingFilter enumeration. The default is
+     * SMOOTHING_NONE.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setSmoothingFilter(SmoothingFilter filter) const;
+
+    /**
+     * The filter currently used by the smoothing stage.
+     *
+     * @since 4.1
+     */
+    LEAP_EXPORT SmoothingFilter smoothingFilter() const;
+
+    /**
+     * Sets the parameters of the SMOOTHING_ONE_EURO filter.
+     *
+     * @param minCutoff The cutoff frequency in Hz at rest. Lower values remove
+     * more jitter. The default is 1.0.
+     * @param beta How quickly the cutoff frequency rises with speed, in
+     * Hz per mm/s. Higher values reduce lag. The default is 0.01.
+     * @param derivativeCutoff The cutoff frequency in Hz used to filter the
+     * speed estimate. The default is 1.0.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setOneEuroParameters(float minCutoff, float beta, float derivativeCutoff) const;
+
+    /**
+     * Sets the parameters of the SMOOTHING_KALMAN filter.
+     *
+     * @param accelerationNoise The standard deviation of the unmodelled
+     * acceleration in mm/s^2. Higher values follow fast motion more closely.
+     * The default is 5000.
+     * @param measurementNoise The standard deviation of the tracking noise in mm.
+     * Higher values smooth more. The default is 2.
+     * @since 4.1
+     */
+    LEAP_EXPORT void setKalmanParameters(float accelerationNoise, float measurementNoise) const;
+
      /**
      * Pauses or resumes the Leap Motion service.
      *
@@ -3423,6 +5328,38 @@ namespace Leap {
     * @since 4.0
     */
     LEAP_EXPORT virtual void onHeadPose(const Controller&, int64_t timestamp) {}
+
+    /**
+    * Called when a gesture registered with Controller::addGesture() starts,
+    * updates or stops on a hand.
+    *
+    * @param controller The Controller object invoking this callback function.
+    * @param event The gesture event.
+    * @since 4.1
+    */
+    LEAP_EXPORT virtual void onGesture(const Controller&, const GestureEvent& event) {}
+
+    /**
+    * Called when a hand that was not in the previous frame appears.
+    *
+    * Called before onFrame() for the frame containing the hand.
+    *
+    * @param controller The Controller object invoking this callback function.
+    * @param hand The new hand.
+    * @since 4.1
+    */
+    LEAP_EXPORT virtual void onHandFound(const Controller&, const Hand& hand) {}
+
+    /**
+    * Called when a hand of the previous frame is no longer tracked.
+    *
+    * Called before onFrame() for the first frame without the hand.
+    *
+    * @param controller The Controller object invoking this callback function.
+    * @param handId The Hand::id() of the lost hand.
+    * @since 4.1
+    */
+    LEAP_EXPORT virtual void onHandLost(const Controller&, int32_t handId) {}
   };
 }
 
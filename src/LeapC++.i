@@ -78,6 +78,12 @@
 %rename(BoneType) Leap::Bone::Type;
 %rename(DeviceType) Leap::Device::Type;
 %rename(FailureType) Leap::FailedDevice::Failure;
+%rename(GestureSignal) Leap::GestureDefinition::Signal;
+%rename(GestureType) Leap::GestureDefinition::Type;
+%rename(GestureState) Leap::GestureEvent::State;
+%rename(HandTransitionType) Leap::HandTransition::Type;
+%rename(AggregateKind) Leap::WindowAggregate::Kind;
+%rename(ColliderType) Leap::Collider::Type;
 
 #endif
 
@@ -235,6 +241,25 @@
 
 %ignore Leap::Image::data() const;
 %ignore Leap::Image::distortion() const;
+%ignore Leap::Device::distanceToBoundary(const Vector*, float*, size_t) const;
+%ignore Leap::Device::containedInBoundary(const Vector*, bool*, size_t) const;
+%ignore Leap::Frame::writeBoneInstances(void*, size_t, int) const;
+%ignore Leap::Frame::writeHandCrops;
+%ignore Leap::CollisionScene::setColliders(const Collider*, size_t);
+%ignore Leap::PoseIndex::nearest(const PoseFeatures&, int, PoseMatch*) const;
+%ignore Leap::MapPointList::MapPointList(const std::shared_ptr<Leap::MapPointListImplementation>&);
+%ignore Leap::MapPointList::points() const;
+%ignore Leap::MapPointList::ids() const;
+%ignore Leap::Image::convert;
+%ignore Leap::Image::packStereo;
+%ignore Leap::Image::pyramidLevel(int) const;
+%ignore Leap::Image::integralImage() const;
+%ignore Leap::Image::undistortionMap;
+%ignore Leap::StereoDepth::rectifiedImage(int) const;
+%ignore Leap::StereoDepth::computeDepth(const StereoRegion&, float*) const;
+%ignore Leap::ImageCodec::encode;
+%ignore Leap::ImageCodec::frameInfo;
+%ignore Leap::ImageCodec::decode;
 
 #if SWIGPYTHON
 
@@ -594,6 +619,8 @@ extern "C" BOOL WINAPI DllMain(
 %leap_list_helper(Image);
 %leap_list_helper(Hand);
 %leap_list_helper(MapPoint);
+%leap_list_helper(HandTransition);
+%leap_list_helper(Contact);
 %leap_list_helper(Device);
 %leap_list_helper(FailedDevice);
 
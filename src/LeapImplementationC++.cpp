@@ -7,6 +7,8 @@
 \******************************************************************************/
 
 #include "LeapImplementationC++.h"
+#include <cstdio>
+#include <fstream>
 
 namespace Leap {
 
@@ -21,6 +23,8 @@ ImageImplementation::ImageImplementation(const std::shared_ptr<ControllerImpleme
 {
   if (controllerImpl) {
     m_ref = controllerImpl->getSharedBufferReference(m_image_event.image[m_imageId].data);
+    m_bufferPool = controllerImpl->imageBufferPool();
+    m_distortionCache = controllerImpl->distortionMapCache();
   }
 }
 
@@ -40,18 +44,3004 @@ Vector ImageImplementation::warp(const Vector& xy) const {
   return controllerImpl->warp(m_imageId == 0 ? eLeapPerspectiveType_stereo_left : eLeapPerspectiveType_stereo_right, xy);
 }
 
+namespace {
+
+// Round-to-nearest-even conversion to IEEE 754 binary16
+uint16_t floatToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  uint32_t magnitude = bits & 0x7fffffff;
+  if (magnitude >= 0x7f800000) { // Inf or NaN
+    return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+  }
+  if (magnitude < 0x38800000) { // Subnormal or zero; the spacing of half subnormals is 2^-24
+    return sign | static_cast<uint16_t>(std::nearbyint(std::abs(value)*16777216.0f));
+  }
+  magnitude -= (127 - 15) << 23;
+  magnitude += 0xfff + ((magnitude >> 13) & 1);
+  return sign | static_cast<uint16_t>(std::min<uint32_t>(magnitude >> 13, 0x7c00));
+}
+
+// The position of the pixel that sees a ray, as fractions of the image size, interpolated in a
+// distortion map (see Image::distortion()). False where the ray is outside the map or does not
+// reach the image.
+bool distortedPosition(const float* distortion, float rayScaleX, float rayOffsetX, float rayScaleY, float rayOffsetY,
+                       float slopeX, float slopeY, float normalized[2]) {
+  const int n = LEAP_DISTORTION_MATRIX_N;
+  const float gx = (slopeX*rayScaleX + rayOffsetX)*(n - 1);
+  const float gy = (slopeY*rayScaleY + rayOffsetY)*(n - 1);
+  if (!(gx >= 0.0f && gx <= n - 1 && gy >= 0.0f && gy <= n - 1)) {
+    return false;
+  }
+  const int ix = std::min(static_cast<int>(gx), n - 2);
+  const int iy = std::min(static_cast<int>(gy), n - 2);
+  const float tx = gx - ix, ty = gy - iy;
+  const float* p00 = distortion + 2*(iy*n + ix);
+  const float* p10 = p00 + 2*n;
+  for (int c = 0; c < 2; c++) {
+    normalized[c] = (p00[c]*(1.0f - tx) + p00[c + 2]*tx)*(1.0f - ty) + (p10[c]*(1.0f - tx) + p10[c + 2]*tx)*ty;
+  }
+  return normalized[0] >= 0.0f && normalized[0] <= 1.0f && normalized[1] >= 0.0f && normalized[1] <= 1.0f;
+}
+
+size_t outputPixelSize(Image::OutputFormat format) {
+  switch (format) {
+  case Image::OUTPUT_GRAY8: return 1;
+  case Image::OUTPUT_FLOAT32: return sizeof(float);
+  case Image::OUTPUT_FLOAT16: return sizeof(uint16_t);
+  case Image::OUTPUT_RGBA8: return 4;
+  }
+  return 0;
+}
+
+// Averages each downscale x downscale block of a band of downscale rows, with rounding. The
+// rows are summed into 16-bit lanes, then adjacent sums are added pairwise in place, once for
+// 2x and twice for 4x; a 4x4 block sums to at most 4080, so the lanes never overflow.
+void downscaleRows(const uint8_t* src, int width, int downscale, uint16_t* sums, uint8_t* out) {
+  const int outWidth = width/downscale;
+  const int used = outWidth*downscale;
+  int x = 0;
+#if LEAP_CPP_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; x + 16 <= used; x += 16) {
+    __m128i lo = zero, hi = zero;
+    for (int r = 0; r < downscale; r++) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + r*width + x));
+      lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+      hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x), lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x + 8), hi);
+  }
+#endif
+  for (; x < used; x++) {
+    uint16_t sum = 0;
+    for (int r = 0; r < downscale; r++) {
+      sum += src[r*width + x];
+    }
+    sums[x] = sum;
+  }
+
+  for (int n = used; n > outWidth; n /= 2) {
+    const int half = n/2;
+    int i = 0;
+#if LEAP_CPP_SSE2
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; i + 8 <= half; i += 8) {
+      const __m128i a = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2*i)), ones);
+      const __m128i b = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2*i + 8)), ones);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), _mm_packs_epi32(a, b));
+    }
+#endif
+    for (; i < half; i++) {
+      sums[i] = sums[2*i] + sums[2*i + 1];
+    }
+  }
+
+  const int shift = downscale == 2 ? 2 : 4;
+  const uint16_t round = static_cast<uint16_t>(1 << (shift - 1));
+  int i = 0;
+#if LEAP_CPP_SSE2
+  const __m128i vRound = _mm_set1_epi16(static_cast<short>(round));
+  const __m128i vShift = _mm_cvtsi32_si128(shift);
+  for (; i + 16 <= outWidth; i += 16) {
+    const __m128i a = _mm_srl_epi16(_mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i)), vRound), vShift);
+    const __m128i b = _mm_srl_epi16(_mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i + 8)), vRound), vShift);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(a, b));
+  }
+#endif
+  for (; i < outWidth; i++) {
+    out[i] = static_cast<uint8_t>((sums[i] + round) >> shift);
+  }
+}
+
+// Converts one row of 8-bit pixels; halfs maps each brightness to its OUTPUT_FLOAT16 value
+void convertRow(const uint8_t* src, int width, Image::OutputFormat format, float gain, float offset,
+                const uint16_t* halfs, uint8_t* dst) {
+  int x = 0;
+  switch (format) {
+  case Image::OUTPUT_GRAY8:
+    std::memcpy(dst, src, width);
+    break;
+  case Image::OUTPUT_FLOAT32: {
+    float* out = reinterpret_cast<float*>(dst);
+#if LEAP_CPP_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 vGain = _mm_set1_ps(gain);
+    const __m128 vOffset = _mm_set1_ps(offset);
+    for (; x + 16 <= width; x += 16) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+      const __m128i lo = _mm_unpacklo_epi8(v, zero);
+      const __m128i hi = _mm_unpackhi_epi8(v, zero);
+      const __m128i quads[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                                 _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+      for (int q = 0; q < 4; q++) {
+        _mm_storeu_ps(out + x + 4*q, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(quads[q]), vGain), vOffset));
+      }
+    }
+#endif
+    for (; x < width; x++) {
+      out[x] = src[x]*gain + offset;
+    }
+    break;
+  }
+  case Image::OUTPUT_FLOAT16: {
+    // There are only 256 inputs, so a table beats converting each pixel
+    uint16_t* out = reinterpret_cast<uint16_t*>(dst);
+    for (; x < width; x++) {
+      out[x] = halfs[src[x]];
+    }
+    break;
+  }
+  case Image::OUTPUT_RGBA8: {
+#if LEAP_CPP_SSE2
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+    for (; x + 16 <= width; x += 16) {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+      const __m128i rg[2] = { _mm_unpacklo_epi8(v, v), _mm_unpackhi_epi8(v, v) };
+      const __m128i ba[2] = { _mm_unpacklo_epi8(v, alpha), _mm_unpackhi_epi8(v, alpha) };
+      for (int h = 0; h < 2; h++) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4*x + 32*h), _mm_unpacklo_epi16(rg[h], ba[h]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4*x + 32*h + 16), _mm_unpackhi_epi16(rg[h], ba[h]));
+      }
+    }
+#endif
+    for (; x < width; x++) {
+      dst[4*x] = dst[4*x + 1] = dst[4*x + 2] = src[x];
+      dst[4*x + 3] = 0xff;
+    }
+    break;
+  }
+  }
+}
+
+}
+
+size_t ImageImplementation::convertedSize(Image::OutputFormat format, int downscale) const {
+  if (!isValid() || bytesPerPixel() != 1 || (downscale != 1 && downscale != 2 && downscale != 4)) {
+    return 0;
+  }
+  return static_cast<size_t>(width()/downscale)*static_cast<size_t>(height()/downscale)*outputPixelSize(format);
+}
+
+size_t ImageImplementation::convert(void* buffer, size_t bufferSize, Image::OutputFormat format, int downscale,
+                                    float gain, float offset) const {
+  return pack(*this, *this, false, buffer, bufferSize, format, downscale, gain, offset);
+}
+
+size_t ImageImplementation::packStereo(const ImageImplementation& left, const ImageImplementation& right, void* buffer,
+                                       size_t bufferSize, Image::OutputFormat format, int downscale, float gain, float offset) {
+  return pack(left, right, true, buffer, bufferSize, format, downscale, gain, offset);
+}
+
+// Writes left and right at the same row stride; without stereo, only left is converted, which is
+// how convert() is implemented
+size_t ImageImplementation::pack(const ImageImplementation& left, const ImageImplementation& right, bool stereo, void* buffer,
+                                 size_t bufferSize, Image::OutputFormat format, int downscale, float gain, float offset) {
+  const size_t size = left.convertedSize(format, downscale);
+  if (size == 0 || !buffer || (stereo && (right.convertedSize(format, downscale) != size || right.width() != left.width()))) {
+    return 0;
+  }
+  const size_t total = stereo ? 2*size : size;
+  if (bufferSize < total) {
+    return 0;
+  }
+
+  const int width = left.width();
+  const int outWidth = width/downscale;
+  const int outHeight = left.height()/downscale;
+  const size_t rowSize = static_cast<size_t>(outWidth)*outputPixelSize(format);
+  const size_t stride = stereo ? 2*rowSize : rowSize;
+  uint16_t halfs[256];
+  if (format == Image::OUTPUT_FLOAT16) {
+    for (int i = 0; i < 256; i++) {
+      halfs[i] = floatToHalf(i*gain + offset);
+    }
+  }
+  std::vector<uint16_t> sums(downscale > 1 ? width : 0);
+  std::vector<uint8_t> downscaled(downscale > 1 ? outWidth : 0);
+  uint8_t* out = static_cast<uint8_t*>(buffer);
+  for (int side = 0; side < (stereo ? 2 : 1); side++) {
+    const uint8_t* data = (side == 0 ? left : right).data();
+    for (int y = 0; y < outHeight; y++) {
+      const uint8_t* row = data + static_cast<size_t>(y)*downscale*width;
+      if (downscale > 1) {
+        downscaleRows(row, width, downscale, sums.data(), downscaled.data());
+        row = downscaled.data();
+      }
+      convertRow(row, outWidth, format, gain, offset, halfs, out + side*rowSize + y*stride);
+    }
+  }
+  return total;
+}
+
+// ImageBufferPool
+
+std::shared_ptr<uint8_t> ImageBufferPool::acquire(size_t size) {
+  std::unique_ptr<uint8_t[]> buffer;
+  {
+    std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+    auto found = m_free.find(size);
+    if (found != m_free.end() && !found->second.empty()) {
+      buffer = std::move(found->second.back());
+      found->second.pop_back();
+    }
+  }
+  if (!buffer) {
+    buffer.reset(new uint8_t[size]);
+  }
+  const std::weak_ptr<ImageBufferPool> weakPool = shared_from_this();
+  return std::shared_ptr<uint8_t>(buffer.release(), [weakPool, size](uint8_t* released) {
+    const auto pool = weakPool.lock();
+    if (pool) {
+      pool->release(released, size);
+    } else {
+      delete[] released;
+    }
+  });
+}
+
+size_t ImageBufferPool::freeCount(size_t size) {
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  auto found = m_free.find(size);
+  return found != m_free.end() ? found->second.size() : 0;
+}
+
+void ImageBufferPool::release(uint8_t* buffer, size_t size) {
+  std::unique_ptr<uint8_t[]> owned(buffer);
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  auto& buffers = m_free[size];
+  if (buffers.size() < MAX_FREE_BUFFERS) {
+    buffers.push_back(std::move(owned));
+  }
+}
+
+// Image pyramid and integral image
+
+namespace {
+
+std::shared_ptr<uint8_t> acquireBuffer(const std::shared_ptr<ImageBufferPool>& pool, size_t size) {
+  if (pool) {
+    return pool->acquire(size);
+  }
+  return std::shared_ptr<uint8_t>(new uint8_t[size], std::default_delete<uint8_t[]>());
+}
+
+// Blurs with the 5-tap binomial filter [1 4 6 4 1]/16 in both directions, clamping at the
+// borders, and keeps every other pixel of every other row
+void pyramidDown(const uint8_t* src, int width, int height, uint8_t* dst, int outWidth, int outHeight,
+                 std::vector<uint16_t>& column) {
+  column.resize(width);
+  for (int y = 0; y < outHeight; y++) {
+    const uint8_t* rows[5];
+    for (int i = 0; i < 5; i++) {
+      rows[i] = src + std::min(std::max(2*y + i - 2, 0), height - 1)*width;
+    }
+    int x = 0;
+#if LEAP_CPP_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16) {
+      __m128i lo[5], hi[5];
+      for (int i = 0; i < 5; i++) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[i] + x));
+        lo[i] = _mm_unpacklo_epi8(v, zero);
+        hi[i] = _mm_unpackhi_epi8(v, zero);
+      }
+      // r0 + r4 + 4*(r1 + r3) + 6*r2, with 6*r2 = 4*r2 + 2*r2
+      const __m128i sumLo = _mm_add_epi16(_mm_add_epi16(lo[0], lo[4]),
+                                          _mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(_mm_add_epi16(lo[1], lo[3]), lo[2]), 2), _mm_slli_epi16(lo[2], 1)));
+      const __m128i sumHi = _mm_add_epi16(_mm_add_epi16(hi[0], hi[4]),
+                                          _mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(_mm_add_epi16(hi[1], hi[3]), hi[2]), 2), _mm_slli_epi16(hi[2], 1)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&column[x]), sumLo);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&column[x + 8]), sumHi);
+    }
+#endif
+    for (; x < width; x++) {
+      column[x] = static_cast<uint16_t>(rows[0][x] + rows[4][x] + 4*(rows[1][x] + rows[3][x]) + 6*rows[2][x]);
+    }
+    uint8_t* out = dst + y*outWidth;
+    for (int ox = 0; ox < outWidth; ox++) {
+      const int c = 2*ox;
+      const uint32_t sum = column[std::max(c - 2, 0)] + column[std::min(c + 2, width - 1)] +
+                           4u*(column[std::max(c - 1, 0)] + column[std::min(c + 1, width - 1)]) + 6u*column[c];
+      out[ox] = static_cast<uint8_t>((sum + 128) >> 8);
+    }
+  }
+}
+
+}
+
+const ImageImplementation::Pyramid& ImageImplementation::pyramid() const {
+  std::lock_guard<decltype(m_derivedMutex)> lk(m_derivedMutex);
+  if (m_pyramid) {
+    return *m_pyramid;
+  }
+  auto pyramid = std::make_shared<Pyramid>();
+  if (isValid() && bytesPerPixel() == 1 && width() > 0 && height() > 0) {
+    pyramid->count = 1;
+    pyramid->width[0] = width();
+    pyramid->height[0] = height();
+    pyramid->levels[0] = data();
+    size_t size = 0;
+    while (pyramid->count < Pyramid::MAX_LEVELS &&
+           pyramid->width[pyramid->count - 1]/2 >= Pyramid::MIN_SIZE && pyramid->height[pyramid->count - 1]/2 >= Pyramid::MIN_SIZE) {
+      pyramid->width[pyramid->count] = pyramid->width[pyramid->count - 1]/2;
+      pyramid->height[pyramid->count] = pyramid->height[pyramid->count - 1]/2;
+      size += static_cast<size_t>(pyramid->width[pyramid->count])*pyramid->height[pyramid->count];
+      pyramid->count++;
+    }
+    if (size > 0) {
+      pyramid->buffer = acquireBuffer(m_bufferPool, size);
+      uint8_t* level = pyramid->buffer.get();
+      std::vector<uint16_t> column;
+      for (int i = 1; i < pyramid->count; i++) {
+        pyramidDown(pyramid->levels[i - 1], pyramid->width[i - 1], pyramid->height[i - 1],
+                    level, pyramid->width[i], pyramid->height[i], column);
+        pyramid->levels[i] = level;
+        level += static_cast<size_t>(pyramid->width[i])*pyramid->height[i];
+      }
+    }
+  }
+  m_pyramid = pyramid;
+  return *m_pyramid;
+}
+
+const uint32_t* ImageImplementation::integralImage() const {
+  std::lock_guard<decltype(m_derivedMutex)> lk(m_derivedMutex);
+  if (!m_integral && isValid() && bytesPerPixel() == 1) {
+    const int w = width(), h = height();
+    const size_t stride = static_cast<size_t>(w) + 1;
+    m_integral = acquireBuffer(m_bufferPool, stride*(h + 1)*sizeof(uint32_t));
+    uint32_t* table = reinterpret_cast<uint32_t*>(m_integral.get());
+    std::fill(table, table + stride, 0u);
+    const uint8_t* pixels = data();
+    for (int y = 0; y < h; y++) {
+      const uint32_t* above = table + y*stride;
+      uint32_t* row = table + (y + 1)*stride;
+      uint32_t sum = 0;
+      row[0] = 0;
+      for (int x = 0; x < w; x++) {
+        sum += pixels[y*w + x];
+        row[x + 1] = above[x + 1] + sum;
+      }
+    }
+  }
+  return reinterpret_cast<const uint32_t*>(m_integral.get());
+}
+
+int64_t ImageImplementation::retainedBytes() const {
+  int64_t bytes = sizeof(ImageImplementation) + static_cast<int64_t>(width())*height()*bytesPerPixel();
+  std::lock_guard<decltype(m_derivedMutex)> lk(m_derivedMutex);
+  if (m_pyramid) {
+    for (int i = 1; i < m_pyramid->count; i++) {
+      bytes += static_cast<int64_t>(m_pyramid->width[i])*m_pyramid->height[i];
+    }
+  }
+  if (m_integral) {
+    bytes += (static_cast<int64_t>(width()) + 1)*(height() + 1)*sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+uint32_t ImageImplementation::integralSum(int x, int y, int width, int height) const {
+  const uint32_t* table = integralImage();
+  if (!table) {
+    return 0;
+  }
+  const int w = this->width(), h = this->height();
+  const size_t stride = static_cast<size_t>(w) + 1;
+  const int x0 = std::min(std::max(x, 0), w), x1 = std::min(std::max(x + width, x0), w);
+  const int y0 = std::min(std::max(y, 0), h), y1 = std::min(std::max(y + height, y0), h);
+  // Unsigned wrap-around cancels out
+  return table[y1*stride + x1] - table[y0*stride + x1] - table[y1*stride + x0] + table[y0*stride + x0];
+}
+
+// Calibration hash and undistortion maps
+
+uint64_t ImageImplementation::calibrationHash() const {
+  if (!isValid() || !m_image_event.image[m_imageId].distortion_matrix) {
+    return 0;
+  }
+  std::lock_guard<decltype(m_derivedMutex)> lk(m_derivedMutex);
+  if (!m_calibrationHash) {
+    // FNV-1a over the distortion map and the ray factors, 64 bits at a time
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&hash](uint64_t word) { hash = (hash ^ word)*1099511628211ull; };
+    const float* grid = distortion();
+    const size_t gridSize = static_cast<size_t>(distortionWidth())*distortionHeight();
+    for (size_t i = 0; i + 2 <= gridSize; i += 2) {
+      uint64_t word;
+      std::memcpy(&word, grid + i, sizeof(word));
+      mix(word);
+    }
+    const float factors[4] = {rayOffsetX(), rayOffsetY(), rayScaleX(), rayScaleY()};
+    for (size_t i = 0; i < 4; i += 2) {
+      uint64_t word;
+      std::memcpy(&word, factors + i, sizeof(word));
+      mix(word);
+    }
+    m_calibrationHash = hash ? hash : 1;
+  }
+  return m_calibrationHash;
+}
+
+const float* ImageImplementation::undistortionMap(int width, int height, float maxSlope) const {
+  if (!isValid() || width <= 0 || height <= 0 || !(maxSlope > 0.0f) || !m_image_event.image[m_imageId].distortion_matrix) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<decltype(m_derivedMutex)> lk(m_derivedMutex);
+    for (const UndistortionMap& held : m_undistortionMaps) {
+      if (held.width == width && held.height == height && held.maxSlope == maxSlope) {
+        return held.map->data();
+      }
+    }
+  }
+  DistortionMapCache::Map map;
+  if (m_distortionCache) {
+    const auto controllerImpl = m_weakControllerImpl.lock();
+    map = m_distortionCache->acquire(*this, controllerImpl ? controllerImpl->imageDeviceSerial() : std::string(),
+                                     width, height, maxSlope);
+  } else {
+    map = std::make_shared<const std::vector<float>>(DistortionMapCache::build(*this, width, height, maxSlope));
+  }
+  std::lock_guard<decltype(m_derivedMutex)> lk(m_derivedMutex);
+  m_undistortionMaps.push_back({width, height, maxSlope, map});
+  return map->data();
+}
+
+// DistortionMapCache
+
+namespace {
+
+const char UNDISTORTION_MAGIC[4] = {'L', 'U', 'N', 'D'};
+const uint32_t UNDISTORTION_VERSION = 1;
+
+} // namespace
+
+DistortionMapCache::Map DistortionMapCache::acquire(const ImageImplementation& image, const std::string& serial,
+                                                    int width, int height, float maxSlope) {
+  const Key key = {image.calibrationHash(), image.width(), image.height(), width, height, maxSlope};
+  // Held while building, so that each map is built once even when requested from several threads
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto it = m_maps.begin(); it != m_maps.end(); ++it) {
+    if (it->first == key) {
+      const Map map = it->second;
+      m_maps.erase(it);
+      m_maps.emplace_front(key, map);
+      return map;
+    }
+  }
+
+  const std::string file = m_directory.empty() || serial.empty() ? std::string() : path(serial, image.id(), key);
+  Map map = file.empty() ? Map() : load(file, key);
+  if (!map) {
+    const auto built = std::make_shared<const std::vector<float>>(build(image, width, height, maxSlope));
+    m_buildCount++;
+    if (!file.empty()) {
+      save(file, key, *built);
+    }
+    map = built;
+  }
+  m_maps.emplace_front(key, map);
+  if (m_maps.size() > MAX_MAPS) {
+    m_maps.pop_back();
+  }
+  return map;
+}
+
+std::vector<float> DistortionMapCache::build(const ImageImplementation& image, int width, int height, float maxSlope) {
+  std::vector<float> map(2*static_cast<size_t>(width)*height, -1.0f);
+  const float* grid = image.distortion();
+  const int sourceWidth = image.width();
+  const int sourceHeight = image.height();
+  float* position = map.data();
+  for (int v = 0; v < height; v++) {
+    const float slopeY = ((v + 0.5f)*2.0f/height - 1.0f)*maxSlope;
+    for (int u = 0; u < width; u++, position += 2) {
+      const float slopeX = ((u + 0.5f)*2.0f/width - 1.0f)*maxSlope;
+      float normalized[2];
+      if (distortedPosition(grid, image.rayScaleX(), image.rayOffsetX(), image.rayScaleY(), image.rayOffsetY(), slopeX, slopeY,
+                            normalized)) {
+        // Pixel centers are at half-integer normalized positions
+        position[0] = normalized[0]*sourceWidth - 0.5f;
+        position[1] = normalized[1]*sourceHeight - 0.5f;
+      }
+    }
+  }
+  return map;
+}
+
+std::string DistortionMapCache::path(const std::string& serial, int camera, const Key& key) const {
+  std::ostringstream oss;
+  oss << m_directory << '/';
+  for (const char c : serial) {
+    if (!c) {
+      break;
+    }
+    const bool safe = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+    oss << (safe ? c : '_');
+  }
+  oss << '-' << camera << '-' << key.width << 'x' << key.height << '-' << std::lround(key.maxSlope*1000.0f) << ".undistortion";
+  return oss.str();
+}
+
+DistortionMapCache::Map DistortionMapCache::load(const std::string& path, const Key& key) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[sizeof(UNDISTORTION_MAGIC)];
+  uint32_t version = 0;
+  uint64_t calibration = 0;
+  int32_t sizes[4];
+  float maxSlope = 0.0f;
+  if (!file.read(magic, sizeof(magic)) || !file.read(reinterpret_cast<char*>(&version), sizeof(version)) ||
+      !file.read(reinterpret_cast<char*>(&calibration), sizeof(calibration)) ||
+      !file.read(reinterpret_cast<char*>(sizes), sizeof(sizes)) ||
+      !file.read(reinterpret_cast<char*>(&maxSlope), sizeof(maxSlope)) ||
+      !std::equal(magic, magic + sizeof(magic), UNDISTORTION_MAGIC) || version != UNDISTORTION_VERSION) {
+    return Map();
+  }
+  // A file of another calibration is left to be overwritten
+  const Key stored = {calibration, sizes[0], sizes[1], sizes[2], sizes[3], maxSlope};
+  if (!(stored == key)) {
+    return Map();
+  }
+  auto map = std::make_shared<std::vector<float>>(2*static_cast<size_t>(key.width)*key.height);
+  if (!file.read(reinterpret_cast<char*>(map->data()), map->size()*sizeof(float)) ||
+      file.peek() != std::ifstream::traits_type::eof()) {
+    return Map();
+  }
+  return map;
+}
+
+void DistortionMapCache::save(const std::string& path, const Key& key, const std::vector<float>& map) {
+  // Written under another name and renamed, so that no process ever reads a partial file
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return;
+    }
+    const int32_t sizes[4] = {key.sourceWidth, key.sourceHeight, key.width, key.height};
+    file.write(UNDISTORTION_MAGIC, sizeof(UNDISTORTION_MAGIC));
+    file.write(reinterpret_cast<const char*>(&UNDISTORTION_VERSION), sizeof(UNDISTORTION_VERSION));
+    file.write(reinterpret_cast<const char*>(&key.calibration), sizeof(key.calibration));
+    file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    file.write(reinterpret_cast<const char*>(&key.maxSlope), sizeof(key.maxSlope));
+    file.write(reinterpret_cast<const char*>(map.data()), map.size()*sizeof(float));
+    if (!file.flush()) {
+      file.close();
+      std::remove(temporary.c_str());
+      return;
+    }
+  }
+  std::remove(path.c_str());
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+  }
+}
+
+// DerivedHandData
+
+void DerivedHandData::compute(const LEAP_HAND* hands, size_t count, DerivedHandData* derived) {
+  for (size_t i = 0; i < count; i++) {
+    const LEAP_HAND& hand = hands[i];
+    DerivedHandData& out = derived[i];
+    const bool isLeftHand = hand.type == eLeapHandType_Left;
+
+    out.direction = palmDirectionOf(hand);
+    out.basis = palmBasisOf(hand);
+    out.armDirection = directionOf(hand.arm);
+    out.armBasis = basisOf(hand.arm, isLeftHand);
+    for (int b = 0; b < NUM_BONES; b++) {
+      const LEAP_BONE& bone = hand.digits[b/4].bones[b%4];
+      out.boneDirection[b] = directionOf(bone);
+      out.boneLength[b] = lengthOf(bone);
+      out.boneBasis[b] = basisOf(bone, isLeftHand);
+    }
+  }
+}
+
+// JointKinematicsState
+
+void JointKinematicsState::update(const LEAP_HAND& hand, int64_t timestamp, float velocityTimeConstant, float accelerationTimeConstant) {
+  Vector current[HandJoints::NUM_JOINTS];
+  HandJoints::positions(hand, current);
+
+  const float dt = static_cast<float>(static_cast<double>(timestamp - this->timestamp)*1e-6);
+  if (samples == 0 || dt <= 0.0f) {
+    // First sighting (or a repeated timestamp): there is nothing to difference against yet
+    if (samples == 0) {
+      estimate = JointKinematics();
+    }
+    std::copy(current, current + HandJoints::NUM_JOINTS, position);
+    this->timestamp = timestamp;
+    samples = std::max(samples, 1);
+    return;
+  }
+
+  // Exponential smoothing factors for this frame interval; the first estimate is taken as is
+  const float invDt = 1.0f/dt;
+  const float alphaV = (velocityTimeConstant > 0.0f && samples > 1) ? 1.0f - std::exp(-dt/velocityTimeConstant) : 1.0f;
+  const float alphaA = (accelerationTimeConstant > 0.0f && samples > 2) ? 1.0f - std::exp(-dt/accelerationTimeConstant) : 1.0f;
+  for (int j = 0; j < HandJoints::NUM_JOINTS; j++) {
+    const Vector velocity = (current[j] - position[j])*invDt;
+    const Vector previousVelocity = estimate.velocity[j];
+    estimate.velocity[j] = previousVelocity + (velocity - previousVelocity)*alphaV;
+    if (samples > 1) {
+      const Vector acceleration = (estimate.velocity[j] - previousVelocity)*invDt;
+      estimate.acceleration[j] += (acceleration - estimate.acceleration[j])*alphaA;
+    }
+    position[j] = current[j];
+  }
+  this->timestamp = timestamp;
+  samples++;
+}
+
+// JointSmoothingState
+
+void JointSmoothingState::update(const LEAP_HAND& hand, int64_t timestamp, const SmoothingParameters& params, SmoothedJoints& smoothed) {
+  Vector joints[HandJoints::NUM_JOINTS];
+  HandJoints::positions(hand, joints);
+  float measured[NUM_LANES] = {};
+  for (int j = 0; j < HandJoints::NUM_JOINTS; j++) {
+    measured[j*3 + 0] = joints[j].x;
+    measured[j*3 + 1] = joints[j].y;
+    measured[j*3 + 2] = joints[j].z;
+  }
+
+  const float dt = static_cast<float>(static_cast<double>(timestamp - this->timestamp)*1e-6);
+  if (samples == 0 || filter != params.filter || dt <= 0.0f) {
+    if (samples == 0 || filter != params.filter) {
+      // (Re)start the filter at the measurement
+      std::copy(measured, measured + NUM_LANES, value);
+      std::fill(derivative, derivative + NUM_LANES, 0.0f);
+      const float r = params.measurementNoise*params.measurementNoise;
+      covariance[0] = r;
+      covariance[1] = 0.0f;
+      covariance[2] = 1e8f;
+      filter = params.filter;
+      samples = 0;
+    }
+    this->timestamp = timestamp;
+    samples++;
+    std::copy(joints, joints + HandJoints::NUM_JOINTS, smoothed.position);
+    return;
+  }
+
+  int i = 0;
+  if (filter == Controller::SMOOTHING_ONE_EURO) {
+    // alpha(cutoff) = r/(r + 1) with r = 2*pi*cutoff*dt
+    const float twoPiDt = 2.0f*PI*dt;
+    const float rateD = twoPiDt*params.derivativeCutoff;
+    const float alphaD = rateD/(rateD + 1.0f);
+    const float invDt = 1.0f/dt;
+#if LEAP_CPP_SSE2
+    const __m128 vInvDt = _mm_set1_ps(invDt);
+    const __m128 vAlphaD = _mm_set1_ps(alphaD);
+    const __m128 vMinCutoff = _mm_set1_ps(params.minCutoff);
+    const __m128 vBeta = _mm_set1_ps(params.beta);
+    const __m128 vTwoPiDt = _mm_set1_ps(twoPiDt);
+    const __m128 vOne = _mm_set1_ps(1.0f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= NUM_LANES; i += 4) {
+      const __m128 x = _mm_loadu_ps(measured + i);
+      __m128 xHat = _mm_loadu_ps(value + i);
+      __m128 dxHat = _mm_loadu_ps(derivative + i);
+      const __m128 dx = _mm_mul_ps(_mm_sub_ps(x, xHat), vInvDt);
+      dxHat = _mm_add_ps(dxHat, _mm_mul_ps(vAlphaD, _mm_sub_ps(dx, dxHat)));
+      const __m128 cutoff = _mm_add_ps(vMinCutoff, _mm_mul_ps(vBeta, _mm_and_ps(dxHat, absMask)));
+      const __m128 rate = _mm_mul_ps(vTwoPiDt, cutoff);
+      const __m128 alpha = _mm_div_ps(rate, _mm_add_ps(rate, vOne));
+      xHat = _mm_add_ps(xHat, _mm_mul_ps(alpha, _mm_sub_ps(x, xHat)));
+      _mm_storeu_ps(value + i, xHat);
+      _mm_storeu_ps(derivative + i, dxHat);
+    }
+#endif
+    for (; i < NUM_LANES; i++) {
+      const float dx = (measured[i] - value[i])*invDt;
+      derivative[i] += alphaD*(dx - derivative[i]);
+      const float rate = twoPiDt*(params.minCutoff + params.beta*std::fabs(derivative[i]));
+      value[i] += rate/(rate + 1.0f)*(measured[i] - value[i]);
+    }
+  } else if (filter == Controller::SMOOTHING_KALMAN) {
+    // Constant-velocity model driven by white acceleration noise. The covariance only depends
+    // on dt and the noise parameters, never on the measurements, so every lane shares one
+    // covariance and one pair of gains and only the state update runs per lane.
+    const float q = params.accelerationNoise*params.accelerationNoise;
+    const float r = params.measurementNoise*params.measurementNoise;
+    const float dt2 = dt*dt;
+    const float p00 = covariance[0] + 2.0f*dt*covariance[1] + dt2*covariance[2] + 0.25f*q*dt2*dt2;
+    const float p01 = covariance[1] + dt*covariance[2] + 0.5f*q*dt2*dt;
+    const float p11 = covariance[2] + q*dt2;
+    const float k0 = p00/(p00 + r);
+    const float k1 = p01/(p00 + r);
+    covariance[0] = (1.0f - k0)*p00;
+    covariance[1] = (1.0f - k0)*p01;
+    covariance[2] = p11 - k1*p01;
+#if LEAP_CPP_SSE2
+    const __m128 vDt = _mm_set1_ps(dt);
+    const __m128 vK0 = _mm_set1_ps(k0);
+    const __m128 vK1 = _mm_set1_ps(k1);
+    for (; i + 4 <= NUM_LANES; i += 4) {
+      const __m128 velocity = _mm_loadu_ps(derivative + i);
+      const __m128 predicted = _mm_add_ps(_mm_loadu_ps(value + i), _mm_mul_ps(velocity, vDt));
+      const __m128 residual = _mm_sub_ps(_mm_loadu_ps(measured + i), predicted);
+      _mm_storeu_ps(value + i, _mm_add_ps(predicted, _mm_mul_ps(vK0, residual)));
+      _mm_storeu_ps(derivative + i, _mm_add_ps(velocity, _mm_mul_ps(vK1, residual)));
+    }
+#endif
+    for (; i < NUM_LANES; i++) {
+      const float predicted = value[i] + derivative[i]*dt;
+      const float residual = measured[i] - predicted;
+      value[i] = predicted + k0*residual;
+      derivative[i] += k1*residual;
+    }
+  } else {
+    std::copy(measured, measured + NUM_LANES, value);
+  }
+  this->timestamp = timestamp;
+  samples++;
+
+  for (int j = 0; j < HandJoints::NUM_JOINTS; j++) {
+    smoothed.position[j] = Vector(value[j*3 + 0], value[j*3 + 1], value[j*3 + 2]);
+  }
+}
+
+// MotionAccumulator
+
+namespace {
+
+// Finds the eigenvector of the largest eigenvalue of a symmetric 4x4 matrix by cyclic Jacobi
+// rotations. Returns the eigenvalue; m is destroyed.
+double largestEigenvector(double m[4][4], double vector[4]) {
+  double v[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+  for (int sweep = 0; sweep < 16; sweep++) {
+    double offDiagonal = 0;
+    for (int p = 0; p < 3; p++) {
+      for (int q = p + 1; q < 4; q++) {
+        offDiagonal += m[p][q]*m[p][q];
+      }
+    }
+    if (offDiagonal < 1e-18*(m[0][0]*m[0][0] + m[1][1]*m[1][1] + m[2][2]*m[2][2] + m[3][3]*m[3][3]) + 1e-300) {
+      break;
+    }
+    for (int p = 0; p < 3; p++) {
+      for (int q = p + 1; q < 4; q++) {
+        if (m[p][q] == 0) {
+          continue;
+        }
+        const double theta = (m[q][q] - m[p][p])/(2*m[p][q]);
+        const double t = (theta >= 0 ? 1.0 : -1.0)/(std::abs(theta) + std::sqrt(theta*theta + 1));
+        const double c = 1/std::sqrt(t*t + 1);
+        const double s = t*c;
+        for (int k = 0; k < 4; k++) {
+          const double mkp = m[k][p], mkq = m[k][q];
+          m[k][p] = c*mkp - s*mkq;
+          m[k][q] = s*mkp + c*mkq;
+        }
+        for (int k = 0; k < 4; k++) {
+          const double mpk = m[p][k], mqk = m[q][k];
+          m[p][k] = c*mpk - s*mqk;
+          m[q][k] = s*mpk + c*mqk;
+        }
+        for (int k = 0; k < 4; k++) {
+          const double vkp = v[k][p], vkq = v[k][q];
+          v[k][p] = c*vkp - s*vkq;
+          v[k][q] = s*vkp + c*vkq;
+        }
+      }
+    }
+  }
+  int best = 0;
+  for (int i = 1; i < 4; i++) {
+    if (m[i][i] > m[best][best]) {
+      best = i;
+    }
+  }
+  for (int k = 0; k < 4; k++) {
+    vector[k] = v[k][best];
+  }
+  return m[best][best];
+}
+
+}
+
+void MotionAccumulator::add(const Vector& from, const Vector& to) {
+  const double p[3] = {from.x, from.y, from.z};
+  const double q[3] = {to.x, to.y, to.z};
+  for (int a = 0; a < 3; a++) {
+    m_sumFrom[a] += p[a];
+    m_sumTo[a] += q[a];
+    for (int b = 0; b < 3; b++) {
+      m_cross[a][b] += p[a]*q[b];
+    }
+  }
+  m_normFrom += p[0]*p[0] + p[1]*p[1] + p[2]*p[2];
+  m_normTo += q[0]*q[0] + q[1]*q[1] + q[2]*q[2];
+  m_count++;
+}
+
+void MotionAccumulator::addHand(const LEAP_HAND& from, const LEAP_HAND& to) {
+  Vector p[HandJoints::NUM_JOINTS], q[HandJoints::NUM_JOINTS];
+  HandJoints::positions(from, p);
+  HandJoints::positions(to, q);
+  for (int j = 0; j < HandJoints::NUM_JOINTS; j++) {
+    add(p[j], q[j]);
+  }
+}
+
+RigidMotion MotionAccumulator::solve() const {
+  RigidMotion motion;
+  if (m_count < 3) {
+    return motion;
+  }
+
+  // Centered sums: S = sum(p' q'^T), with p' and q' relative to the centroids
+  const double n = m_count;
+  const double cp[3] = {m_sumFrom[0]/n, m_sumFrom[1]/n, m_sumFrom[2]/n};
+  const double cq[3] = {m_sumTo[0]/n, m_sumTo[1]/n, m_sumTo[2]/n};
+  double S[3][3];
+  for (int a = 0; a < 3; a++) {
+    for (int b = 0; b < 3; b++) {
+      S[a][b] = m_cross[a][b] - n*cp[a]*cq[b];
+    }
+  }
+  const double normFrom = m_normFrom - n*(cp[0]*cp[0] + cp[1]*cp[1] + cp[2]*cp[2]);
+  const double normTo = m_normTo - n*(cq[0]*cq[0] + cq[1]*cq[1] + cq[2]*cq[2]);
+  if (!(normFrom > 1e-6*n) || !(normTo > 1e-6*n)) {
+    return motion;
+  }
+
+  double N[4][4] = {
+    {S[0][0] + S[1][1] + S[2][2], S[1][2] - S[2][1], S[2][0] - S[0][2], S[0][1] - S[1][0]},
+    {S[1][2] - S[2][1], S[0][0] - S[1][1] - S[2][2], S[0][1] + S[1][0], S[2][0] + S[0][2]},
+    {S[2][0] - S[0][2], S[0][1] + S[1][0], -S[0][0] + S[1][1] - S[2][2], S[1][2] + S[2][1]},
+    {S[0][1] - S[1][0], S[2][0] + S[0][2], S[1][2] + S[2][1], -S[0][0] - S[1][1] + S[2][2]}
+  };
+  double quaternion[4]; // w, x, y, z
+  const double lambda = largestEigenvector(N, quaternion);
+
+  motion.rotation = Matrix(static_cast<float>(quaternion[1]), static_cast<float>(quaternion[2]),
+                           static_cast<float>(quaternion[3]), static_cast<float>(quaternion[0]));
+  const double scale = std::sqrt(normTo/normFrom);
+  const Vector rotatedCentroid = motion.rotation.transformDirection(Vector(static_cast<float>(cp[0]), static_cast<float>(cp[1]), static_cast<float>(cp[2])));
+  motion.translation = Vector(static_cast<float>(cq[0]), static_cast<float>(cq[1]), static_cast<float>(cq[2])) - rotatedCentroid*static_cast<float>(scale);
+  motion.scale = static_cast<float>(scale);
+  // sum |s R p' - q'|^2 = s^2 |p'|^2 + |q'|^2 - 2 s lambda, as lambda = sum q'.(R p')
+  motion.rmsError = static_cast<float>(std::sqrt(std::max(0.0, (2*normTo - 2*scale*lambda)/n)));
+  motion.valid = true;
+  return motion;
+}
+
+// FrameImplementation
+
+namespace {
+
+// How far past the most recent frame predictFrame() will extrapolate
+const int64_t MAX_PREDICTION_TIME = 100000; // us
+
+LEAP_QUATERNION multiply(const LEAP_QUATERNION& a, const LEAP_QUATERNION& b) {
+  LEAP_QUATERNION q;
+  q.w = a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z;
+  q.x = a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y;
+  q.y = a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x;
+  q.z = a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w;
+  return q;
+}
+
+LEAP_QUATERNION conjugate(const LEAP_QUATERNION& q) {
+  LEAP_QUATERNION c;
+  c.x = -q.x; c.y = -q.y; c.z = -q.z; c.w = q.w;
+  return c;
+}
+
+LEAP_VECTOR rotate(const LEAP_QUATERNION& q, const LEAP_VECTOR& v) {
+  LEAP_QUATERNION p;
+  p.x = v.x; p.y = v.y; p.z = v.z; p.w = 0.0f;
+  const LEAP_QUATERNION r = multiply(multiply(q, p), conjugate(q));
+  LEAP_VECTOR out;
+  out.x = r.x; out.y = r.y; out.z = r.z;
+  return out;
+}
+
+// The rotation that takes q0 to q1, scaled by s (in axis-angle space). Identity if there is none.
+LEAP_QUATERNION scaledDelta(const LEAP_QUATERNION& q0, const LEAP_QUATERNION& q1, float s) {
+  LEAP_QUATERNION d = multiply(q1, conjugate(q0));
+  if (d.w < 0.0f) {
+    d.x = -d.x; d.y = -d.y; d.z = -d.z; d.w = -d.w;
+  }
+  const float sinHalf = std::sqrt(d.x*d.x + d.y*d.y + d.z*d.z);
+  LEAP_QUATERNION r;
+  if (sinHalf < 1e-6f) {
+    r.x = r.y = r.z = 0.0f; r.w = 1.0f;
+    return r;
+  }
+  const float halfAngle = std::atan2(sinHalf, d.w)*s;
+  const float scale = std::sin(halfAngle)/sinHalf;
+  r.x = d.x*scale; r.y = d.y*scale; r.z = d.z*scale; r.w = std::cos(halfAngle);
+  return r;
+}
+
+LEAP_QUATERNION extrapolate(const LEAP_QUATERNION& q0, const LEAP_QUATERNION& q1, float s) {
+  LEAP_QUATERNION q = multiply(scaledDelta(q0, q1, s), q1);
+  const float norm = std::sqrt(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+  if (norm > 0.0f) {
+    q.x /= norm; q.y /= norm; q.z /= norm; q.w /= norm;
+  }
+  return q;
+}
+
+LEAP_VECTOR extrapolate(const LEAP_VECTOR& p0, const LEAP_VECTOR& p1, float s) {
+  LEAP_VECTOR p;
+  p.x = p1.x + (p1.x - p0.x)*s;
+  p.y = p1.y + (p1.y - p0.y)*s;
+  p.z = p1.z + (p1.z - p0.z)*s;
+  return p;
+}
+
+void extrapolate(const LEAP_BONE& b0, LEAP_BONE& b1, float s) {
+  b1.prev_joint = extrapolate(b0.prev_joint, b1.prev_joint, s);
+  b1.next_joint = extrapolate(b0.next_joint, b1.next_joint, s);
+  b1.rotation = extrapolate(b0.rotation, b1.rotation, s);
+}
+
+void translate(LEAP_VECTOR& p, const LEAP_VECTOR& offset) {
+  p.x += offset.x; p.y += offset.y; p.z += offset.z;
+}
+
+// Constant linear and angular velocity over the interval between the two samples of the hand;
+// s is the prediction horizon in units of that interval
+void extrapolateHand(const LEAP_HAND& h0, LEAP_HAND& h1, float s) {
+  const LEAP_QUATERNION palmDelta = scaledDelta(h0.palm.orientation, h1.palm.orientation, s);
+  h1.palm.position = extrapolate(h0.palm.position, h1.palm.position, s);
+  h1.palm.stabilized_position = extrapolate(h0.palm.stabilized_position, h1.palm.stabilized_position, s);
+  h1.palm.orientation = extrapolate(h0.palm.orientation, h1.palm.orientation, s);
+  h1.palm.normal = rotate(palmDelta, h1.palm.normal);
+  h1.palm.direction = rotate(palmDelta, h1.palm.direction);
+  extrapolate(h0.arm, h1.arm, s);
+  for (int d = 0; d < 5; d++) {
+    for (int b = 0; b < 4; b++) {
+      extrapolate(h0.digits[d].bones[b], h1.digits[d].bones[b], s);
+    }
+  }
+}
+
+// Without a previous sample, the whole hand moves with the palm velocity reported by the service
+void translateHand(LEAP_HAND& hand, float dt) {
+  LEAP_VECTOR offset;
+  offset.x = hand.palm.velocity.x*dt;
+  offset.y = hand.palm.velocity.y*dt;
+  offset.z = hand.palm.velocity.z*dt;
+  translate(hand.palm.position, offset);
+  translate(hand.palm.stabilized_position, offset);
+  translate(hand.arm.prev_joint, offset);
+  translate(hand.arm.next_joint, offset);
+  for (int d = 0; d < 5; d++) {
+    for (int b = 0; b < 4; b++) {
+      translate(hand.digits[d].bones[b].prev_joint, offset);
+      translate(hand.digits[d].bones[b].next_joint, offset);
+    }
+  }
+}
+
+}
+
+std::shared_ptr<FrameImplementation> FrameImplementation::predict(const FrameImplementation* previous, int64_t targetTimestamp) const {
+  const auto predicted = std::make_shared<FrameImplementation>();
+  predictInto(previous, targetTimestamp, *predicted);
+  return predicted;
+}
+
+void FrameImplementation::predictInto(const FrameImplementation* previous, int64_t targetTimestamp, FrameImplementation& out) const {
+  const int64_t t1 = timestamp();
+  const int64_t t0 = previous ? previous->timestamp() : t1;
+  const int64_t target = std::min(std::max(targetTimestamp, std::min(t0, t1)), t1 + MAX_PREDICTION_TIME);
+
+  bool sameHands = out.m_raw_hands.size() == m_raw_hands.size();
+  for (size_t i = 0; sameHands && i < m_raw_hands.size(); i++) {
+    sameHands = out.m_raw_hands[i].id == m_raw_hands[i].id;
+  }
+  out.m_raw_hands.assign(m_raw_hands.begin(), m_raw_hands.end());
+  out.m_tracking_event = m_tracking_event;
+  out.m_tracking_event.info.timestamp = target;
+  out.m_tracking_event.pHands = !out.m_raw_hands.empty() ? &out.m_raw_hands[0] : nullptr;
+  out.m_name = m_name;
+  if (!sameHands) {
+    out.m_handIndices.clear();
+    for (size_t i = 0; i < out.m_raw_hands.size(); i++) {
+      out.m_handIndices.emplace(static_cast<int32_t>(out.m_raw_hands[i].id), i);
+    }
+  }
+  out.m_handBounds.clear();
+
+  // Nothing derived from the previous contents of out survives
+  out.m_hands.clear();
+  out.m_fingers.clear();
+  out.m_allHands = false;
+  out.m_derivedData.reset();
+  out.m_kinematics.reset();
+  out.m_smoothed.reset();
+  out.m_handTransitions.clear();
+  out.setImages(std::vector<std::shared_ptr<ImageImplementation>>());
+  out.clearMapPoints();
+
+  for (size_t i = 0; i < out.m_raw_hands.size(); i++) {
+    LEAP_HAND& hand = out.m_raw_hands[i];
+    const LEAP_HAND* h0 = (previous && t1 > t0) ? previous->rawHand(static_cast<int32_t>(hand.id)) : nullptr;
+    if (h0) {
+      extrapolateHand(*h0, hand, static_cast<float>(static_cast<double>(target - t1)/static_cast<double>(t1 - t0)));
+    } else {
+      translateHand(hand, static_cast<float>(static_cast<double>(target - t1)*1e-6));
+    }
+  }
+}
+
+namespace {
+
+// Writes the rows of an instance: the 3x4 transform [basis | center] followed by
+// (radius, length, part, hand index)
+void writeInstance(const Matrix& basis, const Vector& center, float radius, float length, int part, size_t handIndex,
+                   bool halfFloat, unsigned char* out) {
+  const float instance[16] = {
+    basis.xBasis.x, basis.yBasis.x, basis.zBasis.x, center.x,
+    basis.xBasis.y, basis.yBasis.y, basis.zBasis.y, center.y,
+    basis.xBasis.z, basis.yBasis.z, basis.zBasis.z, center.z,
+    radius, length, static_cast<float>(part), static_cast<float>(handIndex)
+  };
+  if (halfFloat) {
+    uint16_t encoded[16];
+    for (int i = 0; i < 16; i++) {
+      encoded[i] = floatToHalf(instance[i]);
+    }
+    std::memcpy(out, encoded, sizeof(encoded));
+  } else {
+    std::memcpy(out, instance, sizeof(instance));
+  }
+}
+
+}
+
+size_t FrameImplementation::writeBoneInstances(void* buffer, size_t bufferSize, int flags) const {
+  const bool halfFloat = (flags & Frame::BONE_INSTANCE_HALF_FLOAT) != 0;
+  const bool palmAndArm = (flags & Frame::BONE_INSTANCE_PALM_AND_ARM) != 0;
+  const size_t stride = boneInstanceStride(flags);
+  const size_t perHand = boneInstancesPerHand(flags);
+  const size_t hands = buffer ? std::min(m_raw_hands.size(), bufferSize/(stride*perHand)) : 0;
+
+  unsigned char* out = static_cast<unsigned char*>(buffer);
+  for (size_t h = 0; h < hands; h++) {
+    const LEAP_HAND& hand = m_raw_hands[h];
+    const bool isLeft = hand.type == eLeapHandType_Left;
+    const DerivedHandData* derived = m_derivedData ? &(*m_derivedData)[h] : nullptr;
+    for (int d = 0; d < 5; d++) {
+      for (int b = 0; b < 4; b++) {
+        const LEAP_BONE& bone = hand.digits[d].bones[b];
+        const int index = d*4 + b;
+        const Vector center = (Vector(bone.prev_joint.v) + Vector(bone.next_joint.v))*0.5f;
+        writeInstance(derived ? derived->boneBasis[index] : DerivedHandData::basisOf(bone, isLeft), center, bone.width*0.5f,
+                      derived ? derived->boneLength[index] : DerivedHandData::lengthOf(bone), index, h, halfFloat, out);
+        out += stride;
+      }
+    }
+    if (palmAndArm) {
+      // The palm is a capsule spanning the knuckles, a quarter of the palm width thick
+      writeInstance(derived ? derived->basis : DerivedHandData::palmBasisOf(hand), hand.palm.position.v, hand.palm.width*0.25f,
+                    hand.palm.width*0.5f, HandJoints::PALM, h, halfFloat, out);
+      out += stride;
+      const Vector armCenter = (Vector(hand.arm.prev_joint.v) + Vector(hand.arm.next_joint.v))*0.5f;
+      writeInstance(derived ? derived->armBasis : DerivedHandData::basisOf(hand.arm, isLeft), armCenter, hand.arm.width*0.5f,
+                    DerivedHandData::lengthOf(hand.arm), HandJoints::WRIST, h, halfFloat, out);
+      out += stride;
+    }
+  }
+  return hands*perHand;
+}
+
+bool FrameImplementation::cropImages(std::shared_ptr<ImageImplementation> (&images)[2]) {
+  {
+    std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
+    for (const auto& image : m_images) {
+      const int32_t camera = image->id();
+      if (image->type() == eLeapImageType_Default && (camera == 0 || camera == 1)) {
+        images[camera] = image;
+      }
+    }
+  }
+  return images[0] && images[1] && images[0]->bytesPerPixel() == 1 && images[1]->bytesPerPixel() == 1;
+}
+
+size_t FrameImplementation::handCropCount() {
+  std::shared_ptr<ImageImplementation> images[2];
+  return cropImages(images) ? 2*m_raw_hands.size() : 0;
+}
+
+namespace {
+
+// Resamples a square of an image, in image pixels, from the pyramid level closest to the output
+// resolution. Pixel k of pyramid level L is centered on pixel k*2^L of the image (see
+// pyramidDown()). Samples outside the image have a brightness of 0.
+void sampleCrop(const ImageImplementation& image, const HandCrop& crop, int cropSize, float gain, float offset, float* out) {
+  const ImageImplementation::Pyramid& pyramid = image.pyramid();
+  const float scale = crop.size/cropSize;
+  int level = 0;
+  while (level + 1 < pyramid.count && static_cast<float>(1 << (level + 1)) <= scale) {
+    level++;
+  }
+  const uint8_t* pixels = pyramid.levels[level];
+  const int width = pyramid.width[level], height = pyramid.height[level];
+  const float toLevel = 1.0f/(1 << level);
+  auto at = [pixels, width, height](int x, int y) -> float {
+    return x >= 0 && x < width && y >= 0 && y < height ? pixels[y*width + x] : 0.0f;
+  };
+  for (int j = 0; j < cropSize; j++) {
+    const float sy = (crop.y + (j + 0.5f)*scale - 0.5f)*toLevel;
+    const int y = static_cast<int>(std::floor(sy));
+    const float ty = sy - y;
+    for (int i = 0; i < cropSize; i++) {
+      const float sx = (crop.x + (i + 0.5f)*scale - 0.5f)*toLevel;
+      const int x = static_cast<int>(std::floor(sx));
+      const float tx = sx - x;
+      const float top = at(x, y)*(1.0f - tx) + at(x + 1, y)*tx;
+      const float bottom = at(x, y + 1)*(1.0f - tx) + at(x + 1, y + 1)*tx;
+      out[j*cropSize + i] = (top*(1.0f - ty) + bottom*ty)*gain + offset;
+    }
+  }
+}
+
+}
+
+size_t FrameImplementation::writeHandCrops(void* buffer, size_t bufferSize, int cropSize, HandCrop* crops, float baseline,
+                                           float padding, float gain, float offset) {
+  std::shared_ptr<ImageImplementation> images[2];
+  if (!cropImages(images) || cropSize <= 0 || !buffer) {
+    return 0;
+  }
+  const size_t cropFloats = static_cast<size_t>(cropSize)*cropSize;
+  const size_t hands = std::min(m_raw_hands.size(), bufferSize/(2*cropFloats*sizeof(float)));
+  float* out = static_cast<float*>(buffer);
+
+  // The palm, the wrist and the 25 finger joints of each hand
+  static const int NUM_CROP_JOINTS = 2 + 5 + 5*4;
+  for (size_t h = 0; h < hands; h++) {
+    const LEAP_HAND& hand = m_raw_hands[h];
+    const LEAP_VECTOR* joints[NUM_CROP_JOINTS];
+    int count = 0;
+    joints[count++] = &hand.palm.position;
+    joints[count++] = &hand.arm.next_joint;
+    for (int d = 0; d < 5; d++) {
+      joints[count++] = &hand.digits[d].bones[0].prev_joint;
+      for (int b = 0; b < 4; b++) {
+        joints[count++] = &hand.digits[d].bones[b].next_joint;
+      }
+    }
+
+    for (int camera = 0; camera < 2; camera++) {
+      const ImageImplementation& image = *images[camera];
+      const float* distortion = image.distortion();
+      // Ray slopes as seen from the camera, which sits half a baseline to the side
+      const float cameraOffset = 0.5f*baseline*(2*camera - 1);
+      float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+      for (int j = 0; j < count; j++) {
+        const LEAP_VECTOR& joint = *joints[j];
+        float normalized[2];
+        if (joint.y <= 0.0f ||
+            !distortedPosition(distortion, image.rayScaleX(), image.rayOffsetX(), image.rayScaleY(), image.rayOffsetY(),
+                               -(joint.x + cameraOffset)/joint.y, joint.z/joint.y, normalized)) {
+          continue;
+        }
+        minX = std::min(minX, normalized[0]*image.width());
+        maxX = std::max(maxX, normalized[0]*image.width());
+        minY = std::min(minY, normalized[1]*image.height());
+        maxY = std::max(maxY, normalized[1]*image.height());
+      }
+
+      HandCrop crop = {static_cast<int32_t>(hand.id), camera, 0.0f, 0.0f, 0.0f};
+      float* tensor = out + (2*h + camera)*cropFloats;
+      if (minX <= maxX) {
+        crop.size = std::max(std::max(maxX - minX, maxY - minY)*(1.0f + 2.0f*padding), 1.0f);
+        crop.x = 0.5f*(minX + maxX - crop.size);
+        crop.y = 0.5f*(minY + maxY - crop.size);
+        sampleCrop(image, crop, cropSize, gain, offset, tensor);
+      } else {
+        std::fill(tensor, tensor + cropFloats, offset);
+      }
+      if (crops) {
+        crops[2*h + camera] = crop;
+      }
+    }
+  }
+  return 2*hands;
+}
+
+// CompactFrame
+
+namespace {
+
+int16_t toFixed(float value, float scale) {
+  return static_cast<int16_t>(std::min(std::max(std::round(value*scale), -32767.0f), 32767.0f));
+}
+
+uint8_t toUnsigned8(float value, float scale) {
+  return static_cast<uint8_t>(std::min(std::max(std::round(value*scale), 0.0f), 255.0f));
+}
+
+uint16_t toUnsigned16(float value, float scale) {
+  return static_cast<uint16_t>(std::min(std::max(std::round(value*scale), 0.0f), 65535.0f));
+}
+
+void encodeOffset(const LEAP_VECTOR& point, const LEAP_VECTOR& origin, int16_t* out) {
+  for (int i = 0; i < 3; i++) {
+    out[i] = toFixed(point.v[i] - origin.v[i], static_cast<float>(CompactHand::POSITION_SCALE));
+  }
+}
+
+void decodeOffset(const int16_t* in, const LEAP_VECTOR& origin, LEAP_VECTOR& point) {
+  for (int i = 0; i < 3; i++) {
+    point.v[i] = origin.v[i] + in[i]*(1.0f/CompactHand::POSITION_SCALE);
+  }
+}
+
+void encodeVector(const LEAP_VECTOR& vector, float scale, int16_t* out) {
+  for (int i = 0; i < 3; i++) {
+    out[i] = toFixed(vector.v[i], scale);
+  }
+}
+
+void decodeVector(const int16_t* in, float scale, LEAP_VECTOR& vector) {
+  for (int i = 0; i < 3; i++) {
+    vector.v[i] = in[i]/scale;
+  }
+}
+
+// Smallest-three encoding: the index of the largest component in the top two bits, then the
+// other three components, which lie within +-1/sqrt(2), in 10 bits each. The largest component is
+// made positive (q and -q are the same rotation) and recovered from the unit norm.
+const float SMALLEST_THREE_RANGE = 0.70710678f;
+
+uint32_t encodeQuaternion(const LEAP_QUATERNION& q) {
+  int largest = 0;
+  for (int i = 1; i < 4; i++) {
+    if (std::abs(q.v[i]) > std::abs(q.v[largest])) {
+      largest = i;
+    }
+  }
+  const float sign = q.v[largest] < 0 ? -1.0f : 1.0f;
+  const float norm = std::sqrt(q.v[0]*q.v[0] + q.v[1]*q.v[1] + q.v[2]*q.v[2] + q.v[3]*q.v[3]);
+  const float scale = norm > 0 ? sign/norm : 0.0f;
+  uint32_t packed = static_cast<uint32_t>(largest) << 30;
+  int shift = 20;
+  for (int i = 0; i < 4; i++) {
+    if (i != largest) {
+      const float unit = (q.v[i]*scale/SMALLEST_THREE_RANGE)*0.5f + 0.5f;
+      packed |= static_cast<uint32_t>(std::min(std::max(std::round(unit*1023.0f), 0.0f), 1023.0f)) << shift;
+      shift -= 10;
+    }
+  }
+  return packed;
+}
+
+void decodeQuaternion(uint32_t packed, LEAP_QUATERNION& q) {
+  const int largest = static_cast<int>(packed >> 30);
+  float sumSquares = 0;
+  int shift = 20;
+  for (int i = 0; i < 4; i++) {
+    if (i != largest) {
+      const float unit = static_cast<float>((packed >> shift) & 0x3ff)/1023.0f;
+      q.v[i] = (unit*2.0f - 1.0f)*SMALLEST_THREE_RANGE;
+      sumSquares += q.v[i]*q.v[i];
+      shift -= 10;
+    }
+  }
+  q.v[largest] = std::sqrt(std::max(0.0f, 1.0f - sumSquares));
+}
+
+}
+
+void CompactHand::encode(const LEAP_HAND& hand, CompactHand& compact) {
+  const LEAP_VECTOR& palm = hand.palm.position;
+  compact.id = hand.id;
+  compact.flags = hand.flags;
+  compact.visibleTime = hand.visible_time;
+  std::copy(palm.v, palm.v + 3, compact.palmPosition);
+  encodeOffset(hand.palm.stabilized_position, palm, compact.stabilizedPosition);
+  encodeVector(hand.palm.velocity, 1.0f, compact.velocity);
+  encodeVector(hand.palm.normal, 32767.0f, compact.normal);
+  encodeVector(hand.palm.direction, 32767.0f, compact.direction);
+  compact.orientation = encodeQuaternion(hand.palm.orientation);
+  encodeOffset(hand.arm.prev_joint, palm, compact.arm[0]);
+  encodeOffset(hand.arm.next_joint, palm, compact.arm[1]);
+  compact.armRotation = encodeQuaternion(hand.arm.rotation);
+  compact.extendedFingers = 0;
+  for (int d = 0; d < 5; d++) {
+    const LEAP_DIGIT& digit = hand.digits[d];
+    encodeOffset(digit.bones[0].prev_joint, palm, compact.metacarpalBase[d]);
+    for (int b = 0; b < 4; b++) {
+      const LEAP_BONE& bone = digit.bones[b];
+      encodeOffset(bone.next_joint, palm, compact.joints[d*4 + b]);
+      compact.boneRotations[d*4 + b] = encodeQuaternion(bone.rotation);
+      compact.boneWidths[d*4 + b] = toUnsigned8(bone.width, 2.0f);
+    }
+    compact.extendedFingers |= digit.is_extended ? (1 << d) : 0;
+  }
+  compact.palmWidth = toUnsigned8(hand.palm.width, 2.0f);
+  compact.armWidth = toUnsigned8(hand.arm.width, 2.0f);
+  compact.type = static_cast<uint8_t>(hand.type);
+  compact.confidence = toUnsigned8(hand.confidence, 255.0f);
+  compact.pinchStrength = toUnsigned8(hand.pinch_strength, 255.0f);
+  compact.grabStrength = toUnsigned8(hand.grab_strength, 255.0f);
+  compact.pinchDistance = toUnsigned16(hand.pinch_distance, 100.0f);
+  compact.grabAngle = toUnsigned16(hand.grab_angle, 10000.0f);
+}
+
+void CompactHand::decode(const CompactHand& compact, LEAP_HAND& hand) {
+  std::memset(&hand, 0, sizeof(hand));
+  LEAP_VECTOR& palm = hand.palm.position;
+  hand.id = compact.id;
+  hand.flags = compact.flags;
+  hand.visible_time = compact.visibleTime;
+  std::copy(compact.palmPosition, compact.palmPosition + 3, palm.v);
+  decodeOffset(compact.stabilizedPosition, palm, hand.palm.stabilized_position);
+  decodeVector(compact.velocity, 1.0f, hand.palm.velocity);
+  decodeVector(compact.normal, 32767.0f, hand.palm.normal);
+  decodeVector(compact.direction, 32767.0f, hand.palm.direction);
+  decodeQuaternion(compact.orientation, hand.palm.orientation);
+  decodeOffset(compact.arm[0], palm, hand.arm.prev_joint);
+  decodeOffset(compact.arm[1], palm, hand.arm.next_joint);
+  decodeQuaternion(compact.armRotation, hand.arm.rotation);
+  for (int d = 0; d < 5; d++) {
+    LEAP_DIGIT& digit = hand.digits[d];
+    digit.finger_id = d;
+    digit.is_extended = (compact.extendedFingers >> d) & 1;
+    decodeOffset(compact.metacarpalBase[d], palm, digit.bones[0].prev_joint);
+    for (int b = 0; b < 4; b++) {
+      LEAP_BONE& bone = digit.bones[b];
+      if (b > 0) {
+        bone.prev_joint = digit.bones[b - 1].next_joint;
+      }
+      decodeOffset(compact.joints[d*4 + b], palm, bone.next_joint);
+      decodeQuaternion(compact.boneRotations[d*4 + b], bone.rotation);
+      bone.width = compact.boneWidths[d*4 + b]*0.5f;
+    }
+  }
+  hand.palm.width = compact.palmWidth*0.5f;
+  hand.arm.width = compact.armWidth*0.5f;
+  hand.type = static_cast<eLeapHandType>(compact.type);
+  hand.confidence = compact.confidence/255.0f;
+  hand.pinch_strength = compact.pinchStrength/255.0f;
+  hand.grab_strength = compact.grabStrength/255.0f;
+  hand.pinch_distance = compact.pinchDistance/100.0f;
+  hand.grab_angle = compact.grabAngle/10000.0f;
+}
+
+CompactFrame CompactFrame::encode(const LEAP_TRACKING_EVENT& tracking_event) {
+  CompactFrame frame;
+  frame.id = tracking_event.info.frame_id;
+  frame.timestamp = tracking_event.info.timestamp;
+  frame.trackingFrameId = tracking_event.tracking_frame_id;
+  frame.framerate = tracking_event.framerate;
+  frame.hands.resize(tracking_event.nHands);
+  for (uint32_t i = 0; i < tracking_event.nHands; i++) {
+    CompactHand::encode(tracking_event.pHands[i], frame.hands[i]);
+  }
+  return frame;
+}
+
+std::shared_ptr<FrameImplementation> CompactFrame::decode() const {
+  LEAP_HAND hands[4];
+  std::vector<LEAP_HAND> overflow;
+  LEAP_HAND* decoded = hands;
+  if (this->hands.size() > 4) {
+    overflow.resize(this->hands.size());
+    decoded = overflow.data();
+  }
+  for (size_t i = 0; i < this->hands.size(); i++) {
+    CompactHand::decode(this->hands[i], decoded[i]);
+  }
+
+  LEAP_TRACKING_EVENT tracking_event;
+  std::memset(&tracking_event, 0, sizeof(tracking_event));
+  tracking_event.info.frame_id = id;
+  tracking_event.info.timestamp = timestamp;
+  tracking_event.tracking_frame_id = trackingFrameId;
+  tracking_event.framerate = framerate;
+  tracking_event.nHands = static_cast<uint32_t>(this->hands.size());
+  tracking_event.pHands = tracking_event.nHands ? decoded : nullptr;
+  return std::make_shared<FrameImplementation>(tracking_event);
+}
+
+// HandCapsules
+
+void HandCapsules::collect(const LEAP_HAND& hand, Capsule* capsules) {
+  for (int d = 0; d < 5; d++) {
+    for (int b = 0; b < 4; b++) {
+      const LEAP_BONE& bone = hand.digits[d].bones[b];
+      capsules[d*4 + b] = {bone.prev_joint.v, bone.next_joint.v, bone.width*0.5f};
+    }
+  }
+  const Vector palm(hand.palm.position.v);
+  const Vector across = DerivedHandData::palmBasisOf(hand).xBasis*(hand.palm.width*0.25f);
+  capsules[HandJoints::PALM] = {palm - across, palm + across, hand.palm.width*0.25f};
+  capsules[HandJoints::WRIST] = {hand.arm.prev_joint.v, hand.arm.next_joint.v, hand.arm.width*0.5f};
+}
+
+AxisAlignedBox HandCapsules::bounds(const LEAP_HAND& hand) {
+  Capsule capsules[NUM_CAPSULES];
+  collect(hand, capsules);
+  AxisAlignedBox box;
+  for (const auto& capsule : capsules) {
+    box.add(capsule.bounds());
+  }
+  return box;
+}
+
+// ImageDispatcher
+
+ImageDispatcher::ImageDispatcher(Listener& listener, const Controller& controller) : m_state(std::make_shared<State>()) {
+  // The thread shares the state rather than this object, in case it outlives a detaching destructor
+  const std::shared_ptr<State> state = m_state;
+  Listener* target = &listener;
+  const Controller* source = &controller;
+  m_thread = std::thread([state, target, source] {
+    std::unique_lock<std::mutex> lk(state->mutex);
+    for (;;) {
+      state->wake.wait(lk, [&state] { return state->pending || state->stopped; });
+      if (state->stopped)
+        return;
+      state->pending = false;
+      lk.unlock();
+      target->onImages(*source);
+      lk.lock();
+    }
+  });
+}
+
+ImageDispatcher::~ImageDispatcher() {
+  {
+    std::lock_guard<std::mutex> lk(m_state->mutex);
+    m_state->stopped = true;
+  }
+  m_state->wake.notify_one();
+  if (m_thread.get_id() == std::this_thread::get_id()) {
+    m_thread.detach(); // Destroyed from the listener's own callback
+  } else {
+    m_thread.join();
+  }
+}
+
+bool ImageDispatcher::post() {
+  bool posted;
+  {
+    std::lock_guard<std::mutex> lk(m_state->mutex);
+    posted = !m_state->pending;
+    m_state->pending = true;
+  }
+  m_state->wake.notify_one();
+  return posted;
+}
+
+// CollisionSceneImplementation
+
+namespace {
+
+float closestOnSegment(const Vector& a, const Vector& b, const Vector& point) {
+  const Vector ab = b - a;
+  const float lengthSquared = ab.magnitudeSquared();
+  return lengthSquared > 0 ? std::min(std::max((point - a).dot(ab)/lengthSquared, 0.0f), 1.0f) : 0.0f;
+}
+
+// Closest points of segments p0-p1 and q0-q1 (Ericson, Real-Time Collision Detection, 5.1.9)
+void closestSegmentSegment(const Vector& p0, const Vector& p1, const Vector& q0, const Vector& q1, Vector& p, Vector& q) {
+  const Vector d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+  const float a = d1.magnitudeSquared(), e = d2.magnitudeSquared(), f = d2.dot(r);
+  float s = 0, t = 0;
+  if (a <= FLT_EPSILON && e <= FLT_EPSILON) {
+    s = t = 0;
+  } else if (a <= FLT_EPSILON) {
+    t = std::min(std::max(f/e, 0.0f), 1.0f);
+  } else {
+    const float c = d1.dot(r);
+    if (e <= FLT_EPSILON) {
+      s = std::min(std::max(-c/a, 0.0f), 1.0f);
+    } else {
+      const float b = d1.dot(d2), denominator = a*e - b*b;
+      s = denominator != 0 ? std::min(std::max((b*f - c*e)/denominator, 0.0f), 1.0f) : 0.0f;
+      t = (b*s + f)/e;
+      if (t < 0) {
+        t = 0;
+        s = std::min(std::max(-c/a, 0.0f), 1.0f);
+      } else if (t > 1) {
+        t = 1;
+        s = std::min(std::max((b - c)/a, 0.0f), 1.0f);
+      }
+    }
+  }
+  p = p0 + d1*s;
+  q = q0 + d2*t;
+}
+
+// Closest point of triangle abc to a point (Ericson, 5.1.5)
+Vector closestOnTriangle(const Vector& p, const Vector& a, const Vector& b, const Vector& c) {
+  const Vector ab = b - a, ac = c - a, ap = p - a;
+  const float d1 = ab.dot(ap), d2 = ac.dot(ap);
+  if (d1 <= 0 && d2 <= 0) return a;
+  const Vector bp = p - b;
+  const float d3 = ab.dot(bp), d4 = ac.dot(bp);
+  if (d3 >= 0 && d4 <= d3) return b;
+  const float vc = d1*d4 - d3*d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab*(d1/(d1 - d3));
+  const Vector cp = p - c;
+  const float d5 = ab.dot(cp), d6 = ac.dot(cp);
+  if (d6 >= 0 && d5 <= d6) return c;
+  const float vb = d5*d2 - d1*d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac*(d2/(d2 - d6));
+  const float va = d3*d6 - d5*d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) return b + (c - b)*((d4 - d3)/((d4 - d3) + (d5 - d6)));
+  const float denominator = 1/(va + vb + vc);
+  return a + ab*(vb*denominator) + ac*(vc*denominator);
+}
+
+// Turns the closest points of the capsule axis and the collider into a contact
+bool separatedContact(const Vector& onAxis, const Vector& onCollider, float radius, Contact& contact) {
+  const Vector offset = onAxis - onCollider;
+  const float distance = offset.magnitude();
+  if (distance > radius || distance <= FLT_EPSILON) {
+    return false;
+  }
+  contact.position = onCollider;
+  contact.normal = offset/distance;
+  contact.depth = radius - distance;
+  return true;
+}
+
+bool collideSphere(const Capsule& capsule, const Collider& sphere, Contact& contact) {
+  const Vector onAxis = capsule.a + (capsule.b - capsule.a)*closestOnSegment(capsule.a, capsule.b, sphere.a);
+  const Vector offset = onAxis - sphere.a;
+  const float distance = offset.magnitude();
+  if (distance > capsule.radius + sphere.radius) {
+    return false;
+  }
+  contact.normal = distance > FLT_EPSILON ? offset/distance : Vector::up();
+  contact.position = sphere.a + contact.normal*sphere.radius;
+  contact.depth = capsule.radius + sphere.radius - distance;
+  return true;
+}
+
+bool collideBox(const Capsule& capsule, const Collider& box, Contact& contact) {
+  const Vector minimum(std::min(box.a.x, box.b.x), std::min(box.a.y, box.b.y), std::min(box.a.z, box.b.z));
+  const Vector maximum(std::max(box.a.x, box.b.x), std::max(box.a.y, box.b.y), std::max(box.a.z, box.b.z));
+  auto clamp = [&minimum, &maximum](const Vector& p) {
+    return Vector(std::min(std::max(p.x, minimum.x), maximum.x),
+                  std::min(std::max(p.y, minimum.y), maximum.y),
+                  std::min(std::max(p.z, minimum.z), maximum.z));
+  };
+  // The distance from the box is convex along the axis, so a ternary search finds its minimum
+  const Vector axis = capsule.b - capsule.a;
+  float lo = 0, hi = 1;
+  for (int i = 0; i < 24 && hi - lo > 1e-4f; i++) {
+    const float t0 = lo + (hi - lo)/3, t1 = hi - (hi - lo)/3;
+    const Vector p0 = capsule.a + axis*t0, p1 = capsule.a + axis*t1;
+    if ((p0 - clamp(p0)).magnitudeSquared() <= (p1 - clamp(p1)).magnitudeSquared()) {
+      hi = t1;
+    } else {
+      lo = t0;
+    }
+  }
+  const Vector onAxis = capsule.a + axis*((lo + hi)*0.5f);
+  const Vector onBox = clamp(onAxis);
+  if (onAxis != onBox) {
+    return separatedContact(onAxis, onBox, capsule.radius, contact);
+  }
+
+  // The axis enters the box: push out through the nearest face
+  const float faces[6] = {onAxis.x - minimum.x, maximum.x - onAxis.x, onAxis.y - minimum.y,
+                          maximum.y - onAxis.y, onAxis.z - minimum.z, maximum.z - onAxis.z};
+  const int face = static_cast<int>(std::min_element(faces, faces + 6) - faces);
+  float normal[3] = {0, 0, 0};
+  normal[face/2] = (face % 2) ? 1.0f : -1.0f;
+  contact.normal = Vector(normal[0], normal[1], normal[2]);
+  contact.position = onAxis + contact.normal*faces[face];
+  contact.depth = faces[face] + capsule.radius;
+  return true;
+}
+
+bool collideTriangle(const Capsule& capsule, const Collider& triangle, Contact& contact) {
+  const Vector& a = triangle.a;
+  const Vector& b = triangle.b;
+  const Vector& c = triangle.c;
+  const Vector faceNormal = (b - a).cross(c - a).normalized();
+
+  // The axis crosses the triangle
+  const float h0 = faceNormal.dot(capsule.a - a), h1 = faceNormal.dot(capsule.b - a);
+  if (faceNormal != Vector::zero() && ((h0 <= 0 && h1 >= 0) || (h0 >= 0 && h1 <= 0)) && h0 != h1) {
+    const Vector crossing = capsule.a + (capsule.b - capsule.a)*(h0/(h0 - h1));
+    if ((closestOnTriangle(crossing, a, b, c) - crossing).magnitudeSquared() <= 1e-6f) {
+      // Push out towards the side the larger part of the capsule is on
+      const bool front = std::abs(h0) >= std::abs(h1) ? h0 >= 0 : h1 >= 0;
+      contact.normal = front ? faceNormal : -faceNormal;
+      contact.position = crossing;
+      contact.depth = std::min(std::abs(h0), std::abs(h1)) + capsule.radius;
+      return true;
+    }
+  }
+
+  Vector bestAxis = capsule.a, bestTriangle = closestOnTriangle(capsule.a, a, b, c);
+  float best = (bestAxis - bestTriangle).magnitudeSquared();
+  auto consider = [&](const Vector& onAxis, const Vector& onTriangle) {
+    const float distanceSquared = (onAxis - onTriangle).magnitudeSquared();
+    if (distanceSquared < best) {
+      best = distanceSquared;
+      bestAxis = onAxis;
+      bestTriangle = onTriangle;
+    }
+  };
+  consider(capsule.b, closestOnTriangle(capsule.b, a, b, c));
+  const Vector edges[3][2] = {{a, b}, {b, c}, {c, a}};
+  for (const auto& edge : edges) {
+    Vector onAxis, onEdge;
+    closestSegmentSegment(capsule.a, capsule.b, edge[0], edge[1], onAxis, onEdge);
+    consider(onAxis, onEdge);
+  }
+  if (best <= FLT_EPSILON && faceNormal != Vector::zero()) {
+    // Touching the plane of the triangle
+    contact.normal = faceNormal.dot((capsule.a + capsule.b)*0.5f - a) >= 0 ? faceNormal : -faceNormal;
+    contact.position = bestTriangle;
+    contact.depth = capsule.radius;
+    return true;
+  }
+  return separatedContact(bestAxis, bestTriangle, capsule.radius, contact);
+}
+
+AxisAlignedBox colliderBounds(const Collider& collider) {
+  AxisAlignedBox box;
+  switch (collider.type) {
+    case Collider::TYPE_SPHERE:
+      box.add(collider.a, collider.radius);
+      break;
+    case Collider::TYPE_BOX:
+      box.add(collider.a);
+      box.add(collider.b);
+      break;
+    case Collider::TYPE_TRIANGLE:
+      box.add(collider.a);
+      box.add(collider.b);
+      box.add(collider.c);
+      break;
+  }
+  return box;
+}
+
+}
+
+void CollisionSceneImplementation::update() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_dirty) {
+    return;
+  }
+  m_colliderBounds.resize(m_colliders.size());
+  m_order.resize(m_colliders.size());
+  for (size_t i = 0; i < m_colliders.size(); i++) {
+    m_colliderBounds[i] = colliderBounds(m_colliders[i]);
+    m_order[i] = static_cast<uint32_t>(i);
+  }
+  m_nodes.clear();
+  if (!m_colliders.empty()) {
+    m_nodes.reserve(2*m_colliders.size()/MAX_LEAF_SIZE + 1);
+    build(0, static_cast<uint32_t>(m_colliders.size()));
+  }
+  m_dirty = false;
+}
+
+// Median split along the longest axis of the collider centers
+uint32_t CollisionSceneImplementation::build(uint32_t begin, uint32_t end) const {
+  const uint32_t index = static_cast<uint32_t>(m_nodes.size());
+  m_nodes.push_back(Node());
+  AxisAlignedBox bounds, centers;
+  for (uint32_t i = begin; i < end; i++) {
+    bounds.add(m_colliderBounds[m_order[i]]);
+    centers.add(m_colliderBounds[m_order[i]].center());
+  }
+  m_nodes[index].bounds = bounds;
+  if (end - begin <= MAX_LEAF_SIZE) {
+    m_nodes[index].first = begin;
+    m_nodes[index].count = end - begin;
+    return index;
+  }
+
+  const Vector extent = centers.max - centers.min;
+  const unsigned int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+  const uint32_t middle = begin + (end - begin)/2;
+  std::nth_element(m_order.begin() + begin, m_order.begin() + middle, m_order.begin() + end,
+                   [this, axis](uint32_t lhs, uint32_t rhs) {
+                     return m_colliderBounds[lhs].center()[axis] < m_colliderBounds[rhs].center()[axis];
+                   });
+  build(begin, middle);
+  const uint32_t right = build(middle, end);
+  m_nodes[index].first = right;
+  m_nodes[index].count = 0;
+  return index;
+}
+
+void CollisionSceneImplementation::collide(const FrameImplementation& frame, std::vector<Contact>& contacts) const {
+  update();
+  if (m_nodes.empty()) {
+    return;
+  }
+
+  const auto& hands = frame.rawHands();
+  const auto& handBounds = frame.handBounds();
+  std::vector<uint32_t> candidates;
+  for (size_t h = 0; h < hands.size(); h++) {
+    // Broadphase: the colliders whose bounds overlap those of the hand
+    candidates.clear();
+    uint32_t stack[64];
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+      const Node& node = m_nodes[stack[--depth]];
+      if (!node.bounds.overlaps(handBounds[h])) {
+        continue;
+      }
+      if (node.count > 0) {
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+          if (m_colliderBounds[m_order[i]].overlaps(handBounds[h])) {
+            candidates.push_back(m_order[i]);
+          }
+        }
+      } else {
+        stack[depth++] = node.first;
+        stack[depth++] = static_cast<uint32_t>(&node - &m_nodes[0]) + 1;
+      }
+    }
+    if (candidates.empty()) {
+      continue;
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    // Narrowphase: every capsule of the hand against the candidates
+    Capsule capsules[HandCapsules::NUM_CAPSULES];
+    HandCapsules::collect(hands[h], capsules);
+    for (int part = 0; part < HandCapsules::NUM_CAPSULES; part++) {
+      const AxisAlignedBox capsuleBounds = capsules[part].bounds();
+      for (const uint32_t c : candidates) {
+        if (!capsuleBounds.overlaps(m_colliderBounds[c])) {
+          continue;
+        }
+        const Collider& collider = m_colliders[c];
+        Contact contact = {collider.id, static_cast<int32_t>(hands[h].id), part, Vector(), Vector(), 0.0f};
+        bool touching = false;
+        switch (collider.type) {
+          case Collider::TYPE_SPHERE:
+            touching = collideSphere(capsules[part], collider, contact);
+            break;
+          case Collider::TYPE_BOX:
+            touching = collideBox(capsules[part], collider, contact);
+            break;
+          case Collider::TYPE_TRIANGLE:
+            touching = collideTriangle(capsules[part], collider, contact);
+            break;
+        }
+        if (touching) {
+          contacts.push_back(contact);
+        }
+      }
+    }
+  }
+}
+
+// PoseFeatures
+
+void poseFeaturesOf(const LEAP_HAND& hand, PoseFeatures& features) {
+  const Vector wrist(hand.arm.next_joint.v);
+  const float scale = (Vector(hand.digits[2].bones[0].next_joint.v) - wrist).magnitude();
+  const Matrix basis = DerivedHandData::palmBasisOf(hand);
+  features.valid = scale > FLT_EPSILON && basis.xBasis.magnitudeSquared() > 0.5f;
+  if (!features.valid) {
+    std::fill(features.values, features.values + PoseFeatures::LENGTH, 0.0f);
+    return;
+  }
+  // The palm basis is orthonormal, so projecting onto its axes applies its inverse
+  const float inverseScale = 1/scale;
+  float* out = features.values;
+  for (int d = 0; d < 5; d++) {
+    for (int b = 0; b < 4; b++) {
+      const Vector offset = (Vector(hand.digits[d].bones[b].next_joint.v) - wrist)*inverseScale;
+      *out++ = basis.xBasis.dot(offset);
+      *out++ = basis.yBasis.dot(offset);
+      *out++ = basis.zBasis.dot(offset);
+    }
+  }
+}
+
+// PoseIndexImplementation
+
+namespace {
+
+const char POSE_INDEX_MAGIC[4] = {'L', 'P', 'I', 'X'};
+const uint32_t POSE_INDEX_VERSION = 1;
+
+float poseDistance(const float* a, const float* b) {
+  // Independent partial sums, so the loop vectorizes without reassociating floating point math
+  float sums[4] = {0, 0, 0, 0};
+  for (int i = 0; i < PoseFeatures::LENGTH; i += 4) {
+    for (int j = 0; j < 4; j++) {
+      const float d = a[i + j] - b[i + j];
+      sums[j] += d*d;
+    }
+  }
+  return std::sqrt((sums[0] + sums[1]) + (sums[2] + sums[3]));
+}
+static_assert(PoseFeatures::LENGTH % 4 == 0, "poseDistance() processes features four at a time");
+
+}
+
+void PoseIndexImplementation::update() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_dirty) {
+    return;
+  }
+  std::vector<std::pair<float, uint32_t>> order(m_labels.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = std::make_pair(0.0f, static_cast<uint32_t>(i));
+  }
+  std::vector<float> features;
+  std::vector<int32_t> labels;
+  features.reserve(m_features.size());
+  labels.reserve(m_labels.size());
+  m_nodes.clear();
+  m_nodes.reserve(m_labels.size());
+  build(order, 0, order.size(), features, labels);
+  m_features.swap(features);
+  m_labels.swap(labels);
+  m_dirty = false;
+}
+
+// Takes the middle pose of the range as vantage point and splits the others at their median
+// distance from it
+int32_t PoseIndexImplementation::build(std::vector<std::pair<float, uint32_t>>& order, size_t begin, size_t end,
+                                       std::vector<float>& features, std::vector<int32_t>& labels) const {
+  if (begin == end) {
+    return -1;
+  }
+  const int32_t index = static_cast<int32_t>(m_nodes.size());
+  m_nodes.push_back(Node{0.0f, -1, -1});
+  std::swap(order[begin], order[begin + (end - begin)/2]);
+  const float* vantage = featuresAt(order[begin].second);
+  features.insert(features.end(), vantage, vantage + PoseFeatures::LENGTH);
+  labels.push_back(m_labels[order[begin].second]);
+  if (end - begin == 1) {
+    return index;
+  }
+
+  for (size_t i = begin + 1; i < end; i++) {
+    order[i].first = poseDistance(vantage, featuresAt(order[i].second));
+  }
+  const size_t middle = begin + 1 + (end - begin - 1)/2;
+  std::nth_element(order.begin() + begin + 1, order.begin() + middle, order.begin() + end);
+  const float radius = order[middle].first;
+  const int32_t inside = build(order, begin + 1, middle, features, labels);
+  const int32_t outside = build(order, middle, end, features, labels);
+  m_nodes[index].radius = radius;
+  m_nodes[index].inside = inside;
+  m_nodes[index].outside = outside;
+  return index;
+}
+
+void PoseIndexImplementation::search(int32_t node, const float* query, int k, PoseMatch* matches, int& found) const {
+  if (node < 0) {
+    return;
+  }
+  const float distance = poseDistance(query, featuresAt(static_cast<size_t>(node)));
+  if (found < k || distance < matches[found - 1].distance) {
+    // Insert in order of distance, dropping the farthest match if the list is full
+    int i = found < k ? found++ : found - 1;
+    for (; i > 0 && matches[i - 1].distance > distance; i--) {
+      matches[i] = matches[i - 1];
+    }
+    matches[i] = PoseMatch{m_labels[static_cast<size_t>(node)], distance};
+  }
+
+  // Only visit a subtree if it can hold a pose closer than the current k-th match
+  const Node& n = m_nodes[static_cast<size_t>(node)];
+  auto tau = [&]() { return found < k ? FLT_MAX : matches[found - 1].distance; };
+  if (distance < n.radius) {
+    if (distance - tau() <= n.radius) {
+      search(n.inside, query, k, matches, found);
+    }
+    if (distance + tau() >= n.radius) {
+      search(n.outside, query, k, matches, found);
+    }
+  } else {
+    if (distance + tau() >= n.radius) {
+      search(n.outside, query, k, matches, found);
+    }
+    if (distance - tau() <= n.radius) {
+      search(n.inside, query, k, matches, found);
+    }
+  }
+}
+
+int PoseIndexImplementation::nearest(const PoseFeatures& features, int k, PoseMatch* matches) const {
+  if (!features.valid || k <= 0 || !matches) {
+    return 0;
+  }
+  update();
+  int found = 0;
+  search(m_nodes.empty() ? -1 : 0, features.values, k, matches, found);
+  return found;
+}
+
+bool PoseIndexImplementation::save(const char* path) const {
+  update();
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  const uint32_t header[3] = {POSE_INDEX_VERSION, static_cast<uint32_t>(PoseFeatures::LENGTH), static_cast<uint32_t>(m_labels.size())};
+  file.write(POSE_INDEX_MAGIC, sizeof(POSE_INDEX_MAGIC));
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(m_labels.data()), m_labels.size()*sizeof(int32_t));
+  file.write(reinterpret_cast<const char*>(m_features.data()), m_features.size()*sizeof(float));
+  file.write(reinterpret_cast<const char*>(m_nodes.data()), m_nodes.size()*sizeof(Node));
+  return static_cast<bool>(file.flush());
+}
+
+bool PoseIndexImplementation::load(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[sizeof(POSE_INDEX_MAGIC)];
+  uint32_t header[3];
+  if (!file.read(magic, sizeof(magic)) || !file.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+      !std::equal(magic, magic + sizeof(magic), POSE_INDEX_MAGIC) ||
+      header[0] != POSE_INDEX_VERSION || header[1] != static_cast<uint32_t>(PoseFeatures::LENGTH)) {
+    return false;
+  }
+  const size_t count = header[2];
+  const std::streamoff start = file.tellg();
+  file.seekg(0, std::ios::end);
+  if (file.tellg() - start != static_cast<std::streamoff>(count*(sizeof(int32_t) + PoseFeatures::LENGTH*sizeof(float) + sizeof(Node)))) {
+    return false;
+  }
+  file.seekg(start);
+  std::vector<int32_t> labels(count);
+  std::vector<float> features(count*PoseFeatures::LENGTH);
+  std::vector<Node> nodes(count);
+  if (!file.read(reinterpret_cast<char*>(labels.data()), count*sizeof(int32_t)) ||
+      !file.read(reinterpret_cast<char*>(features.data()), features.size()*sizeof(float)) ||
+      !file.read(reinterpret_cast<char*>(nodes.data()), count*sizeof(Node))) {
+    return false;
+  }
+  // Children always follow their parent in preorder
+  for (size_t i = 0; i < count; i++) {
+    for (const int32_t child : {nodes[i].inside, nodes[i].outside}) {
+      if (child != -1 && (child <= static_cast<int32_t>(i) || child >= static_cast<int32_t>(count))) {
+        return false;
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_labels.swap(labels);
+  m_features.swap(features);
+  m_nodes.swap(nodes);
+  m_dirty = false;
+  return true;
+}
+
+// MapPointStoreImplementation
+
+MapPointStoreImplementation::VoxelCoordinates MapPointStoreImplementation::coordinatesOf(const Vector& position) const {
+  // Clamped to the 21 bits per axis that keyOf() packs
+  auto axis = [this](float value) {
+    return static_cast<int32_t>(std::min(std::max(std::floor(value/m_voxelSize), -1048576.0f), 1048575.0f));
+  };
+  return VoxelCoordinates{axis(position.x), axis(position.y), axis(position.z)};
+}
+
+uint64_t MapPointStoreImplementation::keyOf(const VoxelCoordinates& coordinates) {
+  const uint64_t mask = (1 << 21) - 1;
+  return ((static_cast<uint64_t>(coordinates.x) & mask) << 42) |
+         ((static_cast<uint64_t>(coordinates.y) & mask) << 21) |
+          (static_cast<uint64_t>(coordinates.z) & mask);
+}
+
+MapPointStoreImplementation::VoxelCoordinates MapPointStoreImplementation::coordinatesOfKey(uint64_t key) {
+  // Sign extends each 21 bit axis packed by keyOf()
+  auto axis = [key](int shift) {
+    const int32_t value = static_cast<int32_t>((key >> shift) & ((1 << 21) - 1));
+    return value >= (1 << 20) ? value - (1 << 21) : value;
+  };
+  return VoxelCoordinates{axis(42), axis(21), axis(0)};
+}
+
+void MapPointStoreImplementation::insert(uint32_t id, Entry& entry) {
+  const VoxelCoordinates coordinates = coordinatesOf(entry.position);
+  entry.voxel = keyOf(coordinates);
+  auto& ids = m_voxels[entry.voxel];
+  entry.slot = static_cast<uint32_t>(ids.size());
+  ids.push_back(id);
+  m_min = {std::min(m_min.x, coordinates.x), std::min(m_min.y, coordinates.y), std::min(m_min.z, coordinates.z)};
+  m_max = {std::max(m_max.x, coordinates.x), std::max(m_max.y, coordinates.y), std::max(m_max.z, coordinates.z)};
+}
+
+void MapPointStoreImplementation::erase(const Entry& entry) {
+  const auto voxel = m_voxels.find(entry.voxel);
+  auto& ids = voxel->second;
+  // Swap with the last id of the voxel so that removal is constant time
+  ids[entry.slot] = ids.back();
+  m_entries[ids[entry.slot]].slot = entry.slot;
+  ids.pop_back();
+  if (ids.empty()) {
+    const VoxelCoordinates coordinates = coordinatesOfKey(entry.voxel);
+    m_boundsStale = m_boundsStale ||
+                    coordinates.x == m_min.x || coordinates.x == m_max.x ||
+                    coordinates.y == m_min.y || coordinates.y == m_max.y ||
+                    coordinates.z == m_min.z || coordinates.z == m_max.z;
+    m_voxels.erase(voxel);
+  }
+}
+
+void MapPointStoreImplementation::updateBounds() {
+  m_min = {INT32_MAX, INT32_MAX, INT32_MAX};
+  m_max = {INT32_MIN, INT32_MIN, INT32_MIN};
+  for (const auto& voxel : m_voxels) {
+    const VoxelCoordinates coordinates = coordinatesOfKey(voxel.first);
+    m_min = {std::min(m_min.x, coordinates.x), std::min(m_min.y, coordinates.y), std::min(m_min.z, coordinates.z)};
+    m_max = {std::max(m_max.x, coordinates.x), std::max(m_max.y, coordinates.y), std::max(m_max.z, coordinates.z)};
+  }
+  m_boundsStale = false;
+}
+
+void MapPointStoreImplementation::update(const Vector* positions, const uint32_t* ids, int count, int64_t timestamp) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (int i = 0; i < count; i++) {
+    const uint32_t id = ids[i];
+    auto found = m_entries.find(id);
+    if (found == m_entries.end()) {
+      Entry& entry = m_entries[id];
+      entry.position = positions[i];
+      entry.lastSeen = timestamp;
+      entry.samples = 1;
+      entry.recency = m_recency.insert(m_recency.end(), id);
+      insert(id, entry);
+      continue;
+    }
+    Entry& entry = found->second;
+    entry.samples = std::min(entry.samples + 1, static_cast<int>(MAX_MEAN_SAMPLES));
+    entry.position += (positions[i] - entry.position)/static_cast<float>(entry.samples);
+    entry.lastSeen = std::max(entry.lastSeen, timestamp);
+    m_recency.splice(m_recency.end(), m_recency, entry.recency);
+    if (keyOf(coordinatesOf(entry.position)) != entry.voxel) {
+      erase(entry);
+      insert(id, entry);
+    }
+  }
+
+  // Age out the least recently observed ids
+  while (!m_recency.empty()) {
+    const auto oldest = m_entries.find(m_recency.front());
+    if (timestamp - oldest->second.lastSeen <= m_maxAge) {
+      break;
+    }
+    erase(oldest->second);
+    m_recency.pop_front();
+    m_entries.erase(oldest);
+  }
+
+  if (m_boundsStale) {
+    updateBounds();
+  }
+}
+
+template<typename Visitor>
+void MapPointStoreImplementation::visitVoxel(const VoxelCoordinates& coordinates, Visitor visit) const {
+  const auto voxel = m_voxels.find(keyOf(coordinates));
+  if (voxel == m_voxels.end()) {
+    return;
+  }
+  for (const uint32_t id : voxel->second) {
+    visit(id, m_entries.find(id)->second);
+  }
+}
+
+MapPointList MapPointStoreImplementation::within(const Vector& center, float radius) const {
+  std::vector<Vector> points;
+  std::vector<uint32_t> ids;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const VoxelCoordinates query[2] = {coordinatesOf(center - Vector(radius, radius, radius)),
+                                       coordinatesOf(center + Vector(radius, radius, radius))};
+    const VoxelCoordinates lo = {std::max(query[0].x, m_min.x), std::max(query[0].y, m_min.y), std::max(query[0].z, m_min.z)};
+    const VoxelCoordinates hi = {std::min(query[1].x, m_max.x), std::min(query[1].y, m_max.y), std::min(query[1].z, m_max.z)};
+    const float radiusSquared = radius*radius;
+    auto collect = [&](uint32_t id, const Entry& entry) {
+      if ((entry.position - center).magnitudeSquared() <= radiusSquared) {
+        points.push_back(entry.position);
+        ids.push_back(id);
+      }
+    };
+    const bool empty = lo.x > hi.x || lo.y > hi.y || lo.z > hi.z;
+    const double cells = empty ? 0.0 : static_cast<double>(hi.x - lo.x + 1)*(hi.y - lo.y + 1)*(hi.z - lo.z + 1);
+    if (cells > m_voxels.size()) {
+      // The box spans more cells than are occupied, so scan the occupied voxels instead
+      for (const auto& voxel : m_voxels) {
+        const VoxelCoordinates coordinates = coordinatesOfKey(voxel.first);
+        if (coordinates.x < lo.x || coordinates.x > hi.x || coordinates.y < lo.y || coordinates.y > hi.y ||
+            coordinates.z < lo.z || coordinates.z > hi.z) {
+          continue;
+        }
+        for (const uint32_t id : voxel.second) {
+          collect(id, m_entries.find(id)->second);
+        }
+      }
+    } else {
+      for (int32_t x = lo.x; x <= hi.x; x++) {
+        for (int32_t y = lo.y; y <= hi.y; y++) {
+          for (int32_t z = lo.z; z <= hi.z; z++) {
+            visitVoxel(VoxelCoordinates{x, y, z}, collect);
+          }
+        }
+      }
+    }
+  }
+  return MapPointList(std::make_shared<MapPointListImplementation>(std::move(points), std::move(ids)));
+}
+
+MapPointList MapPointStoreImplementation::nearest(const Vector& position, int k) const {
+  // Candidates as (squared distance, id), kept as a max-heap of the k closest so far
+  std::vector<std::pair<float, uint32_t>> best;
+  std::vector<Vector> points;
+  std::vector<uint32_t> ids;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (k <= 0 || m_entries.empty()) {
+    return MapPointList(std::make_shared<MapPointListImplementation>());
+  }
+  const size_t wanted = std::min(static_cast<size_t>(k), m_entries.size());
+  best.reserve(wanted + 1);
+  auto consider = [&](uint32_t id, const Entry& entry) {
+    const float distanceSquared = (entry.position - position).magnitudeSquared();
+    if (best.size() < wanted || distanceSquared < best.front().first) {
+      best.emplace_back(distanceSquared, id);
+      std::push_heap(best.begin(), best.end());
+      if (best.size() > wanted) {
+        std::pop_heap(best.begin(), best.end());
+        best.pop_back();
+      }
+    }
+  };
+
+  // Visit shells of voxels at increasing Chebyshev distance from the voxel of the position. Every
+  // point in shell r + 1 is at least r voxels away, so the search stops once the k-th closest
+  // point is nearer than that, or when the shells cover every occupied voxel.
+  const VoxelCoordinates c = coordinatesOf(position);
+  const int32_t lastShell = std::max({c.x - m_min.x, m_max.x - c.x, c.y - m_min.y, m_max.y - c.y, c.z - m_min.z, m_max.z - c.z});
+  for (int32_t r = 0; r <= lastShell; r++) {
+    for (int32_t x = std::max(c.x - r, m_min.x); x <= std::min(c.x + r, m_max.x); x++) {
+      for (int32_t y = std::max(c.y - r, m_min.y); y <= std::min(c.y + r, m_max.y); y++) {
+        const bool xyOnShell = std::abs(x - c.x) == r || std::abs(y - c.y) == r;
+        for (int32_t z = std::max(c.z - r, m_min.z); z <= std::min(c.z + r, m_max.z); z++) {
+          // Inside the shell, only its two faces along z are new
+          if (!xyOnShell && std::abs(z - c.z) != r) {
+            z = std::abs(z - c.z) < r ? c.z + r - 1 : z;
+            continue;
+          }
+          visitVoxel(VoxelCoordinates{x, y, z}, consider);
+        }
+      }
+    }
+    const float reach = r*m_voxelSize;
+    if (best.size() == wanted && best.front().first <= reach*reach) {
+      break;
+    }
+  }
+
+  std::sort_heap(best.begin(), best.end());
+  points.reserve(best.size());
+  ids.reserve(best.size());
+  for (const auto& candidate : best) {
+    points.push_back(m_entries.find(candidate.second)->second.position);
+    ids.push_back(candidate.second);
+  }
+  return MapPointList(std::make_shared<MapPointListImplementation>(std::move(points), std::move(ids)));
+}
+
+// StereoDepthImplementation
+
+void StereoDepthImplementation::buildMap(const Image& image, CameraMap& map) const {
+  const int sourceWidth = image.width();
+  const int sourceHeight = image.height();
+  map.calibration = image.calibrationHash();
+  map.sourceWidth = sourceWidth;
+  map.sourceHeight = sourceHeight;
+  map.offsets.assign(static_cast<size_t>(m_width)*m_height, -1);
+  map.weightX.assign(map.offsets.size(), 0);
+  map.weightY.assign(map.offsets.size(), 0);
+  // Shared with every other user of the same calibration and grid
+  const float* positions = image.undistortionMap(m_width, m_height, m_maxSlope);
+  if (sourceWidth < 2 || sourceHeight < 2 || !positions) {
+    return;
+  }
+
+  for (size_t index = 0; index < map.offsets.size(); index++) {
+    // Positions that rays reach are at least -0.5; the others are -1
+    if (positions[2*index] < -0.5f) {
+      continue;
+    }
+    const float px = std::min(std::max(positions[2*index], 0.0f), sourceWidth - 1.0f);
+    const float py = std::min(std::max(positions[2*index + 1], 0.0f), sourceHeight - 1.0f);
+    const int sx = std::min(static_cast<int>(px), sourceWidth - 2);
+    const int sy = std::min(static_cast<int>(py), sourceHeight - 2);
+    map.offsets[index] = sy*sourceWidth + sx;
+    map.weightX[index] = static_cast<uint16_t>(std::lround((px - sx)*256.0f));
+    map.weightY[index] = static_cast<uint16_t>(std::lround((py - sy)*256.0f));
+  }
+}
+
+bool StereoDepthImplementation::update(const Image& left, const Image& right, float baseline) {
+  const Image* images[2] = { &left, &right };
+  for (int camera = 0; camera < 2; camera++) {
+    if (!images[camera]->isValid() || images[camera]->bytesPerPixel() != 1) {
+      return false;
+    }
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_baseline = baseline;
+  for (int camera = 0; camera < 2; camera++) {
+    const Image& image = *images[camera];
+    CameraMap& map = m_maps[camera];
+    // Rebuild the map only when the calibration changes
+    if (map.sourceWidth != image.width() || map.sourceHeight != image.height() || map.calibration != image.calibrationHash()) {
+      buildMap(image, map);
+    }
+
+    const uint8_t* source = image.data();
+    std::vector<uint8_t>& rectified = m_rectified[camera];
+    rectified.resize(map.offsets.size());
+    const int stride = map.sourceWidth;
+    for (size_t i = 0; i < rectified.size(); i++) {
+      const int32_t offset = map.offsets[i];
+      if (offset < 0) {
+        rectified[i] = 0;
+        continue;
+      }
+      const uint32_t wx = map.weightX[i], wy = map.weightY[i];
+      const uint8_t* p = source + offset;
+      const uint32_t top = p[0]*(256 - wx) + p[1]*wx;
+      const uint32_t bottom = p[stride]*(256 - wx) + p[stride + 1]*wx;
+      rectified[i] = static_cast<uint8_t>((top*(256 - wy) + bottom*wy + 32768) >> 16);
+    }
+  }
+  return true;
+}
+
+StereoRegion StereoDepthImplementation::handRegion(const Hand& hand, int margin, float depthMargin) const {
+  StereoRegion region = {0, 0, 0, 0, 0.0f, 0.0f};
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!hand.isValid() || m_baseline <= 0.0f) {
+    return region;
+  }
+  std::vector<Vector> joints;
+  joints.reserve(2 + 5*5);
+  joints.push_back(hand.palmPosition());
+  joints.push_back(hand.wristPosition());
+  for (const Finger& finger : hand.fingers()) {
+    joints.push_back(finger.bone(Bone::TYPE_METACARPAL).prevJoint());
+    for (int b = 0; b < 4; b++) {
+      joints.push_back(finger.bone(static_cast<Bone::Type>(b)).nextJoint());
+    }
+  }
+
+  // Ray slopes of the left camera, which is half a baseline along -x in image terms
+  float minU = FLT_MAX, maxU = -FLT_MAX, minV = FLT_MAX, maxV = -FLT_MAX;
+  float minDepth = FLT_MAX, maxDepth = 0.0f;
+  for (const Vector& joint : joints) {
+    if (joint.y <= 0.0f) {
+      continue;
+    }
+    const float slopeX = -(joint.x - 0.5f*m_baseline)/joint.y;
+    const float slopeY = joint.z/joint.y;
+    const float u = (slopeX/m_maxSlope + 1.0f)*0.5f*m_width - 0.5f;
+    const float v = (slopeY/m_maxSlope + 1.0f)*0.5f*m_height - 0.5f;
+    minU = std::min(minU, u);
+    maxU = std::max(maxU, u);
+    minV = std::min(minV, v);
+    maxV = std::max(maxV, v);
+    minDepth = std::min(minDepth, joint.y);
+    maxDepth = std::max(maxDepth, joint.y);
+  }
+  if (maxDepth <= 0.0f) {
+    return region;
+  }
+  const int x0 = std::max(static_cast<int>(std::floor(minU)) - margin, 0);
+  const int y0 = std::max(static_cast<int>(std::floor(minV)) - margin, 0);
+  const int x1 = std::min(static_cast<int>(std::ceil(maxU)) + margin + 1, m_width);
+  const int y1 = std::min(static_cast<int>(std::ceil(maxV)) + margin + 1, m_height);
+  if (x1 <= x0 || y1 <= y0) {
+    return region;
+  }
+  region.x = x0;
+  region.y = y0;
+  region.width = x1 - x0;
+  region.height = y1 - y0;
+  region.minDepth = std::max(minDepth - depthMargin, 1.0f);
+  region.maxDepth = maxDepth + depthMargin;
+  return region;
+}
+
+int StereoDepthImplementation::computeDepth(const StereoRegion& region, float* depth) const {
+  if (region.isEmpty() || !depth) {
+    return 0;
+  }
+  std::fill(depth, depth + static_cast<size_t>(region.width)*region.height, 0.0f);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_rectified[0].empty() || m_baseline <= 0.0f || region.minDepth <= 0.0f || region.maxDepth < region.minDepth) {
+    return 0;
+  }
+  const int x0 = std::max(region.x, 0), x1 = std::min(region.x + region.width, m_width);
+  const int y0 = std::max(region.y, 0), y1 = std::min(region.y + region.height, m_height);
+  if (x1 <= x0 || y1 <= y0) {
+    return 0;
+  }
+  // Disparities of the depth range, with one more on each side for the sub-pixel fit
+  const float bf = m_baseline*focalLength();
+  const int minDisparity = std::max(static_cast<int>(std::floor(bf/region.maxDepth)) - 1, 0);
+  const int maxDisparity = std::min(static_cast<int>(std::ceil(bf/region.minDepth)) + 1, m_width - 1);
+  if (maxDisparity - minDisparity < 2) {
+    return 0;
+  }
+
+  const int w = x1 - x0, h = y1 - y0;
+  const int radius = m_blockSize/2;
+  // The absolute differences cover the region plus the block radius, clamped to the image
+  const int ex0 = x0 - radius, ey0 = y0 - radius;
+  const int ew = w + 2*radius, eh = h + 2*radius;
+  const int disparities = maxDisparity - minDisparity + 1;
+  const size_t pixels = static_cast<size_t>(w)*h;
+  m_differences.resize(static_cast<size_t>(ew)*eh);
+  m_integral.assign(static_cast<size_t>(ew + 1)*(eh + 1), 0);
+  m_costs.resize(pixels*disparities);
+  const uint8_t* left = m_rectified[0].data();
+  const uint8_t* right = m_rectified[1].data();
+
+  for (int di = 0; di < disparities; di++) {
+    const int d = minDisparity + di;
+    // Columns whose left and right pixels are both inside the image need no clamping
+    const int inner0 = std::min(std::max(d - ex0, 0), ew);
+    const int inner1 = std::max(std::min(m_width - ex0, ew), inner0);
+    for (int ey = 0; ey < eh; ey++) {
+      const int y = std::min(std::max(ey0 + ey, 0), m_height - 1);
+      const uint8_t* l = left + static_cast<size_t>(y)*m_width;
+      const uint8_t* r = right + static_cast<size_t>(y)*m_width;
+      uint8_t* out = &m_differences[static_cast<size_t>(ey)*ew];
+      for (int ex = 0; ex < inner0; ex++) {
+        const int x = std::min(std::max(ex0 + ex, 0), m_width - 1);
+        out[ex] = x >= d ? static_cast<uint8_t>(std::abs(l[x] - r[x - d])) : 255;
+      }
+      int ex = inner0;
+#if LEAP_CPP_SSE2
+      for (; ex + 16 <= inner1; ex += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(l + ex0 + ex));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + ex0 + ex - d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + ex), _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)));
+      }
+#endif
+      for (; ex < inner1; ex++) {
+        out[ex] = static_cast<uint8_t>(std::abs(l[ex0 + ex] - r[ex0 + ex - d]));
+      }
+      for (; ex < ew; ex++) {
+        const int x = std::min(std::max(ex0 + ex, 0), m_width - 1);
+        out[ex] = x >= d ? static_cast<uint8_t>(std::abs(l[x] - r[x - d])) : 255;
+      }
+    }
+
+    // Block sums from the integral image of the differences
+    const size_t istride = ew + 1;
+    for (int ey = 0; ey < eh; ey++) {
+      const uint8_t* row = &m_differences[static_cast<size_t>(ey)*ew];
+      const uint32_t* above = &m_integral[ey*istride];
+      uint32_t* integral = &m_integral[(ey + 1)*istride];
+      uint32_t sum = 0;
+      for (int ex = 0; ex < ew; ex++) {
+        sum += row[ex];
+        integral[ex + 1] = above[ex + 1] + sum;
+      }
+    }
+    uint16_t* costs = &m_costs[di*pixels];
+    const int block = m_blockSize;
+    for (int y = 0; y < h; y++) {
+      const uint32_t* top = &m_integral[y*istride];
+      const uint32_t* bottom = &m_integral[(y + block)*istride];
+      for (int x = 0; x < w; x++) {
+        costs[y*w + x] = static_cast<uint16_t>(bottom[x + block] - top[x + block] - bottom[x] + top[x]);
+      }
+    }
+  }
+
+  int valid = 0;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      const size_t pixel = static_cast<size_t>(y)*w + x;
+      int best = 0;
+      for (int di = 1; di < disparities; di++) {
+        if (m_costs[di*pixels + pixel] < m_costs[best*pixels + pixel]) {
+          best = di;
+        }
+      }
+      // The minimum must be inside the searched range, and unique
+      if (best == 0 || best == disparities - 1) {
+        continue;
+      }
+      const int c = m_costs[best*pixels + pixel];
+      int second = INT32_MAX;
+      for (int di = 0; di < disparities; di++) {
+        if (di < best - 1 || di > best + 1) {
+          second = std::min(second, static_cast<int>(m_costs[di*pixels + pixel]));
+        }
+      }
+      if (second != INT32_MAX && c*100 >= second*(100 - UNIQUENESS)) {
+        continue;
+      }
+      // Parabola through the costs around the minimum
+      const int cm = m_costs[(best - 1)*pixels + pixel];
+      const int cp = m_costs[(best + 1)*pixels + pixel];
+      const int curvature = cm - 2*c + cp;
+      const float offset = curvature > 0 ? 0.5f*(cm - cp)/curvature : 0.0f;
+      const float disparity = minDisparity + best + offset;
+      if (disparity <= 0.0f) {
+        continue;
+      }
+      const float z = bf/disparity;
+      if (z < region.minDepth || z > region.maxDepth) {
+        continue;
+      }
+      depth[static_cast<size_t>(y0 - region.y + y)*region.width + (x0 - region.x + x)] = z;
+      valid++;
+    }
+  }
+  return valid;
+}
+
+// ImageCodecImplementation
+
+namespace {
+
+// Header of an encoded pair: magic, version, flags, sequence number, width, height and the sizes
+// of the two encoded planes, little-endian
+const uint32_t CODEC_MAGIC = 0x4352494c; // "LIRC"
+const uint32_t CODEC_VERSION = 1;
+const uint32_t CODEC_KEYFRAME = 1;
+const size_t CODEC_HEADER_SIZE = 24;
+
+void put16(uint8_t* p, uint32_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void put32(uint8_t* p, uint32_t value) {
+  put16(p, value);
+  put16(p + 2, value >> 16);
+}
+
+uint32_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+uint32_t get32(const uint8_t* p) { return get16(p) | (get16(p + 2) << 16); }
+
+size_t planeBlocks(int width, int height) {
+  const int blockSize = ImageCodecImplementation::BLOCK_SIZE;
+  return (static_cast<size_t>(width)*height + blockSize - 1)/blockSize;
+}
+
+// An encoded plane is the mode of each row, the bit width of each block in 4 bits, then the bit
+// planes of each block, most significant first, as 16-bit masks
+size_t planeHeaderSize(int height, size_t blocks) { return height + (blocks + 1)/2; }
+
+struct BitTables {
+  uint8_t widths[256];  // The number of bits needed by each value
+  uint64_t spread[256]; // Bit i of each value moved to the lowest bit of byte i
+  BitTables() {
+    for (int value = 0; value < 256; value++) {
+      int bits = 0;
+      while (value >> bits) {
+        bits++;
+      }
+      widths[value] = static_cast<uint8_t>(bits);
+      spread[value] = 0;
+      for (int i = 0; i < 8; i++) {
+        spread[value] |= static_cast<uint64_t>((value >> i) & 1) << (8*i);
+      }
+    }
+  }
+};
+
+const BitTables& bitTables() {
+  static const BitTables tables;
+  return tables;
+}
+
+// Maps residuals 0, -1, 1, -2, ... to 0, 1, 2, 3, ... so that small residuals need few bits
+inline uint8_t zigzag(uint8_t r) { return static_cast<uint8_t>((r << 1) ^ (0 - (r >> 7))); }
+inline uint8_t unzigzag(uint8_t z) { return static_cast<uint8_t>((z >> 1) ^ (0 - (z & 1))); }
+
+#if LEAP_CPP_SSE2
+inline __m128i zigzag(__m128i r) {
+  return _mm_xor_si128(_mm_add_epi8(r, r), _mm_cmpgt_epi8(_mm_setzero_si128(), r));
+}
+
+inline __m128i unzigzag(__m128i z) {
+  const __m128i half = _mm_and_si128(_mm_srli_epi16(z, 1), _mm_set1_epi8(0x7f));
+  return _mm_xor_si128(half, _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi8(1))));
+}
+#endif
+
+// Writes the zigzag residuals of a row predicted from a reference row, optionally through the
+// differences of neighbors
+void rowResiduals(const uint8_t* row, const uint8_t* reference, bool horizontal, int width, uint8_t* out) {
+  int x = 0;
+#if LEAP_CPP_SSE2
+  __m128i previous = _mm_setzero_si128();
+  for (; x + 16 <= width; x += 16) {
+    const __m128i d = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference + x)));
+    __m128i r = d;
+    if (horizontal) {
+      r = _mm_sub_epi8(d, _mm_or_si128(_mm_slli_si128(d, 1), _mm_srli_si128(previous, 15)));
+      previous = d;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), zigzag(r));
+  }
+#endif
+  uint8_t left = x > 0 && horizontal ? static_cast<uint8_t>(row[x - 1] - reference[x - 1]) : 0;
+  for (; x < width; x++) {
+    const uint8_t d = static_cast<uint8_t>(row[x] - reference[x]);
+    out[x] = zigzag(static_cast<uint8_t>(d - left));
+    if (horizontal) {
+      left = d;
+    }
+  }
+}
+
+// Estimates the sums of the zigzag residuals of a row for each of the references, directly
+// (costs[2*i]) and through the differences of neighbors (costs[2*i + 1]), in one pass over the
+// row. The vectorized pass only samples every other 16 pixels of wide rows.
+void rowCosts(const uint8_t* row, const uint8_t* const* references, int count, int width, uint32_t* costs) {
+  int tail = 0;
+  std::fill(costs, costs + 2*count, 0);
+#if LEAP_CPP_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums[ImageCodecImplementation::NUM_REFERENCES];
+  for (int i = 0; i < count; i++) {
+    sums[i] = zero;
+  }
+  tail = width & ~15;
+  const int stride = width >= 64 ? 32 : 16;
+  for (int x = 0; x < tail; x += stride) {
+    const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+    const __m128i leftPixels = x > 0 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1)) : _mm_slli_si128(pixels, 1);
+    for (int i = 0; i < count; i++) {
+      const uint8_t* reference = references[i] + x;
+      const __m128i referencePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference));
+      const __m128i d = _mm_sub_epi8(pixels, referencePixels);
+      const __m128i left = _mm_sub_epi8(leftPixels, x > 0 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference - 1))
+                                                          : _mm_slli_si128(referencePixels, 1));
+      // Direct sums in the low 32 bits of each half, neighbor differences in the high 32 bits
+      sums[i] = _mm_add_epi32(sums[i], _mm_or_si128(_mm_sad_epu8(zigzag(d), zero),
+                                                     _mm_slli_epi64(_mm_sad_epu8(zigzag(_mm_sub_epi8(d, left)), zero), 32)));
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    const __m128i total = _mm_add_epi32(sums[i], _mm_srli_si128(sums[i], 8));
+    costs[2*i] = static_cast<uint32_t>(_mm_cvtsi128_si32(total));
+    costs[2*i + 1] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(total, 4)));
+  }
+#endif
+  for (int i = 0; i < count; i++) {
+    uint8_t left = tail > 0 ? static_cast<uint8_t>(row[tail - 1] - references[i][tail - 1]) : 0;
+    for (int x = tail; x < width; x++) {
+      const uint8_t d = static_cast<uint8_t>(row[x] - references[i][x]);
+      costs[2*i] += zigzag(d);
+      costs[2*i + 1] += zigzag(static_cast<uint8_t>(d - left));
+      left = d;
+    }
+  }
+}
+
+// Inverse of rowResiduals(): turns the residuals of a row, already unzigzagged, into pixels
+void reconstructRow(uint8_t* row, const uint8_t* reference, bool horizontal, int width) {
+  int x = 0;
+  uint8_t left = 0;
+#if LEAP_CPP_SSE2
+  __m128i carry = _mm_setzero_si128();
+  for (; x + 16 <= width; x += 16) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+    if (horizontal) {
+      // Prefix sum of the differences, plus the last difference of the previous 16 pixels
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 1));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 2));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+      d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+      d = _mm_add_epi8(d, carry);
+      const __m128i high = _mm_shufflehi_epi16(_mm_unpackhi_epi8(d, d), 0xff);
+      carry = _mm_unpackhi_epi64(high, high);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x),
+                     _mm_add_epi8(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference + x))));
+  }
+  left = static_cast<uint8_t>(_mm_cvtsi128_si32(carry));
+#endif
+  for (; x < width; x++) {
+    const uint8_t d = horizontal ? static_cast<uint8_t>(row[x] + left) : row[x];
+    left = d;
+    row[x] = static_cast<uint8_t>(d + reference[x]);
+  }
+}
+
+} // namespace
+
+size_t ImageCodecImplementation::maxEncodedSize(int width, int height) {
+  if (width <= 0 || height <= 0) {
+    return 0;
+  }
+  const size_t blocks = planeBlocks(width, height);
+  return CODEC_HEADER_SIZE + 2*(planeHeaderSize(height, blocks) + blocks*BLOCK_SIZE);
+}
+
+uint8_t* ImageCodecImplementation::encodePlane(const uint8_t* pixels, const uint8_t* previous, const uint8_t* leftImage,
+                                               int width, int height, uint8_t* out, const uint8_t* end) {
+  const size_t blocks = planeBlocks(width, height);
+  if (static_cast<size_t>(end - out) < planeHeaderSize(height, blocks)) {
+    return nullptr;
+  }
+  uint8_t* modes = out;
+  uint8_t* widths = modes + height;
+  uint8_t* packed = widths + (blocks + 1)/2;
+  std::fill(widths, packed, 0);
+
+  // Pick the prediction that leaves the smallest residuals in each row
+  const size_t pixelCount = static_cast<size_t>(width)*height;
+  m_residuals.resize(blocks*BLOCK_SIZE);
+  std::fill(m_residuals.begin() + pixelCount, m_residuals.end(), 0);
+  for (int y = 0; y < height; y++) {
+    const size_t offset = static_cast<size_t>(y)*width;
+    const uint8_t* references[NUM_REFERENCES];
+    uint8_t candidates[NUM_REFERENCES];
+    int count = 0;
+    references[count] = m_zeros.data();
+    candidates[count++] = REFERENCE_ZERO;
+    if (y > 0) {
+      references[count] = pixels + offset - width;
+      candidates[count++] = REFERENCE_ABOVE;
+    }
+    if (previous) {
+      references[count] = previous + offset;
+      candidates[count++] = REFERENCE_PREVIOUS;
+    }
+    if (leftImage) {
+      references[count] = leftImage + offset;
+      candidates[count++] = REFERENCE_LEFT_IMAGE;
+    }
+    uint32_t costs[2*NUM_REFERENCES];
+    rowCosts(pixels + offset, references, count, width, costs);
+    int best = 0;
+    for (int i = 1; i < 2*count; i++) {
+      if (costs[i] < costs[best]) {
+        best = i;
+      }
+    }
+    const bool horizontal = (best & 1) != 0;
+    modes[y] = static_cast<uint8_t>(candidates[best/2] | (horizontal ? MODE_HORIZONTAL : 0));
+    rowResiduals(pixels + offset, references[best/2], horizontal, width, m_residuals.data() + offset);
+  }
+
+  // Pack each block with the bits of its largest residual
+  const BitTables& tables = bitTables();
+  const uint8_t* residuals = m_residuals.data();
+  for (size_t block = 0; block < blocks; block++, residuals += BLOCK_SIZE) {
+#if LEAP_CPP_SSE2
+    const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(residuals));
+    __m128i any = _mm_or_si128(values, _mm_srli_si128(values, 8));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 4));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 2));
+    any = _mm_or_si128(any, _mm_srli_si128(any, 1));
+    const int bits = tables.widths[_mm_cvtsi128_si32(any) & 0xff];
+#else
+    uint8_t any = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+      any |= residuals[i];
+    }
+    const int bits = tables.widths[any];
+#endif
+    if (end - packed < 2*bits) {
+      return nullptr;
+    }
+    widths[block/2] |= static_cast<uint8_t>(bits << 4*(block & 1));
+#if LEAP_CPP_SSE2
+    // Move the top bit to bit 7 of each byte; the movemask of each doubling is the next bit plane.
+    // All 8 planes are gathered and stored at once, which avoids a branch per plane.
+    __m128i plane = _mm_sll_epi16(values, _mm_cvtsi32_si128(8 - bits));
+    __m128i planes = _mm_cvtsi32_si128(_mm_movemask_epi8(plane));
+    plane = _mm_add_epi8(plane, plane);
+    planes = _mm_insert_epi16(planes, _mm_movemask_epi8(plane), 1);
+    plane = _mm_add_epi8(plane, plane);
+    planes = _mm_insert_epi16(planes, _mm_movemask_epi8(plane), 2);
+    plane = _mm_add_epi8(plane, plane);
+    planes = _mm_insert_epi16(planes, _mm_movemask_epi8(plane), 3);
+    plane = _mm_add_epi8(plane, plane);
+    planes = _mm_insert_epi16(planes, _mm_movemask_epi8(plane), 4);
+    plane = _mm_add_epi8(plane, plane);
+    planes = _mm_insert_epi16(planes, _mm_movemask_epi8(plane), 5);
+    plane = _mm_add_epi8(plane, plane);
+    planes = _mm_insert_epi16(planes, _mm_movemask_epi8(plane), 6);
+    plane = _mm_add_epi8(plane, plane);
+    planes = _mm_insert_epi16(planes, _mm_movemask_epi8(plane), 7);
+    if (end - packed >= 16) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(packed), planes);
+    } else {
+      uint8_t bytes[16];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), planes);
+      std::copy(bytes, bytes + 2*bits, packed);
+    }
+    packed += 2*bits;
+#else
+    for (int bit = bits - 1; bit >= 0; bit--, packed += 2) {
+      uint32_t mask = 0;
+      for (int i = 0; i < BLOCK_SIZE; i++) {
+        mask |= ((residuals[i] >> bit) & 1u) << i;
+      }
+      put16(packed, mask);
+    }
+#endif
+  }
+  return packed;
+}
+
+bool ImageCodecImplementation::decodePlane(const uint8_t* in, size_t size, const uint8_t* previous, const uint8_t* leftImage,
+                                           int width, int height, uint8_t* pixels) {
+  const size_t blocks = planeBlocks(width, height);
+  if (size < planeHeaderSize(height, blocks)) {
+    return false;
+  }
+  const uint8_t* modes = in;
+  const uint8_t* widths = modes + height;
+  const uint8_t* packed = widths + (blocks + 1)/2;
+
+  // Validate the modes and the bit widths up front, so the blocks unpack without checks
+  for (int y = 0; y < height; y++) {
+    const int reference = modes[y] & ~MODE_HORIZONTAL;
+    if (reference >= NUM_REFERENCES || (reference == REFERENCE_ABOVE && y == 0) ||
+        (reference == REFERENCE_PREVIOUS && !previous) || (reference == REFERENCE_LEFT_IMAGE && !leftImage)) {
+      return false;
+    }
+  }
+  size_t packedSize = 0;
+  for (size_t block = 0; block < blocks; block++) {
+    const int bits = (widths[block/2] >> 4*(block & 1)) & 0xf;
+    if (bits > 8) {
+      return false;
+    }
+    packedSize += 2*bits;
+  }
+  if (static_cast<size_t>(in + size - packed) != packedSize) {
+    return false;
+  }
+
+  // Unpack the residuals into the pixels; the last block may only partly fit
+  const BitTables& tables = bitTables();
+  const size_t pixelCount = static_cast<size_t>(width)*height;
+  uint8_t last[BLOCK_SIZE];
+  for (size_t block = 0; block < blocks; block++) {
+    const int bits = (widths[block/2] >> 4*(block & 1)) & 0xf;
+    const size_t offset = block*BLOCK_SIZE;
+    uint8_t* out = offset + BLOCK_SIZE <= pixelCount ? pixels + offset : last;
+#if LEAP_CPP_SSE2
+    __m128i values = _mm_setzero_si128();
+    for (int bit = 0; bit < bits; bit++, packed += 2) {
+      const __m128i plane = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&tables.spread[packed[0]])),
+                                               _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&tables.spread[packed[1]])));
+      values = _mm_add_epi8(_mm_add_epi8(values, values), plane);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), unzigzag(values));
+#else
+    uint8_t values[BLOCK_SIZE] = {};
+    for (int bit = 0; bit < bits; bit++, packed += 2) {
+      const uint32_t mask = get16(packed);
+      for (int i = 0; i < BLOCK_SIZE; i++) {
+        values[i] = static_cast<uint8_t>((values[i] << 1) | ((mask >> i) & 1));
+      }
+    }
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+      out[i] = unzigzag(values[i]);
+    }
+#endif
+    if (out == last) {
+      std::copy(last, last + (pixelCount - offset), pixels + offset);
+    }
+  }
+
+  for (int y = 0; y < height; y++) {
+    const size_t offset = static_cast<size_t>(y)*width;
+    const int reference = modes[y] & ~MODE_HORIZONTAL;
+    const uint8_t* source = reference == REFERENCE_ABOVE ? pixels + offset - width :
+                            reference == REFERENCE_PREVIOUS ? previous + offset :
+                            reference == REFERENCE_LEFT_IMAGE ? leftImage + offset : m_zeros.data();
+    reconstructRow(pixels + offset, source, (modes[y] & MODE_HORIZONTAL) != 0, width);
+  }
+  return true;
+}
+
+size_t ImageCodecImplementation::encode(const Image& left, const Image& right, void* buffer, size_t bufferSize) {
+  if (!left.isValid() || !right.isValid() || left.bytesPerPixel() != 1 || right.bytesPerPixel() != 1 ||
+      left.width() != right.width() || left.height() != right.height() || !left.data() || !right.data()) {
+    return 0;
+  }
+  return encode(left.data(), right.data(), left.width(), left.height(), buffer, bufferSize);
+}
+
+size_t ImageCodecImplementation::encode(const unsigned char* left, const unsigned char* right, int width, int height,
+                                        void* buffer, size_t bufferSize) {
+  if (!left || !right || !buffer || width <= 0 || height <= 0 || width > 0xffff || height > 0xffff ||
+      bufferSize < CODEC_HEADER_SIZE) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  StreamState& stream = m_encoder;
+  const bool keyframe = !stream.valid || stream.width != width || stream.height != height ||
+                        stream.sinceKeyframe >= m_keyframeInterval;
+  m_zeros.resize(std::max(m_zeros.size(), static_cast<size_t>(width)), 0);
+
+  uint8_t* out = static_cast<uint8_t*>(buffer);
+  const uint8_t* end = out + bufferSize;
+  uint8_t* leftEnd = encodePlane(left, keyframe ? nullptr : stream.previous[0].data(), nullptr, width, height,
+                                 out + CODEC_HEADER_SIZE, end);
+  uint8_t* rightEnd = leftEnd ? encodePlane(right, keyframe ? nullptr : stream.previous[1].data(), left, width, height,
+                                            leftEnd, end) : nullptr;
+  if (!rightEnd) {
+    return 0;
+  }
+
+  const uint32_t sequence = stream.sequence + 1;
+  put32(out, CODEC_MAGIC);
+  put16(out + 4, CODEC_VERSION);
+  put16(out + 6, keyframe ? CODEC_KEYFRAME : 0);
+  put32(out + 8, sequence);
+  put16(out + 12, static_cast<uint32_t>(width));
+  put16(out + 14, static_cast<uint32_t>(height));
+  put32(out + 16, static_cast<uint32_t>(leftEnd - out - CODEC_HEADER_SIZE));
+  put32(out + 20, static_cast<uint32_t>(rightEnd - leftEnd));
+
+  const size_t pixelCount = static_cast<size_t>(width)*height;
+  stream.previous[0].assign(left, left + pixelCount);
+  stream.previous[1].assign(right, right + pixelCount);
+  stream.valid = true;
+  stream.sequence = sequence;
+  stream.width = width;
+  stream.height = height;
+  stream.sinceKeyframe = keyframe ? 1 : stream.sinceKeyframe + 1;
+  return static_cast<size_t>(rightEnd - out);
+}
+
+bool ImageCodecImplementation::frameInfo(const void* data, size_t size, int* width, int* height, bool* isKeyframe) {
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  if (!in || size < CODEC_HEADER_SIZE || get32(in) != CODEC_MAGIC || get16(in + 4) != CODEC_VERSION ||
+      get16(in + 12) == 0 || get16(in + 14) == 0) {
+    return false;
+  }
+  if (width) {
+    *width = static_cast<int>(get16(in + 12));
+  }
+  if (height) {
+    *height = static_cast<int>(get16(in + 14));
+  }
+  if (isKeyframe) {
+    *isKeyframe = (get16(in + 6) & CODEC_KEYFRAME) != 0;
+  }
+  return true;
+}
+
+bool ImageCodecImplementation::decode(const void* data, size_t size, unsigned char* left, unsigned char* right) {
+  int width = 0, height = 0;
+  bool keyframe = false;
+  if (!left || !right || !frameInfo(data, size, &width, &height, &keyframe)) {
+    return false;
+  }
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  const uint32_t sequence = get32(in + 8);
+  const size_t leftSize = get32(in + 16);
+  const size_t rightSize = get32(in + 20);
+  if (leftSize > size - CODEC_HEADER_SIZE || rightSize > size - CODEC_HEADER_SIZE - leftSize) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  StreamState& stream = m_decoder;
+  if (!keyframe && (!stream.valid || stream.width != width || stream.height != height || sequence != stream.sequence + 1)) {
+    return false;
+  }
+  m_zeros.resize(std::max(m_zeros.size(), static_cast<size_t>(width)), 0);
+  const uint8_t* leftIn = in + CODEC_HEADER_SIZE;
+  if (!decodePlane(leftIn, leftSize, keyframe ? nullptr : stream.previous[0].data(), nullptr, width, height, left) ||
+      !decodePlane(leftIn + leftSize, rightSize, keyframe ? nullptr : stream.previous[1].data(), left, width, height, right)) {
+    stream.valid = false;
+    return false;
+  }
+
+  const size_t pixelCount = static_cast<size_t>(width)*height;
+  stream.previous[0].assign(left, left + pixelCount);
+  stream.previous[1].assign(right, right + pixelCount);
+  stream.valid = true;
+  stream.sequence = sequence;
+  stream.width = width;
+  stream.height = height;
+  return true;
+}
+
+// HandPresence
+
+void HandPresence::collect(const LEAP_TRACKING_EVENT& tracking_event, std::vector<HandPresence>& hands) {
+  hands.clear();
+  for (uint32_t i = 0; i < tracking_event.nHands; i++) {
+    const LEAP_HAND& hand = tracking_event.pHands[i];
+    uint8_t extended = 0;
+    for (int d = 0; d < 5; d++) {
+      extended |= hand.digits[d].is_extended ? static_cast<uint8_t>(1 << d) : 0;
+    }
+    hands.push_back(HandPresence{static_cast<int32_t>(hand.id), hand.type, extended});
+  }
+  std::sort(hands.begin(), hands.end(), [](const HandPresence& a, const HandPresence& b) { return a.id < b.id; });
+}
+
+void HandPresence::diff(const std::vector<HandPresence>& previous, const std::vector<HandPresence>& current,
+                        std::vector<HandTransition>& transitions) {
+  transitions.clear();
+  auto prev = previous.begin();
+  auto cur = current.begin();
+  while (prev != previous.end() || cur != current.end()) {
+    if (cur == current.end() || (prev != previous.end() && prev->id < cur->id)) {
+      transitions.push_back(HandTransition{prev->id, HandTransition::TYPE_LOST, 0, prev->extendedFingers});
+      ++prev;
+    } else if (prev == previous.end() || cur->id < prev->id) {
+      transitions.push_back(HandTransition{cur->id, HandTransition::TYPE_FOUND, cur->extendedFingers, 0});
+      ++cur;
+    } else {
+      if (prev->type != cur->type || prev->extendedFingers != cur->extendedFingers) {
+        transitions.push_back(HandTransition{cur->id, HandTransition::TYPE_CHANGED, cur->extendedFingers, prev->extendedFingers});
+      }
+      ++prev;
+      ++cur;
+    }
+  }
+}
+
 // BoneImplementation
 
 LEAP_BONE BoneImplementation::s_invalid;
 
 // FingerImplementation
 
-FingerImplementation::FingerImplementation(const std::shared_ptr<HandImplementation>& handImpl, const LEAP_DIGIT& digit) :
+FingerImplementation::FingerImplementation(const std::shared_ptr<HandImplementation>& handImpl, const LEAP_DIGIT& digit, int digitIndex) :
   m_weakHandImpl(handImpl), m_digit(digit), m_id((handImpl ? handImpl->id()*10 : 0) + m_digit.finger_id), m_name([this]{
     std::ostringstream oss;
     oss << "Finger Id:" << m_id;
     return oss.str();
-  }()), m_isLeftHand(handImpl ? handImpl->isLeft() : false) {}
+  }()), m_isLeftHand(handImpl ? handImpl->isLeft() : false), m_digitIndex(digitIndex),
+  m_stageData(handImpl ? handImpl->stageData() : HandStageData()) {}
 Frame FingerImplementation::frame() const { auto handImpl = m_weakHandImpl.lock(); return handImpl ? handImpl->frame() : Frame::invalid(); }
 Hand FingerImplementation::hand() const { auto handImpl = m_weakHandImpl.lock(); return handImpl ? Hand(handImpl.get()) : Hand::invalid(); }
 float FingerImplementation::timeVisible() const { auto handImpl = m_weakHandImpl.lock(); return handImpl ? handImpl->timeVisible() : 0.0f; }
@@ -61,52 +3051,378 @@ LEAP_DIGIT FingerImplementation::s_invalid{0};
 
 LEAP_HAND HandImplementation::s_invalid{static_cast<uint32_t>(-1)};
 
-// DeviceImplementation
+// GestureEngine
+
+int32_t GestureEngine::add(const GestureDefinition& definition) {
+  CompiledGesture gesture;
+  // A gesture whose start threshold is below its end threshold is active while the signal is
+  // low; negating the signal and both thresholds turns it into the usual "high" test
+  gesture.sign = definition.startThreshold >= definition.endThreshold ? 1.0f : -1.0f;
+  gesture.signal = definition.signal;
+  gesture.discrete = definition.type == GestureDefinition::TYPE_DISCRETE;
+  gesture.start = gesture.sign*definition.startThreshold;
+  gesture.end = gesture.sign*definition.endThreshold;
+  gesture.minDuration = std::max<int64_t>(definition.minDuration, 0);
+  gesture.maxDuration = std::max<int64_t>(definition.maxDuration, 0);
+
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  gesture.id = m_nextId++;
+  m_gestures.push_back(gesture);
+  return gesture.id;
+}
+
+bool GestureEngine::remove(int32_t gestureId) {
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  for (size_t i = 0; i < m_gestures.size(); i++) {
+    if (m_gestures[i].id == gestureId) {
+      m_gestures.erase(m_gestures.begin() + i);
+      m_hands.forEach([i](int32_t, HandGestures& hand) {
+        if (i < hand.states.size()) {
+          hand.states.erase(hand.states.begin() + i);
+        }
+      });
+      return true;
+    }
+  }
+  return false;
+}
 
-float DeviceImplementation::distanceToBoundary(const Vector& position) const {
-  const Vector pos = position;
-  const Vector center(0, 0, 0);
+float handSignal(GestureDefinition::Signal signal, const LEAP_HAND& hand, const JointKinematics* kinematics) {
+  switch (signal) {
+    case GestureDefinition::SIGNAL_PINCH_STRENGTH: return hand.pinch_strength;
+    case GestureDefinition::SIGNAL_GRAB_STRENGTH: return hand.grab_strength;
+    case GestureDefinition::SIGNAL_PINCH_DISTANCE: return hand.pinch_distance;
+    case GestureDefinition::SIGNAL_PALM_SPEED: return Vector(hand.palm.velocity.v).magnitude();
+    case GestureDefinition::SIGNAL_PALM_VELOCITY_X: return hand.palm.velocity.x;
+    case GestureDefinition::SIGNAL_PALM_VELOCITY_Y: return hand.palm.velocity.y;
+    case GestureDefinition::SIGNAL_PALM_VELOCITY_Z: return hand.palm.velocity.z;
+    case GestureDefinition::SIGNAL_INDEX_TIP_VELOCITY_Y:
+      return kinematics ? kinematics->velocity[HandJoints::index(Finger::TYPE_INDEX, Finger::JOINT_TIP)].y : 0.0f;
+    case GestureDefinition::SIGNAL_CONFIDENCE: return hand.confidence;
+    default: return 0.0f;
+  }
+}
+
+void GestureEngine::update(const LEAP_TRACKING_EVENT& tracking_event, const std::vector<JointKinematics>* kinematics,
+                           std::vector<GestureEvent>& events) {
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  const int64_t frameId = tracking_event.info.frame_id;
+  const int64_t timestamp = tracking_event.info.timestamp;
+  auto emit = [&](const CompiledGesture& gesture, int32_t handId, GestureEvent::State state, const GestureState& gestureState) {
+    events.push_back(GestureEvent{gesture.id, handId, state, gestureState.value, timestamp - gestureState.startTime, frameId, timestamp});
+  };
+
+  for (uint32_t h = 0; h < tracking_event.nHands; h++) {
+    const LEAP_HAND& hand = tracking_event.pHands[h];
+    const int32_t handId = static_cast<int32_t>(hand.id);
+    HandGestures* handGestures = m_hands.update(handId, frameId);
+    if (!handGestures) {
+      continue;
+    }
+    handGestures->states.resize(m_gestures.size());
+    const JointKinematics* handKinematics = (kinematics && h < kinematics->size()) ? &(*kinematics)[h] : nullptr;
+
+    for (size_t g = 0; g < m_gestures.size(); g++) {
+      const CompiledGesture& gesture = m_gestures[g];
+      GestureState& state = handGestures->states[g];
+      state.value = handSignal(gesture.signal, hand, handKinematics);
+      const float x = gesture.sign*state.value;
+
+      if (state.phase == PHASE_IDLE) {
+        if (x < gesture.start) {
+          continue;
+        }
+        state.phase = PHASE_PENDING;
+        state.startTime = timestamp;
+      }
+      const int64_t duration = timestamp - state.startTime;
+
+      if (x < gesture.end) {
+        // Released
+        if (state.phase == PHASE_ACTIVE) {
+          emit(gesture, handId, GestureEvent::STATE_STOP, state);
+        } else if (gesture.discrete && state.phase == PHASE_PENDING && duration >= gesture.minDuration &&
+                   (gesture.maxDuration <= 0 || duration <= gesture.maxDuration)) {
+          emit(gesture, handId, GestureEvent::STATE_STOP, state);
+        }
+        state.phase = PHASE_IDLE;
+        continue;
+      }
+      if (state.phase == PHASE_REJECTED) {
+        continue;
+      }
+      if (gesture.maxDuration > 0 && duration > gesture.maxDuration) {
+        if (state.phase == PHASE_ACTIVE) {
+          emit(gesture, handId, GestureEvent::STATE_STOP, state);
+        }
+        state.phase = PHASE_REJECTED;
+        continue;
+      }
+      if (!gesture.discrete) {
+        if (state.phase == PHASE_ACTIVE) {
+          emit(gesture, handId, GestureEvent::STATE_UPDATE, state);
+        } else if (duration >= gesture.minDuration) {
+          state.phase = PHASE_ACTIVE;
+          emit(gesture, handId, GestureEvent::STATE_START, state);
+        }
+      }
+    }
+  }
+
+  // Gestures in progress on a hand that is no longer tracked are stopped
+  m_hands.releaseStale(frameId, [&](int32_t handId, HandGestures& hand) {
+    for (size_t g = 0; g < hand.states.size() && g < m_gestures.size(); g++) {
+      if (hand.states[g].phase == PHASE_ACTIVE) {
+        emit(m_gestures[g], handId, GestureEvent::STATE_STOP, hand.states[g]);
+      }
+    }
+  });
+}
+
+// WindowAggregator
+
+int32_t WindowAggregator::add(const WindowAggregate& aggregate) {
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  Registered registered = {m_nextId++, aggregate};
+  registered.aggregate.window = std::max<int64_t>(registered.aggregate.window, 0);
+  m_indices[registered.id] = m_aggregates.size();
+  m_aggregates.push_back(registered);
+  return registered.id;
+}
+
+bool WindowAggregator::remove(int32_t aggregateId) {
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  const auto found = m_indices.find(aggregateId);
+  if (found == m_indices.end()) {
+    return false;
+  }
+  const size_t i = found->second;
+  m_indices.erase(found);
+  m_aggregates.erase(m_aggregates.begin() + i);
+  for (size_t j = i; j < m_aggregates.size(); j++) {
+    m_indices[m_aggregates[j].id] = j;
+  }
+  m_hands.forEach([i](int32_t, HandAggregates& hand) {
+    if (i < hand.states.size()) {
+      hand.states.erase(hand.states.begin() + i);
+    }
+  });
+  return true;
+}
 
-  if (!isValid() || (pos - center).magnitudeSquared() > range()*range()) {
+float WindowAggregator::value(int32_t aggregateId, int32_t handId) {
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  const HandAggregates* hand = m_hands.find(handId);
+  const auto found = m_indices.find(aggregateId);
+  if (!hand || found == m_indices.end() || found->second >= hand->states.size()) {
     return 0.0f;
   }
+  return hand->states[found->second].value(m_aggregates[found->second].aggregate);
+}
+
+void WindowAggregator::update(const LEAP_TRACKING_EVENT& tracking_event, const std::vector<JointKinematics>* kinematics) {
+  std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+  for (uint32_t h = 0; h < tracking_event.nHands; h++) {
+    const LEAP_HAND& hand = tracking_event.pHands[h];
+    HandAggregates* aggregates = m_hands.update(static_cast<int32_t>(hand.id), tracking_event.info.frame_id);
+    if (!aggregates) {
+      continue;
+    }
+    aggregates->states.resize(m_aggregates.size());
+    const JointKinematics* handKinematics = (kinematics && h < kinematics->size()) ? &(*kinematics)[h] : nullptr;
+    for (size_t i = 0; i < m_aggregates.size(); i++) {
+      const WindowAggregate& aggregate = m_aggregates[i].aggregate;
+      aggregates->states[i].update(aggregate, tracking_event.info.timestamp, handSignal(aggregate.signal, hand, handKinematics));
+    }
+  }
+  m_hands.releaseStale(tracking_event.info.frame_id);
+}
+
+void WindowAggregator::State::update(const WindowAggregate& aggregate, int64_t timestamp, float value) {
+  const int64_t oldest = timestamp - aggregate.window;
+  switch (aggregate.kind) {
+    case WindowAggregate::KIND_MIN:
+    case WindowAggregate::KIND_MAX: {
+      // Monotonic deque: drop samples that can never be the extreme again, then expired ones
+      const bool isMax = aggregate.kind == WindowAggregate::KIND_MAX;
+      while (!samples.empty() && (isMax ? samples.back().value <= value : samples.back().value >= value)) {
+        samples.pop_back();
+      }
+      samples.push_back(Sample{timestamp, value});
+      while (samples.front().timestamp < oldest) {
+        samples.pop_front();
+      }
+      break;
+    }
+    case WindowAggregate::KIND_SUM:
+    case WindowAggregate::KIND_MEAN:
+      samples.push_back(Sample{timestamp, value});
+      sum += value;
+      while (samples.front().timestamp < oldest) {
+        sum -= samples.front().value;
+        samples.pop_front();
+      }
+      if (samples.size() == 1) {
+        sum = samples.front().value; // Drop accumulated rounding error whenever the window drains
+      }
+      break;
+    case WindowAggregate::KIND_EWMA:
+      if (!initialized || aggregate.window <= 0) {
+        ewma = value;
+      } else if (timestamp > this->timestamp) {
+        const float alpha = 1.0f - std::exp(-static_cast<float>(timestamp - this->timestamp)/static_cast<float>(aggregate.window));
+        ewma += alpha*(value - ewma);
+      }
+      break;
+    case WindowAggregate::KIND_HELD_DURATION:
+      if (value < aggregate.threshold) {
+        heldSince = -1;
+      } else if (heldSince < 0) {
+        heldSince = timestamp;
+      }
+      break;
+  }
+  this->timestamp = timestamp;
+  initialized = true;
+}
+
+float WindowAggregator::State::value(const WindowAggregate& aggregate) const {
+  switch (aggregate.kind) {
+    case WindowAggregate::KIND_MIN:
+    case WindowAggregate::KIND_MAX: return samples.empty() ? 0.0f : samples.front().value;
+    case WindowAggregate::KIND_SUM: return static_cast<float>(sum);
+    case WindowAggregate::KIND_MEAN: return samples.empty() ? 0.0f : static_cast<float>(sum/static_cast<double>(samples.size()));
+    case WindowAggregate::KIND_EWMA: return ewma;
+    case WindowAggregate::KIND_HELD_DURATION: return heldSince < 0 ? 0.0f : static_cast<float>(static_cast<double>(timestamp - heldSince)*1e-6);
+    default: return 0.0f;
+  }
+}
+
+// ControllerImplementation
+
+std::shared_ptr<std::vector<JointKinematics>> ControllerImplementation::updateKinematics(const LEAP_TRACKING_EVENT& tracking_event) {
+  const float velocityTimeConstant = m_velocityTimeConstant;
+  const float accelerationTimeConstant = m_accelerationTimeConstant;
+  auto kinematics = std::make_shared<std::vector<JointKinematics>>(tracking_event.nHands);
+  for (uint32_t i = 0; i < tracking_event.nHands; i++) {
+    const LEAP_HAND& hand = tracking_event.pHands[i];
+    if (JointKinematicsState* state = m_kinematicsSlots.update(static_cast<int32_t>(hand.id), tracking_event.info.frame_id)) {
+      state->update(hand, tracking_event.info.timestamp, velocityTimeConstant, accelerationTimeConstant);
+      (*kinematics)[i] = state->estimate;
+    }
+  }
+  m_kinematicsSlots.releaseStale(tracking_event.info.frame_id);
+  return kinematics;
+}
 
-  const auto closestPointOnBoundary = [this, &position] {
-    const float tanH = std::tan(horizontalViewAngle()*0.5f);
-    const float tanV = std::tan(verticalViewAngle()*0.5f);
-
-    // Check horizontal walls
-    float m = 1.0f / tanH;
-    const float x = (m * position.y + fabs(position.x)) / (m*m + 1.0f);
-    float y = m * x;
-    Vector horiz(x, y, position.z);
-    if (position.x < 0) { horiz.x *= -1; }
-
-    // Check vertical walls
-    m = 1.0f / tanV;
-    const float z = (m * position.y + std::fabs(position.z)) / (m*m + 1.0f);
-    y = m * z;
-    Vector vert(position.x, y, z);
-    if (position.z < 0) { vert.z *= -1; }
-
-    // Check squared distances
-    const Vector dirNorm = position.normalized();
-    const double distSqTop = (dirNorm*range() - position).magnitudeSquared();
-    const double distSqHoriz = (horiz - position).magnitudeSquared();
-    const double distSqVert = (vert - position).magnitudeSquared();
-
-    // Return the closest one
-    if (distSqTop < distSqHoriz && distSqTop < distSqVert) {
-      return dirNorm * range();
-    } else if (distSqHoriz < distSqVert) {
-      return horiz;
+std::shared_ptr<std::vector<SmoothedJoints>> ControllerImplementation::updateSmoothing(const LEAP_TRACKING_EVENT& tracking_event) {
+  SmoothingParameters params;
+  {
+    std::lock_guard<decltype(m_smoothingMutex)> lk(m_smoothingMutex);
+    params = m_smoothingParameters;
+  }
+  if (params.filter == Controller::SMOOTHING_NONE) {
+    m_smoothingSlots.clear();
+    return nullptr;
+  }
+  auto smoothed = std::make_shared<std::vector<SmoothedJoints>>(tracking_event.nHands);
+  for (uint32_t i = 0; i < tracking_event.nHands; i++) {
+    const LEAP_HAND& hand = tracking_event.pHands[i];
+    if (JointSmoothingState* state = m_smoothingSlots.update(static_cast<int32_t>(hand.id), tracking_event.info.frame_id)) {
+      state->update(hand, tracking_event.info.timestamp, params, (*smoothed)[i]);
     } else {
-      return vert;
+      HandJoints::positions(hand, (*smoothed)[i].position);
+    }
+  }
+  m_smoothingSlots.releaseStale(tracking_event.info.frame_id);
+  return smoothed;
+}
+
+// DeviceImplementation
+
+void DeviceImplementation::distanceToBoundary(const Vector* positions, float* distances, size_t count) const {
+  if (!isValid()) {
+    std::fill(distances, distances + count, 0.0f);
+    return;
+  }
+  const BoundaryGeometry& g = m_boundary;
+
+  // For each point, the nearest point on the boundary is the closest of: the projection onto the
+  // horizontal wall, the projection onto the vertical wall, and the point on the roof along the
+  // same ray. The walls are symmetric, so the projections are computed on |x| and |z|.
+  size_t i = 0;
+#if LEAP_CPP_SSE2
+  const __m128 range = _mm_set1_ps(g.range);
+  const __m128 rangeSq = _mm_set1_ps(g.rangeSq);
+  const __m128 slopeH = _mm_set1_ps(g.slopeH);
+  const __m128 slopeV = _mm_set1_ps(g.slopeV);
+  const __m128 invDenH = _mm_set1_ps(g.invDenH);
+  const __m128 invDenV = _mm_set1_ps(g.invDenV);
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  for (; i + 4 <= count; i += 4) {
+    const Vector* p = positions + i;
+    const __m128 x = _mm_and_ps(_mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x), absMask);
+    const __m128 y = _mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y);
+    const __m128 z = _mm_and_ps(_mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z), absMask);
+    const __m128 magSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+
+    const __m128 hx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(slopeH, y), x), invDenH);
+    const __m128 hdx = _mm_sub_ps(hx, x);
+    const __m128 hdy = _mm_sub_ps(_mm_mul_ps(slopeH, hx), y);
+    const __m128 distSqHoriz = _mm_add_ps(_mm_mul_ps(hdx, hdx), _mm_mul_ps(hdy, hdy));
+
+    const __m128 vz = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(slopeV, y), z), invDenV);
+    const __m128 vdz = _mm_sub_ps(vz, z);
+    const __m128 vdy = _mm_sub_ps(_mm_mul_ps(slopeV, vz), y);
+    const __m128 distSqVert = _mm_add_ps(_mm_mul_ps(vdz, vdz), _mm_mul_ps(vdy, vdy));
+
+    const __m128 distTop = _mm_sub_ps(range, _mm_sqrt_ps(magSq));
+    const __m128 distSqTop = _mm_mul_ps(distTop, distTop);
+
+    const __m128 distance = _mm_sqrt_ps(_mm_min_ps(distSqTop, _mm_min_ps(distSqHoriz, distSqVert)));
+    _mm_storeu_ps(distances + i, _mm_and_ps(distance, _mm_cmple_ps(magSq, rangeSq)));
+  }
+#endif
+  for (; i < count; i++) {
+    const float x = std::fabs(positions[i].x);
+    const float y = positions[i].y;
+    const float z = std::fabs(positions[i].z);
+    const float magSq = x*x + y*y + z*z;
+    if (magSq > g.rangeSq) {
+      distances[i] = 0.0f;
+      continue;
     }
-  };
 
-  const auto point = closestPointOnBoundary();
-  return (pos - point).magnitude();
+    const float hx = (g.slopeH*y + x)*g.invDenH;
+    const float distSqHoriz = (hx - x)*(hx - x) + (g.slopeH*hx - y)*(g.slopeH*hx - y);
+
+    const float vz = (g.slopeV*y + z)*g.invDenV;
+    const float distSqVert = (vz - z)*(vz - z) + (g.slopeV*vz - y)*(g.slopeV*vz - y);
+
+    const float distTop = g.range - std::sqrt(magSq);
+    const float distSqTop = distTop*distTop;
+
+    distances[i] = std::sqrt(std::min(distSqTop, std::min(distSqHoriz, distSqVert)));
+  }
+}
+
+size_t DeviceImplementation::containedInBoundary(const Vector* positions, bool* contained, size_t count) const {
+  if (!isValid()) {
+    std::fill(contained, contained + count, false);
+    return 0;
+  }
+  const BoundaryGeometry& g = m_boundary;
+  size_t numContained = 0;
+  for (size_t i = 0; i < count; i++) {
+    const Vector& p = positions[i];
+    const bool inside = p.y >= 0.0f &&
+                        std::fabs(p.x) <= p.y*g.tanH &&
+                        std::fabs(p.z) <= p.y*g.tanV &&
+                        p.magnitudeSquared() <= g.rangeSq;
+    contained[i] = inside;
+    numContained += inside ? 1 : 0;
+  }
+  return numContained;
 }
 
 }
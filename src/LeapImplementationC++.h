@@ -10,7 +10,9 @@
 #include "LeapC++.h"
 #include "LeapC.h"
 #include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <list>
 #include <map>
 #include <mutex>
 #include <set>
@@ -18,6 +20,11 @@
 #include <future>
 #include <unordered_map>
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define LEAP_CPP_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 namespace Leap {
 
 // ListBaseImplementation
@@ -75,6 +82,71 @@ private:
   std::vector<T> m_Data;
 };
 
+// MapPointListImplementation
+
+// A view of the points and ids of a point mapping. The view keeps the buffer holding them alive,
+// so lists are handed out without copying; append() copies both sides into owned storage.
+class MapPointListImplementation : public Interface::Implementation {
+public:
+  static_assert(sizeof(Vector) == sizeof(LEAP_VECTOR), "Map points are viewed as Leap::Vector");
+
+  MapPointListImplementation() = default;
+  MapPointListImplementation(std::vector<Vector> points, std::vector<uint32_t> ids) :
+    m_ownedPoints(std::move(points)),
+    m_ownedIds(std::move(ids)),
+    m_points(m_ownedPoints.data()),
+    m_ids(m_ownedIds.data()),
+    m_count(m_ownedPoints.size()) {}
+  explicit MapPointListImplementation(const std::shared_ptr<const LEAP_POINT_MAPPING>& pointMapping) :
+    m_owner(pointMapping),
+    m_points(reinterpret_cast<const Vector*>(pointMapping->pPoints)),
+    m_ids(pointMapping->pIDs),
+    m_count(pointMapping->nPoints) {}
+
+  int count() const { return static_cast<int>(m_count); }
+  bool empty() const { return m_count == 0; }
+  const Vector* points() const { return m_count ? m_points : nullptr; }
+  const uint32_t* ids() const { return m_count ? m_ids : nullptr; }
+
+  MapPoint at(int index) const {
+    const int size = count();
+    if (index >= size || index < -size) {
+      return MapPoint::invalid();
+    }
+    const size_t i = static_cast<size_t>(index >= 0 ? index : size + index);
+    return MapPoint{m_ids[i], m_points[i]};
+  }
+
+  MapPointListImplementation& append(const MapPointListImplementation& rhs) {
+    if (rhs.m_count == 0) {
+      return *this;
+    }
+    std::vector<Vector> points;
+    std::vector<uint32_t> ids;
+    points.reserve(m_count + rhs.m_count);
+    ids.reserve(m_count + rhs.m_count);
+    points.insert(points.end(), m_points, m_points + m_count);
+    points.insert(points.end(), rhs.m_points, rhs.m_points + rhs.m_count);
+    ids.insert(ids.end(), m_ids, m_ids + m_count);
+    ids.insert(ids.end(), rhs.m_ids, rhs.m_ids + rhs.m_count);
+    m_ownedPoints.swap(points);
+    m_ownedIds.swap(ids);
+    m_owner.reset();
+    m_points = m_ownedPoints.data();
+    m_ids = m_ownedIds.data();
+    m_count = m_ownedPoints.size();
+    return *this;
+  }
+
+private:
+  std::shared_ptr<const void> m_owner;
+  std::vector<Vector> m_ownedPoints;
+  std::vector<uint32_t> m_ownedIds;
+  const Vector* m_points = nullptr;
+  const uint32_t* m_ids = nullptr;
+  size_t m_count = 0;
+};
+
 // DeviceImplementation
 
 class DeviceImplementation : public Interface::Implementation {
@@ -98,6 +170,7 @@ public:
       m_device = nullptr;
     } else {
       m_description = "Connected Device: " + m_serial;
+      updateBoundaryGeometry();
     }
   }
   ~DeviceImplementation() {
@@ -107,7 +180,13 @@ public:
   float verticalViewAngle() const { return m_info.v_fov; }
   float range() const { return static_cast<float>(static_cast<double>(m_info.range)/1000.0); }
   float baseline() const { return static_cast<float>(static_cast<double>(m_info.baseline)/1000.0); }
-  float distanceToBoundary(const Vector& position) const;
+  float distanceToBoundary(const Vector& position) const {
+    float distance;
+    distanceToBoundary(&position, &distance, 1);
+    return distance;
+  }
+  void distanceToBoundary(const Vector* positions, float* distances, size_t count) const;
+  size_t containedInBoundary(const Vector* positions, bool* contained, size_t count) const;
   bool isStreaming() const { return (m_info.status & eLeapDeviceStatus_Streaming) == eLeapDeviceStatus_Streaming; }
   bool isSmudged() const { return (m_info.status & eLeapDeviceStatus_Smudged) == eLeapDeviceStatus_Smudged; }
   bool isLightingBad() const { return false; }
@@ -118,8 +197,34 @@ public:
   eLeapDeviceStatus status() const { return static_cast<eLeapDeviceStatus>(m_info.status); }
 
 protected:
+  // The interaction volume is an inverted pyramid capped by a sphere of radius range().
+  // Everything the boundary queries need from LEAP_DEVICE_INFO is derived once, here.
+  struct BoundaryGeometry {
+    float range = 0.0f;
+    float rangeSq = 0.0f;
+    float tanH = 0.0f;    // tan(horizontalViewAngle/2)
+    float tanV = 0.0f;    // tan(verticalViewAngle/2)
+    float slopeH = 0.0f;  // 1/tanH, the slope of the horizontal walls
+    float slopeV = 0.0f;  // 1/tanV, the slope of the vertical walls
+    float invDenH = 0.0f; // 1/(slopeH^2 + 1)
+    float invDenV = 0.0f; // 1/(slopeV^2 + 1)
+  };
+
+  void updateBoundaryGeometry() {
+    BoundaryGeometry& g = m_boundary;
+    g.range = range();
+    g.rangeSq = g.range*g.range;
+    g.tanH = std::tan(horizontalViewAngle()*0.5f);
+    g.tanV = std::tan(verticalViewAngle()*0.5f);
+    g.slopeH = 1.0f/g.tanH;
+    g.slopeV = 1.0f/g.tanV;
+    g.invDenH = 1.0f/(g.slopeH*g.slopeH + 1.0f);
+    g.invDenV = 1.0f/(g.slopeV*g.slopeV + 1.0f);
+  }
+
   LEAP_DEVICE m_device = nullptr;
   LEAP_DEVICE_INFO m_info;
+  BoundaryGeometry m_boundary;
   std::string m_serial;
   std::string m_description = "Invalid Device";
 
@@ -143,33 +248,255 @@ protected:
   FailedDevice::FailureType m_error = FailedDevice::FAIL_UNKNOWN;
 };
 
+// DerivedHandData
+
+// Quantities derived from a LEAP_HAND: the palm and arm frames, and the basis, direction and
+// length of each of the 20 bones (indexed by digit*4 + bone type). With
+// POLICY_EAGER_DERIVED_DATA these are computed for every hand when the frame arrives;
+// otherwise each accessor computes its value on first use and caches it.
+struct DerivedHandData {
+  enum Field : uint32_t {
+    BASIS = (1 << 0),
+    DIRECTION = (1 << 1),
+    ARM_BASIS = (1 << 2),
+    ARM_DIRECTION = (1 << 3),
+    LENGTH = (1 << 4),
+    ALL = BASIS | DIRECTION | ARM_BASIS | ARM_DIRECTION | LENGTH
+  };
+  static const int NUM_BONES = 20;
+
+  Matrix basis;
+  Vector direction;
+  Matrix armBasis;
+  Vector armDirection;
+  Matrix boneBasis[NUM_BONES];
+  Vector boneDirection[NUM_BONES];
+  float boneLength[NUM_BONES];
+
+  static Matrix basisOf(const LEAP_BONE& bone, bool isLeftHand) {
+    const LEAP_QUATERNION& q = bone.rotation;
+    Matrix mat(q.x, q.y, q.z, q.w);
+    if (isLeftHand) {
+      mat.xBasis = -mat.xBasis;
+    }
+    return mat;
+  }
+  static Vector directionOf(const LEAP_BONE& bone) { return (Vector(bone.next_joint.v) - Vector(bone.prev_joint.v)).normalized(); }
+  static float lengthOf(const LEAP_BONE& bone) { return (Vector(bone.next_joint.v) - Vector(bone.prev_joint.v)).magnitude(); }
+  static Vector palmDirectionOf(const LEAP_HAND& hand) { return Vector(hand.palm.direction.v).normalized(); }
+  static Matrix palmBasisOf(const LEAP_HAND& hand) {
+    const Vector palmNormal(hand.palm.normal.v);
+    const Vector direction(palmDirectionOf(hand));
+    const Vector crossed = palmNormal.cross(direction);
+    return Matrix(hand.type == eLeapHandType_Left ? -crossed : crossed, -palmNormal, -direction);
+  }
+
+  // Fills derived[i] from hands[i]
+  static void compute(const LEAP_HAND* hands, size_t count, DerivedHandData* derived);
+};
+
+// JointKinematics
+
+// The joints tracked by the per-hand stages that run as frames arrive: the four joints of each
+// digit (see Finger::Joint), followed by the palm and the wrist.
+struct HandJoints {
+  static const int NUM_JOINTS = 22;
+  static const int PALM = 20;
+  static const int WRIST = 21;
+
+  static int index(int digit, Finger::Joint joint) { return digit*4 + static_cast<int>(joint); }
+  static void positions(const LEAP_HAND& hand, Vector* positions) {
+    for (int d = 0; d < 5; d++) {
+      for (int b = 0; b < 4; b++) {
+        positions[d*4 + b] = hand.digits[d].bones[b].next_joint.v;
+      }
+    }
+    positions[PALM] = hand.palm.position.v;
+    positions[WRIST] = hand.arm.next_joint.v;
+  }
+};
+
+// Fits the similarity transform mapping one set of points onto a corresponding set in the
+// least-squares sense (Horn's closed-form quaternion method). Only running sums are kept, so any
+// number of hands can be added without buffering their joints.
+class MotionAccumulator {
+public:
+  void add(const Vector& from, const Vector& to);
+  void addHand(const LEAP_HAND& from, const LEAP_HAND& to);
+  RigidMotion solve() const;
+
+private:
+  int m_count = 0;
+  double m_sumFrom[3] = {};
+  double m_sumTo[3] = {};
+  double m_cross[3][3] = {}; // sum of from[a]*to[b]
+  double m_normFrom = 0;
+  double m_normTo = 0;
+};
+
+// Collision geometry
+
+struct AxisAlignedBox {
+  Vector min = Vector(FLT_MAX, FLT_MAX, FLT_MAX);
+  Vector max = Vector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+  void add(const Vector& point, float radius = 0) {
+    min = Vector(std::min(min.x, point.x - radius), std::min(min.y, point.y - radius), std::min(min.z, point.z - radius));
+    max = Vector(std::max(max.x, point.x + radius), std::max(max.y, point.y + radius), std::max(max.z, point.z + radius));
+  }
+  void add(const AxisAlignedBox& other) {
+    min = Vector(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z));
+    max = Vector(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z));
+  }
+  bool overlaps(const AxisAlignedBox& other) const {
+    return min.x <= other.max.x && other.min.x <= max.x &&
+           min.y <= other.max.y && other.min.y <= max.y &&
+           min.z <= other.max.z && other.min.z <= max.z;
+  }
+  Vector center() const { return (min + max)*0.5f; }
+};
+
+struct Capsule {
+  Vector a;
+  Vector b;
+  float radius;
+
+  AxisAlignedBox bounds() const {
+    AxisAlignedBox box;
+    box.add(a, radius);
+    box.add(b, radius);
+    return box;
+  }
+};
+
+// The capsules modeling a hand, indexed as HandJoints: the bones of each digit, then the palm
+// (across the knuckles, as for Frame::writeBoneInstances()) and the arm
+struct HandCapsules {
+  static const int NUM_CAPSULES = HandJoints::NUM_JOINTS;
+
+  static void collect(const LEAP_HAND& hand, Capsule* capsules);
+  static AxisAlignedBox bounds(const LEAP_HAND& hand);
+};
+
+// See Hand::poseFeatures()
+void poseFeaturesOf(const LEAP_HAND& hand, PoseFeatures& features);
+
+// Joint velocities (mm/s) and accelerations (mm/s^2) of one hand, indexed as HandJoints
+struct JointKinematics {
+  Vector velocity[HandJoints::NUM_JOINTS];
+  Vector acceleration[HandJoints::NUM_JOINTS];
+};
+
+// Running estimate for one hand id. Velocities and accelerations are finite differences over
+// consecutive frames, each passed through an exponential filter with the given time constant
+// (in seconds; 0 disables filtering).
+struct JointKinematicsState {
+  int64_t timestamp = 0;
+  int samples = 0;
+  Vector position[HandJoints::NUM_JOINTS];
+  JointKinematics estimate;
+
+  void update(const LEAP_HAND& hand, int64_t timestamp, float velocityTimeConstant, float accelerationTimeConstant);
+};
+
+// Filter parameters of the smoothing stage (see Controller::setSmoothingFilter)
+struct SmoothingParameters {
+  Controller::SmoothingFilter filter = Controller::SMOOTHING_NONE;
+  float minCutoff = 1.0f;
+  float beta = 0.01f;
+  float derivativeCutoff = 1.0f;
+  float accelerationNoise = 5000.0f;
+  float measurementNoise = 2.0f;
+};
+
+// Smoothed joint positions (mm) of one hand, indexed as HandJoints
+struct SmoothedJoints {
+  Vector position[HandJoints::NUM_JOINTS];
+};
+
+// Filter state for one hand id. Every joint coordinate is filtered as an independent scalar and
+// the scalars are laid out in one flat array, so the SSE2 path filters four of them at a time.
+struct JointSmoothingState {
+  static const int NUM_LANES = (HandJoints::NUM_JOINTS*3 + 3) & ~3;
+
+  int64_t timestamp = 0;
+  int samples = 0;
+  Controller::SmoothingFilter filter = Controller::SMOOTHING_NONE;
+  float value[NUM_LANES];      // Filtered position
+  float derivative[NUM_LANES]; // One-Euro: filtered speed; Kalman: velocity
+  float covariance[3];         // Kalman: P00, P01, P11, shared by all lanes (see update())
+
+  void update(const LEAP_HAND& hand, int64_t timestamp, const SmoothingParameters& params, SmoothedJoints& smoothed);
+};
+
+// Per-hand results of the tracking stages, owned by the frame and shared with its hands
+struct HandStageData {
+  std::shared_ptr<const DerivedHandData> derived;
+  std::shared_ptr<const JointKinematics> kinematics;
+  std::shared_ptr<const SmoothedJoints> smoothed;
+};
+
+// HandPresence
+
+// What the lifecycle diff needs to know about a hand of a frame
+struct HandPresence {
+  int32_t id;
+  eLeapHandType type;
+  uint8_t extendedFingers;
+
+  // Summarizes the hands of a tracking event, sorted by id
+  static void collect(const LEAP_TRACKING_EVENT& tracking_event, std::vector<HandPresence>& hands);
+
+  // Merges two sorted summaries into the transitions from previous to current
+  static void diff(const std::vector<HandPresence>& previous, const std::vector<HandPresence>& current,
+                   std::vector<HandTransition>& transitions);
+};
+
 // BoneImplementation
 
 class BoneImplementation : public Interface::Implementation {
 public:
   BoneImplementation() : m_bone(s_invalid), m_type(Bone::TYPE_METACARPAL), m_name("Invalid Bone") {}
-  BoneImplementation(const LEAP_BONE& bone, Bone::Type type, bool isLeftHand) :
+  BoneImplementation(const LEAP_BONE& bone, Bone::Type type, bool isLeftHand, const DerivedHandData* derived = nullptr, int derivedIndex = 0) :
     m_bone(bone), m_type(type), m_name([type]{
       std::ostringstream oss;
       oss << "Bone index:" << static_cast<int>(type);
       return oss.str();
-    }()), m_isLeftHand(isLeftHand), m_isValid(true) {}
+    }()), m_isLeftHand(isLeftHand), m_isValid(true) {
+    if (derived) {
+      m_basis = derived->boneBasis[derivedIndex];
+      m_direction = derived->boneDirection[derivedIndex];
+      m_length = derived->boneLength[derivedIndex];
+      m_derivedMask = DerivedHandData::ALL;
+    }
+  }
   Vector prevJoint() const { return m_bone.prev_joint.v; }
   Vector nextJoint() const { return m_bone.next_joint.v; }
   Vector center() const { return (Vector(m_bone.prev_joint.v) + Vector(m_bone.next_joint.v))*0.5f; }
-  Vector direction() const { return (Vector(m_bone.next_joint.v) - Vector(m_bone.prev_joint.v)).normalized(); }
-  float length() const { return (Vector(m_bone.next_joint.v) - Vector(m_bone.prev_joint.v)).magnitude(); }
+  Vector direction() const {
+    if (!(m_derivedMask & DerivedHandData::DIRECTION)) {
+      m_direction = DerivedHandData::directionOf(m_bone);
+      m_derivedMask |= DerivedHandData::DIRECTION;
+    }
+    return m_direction;
+  }
+  float length() const {
+    if (!(m_derivedMask & DerivedHandData::LENGTH)) {
+      m_length = DerivedHandData::lengthOf(m_bone);
+      m_derivedMask |= DerivedHandData::LENGTH;
+    }
+    return m_length;
+  }
   float width() const { return m_bone.width; }
   Bone::Type type() const { return m_type; }
   Matrix basis() const {
     if (!isValid())
       return Leap::Matrix::identity();
-    const LEAP_QUATERNION& q = m_bone.rotation;
-    Matrix mat(q.x, q.y, q.z, q.w);
-    if (m_isLeftHand) {
-      mat.xBasis = -mat.xBasis;
+    if (!(m_derivedMask & DerivedHandData::BASIS)) {
+      m_basis = DerivedHandData::basisOf(m_bone, m_isLeftHand);
+      m_derivedMask |= DerivedHandData::BASIS;
     }
-    return mat;
+    return m_basis;
   }
   bool isValid() const { return m_isValid; }
   const std::string& toString() const { return m_name; }
@@ -181,6 +508,79 @@ protected:
   const std::string m_name;
   bool m_isLeftHand = false;
   bool m_isValid = false;
+  mutable uint32_t m_derivedMask = 0;
+  mutable Matrix m_basis;
+  mutable Vector m_direction;
+  mutable float m_length = 0.0f;
+};
+
+// ImageBufferPool
+
+// Recycles the image buffers allocated by LeapC and the buffers of image pyramids and integral
+// images across frames. A buffer returns to the pool when its last reference is released, if the
+// pool still exists; at most MAX_FREE_BUFFERS free buffers of each size are kept.
+class ImageBufferPool : public std::enable_shared_from_this<ImageBufferPool> {
+public:
+  std::shared_ptr<uint8_t> acquire(size_t size);
+  size_t freeCount(size_t size);
+
+protected:
+  void release(uint8_t* buffer, size_t size);
+
+  static const size_t MAX_FREE_BUFFERS = 8;
+  std::unordered_map<size_t, std::vector<std::unique_ptr<uint8_t[]>>> m_free;
+  std::mutex m_mutex;
+};
+
+// DistortionMapCache
+
+// Shares the undistortion maps of each calibration (see Image::undistortionMap()) across images.
+// Maps are keyed by the calibration hash of the image, its size and the rectified grid. With a
+// directory set, each map is also saved to a file per device serial, camera and grid, and loaded
+// from there instead of being rebuilt. At most MAX_MAPS maps are kept in memory.
+class DistortionMapCache {
+public:
+  typedef std::shared_ptr<const std::vector<float>> Map;
+
+  Map acquire(const ImageImplementation& image, const std::string& serial, int width, int height, float maxSlope);
+  void setDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directory = directory;
+  }
+  size_t size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_maps.size();
+  }
+  // The number of maps built rather than found in memory or on disk
+  size_t buildCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_buildCount;
+  }
+  static std::vector<float> build(const ImageImplementation& image, int width, int height, float maxSlope);
+
+protected:
+  struct Key {
+    uint64_t calibration;
+    int32_t sourceWidth;
+    int32_t sourceHeight;
+    int32_t width;
+    int32_t height;
+    float maxSlope;
+    bool operator==(const Key& other) const {
+      return calibration == other.calibration && sourceWidth == other.sourceWidth && sourceHeight == other.sourceHeight &&
+             width == other.width && height == other.height && maxSlope == other.maxSlope;
+    }
+  };
+
+  std::string path(const std::string& serial, int camera, const Key& key) const;
+  static Map load(const std::string& path, const Key& key);
+  static void save(const std::string& path, const Key& key, const std::vector<float>& map);
+
+  static const size_t MAX_MAPS = 8;
+  std::deque<std::pair<Key, Map>> m_maps; // Most recently used first
+  std::string m_directory;
+  size_t m_buildCount = 0;
+  std::mutex m_mutex;
 };
 
 // ImageImplementation
@@ -220,6 +620,33 @@ public:
   float rayScaleY() const { return 0.5f/DISTORTION_RANGE; }
   Vector rectify(const Vector& uv) const;
   Vector warp(const Vector& xy) const;
+  // See Image::convert() and Image::packStereo()
+  size_t convertedSize(Image::OutputFormat format, int downscale) const;
+  size_t convert(void* buffer, size_t bufferSize, Image::OutputFormat format, int downscale, float gain, float offset) const;
+  static size_t packStereo(const ImageImplementation& left, const ImageImplementation& right, void* buffer, size_t bufferSize,
+                           Image::OutputFormat format, int downscale, float gain, float offset);
+
+  // Gaussian pyramid of an 8-bit image; level 0 is the image data itself
+  struct Pyramid {
+    static const int MAX_LEVELS = 5;
+    static const int MIN_SIZE = 16;
+
+    int count = 0;
+    int width[MAX_LEVELS];
+    int height[MAX_LEVELS];
+    const uint8_t* levels[MAX_LEVELS];
+    std::shared_ptr<uint8_t> buffer; // Levels 1 and up
+  };
+  // The pyramid and the integral image are computed on first use (or when the image arrives,
+  // with POLICY_IMAGE_PYRAMIDS) and never change afterwards
+  const Pyramid& pyramid() const;
+  const uint32_t* integralImage() const;
+  uint32_t integralSum(int x, int y, int width, int height) const;
+  // The pixel buffer plus the pyramid and integral image built so far, for the retention budget
+  int64_t retainedBytes() const;
+  // See Image::calibrationHash() and Image::undistortionMap()
+  uint64_t calibrationHash() const;
+  const float* undistortionMap(int width, int height, float maxSlope) const;
   float calibOffsetX() const { return m_image_event.image[m_imageId].properties.x_offset; }
   float calibOffsetY() const { return m_image_event.image[m_imageId].properties.y_offset; }
   float calibScaleX() const { return m_image_event.image[m_imageId].properties.x_scale; }
@@ -233,11 +660,29 @@ public:
   const float DISTORTION_RANGE = 4.0f;
 
 protected:
+  // Writes one image, or left and right side by side when stereo is set
+  static size_t pack(const ImageImplementation& left, const ImageImplementation& right, bool stereo, void* buffer,
+                     size_t bufferSize, Image::OutputFormat format, int downscale, float gain, float offset);
+
   std::weak_ptr<ControllerImplementation> m_weakControllerImpl;
   std::shared_ptr<uint8_t> m_ref;
   LEAP_IMAGE_EVENT m_image_event;
   const int32_t m_imageId = 0;
   const std::string m_name;
+  std::shared_ptr<ImageBufferPool> m_bufferPool;
+  std::shared_ptr<DistortionMapCache> m_distortionCache;
+  mutable std::shared_ptr<const Pyramid> m_pyramid;
+  mutable std::shared_ptr<uint8_t> m_integral;
+  mutable uint64_t m_calibrationHash = 0;
+  // The undistortion maps handed out by this image, which stay valid as long as it does
+  struct UndistortionMap {
+    int width;
+    int height;
+    float maxSlope;
+    DistortionMapCache::Map map;
+  };
+  mutable std::vector<UndistortionMap> m_undistortionMaps;
+  mutable std::mutex m_derivedMutex;
 };
 
 // FingerImplementation
@@ -246,7 +691,7 @@ class FingerImplementation : public Interface::Implementation {
 public:
   FingerImplementation() : m_digit(s_invalid), m_id(-1), m_name("Invalid Finger") {}
   FingerImplementation(const std::shared_ptr<HandImplementation>& handImpl,
-                       const LEAP_DIGIT& digit);
+                       const LEAP_DIGIT& digit, int digitIndex = 0);
   Frame frame() const;
   Hand hand() const;
 
@@ -256,7 +701,11 @@ public:
     if (!isValid() || boneIx < Bone::TYPE_METACARPAL || boneIx > Bone::TYPE_DISTAL) {
       return Bone::invalid();
     }
-    return Bone(std::make_shared<BoneImplementation>(m_digit.bones[boneIx], boneIx, m_isLeftHand).get());
+    auto& bone = m_bones[boneIx];
+    if (!bone) {
+      bone = std::make_shared<BoneImplementation>(m_digit.bones[boneIx], boneIx, m_isLeftHand, m_stageData.derived.get(), m_digitIndex*4 + boneIx);
+    }
+    return Bone(bone.get());
   }
   Vector tipPosition() const { return m_digit.distal.next_joint.v; }
   Vector direction() const { return (Vector(m_digit.intermediate.next_joint.v) - Vector(m_digit.intermediate.prev_joint.v)).normalized(); }
@@ -272,6 +721,30 @@ public:
     return m_length;
   }
   bool isExtended() const { return !!m_digit.is_extended; }
+  Vector jointPosition(Finger::Joint joint) const {
+    if (!isValid() || joint < Finger::JOINT_MCP || joint > Finger::JOINT_TIP) {
+      return Vector::zero();
+    }
+    return m_digit.bones[joint].next_joint.v;
+  }
+  Vector smoothedJointPosition(Finger::Joint joint) const {
+    if (!m_stageData.smoothed || joint < Finger::JOINT_MCP || joint > Finger::JOINT_TIP) {
+      return jointPosition(joint);
+    }
+    return m_stageData.smoothed->position[HandJoints::index(m_digitIndex, joint)];
+  }
+  Vector jointVelocity(Finger::Joint joint) const {
+    if (!m_stageData.kinematics || joint < Finger::JOINT_MCP || joint > Finger::JOINT_TIP) {
+      return Vector::zero();
+    }
+    return m_stageData.kinematics->velocity[HandJoints::index(m_digitIndex, joint)];
+  }
+  Vector jointAcceleration(Finger::Joint joint) const {
+    if (!m_stageData.kinematics || joint < Finger::JOINT_MCP || joint > Finger::JOINT_TIP) {
+      return Vector::zero();
+    }
+    return m_stageData.kinematics->acceleration[HandJoints::index(m_digitIndex, joint)];
+  }
   float timeVisible() const;
   bool isValid() const { return m_id != -1; }
   const std::string& toString() const { return m_name; }
@@ -284,6 +757,9 @@ protected:
   mutable float m_length = -1;
   const std::string m_name;
   bool m_isLeftHand = false;
+  const int m_digitIndex = 0;
+  HandStageData m_stageData;
+  mutable std::shared_ptr<BoneImplementation> m_bones[4];
 };
 
 // HandImplementation
@@ -292,12 +768,21 @@ class HandImplementation : public Interface::Implementation {
 public:
   HandImplementation() : m_hand(s_invalid), m_name("Invalid Hand") {}
   HandImplementation(const std::shared_ptr<FrameImplementation>& frameImpl,
-                     const LEAP_HAND& hand) :
-    m_weakFrameImpl(frameImpl), m_hand(hand), m_name([&hand]{
+                     const LEAP_HAND& hand,
+                     const HandStageData& stageData = HandStageData()) :
+    m_weakFrameImpl(frameImpl), m_hand(hand), m_stageData(stageData), m_name([&hand]{
       std::ostringstream oss;
       oss << "Hand Id:" << static_cast<int32_t>(hand.id);
       return oss.str();
-    }()) {}
+    }()) {
+    if (const DerivedHandData* derived = m_stageData.derived.get()) {
+      m_basis = derived->basis;
+      m_direction = derived->direction;
+      m_armBasis = derived->armBasis;
+      m_armDirection = derived->armDirection;
+      m_derivedMask = DerivedHandData::ALL;
+    }
+  }
   int32_t id() const { return static_cast<int32_t>(m_hand.id); }
   Frame frame() const { auto frameImpl = m_weakFrameImpl.lock(); return frameImpl ? Frame(frameImpl.get()) : Frame::invalid(); }
   FingerList fingers() {
@@ -310,28 +795,31 @@ public:
     return FingerList(std::make_shared<ListBaseImplementation<Finger>>(fingers));
   }
   Finger finger(int32_t id) {
-    processFingers();
-    for (const auto& finger : m_fingers) {
-      if (finger->id() == id) {
-        return Finger(finger.get());
-      }
-    }
-    return Finger::invalid();
+    const int index = fingerIndex(id);
+    return index >= 0 ? Finger(fingerAt(index).get()) : Finger::invalid();
   }
   Vector palmPosition() const { return m_hand.palm.position.v; }
   Vector stabilizedPalmPosition() const { return m_hand.palm.stabilized_position.v; }
   Vector palmVelocity() const { return m_hand.palm.velocity.v; }
+  Vector smoothedPalmPosition() const { return m_stageData.smoothed ? m_stageData.smoothed->position[HandJoints::PALM] : palmPosition(); }
+  Vector palmAcceleration() const { return m_stageData.kinematics ? m_stageData.kinematics->acceleration[HandJoints::PALM] : Vector::zero(); }
   Vector palmNormal() const { return m_hand.palm.normal.v; }
   float palmWidth() const { return m_hand.palm.width; }
-  Vector direction() const { return Vector(m_hand.palm.direction.v).normalized(); }
+  Vector direction() const {
+    if (!(m_derivedMask & DerivedHandData::DIRECTION)) {
+      m_direction = DerivedHandData::palmDirectionOf(m_hand);
+      m_derivedMask |= DerivedHandData::DIRECTION;
+    }
+    return m_direction;
+  }
   Matrix basis() const {
     if (!isValid())
       return Leap::Matrix::identity();
-
-    const Vector palmNormal(m_hand.palm.normal.v);
-    const Vector direction(Vector(m_hand.palm.direction.v).normalized());
-    const Vector crossed = palmNormal.cross(direction);
-    return Matrix(isLeft() ? -crossed : crossed, -palmNormal, -direction);
+    if (!(m_derivedMask & DerivedHandData::BASIS)) {
+      m_basis = DerivedHandData::palmBasisOf(m_hand);
+      m_derivedMask |= DerivedHandData::BASIS;
+    }
+    return m_basis;
   }
   Arm arm() { return Arm(this); }
   float pinchDistance() const { return m_hand.pinch_distance; }
@@ -347,19 +835,28 @@ public:
 
   // Arm
   float armWidth() const { return m_hand.arm.width; }
-  Vector armDirection() const { return isValid() ? (Vector(m_hand.arm.next_joint.v) - Vector(m_hand.arm.prev_joint.v)).normalized() : Vector(0, 0, -1); }
+  Vector armDirection() const {
+    if (!isValid())
+      return Vector(0, 0, -1);
+    if (!(m_derivedMask & DerivedHandData::ARM_DIRECTION)) {
+      m_armDirection = DerivedHandData::directionOf(m_hand.arm);
+      m_derivedMask |= DerivedHandData::ARM_DIRECTION;
+    }
+    return m_armDirection;
+  }
   Matrix armBasis() const {
     if (!isValid())
       return Leap::Matrix::identity();
-    const LEAP_QUATERNION& q = m_hand.arm.rotation;
-    Matrix mat(q.x, q.y, q.z, q.w);
-    if (isLeft()) {
-      mat.xBasis = -mat.xBasis;
+    if (!(m_derivedMask & DerivedHandData::ARM_BASIS)) {
+      m_armBasis = DerivedHandData::basisOf(m_hand.arm, isLeft());
+      m_derivedMask |= DerivedHandData::ARM_BASIS;
     }
-    return mat;
+    return m_armBasis;
   }
   Vector elbowPosition() const { return m_hand.arm.prev_joint.v; }
   Vector wristPosition() const { return m_hand.arm.next_joint.v; }
+  Vector smoothedWristPosition() const { return m_stageData.smoothed ? m_stageData.smoothed->position[HandJoints::WRIST] : wristPosition(); }
+  Vector wristVelocity() const { return m_stageData.kinematics ? m_stageData.kinematics->velocity[HandJoints::WRIST] : Vector::zero(); }
   Vector armCenter() const { return (Vector(m_hand.arm.prev_joint.v) + Vector(m_hand.arm.next_joint.v))*0.5f; }
 
   const std::vector<std::shared_ptr<FingerImplementation>>& fingersVector() {
@@ -367,14 +864,62 @@ public:
     return m_fingers;
   }
 
+  const HandStageData& stageData() const { return m_stageData; }
+
+  RigidMotion motionSince(const HandImplementation& since) const {
+    if (!isValid() || !since.isValid()) {
+      return RigidMotion();
+    }
+    MotionAccumulator accumulator;
+    accumulator.addHand(since.m_hand, m_hand);
+    return accumulator.solve();
+  }
+
+  PoseFeatures poseFeatures() const {
+    PoseFeatures features;
+    poseFeaturesOf(m_hand, features);
+    features.valid = features.valid && isValid();
+    return features;
+  }
+
 protected:
+  // Finger ids are hand.id*10 + finger_id (see FingerImplementation), so the digit can be
+  // resolved arithmetically. Returns -1 if the id does not belong to this hand.
+  int fingerIndex(int32_t id) const {
+    if (!isValid()) {
+      return -1;
+    }
+    const int32_t fingerId = id - this->id()*10;
+    if (fingerId >= 0 && fingerId < 5 && m_hand.digits[fingerId].finger_id == fingerId) {
+      return static_cast<int>(fingerId);
+    }
+    for (int i = 0; i < 5; i++) {
+      if (m_hand.digits[i].finger_id == fingerId) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // Materializes the FingerImplementation for a single digit
+  const std::shared_ptr<FingerImplementation>& fingerAt(int index) {
+    if (m_fingers.empty()) {
+      m_fingers.resize(5);
+    }
+    auto& finger = m_fingers[index];
+    if (!finger) {
+      finger = std::make_shared<FingerImplementation>(std::static_pointer_cast<HandImplementation>(shared_from_this()), m_hand.digits[index], index);
+    }
+    return finger;
+  }
+
   void processFingers() {
-    if (m_fingers.empty() && isValid()) {
+    if (!m_allFingers && isValid()) {
       // Cache the FingerImplementations
-      m_fingers.reserve(5);
       for (int i = 0; i < 5; i++) {
-        m_fingers.emplace_back(std::make_shared<FingerImplementation>(std::static_pointer_cast<HandImplementation>(shared_from_this()), m_hand.digits[i]));
+        fingerAt(i);
       }
+      m_allFingers = true;
     }
   }
 
@@ -383,6 +928,13 @@ protected:
   std::weak_ptr<FrameImplementation> m_weakFrameImpl;
   const LEAP_HAND& m_hand;
   mutable std::vector<std::shared_ptr<FingerImplementation>> m_fingers;
+  bool m_allFingers = false;
+  const HandStageData m_stageData;
+  mutable uint32_t m_derivedMask = 0;
+  mutable Matrix m_basis;
+  mutable Vector m_direction;
+  mutable Matrix m_armBasis;
+  mutable Vector m_armDirection;
   const std::string m_name;
 };
 
@@ -412,6 +964,12 @@ public:
     m_raw_hands.clear();
     m_raw_hands.assign(tracking_event.pHands, tracking_event.pHands + tracking_event.nHands);
     m_tracking_event.pHands = !m_raw_hands.empty() ? &m_raw_hands[0] : nullptr;
+
+    // Index the hands by id so that lookups do not have to materialize every hand
+    m_handIndices.reserve(m_raw_hands.size());
+    for (size_t i = 0; i < m_raw_hands.size(); i++) {
+      m_handIndices.emplace(static_cast<int32_t>(m_raw_hands[i].id), i);
+    }
   }
   int64_t id() const { return m_tracking_event.info.frame_id; }
   int64_t timestamp() const { return m_tracking_event.info.timestamp; }
@@ -427,15 +985,11 @@ public:
     return HandList(std::make_shared<ListBaseImplementation<Hand>>(hands));
   }
   Hand hand(int32_t id) {
-    if (m_tracking_event.nHands > 0) {
-      processHands();
-      for (const auto& hand : m_hands) {
-        if (hand->id() == id) {
-          return Hand(hand.get());
-        }
-      }
+    const auto found = m_handIndices.find(id);
+    if (found == m_handIndices.end() || !isValid()) {
+      return Hand::invalid();
     }
-    return Hand::invalid();
+    return Hand(handAt(found->second).get());
   }
   FingerList fingers() {
     std::vector<Finger> fingers;
@@ -449,91 +1003,858 @@ public:
     return FingerList(std::make_shared<ListBaseImplementation<Finger>>(fingers));
   }
   Finger finger(int32_t id) {
-    if (m_tracking_event.nHands > 0) {
-      processFingers();
-      for (const auto& finger : m_fingers) {
-        if (finger->id() == id) {
-          return Finger(finger.get());
+    // Only the owning hand is materialized; see HandImplementation::fingerIndex
+    const auto found = id >= 0 ? m_handIndices.find(id/10) : m_handIndices.end();
+    if (found == m_handIndices.end() || !isValid()) {
+      return Finger::invalid();
+    }
+    return handAt(found->second)->finger(id);
+  }
+  ImageList images() { return getImages(eLeapImageType_Default); }
+  ImageList rawImages() { return getImages(eLeapImageType_Raw); }
+  HandTransitionList handTransitions() const {
+    return HandTransitionList(std::make_shared<ListBaseImplementation<HandTransition>>(m_handTransitions));
+  }
+  MapPointList mapPoints() {
+    std::shared_ptr<const LEAP_POINT_MAPPING> pointMapping;
+    {
+      std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
+      pointMapping = m_pointMapping;
+    }
+    return MapPointList(pointMapping ? std::make_shared<MapPointListImplementation>(pointMapping)
+                                     : std::make_shared<MapPointListImplementation>());
+  }
+  float currentFramesPerSecond() const { return m_tracking_event.framerate; }
+  bool isValid() const { return m_tracking_event.info.frame_id != -1; }
+  const std::string& toString() const { return m_name; }
+
+  ImageList getImages(eLeapImageType type) {
+    std::vector<Image> images;
+    images.reserve(2);
+    {
+      std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
+      for (const auto& image : m_images) {
+        if (image->type() == type) {
+          images.emplace_back(image.get());
         }
       }
     }
-    return Finger::invalid();
-  }
-  ImageList images() { return getImages(eLeapImageType_Default); }
-  ImageList rawImages() { return getImages(eLeapImageType_Raw); }
-  MapPointList mapPoints() {
-    std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
-    return MapPointList(std::make_shared<ListBaseImplementation<MapPoint>>(m_mapPoints));
+    return ImageList(std::make_shared<ListBaseImplementation<Image>>(images));
+  }
+
+  void setImages(const std::vector<std::shared_ptr<ImageImplementation>>& images) {
+    std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
+    m_images = images;
+  }
+
+  // Retains the buffer holding the point mapping, which starts with a LEAP_POINT_MAPPING
+  void setMapPoints(const std::shared_ptr<uint8_t>& buffer) {
+    std::shared_ptr<const LEAP_POINT_MAPPING> pointMapping(buffer, reinterpret_cast<const LEAP_POINT_MAPPING*>(buffer.get()));
+    if (id() != pointMapping->frame_id) {
+      return;
+    }
+    if (pointMapping->nPoints == 0 || pointMapping->nPoints == ~0U) {
+      pointMapping.reset();
+    }
+    std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
+    m_pointMapping = std::move(pointMapping);
+  }
+
+  void clearMapPoints() {
+    std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
+    m_pointMapping.reset();
+  }
+
+  // Memory held for the tracking data, excluding images and map points
+  int64_t trackingBytes() const {
+    int64_t bytes = sizeof(*this) + m_raw_hands.capacity()*sizeof(LEAP_HAND);
+    {
+      std::lock_guard<decltype(m_boundsMutex)> lk(m_boundsMutex);
+      bytes += m_handBounds.capacity()*sizeof(AxisAlignedBox);
+    }
+    if (m_derivedData) {
+      bytes += m_derivedData->capacity()*sizeof(DerivedHandData);
+    }
+    if (m_kinematics) {
+      bytes += m_kinematics->capacity()*sizeof(JointKinematics);
+    }
+    if (m_smoothed) {
+      bytes += m_smoothed->capacity()*sizeof(SmoothedJoints);
+    }
+    return bytes;
+  }
+
+  // Computes the derived quantities of every hand up front (see POLICY_EAGER_DERIVED_DATA).
+  // Must be called before any hand is materialized.
+  void computeDerivedData() {
+    if (m_raw_hands.empty() || m_derivedData) {
+      return;
+    }
+    m_derivedData = std::make_shared<std::vector<DerivedHandData>>(m_raw_hands.size());
+    DerivedHandData::compute(&m_raw_hands[0], m_raw_hands.size(), &(*m_derivedData)[0]);
+  }
+
+  // Attaches the joint kinematics of each raw hand (see POLICY_JOINT_KINEMATICS).
+  // Must be called before any hand is materialized.
+  void setKinematics(std::shared_ptr<std::vector<JointKinematics>> kinematics) {
+    if (kinematics && kinematics->size() == m_raw_hands.size()) {
+      m_kinematics = std::move(kinematics);
+    }
+  }
+
+  // Attaches the smoothed joint positions of each raw hand (see Controller::setSmoothingFilter).
+  // Must be called before any hand is materialized.
+  void setSmoothedJoints(std::shared_ptr<std::vector<SmoothedJoints>> smoothed) {
+    if (smoothed && smoothed->size() == m_raw_hands.size()) {
+      m_smoothed = std::move(smoothed);
+    }
+  }
+
+  void setHandTransitions(std::vector<HandTransition> transitions) {
+    m_handTransitions = std::move(transitions);
+  }
+
+  const LEAP_TRACKING_EVENT& trackingEvent() const { return m_tracking_event; }
+  const std::vector<LEAP_HAND>& rawHands() const { return m_raw_hands; }
+  // Bounds of the hand capsules, for the collision broadphase; computed on the first collision
+  // query, so that frames that are never collided do not pay for them
+  const std::vector<AxisAlignedBox>& handBounds() const {
+    std::lock_guard<decltype(m_boundsMutex)> lk(m_boundsMutex);
+    if (m_handBounds.size() != m_raw_hands.size()) {
+      m_handBounds.clear();
+      m_handBounds.reserve(m_raw_hands.size());
+      for (const auto& hand : m_raw_hands) {
+        m_handBounds.push_back(HandCapsules::bounds(hand));
+      }
+    }
+    return m_handBounds;
+  }
+  const LEAP_HAND* rawHand(int32_t id) const {
+    const auto found = m_handIndices.find(id);
+    return found != m_handIndices.end() ? &m_raw_hands[found->second] : nullptr;
+  }
+
+  RigidMotion motionSince(const FrameImplementation& since) const {
+    MotionAccumulator accumulator;
+    for (const auto& hand : m_raw_hands) {
+      if (const LEAP_HAND* previous = since.rawHand(static_cast<int32_t>(hand.id))) {
+        accumulator.addHand(*previous, hand);
+      }
+    }
+    return accumulator.solve();
+  }
+
+  size_t boneInstanceCount(int flags) const {
+    return m_raw_hands.size()*boneInstancesPerHand(flags);
+  }
+  static size_t boneInstancesPerHand(int flags) {
+    return DerivedHandData::NUM_BONES + ((flags & Frame::BONE_INSTANCE_PALM_AND_ARM) ? 2 : 0);
+  }
+  static size_t boneInstanceStride(int flags) {
+    return (flags & Frame::BONE_INSTANCE_HALF_FLOAT) ? 16*sizeof(uint16_t) : 16*sizeof(float);
+  }
+  // See Frame::writeBoneInstances()
+  size_t writeBoneInstances(void* buffer, size_t bufferSize, int flags) const;
+  // See Frame::writeHandCrops()
+  size_t handCropCount();
+  size_t writeHandCrops(void* buffer, size_t bufferSize, int cropSize, HandCrop* crops, float baseline, float padding,
+                        float gain, float offset);
+
+  // Extrapolates this frame to the target timestamp, using the previous frame (if any) to
+  // estimate the motion of each hand. The hands are extrapolated in place in the new frame.
+  std::shared_ptr<FrameImplementation> predict(const FrameImplementation* previous, int64_t targetTimestamp) const;
+  // Same, but refills out, reusing its hand array and, when the hand ids are unchanged, its index.
+  // The hands, fingers and other objects obtained from out before are invalidated.
+  void predictInto(const FrameImplementation* previous, int64_t targetTimestamp, FrameImplementation& out) const;
+
+protected:
+  // The 8-bit default images of both cameras, which hand crops are taken from; false if either
+  // is missing
+  bool cropImages(std::shared_ptr<ImageImplementation> (&images)[2]);
+
+  // Materializes the HandImplementation for a single raw hand
+  const std::shared_ptr<HandImplementation>& handAt(size_t index) {
+    if (m_hands.empty()) {
+      m_hands.resize(m_raw_hands.size());
+    }
+    auto& hand = m_hands[index];
+    if (!hand) {
+      // The aliasing constructor keeps each per-frame array alive for as long as any hand uses it
+      HandStageData stageData;
+      if (m_derivedData) {
+        stageData.derived = std::shared_ptr<const DerivedHandData>(m_derivedData, &(*m_derivedData)[index]);
+      }
+      if (m_kinematics) {
+        stageData.kinematics = std::shared_ptr<const JointKinematics>(m_kinematics, &(*m_kinematics)[index]);
+      }
+      if (m_smoothed) {
+        stageData.smoothed = std::shared_ptr<const SmoothedJoints>(m_smoothed, &(*m_smoothed)[index]);
+      }
+      hand = std::make_shared<HandImplementation>(std::static_pointer_cast<FrameImplementation>(shared_from_this()), m_raw_hands[index], stageData);
+    }
+    return hand;
+  }
+
+  void processHands() {
+    if (!m_allHands && isValid()) {
+      // Cache the HandImplementations
+      for (size_t i = 0; i < m_raw_hands.size(); i++) {
+        handAt(i);
+      }
+      m_allHands = true;
+    }
+  }
+  void processFingers() {
+    if (m_fingers.empty() && isValid()) {
+      processHands();
+      // Cache the FingerImplementations
+      m_fingers.reserve(m_hands.size() * 5);
+      for (auto& hand : m_hands) {
+        const auto fingers = hand->fingersVector();
+        m_fingers.insert(m_fingers.end(), fingers.begin(), fingers.end());
+      }
+    }
+  }
+
+  LEAP_TRACKING_EVENT m_tracking_event;
+  std::vector<LEAP_HAND> m_raw_hands;
+  std::unordered_map<int32_t, size_t> m_handIndices;
+  mutable std::vector<AxisAlignedBox> m_handBounds;
+  mutable std::mutex m_boundsMutex;
+  std::vector<std::shared_ptr<HandImplementation>> m_hands;
+  std::vector<std::shared_ptr<FingerImplementation>> m_fingers;
+  std::shared_ptr<std::vector<DerivedHandData>> m_derivedData;
+  std::shared_ptr<std::vector<JointKinematics>> m_kinematics;
+  std::shared_ptr<std::vector<SmoothedJoints>> m_smoothed;
+  std::vector<HandTransition> m_handTransitions;
+  bool m_allHands = false;
+  std::vector<std::shared_ptr<ImageImplementation>> m_images;
+  std::shared_ptr<const LEAP_POINT_MAPPING> m_pointMapping;
+  std::mutex m_imageMutex;
+  std::mutex m_mapPointsMutex;
+  std::string m_name;
+};
+
+// CompactFrame
+
+// Quantized copy of the hands of a frame, for the compact history (see
+// Controller::setCompactHistorySize()). Joint positions are fixed point relative to the palm,
+// rotations use the smallest-three encoding, and widths and strengths are 8 bits.
+struct CompactHand {
+  static const int NUM_BONES = 20;
+  static const int POSITION_SCALE = 20; // 1/20 mm
+
+  uint32_t id;
+  uint32_t flags;
+  uint64_t visibleTime;
+  float palmPosition[3];
+  int16_t stabilizedPosition[3];     // Relative to the palm
+  int16_t velocity[3];               // mm/s
+  int16_t normal[3];                 // Unit vectors in 1/32767
+  int16_t direction[3];
+  uint32_t orientation;
+  int16_t arm[2][3];                 // Elbow and wrist
+  uint32_t armRotation;
+  int16_t metacarpalBase[5][3];      // prev_joint of the first bone of each digit
+  int16_t joints[NUM_BONES][3];      // next_joint of each bone; the next bone starts there
+  uint32_t boneRotations[NUM_BONES];
+  uint8_t boneWidths[NUM_BONES];     // 1/2 mm
+  uint8_t palmWidth;
+  uint8_t armWidth;
+  uint8_t type;
+  uint8_t extendedFingers;           // Bit n for digit n
+  uint8_t confidence;                // Unit interval in 1/255
+  uint8_t pinchStrength;
+  uint8_t grabStrength;
+  uint16_t pinchDistance;            // 1/100 mm
+  uint16_t grabAngle;                // 1/10000 radian
+
+  static void encode(const LEAP_HAND& hand, CompactHand& compact);
+  static void decode(const CompactHand& compact, LEAP_HAND& hand);
+};
+
+struct CompactFrame {
+  int64_t id;
+  int64_t timestamp;
+  int64_t trackingFrameId;
+  float framerate;
+  std::vector<CompactHand> hands;
+
+  static CompactFrame encode(const LEAP_TRACKING_EVENT& tracking_event);
+  std::shared_ptr<FrameImplementation> decode() const;
+};
+
+// RetentionQueue
+
+// History of one retention category, newest first, with the bytes retained by each entry and
+// the count and byte budgets set by Controller::setRetentionLimits(). Not thread-safe; the
+// controller guards each queue with the mutex of its category.
+template<typename T>
+class RetentionQueue {
+public:
+  typedef typename std::deque<T>::const_iterator const_iterator;
+
+  explicit RetentionQueue(int maxCount) : m_maxCount(maxCount) {}
+
+  const_iterator begin() const { return m_items.begin(); }
+  const_iterator end() const { return m_items.end(); }
+  const T& operator[](size_t index) const { return m_items[index]; }
+  const T& front() const { return m_items.front(); }
+  size_t size() const { return m_items.size(); }
+  bool empty() const { return m_items.empty(); }
+  int64_t bytes() const { return m_bytes; }
+
+  void setLimits(int maxCount, int64_t maxBytes) {
+    m_maxCount = std::max(maxCount, 0);
+    m_maxBytes = std::max<int64_t>(maxBytes, 0);
+  }
+
+  void push_front(T item, int64_t bytes) {
+    m_items.emplace_front(std::move(item));
+    m_itemBytes.push_front(bytes);
+    m_bytes += bytes;
+  }
+
+  // Drops the oldest entries until the queue is within its budgets, passing each to evicted.
+  // The newest entry is kept whatever its size, unless the count limit is 0.
+  template<typename F>
+  void evict(F evicted) {
+    while (m_items.size() > static_cast<size_t>(m_maxCount) ||
+           (m_maxBytes > 0 && m_bytes > m_maxBytes && m_items.size() > 1)) {
+      T item = std::move(m_items.back());
+      m_bytes -= m_itemBytes.back();
+      m_items.pop_back();
+      m_itemBytes.pop_back();
+      evicted(item);
+    }
+  }
+
+protected:
+  std::deque<T> m_items;
+  std::deque<int64_t> m_itemBytes;
+  int64_t m_bytes = 0;
+  int m_maxCount;
+  int64_t m_maxBytes = 0;
+};
+
+// ImageRateLimiter
+
+// Decides which image pairs a listener receives under Controller::setImageDelivery(). A pair is
+// delivered once its timestamp reaches the due time, which then advances by the interval so that
+// the rate holds at camera frame rates that are not a multiple of it. Not thread-safe; the
+// controller guards it with its listener mutex.
+class ImageRateLimiter {
+public:
+  void setRate(float maxRate) {
+    m_interval = maxRate > 0 ? static_cast<int64_t>(1e6f / maxRate) : 0;
+    m_started = false;
+  }
+
+  bool accept(int64_t timestamp) {
+    if (m_interval <= 0)
+      return true;
+    if (m_started && timestamp < m_due)
+      return false;
+    // Keep the phase unless the stream has fallen behind by a whole interval, or restarted
+    m_due = m_started && timestamp - m_due < m_interval ? m_due + m_interval : timestamp + m_interval;
+    m_started = true;
+    return true;
+  }
+
+protected:
+  int64_t m_interval = 0;
+  int64_t m_due = 0;
+  bool m_started = false;
+};
+
+// ImageDispatcher
+
+// Calls Listener::onImages() on a thread of its own, for latest-only delivery. Posts made while
+// a call is in progress leave a single call pending, so the listener always reads the latest
+// images. The destructor waits for a call in progress, unless it runs on the dispatcher thread.
+class ImageDispatcher {
+public:
+  ImageDispatcher(Listener& listener, const Controller& controller);
+  ~ImageDispatcher();
+
+  // Returns false if a call was already pending.
+  bool post();
+
+protected:
+  struct State {
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool pending = false;
+    bool stopped = false;
+  };
+
+  std::shared_ptr<State> m_state;
+  std::thread m_thread;
+};
+
+// CollisionSceneImplementation
+
+class CollisionSceneImplementation : public Interface::Implementation {
+public:
+  void setColliders(const Collider* colliders, size_t count) {
+    m_colliders.assign(colliders, colliders + count);
+    m_dirty = true;
+  }
+  void addCollider(const Collider& collider) {
+    m_colliders.push_back(collider);
+    m_dirty = true;
+  }
+  void clear() {
+    m_colliders.clear();
+    m_dirty = true;
+  }
+  size_t count() const { return m_colliders.size(); }
+
+  ContactList contacts(const FrameImplementation& frame) const {
+    std::vector<Contact> contacts;
+    collide(frame, contacts);
+    return ContactList(std::make_shared<ListBaseImplementation<Contact>>(std::move(contacts)));
+  }
+  // Appends the contacts of the hands of the frame
+  void collide(const FrameImplementation& frame, std::vector<Contact>& contacts) const;
+
+private:
+  // A node of the bounding volume hierarchy. Leaves cover count colliders of m_order starting at
+  // first; inner nodes (count == 0) have their left child next to them and their right child at
+  // first.
+  struct Node {
+    AxisAlignedBox bounds;
+    uint32_t first;
+    uint32_t count;
+  };
+  static const uint32_t MAX_LEAF_SIZE = 4;
+
+  // Rebuilds the hierarchy if the colliders changed since the last query
+  void update() const;
+  uint32_t build(uint32_t begin, uint32_t end) const;
+
+  std::vector<Collider> m_colliders;
+  mutable std::vector<AxisAlignedBox> m_colliderBounds;
+  mutable std::vector<uint32_t> m_order;
+  mutable std::vector<Node> m_nodes;
+  mutable bool m_dirty = true;
+  mutable std::mutex m_mutex;
+};
+
+// PoseIndexImplementation
+
+class PoseIndexImplementation : public Interface::Implementation {
+public:
+  void add(const PoseFeatures& features, int32_t label) {
+    if (!features.valid) {
+      return;
+    }
+    m_features.insert(m_features.end(), features.values, features.values + PoseFeatures::LENGTH);
+    m_labels.push_back(label);
+    m_dirty = true;
+  }
+  void clear() {
+    m_features.clear();
+    m_labels.clear();
+    m_dirty = true;
+  }
+  size_t count() const { return m_labels.size(); }
+
+  int nearest(const PoseFeatures& features, int k, PoseMatch* matches) const;
+  bool save(const char* path) const;
+  bool load(const char* path);
+
+private:
+  // A node of the vantage-point tree. The tree is stored in preorder, and the features and labels
+  // are kept in the same order, so node i has pose i as its vantage point. Poses closer to it
+  // than radius are in the inside subtree, the others in the outside subtree.
+  struct Node {
+    float radius;
+    int32_t inside;
+    int32_t outside;
+  };
+
+  const float* featuresAt(size_t index) const { return &m_features[index*PoseFeatures::LENGTH]; }
+  // Rebuilds the tree if poses were added since the last query
+  void update() const;
+  int32_t build(std::vector<std::pair<float, uint32_t>>& order, size_t begin, size_t end,
+                std::vector<float>& features, std::vector<int32_t>& labels) const;
+  void search(int32_t node, const float* query, int k, PoseMatch* matches, int& found) const;
+
+  mutable std::vector<float> m_features;
+  mutable std::vector<int32_t> m_labels;
+  mutable std::vector<Node> m_nodes;
+  mutable bool m_dirty = true;
+  mutable std::mutex m_mutex;
+};
+
+// MapPointStoreImplementation
+
+class MapPointStoreImplementation : public Interface::Implementation {
+public:
+  MapPointStoreImplementation(float voxelSize, int64_t maxAge) :
+    m_voxelSize(voxelSize > 0 ? voxelSize : 50.0f), m_maxAge(maxAge) {}
+
+  void update(const Vector* positions, const uint32_t* ids, int count, int64_t timestamp);
+  void clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_voxels.clear();
+    m_recency.clear();
+    m_min = {INT32_MAX, INT32_MAX, INT32_MAX};
+    m_max = {INT32_MIN, INT32_MIN, INT32_MIN};
+    m_boundsStale = false;
+  }
+  int count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_entries.size());
+  }
+  MapPoint point(uint32_t id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto found = m_entries.find(id);
+    return found != m_entries.end() ? MapPoint{id, found->second.position} : MapPoint::invalid();
+  }
+  MapPointList within(const Vector& center, float radius) const;
+  MapPointList nearest(const Vector& position, int k) const;
+
+private:
+  // Running mean over at most this many observations, so that stored points follow slow drift
+  static const int MAX_MEAN_SAMPLES = 16;
+
+  struct Entry {
+    Vector position;
+    int64_t lastSeen;
+    uint64_t voxel;
+    uint32_t slot;    // Index in the id list of the voxel
+    int samples;
+    std::list<uint32_t>::iterator recency;
+  };
+
+  struct VoxelCoordinates {
+    int32_t x, y, z;
+  };
+
+  VoxelCoordinates coordinatesOf(const Vector& position) const;
+  static uint64_t keyOf(const VoxelCoordinates& coordinates);
+  static VoxelCoordinates coordinatesOfKey(uint64_t key);
+  void insert(uint32_t id, Entry& entry);
+  void erase(const Entry& entry);
+  // Shrinks m_min and m_max to the occupied voxels after a voxel on the boundary was emptied
+  void updateBounds();
+  // Calls visit(id, entry) for every point in the voxel
+  template<typename Visitor>
+  void visitVoxel(const VoxelCoordinates& coordinates, Visitor visit) const;
+
+  const float m_voxelSize;
+  const int64_t m_maxAge;
+  std::unordered_map<uint32_t, Entry> m_entries;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> m_voxels;
+  // Ids from least to most recently observed, for aging
+  std::list<uint32_t> m_recency;
+  VoxelCoordinates m_min = {INT32_MAX, INT32_MAX, INT32_MAX};
+  VoxelCoordinates m_max = {INT32_MIN, INT32_MIN, INT32_MIN};
+  bool m_boundsStale = false;
+  mutable std::mutex m_mutex;
+};
+
+// StereoDepthImplementation
+
+class StereoDepthImplementation : public Interface::Implementation {
+public:
+  StereoDepthImplementation(int width, int height, float maxSlope) :
+    m_width(std::max(width, 1)), m_height(std::max(height, 1)), m_maxSlope(maxSlope > 0.0f ? maxSlope : 1.0f) {}
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  void setBlockSize(int size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_blockSize = std::min(std::max(size | 1, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE);
+  }
+  int blockSize() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_blockSize;
+  }
+  bool update(const Image& left, const Image& right, float baseline);
+  const unsigned char* rectifiedImage(int camera) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return camera >= 0 && camera < 2 && !m_rectified[camera].empty() ? m_rectified[camera].data() : nullptr;
+  }
+  StereoRegion handRegion(const Hand& hand, int margin, float depthMargin) const;
+  int computeDepth(const StereoRegion& region, float* depth) const;
+
+private:
+  // Costs are 16-bit, which holds the sum of absolute differences of a 15x15 block
+  static const int MIN_BLOCK_SIZE = 3;
+  static const int MAX_BLOCK_SIZE = 15;
+  // A match is rejected unless it is this many percent better than any non-adjacent disparity
+  static const int UNIQUENESS = 10;
+
+  // Bilinear resampling of one camera onto the rectified grid. For each rectified pixel, the
+  // offset of the top-left source pixel (-1 where no ray reaches the image) and the horizontal
+  // and vertical weights of the right and bottom neighbors, out of 256.
+  struct CameraMap {
+    uint64_t calibration = 0; // The hash of the calibration the map was built from
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+    std::vector<int32_t> offsets;
+    std::vector<uint16_t> weightX;
+    std::vector<uint16_t> weightY;
+  };
+
+  void buildMap(const Image& image, CameraMap& map) const;
+  // Pixels per unit of ray slope along the rows of the rectified grid
+  float focalLength() const { return 0.5f*m_width/m_maxSlope; }
+
+  const int m_width;
+  const int m_height;
+  const float m_maxSlope;
+  int m_blockSize = 7;
+  float m_baseline = 0.0f;
+  CameraMap m_maps[2];
+  std::vector<uint8_t> m_rectified[2];
+  // Scratch buffers of computeDepth()
+  mutable std::vector<uint8_t> m_differences;
+  mutable std::vector<uint32_t> m_integral;
+  mutable std::vector<uint16_t> m_costs;
+  mutable std::mutex m_mutex;
+};
+
+// ImageCodecImplementation
+
+class ImageCodecImplementation : public Interface::Implementation {
+public:
+  explicit ImageCodecImplementation(int keyframeInterval) : m_keyframeInterval(std::max(keyframeInterval, 1)) {}
+
+  int keyframeInterval() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_keyframeInterval;
+  }
+  void setKeyframeInterval(int interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keyframeInterval = std::max(interval, 1);
+  }
+  void reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_encoder = StreamState();
+    m_decoder = StreamState();
+  }
+  static size_t maxEncodedSize(int width, int height);
+  size_t encode(const Image& left, const Image& right, void* buffer, size_t bufferSize);
+  size_t encode(const unsigned char* left, const unsigned char* right, int width, int height, void* buffer, size_t bufferSize);
+  static bool frameInfo(const void* data, size_t size, int* width, int* height, bool* isKeyframe);
+  bool decode(const void* data, size_t size, unsigned char* left, unsigned char* right);
+
+  // The pixels of each row are predicted from a reference row, either directly or through the
+  // difference with their left neighbor (the gradient predictor when the reference is the row
+  // above). The mode of a row is its reference in the low bits, plus MODE_HORIZONTAL.
+  enum Reference {REFERENCE_ZERO, REFERENCE_ABOVE, REFERENCE_PREVIOUS, REFERENCE_LEFT_IMAGE, NUM_REFERENCES};
+  static const uint8_t MODE_HORIZONTAL = 4;
+  static const int BLOCK_SIZE = 16;
+
+private:
+  // The previous pair of images of the stream, which delta frames are predicted from
+  struct StreamState {
+    bool valid = false;
+    uint32_t sequence = 0;
+    int width = 0;
+    int height = 0;
+    int sinceKeyframe = 0;
+    std::vector<uint8_t> previous[2];
+  };
+
+  uint8_t* encodePlane(const uint8_t* pixels, const uint8_t* previous, const uint8_t* leftImage,
+                       int width, int height, uint8_t* out, const uint8_t* end);
+  bool decodePlane(const uint8_t* in, size_t size, const uint8_t* previous, const uint8_t* leftImage,
+                   int width, int height, uint8_t* pixels);
+
+  int m_keyframeInterval;
+  StreamState m_encoder;
+  StreamState m_decoder;
+  // Scratch buffers: the residuals of a plane, and a row of zeros for REFERENCE_ZERO
+  std::vector<uint8_t> m_residuals;
+  std::vector<uint8_t> m_zeros;
+  mutable std::mutex m_mutex;
+};
+
+// HandSlotTable
+
+// Fixed-size table of per-hand-id state for the stages that run as frames arrive. A slot is
+// claimed (and reset) the first time a hand id is seen, and released as soon as a frame
+// arrives without that hand, so no state survives a tracking loss.
+template<typename T, size_t N = 4>
+class HandSlotTable {
+public:
+  // Returns the state for the hand id, claiming a free slot if needed; nullptr if none is free
+  T* update(int32_t id, int64_t frameId) {
+    Slot* free = nullptr;
+    for (auto& slot : m_slots) {
+      if (slot.id == id) {
+        slot.frameId = frameId;
+        return &slot.state;
+      }
+      if (slot.id == -1 && !free) {
+        free = &slot;
+      }
+    }
+    if (!free) {
+      return nullptr;
+    }
+    free->id = id;
+    free->frameId = frameId;
+    free->state = T();
+    return &free->state;
   }
-  float currentFramesPerSecond() const { return m_tracking_event.framerate; }
-  bool isValid() const { return m_tracking_event.info.frame_id != -1; }
-  const std::string& toString() const { return m_name; }
 
-  ImageList getImages(eLeapImageType type) {
-    std::vector<Image> images;
-    images.reserve(2);
-    {
-      std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
-      for (const auto& image : m_images) {
-        if (image->type() == type) {
-          images.emplace_back(image.get());
-        }
+  const T* find(int32_t id) const {
+    for (const auto& slot : m_slots) {
+      if (slot.id == id) {
+        return &slot.state;
       }
     }
-    return ImageList(std::make_shared<ListBaseImplementation<Image>>(images));
+    return nullptr;
   }
 
-  void setImages(const std::vector<std::shared_ptr<ImageImplementation>>& images) {
-    std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
-    m_images = images;
+  // Releases every slot that was not updated by the given frame
+  void releaseStale(int64_t frameId) {
+    releaseStale(frameId, [](int32_t, T&) {});
   }
 
-  void setMapPoints(const LEAP_POINT_MAPPING& pointMapping) {
-    if (id() != pointMapping.frame_id) {
-      return;
-    }
-    std::vector<MapPoint> mapPoints;
-    if (pointMapping.nPoints > 0 && pointMapping.nPoints < ~0U) {
-      mapPoints.reserve(pointMapping.nPoints);
-      for (uint32_t index = 0; index < pointMapping.nPoints; index++) {
-        mapPoints.emplace_back(MapPoint{pointMapping.pIDs[index], Vector{pointMapping.pPoints[index].v}});
+  // As above, calling onRelease(id, state) for each slot before it is released
+  template<typename F>
+  void releaseStale(int64_t frameId, F onRelease) {
+    for (auto& slot : m_slots) {
+      if (slot.id != -1 && slot.frameId != frameId) {
+        onRelease(slot.id, slot.state);
+        slot.id = -1;
       }
     }
-    std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
-    m_mapPoints = std::move(mapPoints);
   }
 
-protected:
-  void processHands() {
-    if (m_hands.empty() && isValid()) {
-      // Cache the HandImplementations
-      m_hands.reserve(m_tracking_event.nHands);
-      for (int i = 0; i < static_cast<int>(m_tracking_event.nHands); i++) {
-        m_hands.emplace_back(std::make_shared<HandImplementation>(std::static_pointer_cast<FrameImplementation>(shared_from_this()), m_raw_hands[i]));
+  // Calls f(id, state) for each claimed slot
+  template<typename F>
+  void forEach(F f) {
+    for (auto& slot : m_slots) {
+      if (slot.id != -1) {
+        f(slot.id, slot.state);
       }
     }
   }
-  void processFingers() {
-    if (m_fingers.empty() && isValid()) {
-      processHands();
-      // Cache the FingerImplementations
-      m_fingers.reserve(m_hands.size() * 5);
-      for (auto& hand : m_hands) {
-        const auto fingers = hand->fingersVector();
-        m_fingers.insert(m_fingers.end(), fingers.begin(), fingers.end());
-      }
+
+  void clear() {
+    for (auto& slot : m_slots) {
+      slot.id = -1;
     }
   }
 
-  LEAP_TRACKING_EVENT m_tracking_event;
-  std::vector<LEAP_HAND> m_raw_hands;
-  std::vector<std::shared_ptr<HandImplementation>> m_hands;
-  std::vector<std::shared_ptr<FingerImplementation>> m_fingers;
-  std::vector<std::shared_ptr<ImageImplementation>> m_images;
-  std::vector<MapPoint> m_mapPoints;
-  std::mutex m_imageMutex;
-  std::mutex m_mapPointsMutex;
-  const std::string m_name;
+protected:
+  struct Slot {
+    int32_t id = -1;
+    int64_t frameId = -1;
+    T state;
+  };
+  Slot m_slots[N];
+};
+
+// Evaluates a hand signal; kinematics may be null
+float handSignal(GestureDefinition::Signal signal, const LEAP_HAND& hand, const JointKinematics* kinematics);
+
+// GestureEngine
+
+// Runs the registered gestures over every tracked hand as frames arrive. Each definition is
+// compiled into a threshold test on one signal, negated where needed so that "active" always
+// means "at or above the start threshold". Each hand keeps one small state per gesture, so a
+// frame costs O(1) per gesture per hand.
+class GestureEngine {
+public:
+  int32_t add(const GestureDefinition& definition);
+  bool remove(int32_t gestureId);
+  bool empty() {
+    std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+    return m_gestures.empty();
+  }
+
+  // Appends the events produced by this frame to events. kinematics may be null.
+  void update(const LEAP_TRACKING_EVENT& tracking_event, const std::vector<JointKinematics>* kinematics,
+              std::vector<GestureEvent>& events);
+
+protected:
+  struct CompiledGesture {
+    int32_t id;
+    GestureDefinition::Signal signal;
+    bool discrete;
+    float sign;
+    float start;
+    float end;
+    int64_t minDuration;
+    int64_t maxDuration;
+  };
+  enum Phase : uint8_t {
+    PHASE_IDLE,     // Signal below the start threshold
+    PHASE_PENDING,  // Crossed the start threshold, not yet recognized
+    PHASE_ACTIVE,   // Continuous gesture in progress
+    PHASE_REJECTED  // Held past maxDuration; waiting for release
+  };
+  struct GestureState {
+    Phase phase = PHASE_IDLE;
+    int64_t startTime = 0;
+    float value = 0.0f;
+  };
+  struct HandGestures {
+    std::vector<GestureState> states; // Indexed as m_gestures
+  };
+
+  std::vector<CompiledGesture> m_gestures;
+  HandSlotTable<HandGestures> m_hands;
+  int32_t m_nextId = 1;
+  std::mutex m_mutex;
+};
+
+// WindowAggregator
+
+// Maintains the registered sliding-window aggregates for every tracked hand. Min and max use
+// monotonic deques, sum and mean a FIFO of the samples in the window with a running sum, so
+// updates are amortized O(1) per aggregate per hand and queries are O(1).
+class WindowAggregator {
+public:
+  int32_t add(const WindowAggregate& aggregate);
+  bool remove(int32_t aggregateId);
+  bool empty() {
+    std::lock_guard<decltype(m_mutex)> lk(m_mutex);
+    return m_aggregates.empty();
+  }
+  float value(int32_t aggregateId, int32_t handId);
+
+  void update(const LEAP_TRACKING_EVENT& tracking_event, const std::vector<JointKinematics>* kinematics);
+
+protected:
+  struct Registered {
+    int32_t id;
+    WindowAggregate aggregate;
+  };
+  struct Sample {
+    int64_t timestamp;
+    float value;
+  };
+  struct State {
+    std::deque<Sample> samples;
+    double sum = 0.0;
+    float ewma = 0.0f;
+    int64_t heldSince = -1;
+    int64_t timestamp = 0;
+    bool initialized = false;
+
+    void update(const WindowAggregate& aggregate, int64_t timestamp, float value);
+    float value(const WindowAggregate& aggregate) const;
+  };
+  struct HandAggregates {
+    std::vector<State> states; // Indexed as m_aggregates
+  };
+
+  std::vector<Registered> m_aggregates;
+  std::unordered_map<int32_t, size_t> m_indices; // Position of each aggregate id in m_aggregates
+  HandSlotTable<HandAggregates> m_hands;
+  int32_t m_nextId = 1;
+  std::mutex m_mutex;
 };
 
 // ControllerImplementation
@@ -590,12 +1911,18 @@ public:
     LeapCloseConnection(m_connection);
     if (m_pollingThread.joinable())
       m_pollingThread.join();
+    // Stop the dispatcher threads while the state their listeners read is still alive
+    std::map<Listener*, ImageDelivery> deliveries;
+    {
+      std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
+      deliveries.swap(m_imageDeliveries);
+    }
+    deliveries.clear();
     LeapDestroyConnection(m_connection);
   }
 
   bool isConnected() {
-    std::lock_guard<decltype(m_deviceMutex)> lk(m_deviceMutex);
-    return !m_devices.empty();
+    return !std::atomic_load(&m_deviceSnapshot)->devices->empty();
   }
 
   bool isServiceConnected() const {
@@ -603,26 +1930,54 @@ public:
   }
 
   Controller::PolicyFlag policyFlags() {
-    return static_cast<Controller::PolicyFlag>(m_policyFlags);
+    return static_cast<Controller::PolicyFlag>(m_policyFlags.load());
   }
 
   void setPolicyFlags(Controller::PolicyFlag flags) {
-    m_policyFlags |= static_cast<uint32_t>(flags);
-    LeapSetPolicyFlags(m_connection, static_cast<uint64_t>(flags), 0);
+    m_policyFlags.fetch_or(static_cast<uint64_t>(flags));
+    LeapSetPolicyFlags(m_connection, static_cast<uint64_t>(flags & ~CLIENT_POLICY_FLAGS), 0);
   }
 
   void setPolicy(Controller::PolicyFlag policy) {
-    m_policyFlags |= static_cast<uint32_t>(policy);
-    LeapSetPolicyFlags(m_connection, static_cast<uint64_t>(m_policyFlags), 0);
+    const uint64_t flags = m_policyFlags.fetch_or(static_cast<uint64_t>(policy)) | static_cast<uint64_t>(policy);
+    LeapSetPolicyFlags(m_connection, flags & ~static_cast<uint64_t>(CLIENT_POLICY_FLAGS), 0);
   }
 
   void clearPolicy(Controller::PolicyFlag policy) {
-    m_policyFlags &= ~static_cast<uint32_t>(policy);
-    LeapSetPolicyFlags(m_connection, 0, static_cast<uint64_t>(policy));
+    m_policyFlags.fetch_and(~static_cast<uint64_t>(policy));
+    LeapSetPolicyFlags(m_connection, 0, static_cast<uint64_t>(policy & ~CLIENT_POLICY_FLAGS));
   }
 
   bool isPolicySet(Controller::PolicyFlag policy) {
-    return (m_policyFlags & static_cast<uint32_t>(policy)) == static_cast<uint32_t>(policy);
+    return (m_policyFlags.load() & static_cast<uint64_t>(policy)) == static_cast<uint64_t>(policy);
+  }
+
+  Controller::SmoothingFilter smoothingFilter() {
+    std::lock_guard<decltype(m_smoothingMutex)> lk(m_smoothingMutex);
+    return m_smoothingParameters.filter;
+  }
+
+  void setSmoothingFilter(Controller::SmoothingFilter filter) {
+    std::lock_guard<decltype(m_smoothingMutex)> lk(m_smoothingMutex);
+    m_smoothingParameters.filter = filter;
+  }
+
+  void setOneEuroParameters(float minCutoff, float beta, float derivativeCutoff) {
+    std::lock_guard<decltype(m_smoothingMutex)> lk(m_smoothingMutex);
+    m_smoothingParameters.minCutoff = std::max(minCutoff, 0.0f);
+    m_smoothingParameters.beta = std::max(beta, 0.0f);
+    m_smoothingParameters.derivativeCutoff = std::max(derivativeCutoff, 0.0f);
+  }
+
+  void setKalmanParameters(float accelerationNoise, float measurementNoise) {
+    std::lock_guard<decltype(m_smoothingMutex)> lk(m_smoothingMutex);
+    m_smoothingParameters.accelerationNoise = std::max(accelerationNoise, 0.0f);
+    m_smoothingParameters.measurementNoise = std::max(measurementNoise, 0.0f);
+  }
+
+  void setKinematicsFilter(float velocityTimeConstant, float accelerationTimeConstant) {
+    m_velocityTimeConstant = std::max(velocityTimeConstant, 0.0f);
+    m_accelerationTimeConstant = std::max(accelerationTimeConstant, 0.0f);
   }
 
   bool addListener(Listener& listener) {
@@ -638,20 +1993,178 @@ public:
   }
 
   bool removeListener(Listener& listener) {
-    std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
-    const bool removed = !!m_listeners.erase(&listener);
-    if (removed)
+    bool removed;
+    std::unique_ptr<ImageDispatcher> dispatcher;
+    {
+      std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
+      removed = !!m_listeners.erase(&listener);
+      auto found = m_imageDeliveries.find(&listener);
+      if (found != m_imageDeliveries.end()) {
+        dispatcher = std::move(found->second.dispatcher);
+        m_imageDeliveries.erase(found);
+      }
+    }
+    // Wait for a call in progress outside the lock, which the listener may need to return
+    dispatcher.reset();
+    if (removed) {
+      std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
       listener.onExit(m_controller);
+    }
     return removed;
   }
 
+  bool setImageDelivery(Listener& listener, float maxRate, bool latestOnly) {
+    std::unique_ptr<ImageDispatcher> stopped;
+    {
+      std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
+      if (!m_listeners.count(&listener))
+        return false;
+      ImageDelivery& delivery = m_imageDeliveries[&listener];
+      delivery.limiter.setRate(maxRate);
+      if (!latestOnly) {
+        stopped = std::move(delivery.dispatcher);
+      } else if (!delivery.dispatcher) {
+        delivery.dispatcher.reset(new ImageDispatcher(listener, m_controller));
+      }
+      if (!(maxRate > 0) && !latestOnly)
+        m_imageDeliveries.erase(&listener);
+    }
+    return true;
+  }
+
   Frame frame(int history) {
+    CompactFrame compactFrame;
     {
       std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
       if (history >= 0 && history < static_cast<int>(m_frames.size()))
         return Frame(m_frames[history].get());
+      const int compact = history - static_cast<int>(m_frames.size());
+      if (history < 0 || compact >= static_cast<int>(m_compactFrames.size()))
+        return Frame();
+      compactFrame = m_compactFrames[compact];
+    }
+    // Decode outside the lock, which the polling thread takes for every frame
+    return Frame(compactFrame.decode().get());
+  }
+
+  void setCompactHistorySize(int frames) {
+    std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+    m_compactHistorySize = std::max(frames, 0);
+    m_compactFrames.resize(std::min(m_compactFrames.size(), static_cast<size_t>(m_compactHistorySize)));
+  }
+
+  int compactHistorySize() {
+    std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+    return m_compactHistorySize;
+  }
+
+  void setRetentionLimits(Controller::RetentionCategory category, int maxCount, int64_t maxBytes) {
+    std::vector<int64_t> evicted;
+    switch (category) {
+    case Controller::RETENTION_FRAMES: {
+      std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+      m_frames.setLimits(std::max(maxCount, 1), maxBytes);
+      evictFrames();
+      break;
+    }
+    case Controller::RETENTION_IMAGES:
+      {
+        std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
+        m_images.setLimits(maxCount, maxBytes);
+        evictImages(evicted);
+      }
+      detachImages(evicted);
+      break;
+    case Controller::RETENTION_MAP_POINTS:
+      {
+        std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
+        m_pointMappingBuffers.setLimits(maxCount, maxBytes);
+        evictMapPoints(evicted);
+      }
+      detachMapPoints(evicted);
+      break;
+    }
+  }
+
+  int retainedCount(Controller::RetentionCategory category) {
+    switch (category) {
+    case Controller::RETENTION_FRAMES: {
+      std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+      return static_cast<int>(m_frames.size());
+    }
+    case Controller::RETENTION_IMAGES: {
+      std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
+      return static_cast<int>(m_images.size());
+    }
+    case Controller::RETENTION_MAP_POINTS: {
+      std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
+      return static_cast<int>(m_pointMappingBuffers.size());
+    }
+    }
+    return 0;
+  }
+
+  int64_t retainedBytes(Controller::RetentionCategory category) {
+    switch (category) {
+    case Controller::RETENTION_FRAMES: {
+      std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+      return m_frames.bytes();
+    }
+    case Controller::RETENTION_IMAGES: {
+      std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
+      return m_images.bytes();
+    }
+    case Controller::RETENTION_MAP_POINTS: {
+      std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
+      return m_pointMappingBuffers.bytes();
+    }
+    }
+    return 0;
+  }
+
+  int32_t addGesture(const GestureDefinition& definition) {
+    return m_gestureEngine.add(definition);
+  }
+
+  bool removeGesture(int32_t gestureId) {
+    return m_gestureEngine.remove(gestureId);
+  }
+
+  int32_t addAggregate(const WindowAggregate& aggregate) {
+    return m_windowAggregator.add(aggregate);
+  }
+
+  bool removeAggregate(int32_t aggregateId) {
+    return m_windowAggregator.remove(aggregateId);
+  }
+
+  float aggregate(int32_t aggregateId, int32_t handId) {
+    return m_windowAggregator.value(aggregateId, handId);
+  }
+
+  Frame predictFrame(int64_t targetTimestamp) {
+    const auto predicted = predictFrame(targetTimestamp, nullptr);
+    return predicted ? Frame(predicted.get()) : Frame();
+  }
+
+  // Extrapolates into reusable if set, or into a new frame; nullptr before the first frame
+  std::shared_ptr<FrameImplementation> predictFrame(int64_t targetTimestamp, std::shared_ptr<FrameImplementation> reusable) {
+    std::shared_ptr<FrameImplementation> latest, previous;
+    {
+      std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+      if (m_frames.empty()) {
+        return nullptr;
+      }
+      latest = m_frames[0];
+      if (m_frames.size() > 1) {
+        previous = m_frames[1];
+      }
+    }
+    if (!reusable) {
+      return latest->predict(previous.get(), targetTimestamp);
     }
-    return Frame();
+    latest->predictInto(previous.get(), targetTimestamp, *reusable);
+    return reusable;
   }
 
   HeadPose headPose(int64_t timestamp) {
@@ -711,38 +2224,15 @@ public:
   }
 
   DeviceList devices() {
-    std::vector<Device> devices;
-    {
-      std::lock_guard<decltype(m_deviceMutex)> lk(m_deviceMutex);
-      devices.reserve(m_devices.size());
-      for (const auto& device : m_devices) {
-        devices.emplace_back(device.second.get());
-      }
-    }
-    return DeviceList(std::make_shared<ListBaseImplementation<Device>>(devices));
+    return DeviceList(std::atomic_load(&m_deviceSnapshot)->devices);
   }
 
   FailedDeviceList failedDevices() {
-    std::vector<FailedDevice> failedDevices;
-    {
-      std::lock_guard<decltype(m_deviceMutex)> lk(m_deviceMutex);
-      failedDevices.reserve(m_devices.size());
-      for (const auto& device : m_devices) {
-        if (LEAP_FAILED(device.second->status())) {
-          FailedDevice::FailureType failure;
-          switch (device.second->status()) {
-          case eLeapDeviceStatus_UnknownFailure: failure = FailedDevice::FAIL_UNKNOWN; break;
-          case eLeapDeviceStatus_BadCalibration: failure = FailedDevice::FAIL_CALIBRATION; break;
-          case eLeapDeviceStatus_BadFirmware: failure = FailedDevice::FAIL_FIRMWARE; break;
-          case eLeapDeviceStatus_BadTransport: failure = FailedDevice::FAIL_TRANSPORT; break;
-          case eLeapDeviceStatus_BadControl: failure = FailedDevice::FAIL_CONTROL; break;
-          default: failure = FailedDevice::FAIL_UNKNOWN; break;
-          }
-          failedDevices.emplace_back(std::make_shared<FailedDeviceImplementation>(device.second->toString(), failure).get());
-        }
-      }
-    }
-    return FailedDeviceList(std::make_shared<ListBaseImplementation<FailedDevice>>(failedDevices));
+    return FailedDeviceList(std::atomic_load(&m_deviceSnapshot)->failedDevices);
+  }
+
+  uint64_t deviceGeneration() const {
+    return m_deviceGeneration;
   }
 
   void setPaused(bool pause) {
@@ -750,14 +2240,7 @@ public:
   }
 
   bool isPaused() {
-    std::lock_guard<decltype(m_deviceMutex)> lk(m_deviceMutex);
-    for (const auto& device : m_devices) {
-      if (!LEAP_FAILED(device.second->status()) &&
-          (device.second->status() & eLeapDeviceStatus_Streaming) == eLeapDeviceStatus_Streaming) {
-        return false; // If any device is streaming, we aren't paused
-      }
-    }
-    return true;
+    return std::atomic_load(&m_deviceSnapshot)->isPaused;
   }
 
   ImageList images() { return getImages(eLeapImageType_Default); }
@@ -799,7 +2282,25 @@ public:
     return nullptr;
   }
 
+  const std::shared_ptr<ImageBufferPool>& imageBufferPool() const { return m_imageBufferPool; }
+  const std::shared_ptr<DistortionMapCache>& distortionMapCache() const { return m_distortionMapCache; }
+  void setCalibrationCacheDirectory(const char* directory) { m_distortionMapCache->setDirectory(directory ? directory : ""); }
+
+  // Image events do not name their device, so images are attributed to the first device
+  std::string imageDeviceSerial() const {
+    const auto snapshot = std::atomic_load(&m_deviceSnapshot);
+    return snapshot->devices->empty() ? std::string() : snapshot->devices->at(0).serialNumber();
+  }
+
 protected:
+  // Immutable view of m_devices, replaced wholesale whenever a device event changes it
+  struct DeviceSnapshot {
+    uint64_t generation = 0;
+    std::shared_ptr<ListBaseImplementation<Device>> devices = std::make_shared<ListBaseImplementation<Device>>();
+    std::shared_ptr<ListBaseImplementation<FailedDevice>> failedDevices = std::make_shared<ListBaseImplementation<FailedDevice>>();
+    bool isPaused = true;
+  };
+
   void onConnection(const LEAP_CONNECTION_EVENT *connection_event) {
     m_isServiceConnected = true;
     std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
@@ -821,7 +2322,10 @@ protected:
     {
       std::lock_guard<decltype(m_deviceMutex)> lk(m_deviceMutex);
       m_devices.clear();
+      updateDeviceSnapshot();
     }
+    // The first frame of the next session reports its hands as found
+    m_previousHands.clear();
   }
 
   void onDeviceStatus(const LEAP_DEVICE_REF& device) {
@@ -832,6 +2336,7 @@ protected:
       std::lock_guard<decltype(m_deviceMutex)> lk(m_deviceMutex);
       newlyConnected = m_devices.empty();
       m_devices[id] = impl;
+      updateDeviceSnapshot();
     }
     {
       std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
@@ -879,9 +2384,11 @@ protected:
       if (m_devices.size() == 1) {
         newlyDisconnected = true;
       }
+      if (impl) {
+        impl->m_info.status = device_event->status;
+        updateDeviceSnapshot();
+      }
     }
-    if (impl)
-      impl->m_info.status = device_event->status;
     {
       std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
       for (auto& listener : m_listeners) {
@@ -896,6 +2403,10 @@ protected:
     {
       std::lock_guard<decltype(m_deviceMutex)> lk(m_deviceMutex);
       m_devices.erase(it);
+      updateDeviceSnapshot();
+    }
+    if (newlyDisconnected) {
+      m_previousHands.clear();
     }
   }
 
@@ -905,6 +2416,7 @@ protected:
       for (const auto& device : m_devices) {
         if (device.second->m_device == device_failure_event->hDevice) {
           device.second->m_info.status = device_failure_event->status;
+          updateDeviceSnapshot();
           break;
         }
       }
@@ -917,8 +2429,75 @@ protected:
     }
   }
 
+  static FailedDevice::FailureType failureType(eLeapDeviceStatus status) {
+    switch (status) {
+    case eLeapDeviceStatus_UnknownFailure: return FailedDevice::FAIL_UNKNOWN;
+    case eLeapDeviceStatus_BadCalibration: return FailedDevice::FAIL_CALIBRATION;
+    case eLeapDeviceStatus_BadFirmware: return FailedDevice::FAIL_FIRMWARE;
+    case eLeapDeviceStatus_BadTransport: return FailedDevice::FAIL_TRANSPORT;
+    case eLeapDeviceStatus_BadControl: return FailedDevice::FAIL_CONTROL;
+    default: return FailedDevice::FAIL_UNKNOWN;
+    }
+  }
+
+  // Rebuilds the device snapshot from m_devices. Must be called with m_deviceMutex held.
+  void updateDeviceSnapshot() {
+    auto snapshot = std::make_shared<DeviceSnapshot>();
+    std::vector<Device> devices;
+    std::vector<FailedDevice> failedDevices;
+    devices.reserve(m_devices.size());
+    for (const auto& device : m_devices) {
+      const eLeapDeviceStatus status = device.second->status();
+      devices.emplace_back(device.second.get());
+      if (LEAP_FAILED(status)) {
+        failedDevices.emplace_back(std::make_shared<FailedDeviceImplementation>(device.second->toString(), failureType(status)).get());
+      } else if ((status & eLeapDeviceStatus_Streaming) == eLeapDeviceStatus_Streaming) {
+        snapshot->isPaused = false; // If any device is streaming, we aren't paused
+      }
+    }
+    snapshot->devices->setData(std::move(devices));
+    snapshot->failedDevices->setData(std::move(failedDevices));
+    // Publish the snapshot before bumping the counter so that a reader who sees the
+    // new generation is guaranteed to also see the new lists
+    snapshot->generation = m_deviceGeneration + 1;
+    std::atomic_store(&m_deviceSnapshot, std::shared_ptr<const DeviceSnapshot>(std::move(snapshot)));
+    ++m_deviceGeneration;
+  }
+
+  // Advances the per-hand joint kinematics and returns the estimates for each hand of the event
+  std::shared_ptr<std::vector<JointKinematics>> updateKinematics(const LEAP_TRACKING_EVENT& tracking_event);
+
+  // Runs the smoothing stage; returns nullptr when it is disabled
+  std::shared_ptr<std::vector<SmoothedJoints>> updateSmoothing(const LEAP_TRACKING_EVENT& tracking_event);
+
   void onTracking(const LEAP_TRACKING_EVENT *tracking_event) {
     auto impl = std::make_shared<FrameImplementation>(*tracking_event);
+    if (isPolicySet(Controller::POLICY_EAGER_DERIVED_DATA)) {
+      impl->computeDerivedData();
+    }
+    std::shared_ptr<std::vector<JointKinematics>> kinematics;
+    if (isPolicySet(Controller::POLICY_JOINT_KINEMATICS)) {
+      kinematics = updateKinematics(*tracking_event);
+      impl->setKinematics(kinematics);
+    } else {
+      m_kinematicsSlots.clear();
+    }
+    impl->setSmoothedJoints(updateSmoothing(*tracking_event));
+    {
+      HandPresence::collect(*tracking_event, m_currentHands);
+      std::vector<HandTransition> transitions;
+      HandPresence::diff(m_previousHands, m_currentHands, transitions);
+      impl->setHandTransitions(transitions);
+      m_handTransitions.swap(transitions);
+      m_previousHands.swap(m_currentHands);
+    }
+    m_gestureEvents.clear();
+    if (!m_gestureEngine.empty()) {
+      m_gestureEngine.update(*tracking_event, kinematics.get(), m_gestureEvents);
+    }
+    if (!m_windowAggregator.empty()) {
+      m_windowAggregator.update(*tracking_event, kinematics.get());
+    }
     const int64_t frame_id = impl->id();
     {
       std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
@@ -935,25 +2514,34 @@ protected:
     }
     {
       std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
-      for (auto it = m_pointMappingBuffers.begin(); it != m_pointMappingBuffers.end(); ++it) {
-        const LEAP_POINT_MAPPING& pointMapping = *reinterpret_cast<LEAP_POINT_MAPPING*>(it->get());
+      for (const auto& buffer : m_pointMappingBuffers) {
+        const LEAP_POINT_MAPPING& pointMapping = *reinterpret_cast<const LEAP_POINT_MAPPING*>(buffer.get());
         if (frame_id == pointMapping.frame_id) {
-          impl->setMapPoints(pointMapping);
-          m_pointMappingBuffers.erase(it, m_pointMappingBuffers.end()); // Discard all older map points
+          impl->setMapPoints(buffer);
           break;
         }
       }
     }
+    const Frame frame(impl.get());
     {
       std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
-      m_frames.emplace_front(std::move(impl));
-      if (m_frames.size() > DEFAULT_FRAME_HISTORY_SIZE) {
-        m_frames.pop_back();
-      }
+      const int64_t bytes = impl->trackingBytes();
+      m_frames.push_front(std::move(impl), bytes);
+      evictFrames();
     }
     {
       std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
       for (auto& listener : m_listeners) {
+        for (const auto& transition : m_handTransitions) {
+          if (transition.type == HandTransition::TYPE_FOUND) {
+            listener->onHandFound(m_controller, frame.hand(transition.handId));
+          } else if (transition.type == HandTransition::TYPE_LOST) {
+            listener->onHandLost(m_controller, transition.handId);
+          }
+        }
+        for (const auto& event : m_gestureEvents) {
+          listener->onGesture(m_controller, event);
+        }
         listener->onFrame(m_controller);
       }
     }
@@ -977,7 +2565,12 @@ protected:
   }
 
   void onPolicy(const LEAP_POLICY_EVENT *policy_event) {
-    m_policyFlags = policy_event->current_policy;
+    // The service does not know about client-side policies, so keep whatever is set locally, even
+    // if a user thread changes them meanwhile
+    const uint64_t service = policy_event->current_policy & ~static_cast<uint64_t>(CLIENT_POLICY_FLAGS);
+    uint64_t flags = m_policyFlags.load();
+    while (!m_policyFlags.compare_exchange_weak(flags, service | (flags & CLIENT_POLICY_FLAGS))) {
+    }
   }
 
   void onConfigChange(const LEAP_CONFIG_CHANGE_EVENT *config_change_event) {
@@ -1013,17 +2606,40 @@ protected:
   }
 
   void onImage(const LEAP_IMAGE_EVENT *image_event) {
+    bool taken = false;
+    bool hasListeners;
+    {
+      std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
+      hasListeners = !m_listeners.empty();
+      for (auto& listener : m_listeners) {
+        auto found = m_imageDeliveries.find(listener);
+        if (found == m_imageDeliveries.end()) {
+          taken = true;
+          continue;
+        }
+        found->second.due = found->second.limiter.accept(image_event->info.timestamp);
+        taken = taken || found->second.due;
+      }
+    }
+    // Without a reference from an image, the buffers are freed as soon as LeapC releases them
+    if (!taken && hasListeners && isPolicySet(Controller::POLICY_LAZY_IMAGE_RETENTION))
+      return;
     {
       std::vector<std::shared_ptr<ImageImplementation>> images;
       images.emplace_back(std::make_shared<ImageImplementation>(std::static_pointer_cast<ControllerImplementation>(shared_from_this()), *image_event, 0));
       images.emplace_back(std::make_shared<ImageImplementation>(std::static_pointer_cast<ControllerImplementation>(shared_from_this()), *image_event, 1));
+      if (isPolicySet(Controller::POLICY_IMAGE_PYRAMIDS)) {
+        for (const auto& image : images) {
+          image->pyramid();
+          image->integralImage();
+        }
+      }
       const int64_t image_id = images[0]->sequenceId();
+      std::vector<int64_t> evicted;
       {
         std::lock_guard<decltype(m_imageMutex)> lk(m_imageMutex);
-        m_images.emplace_front(images);
-        if (m_images.size() > DEFAULT_FRAME_HISTORY_SIZE) {
-          m_images.pop_back();
-        }
+        m_images.push_front(images, imageBytes(images));
+        evictImages(evicted);
       }
       {
         std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
@@ -1040,10 +2656,20 @@ protected:
           }
         }
       }
+      detachImages(evicted);
     }
     std::lock_guard<decltype(m_listenerMutex)> lk(m_listenerMutex);
     for (auto& listener : m_listeners) {
-      listener->onImages(m_controller);
+      auto found = m_imageDeliveries.find(listener);
+      if (found == m_imageDeliveries.end()) {
+        listener->onImages(m_controller);
+      } else if (found->second.due) {
+        found->second.due = false;
+        if (found->second.dispatcher)
+          found->second.dispatcher->post();
+        else
+          listener->onImages(m_controller);
+      }
     }
   }
 
@@ -1067,14 +2693,20 @@ protected:
       return;
     }
     const int64_t map_id = pointMapping->frame_id;
+    std::vector<int64_t> evicted;
+    {
+      std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
+      m_pointMappingBuffers.push_front(buffer, static_cast<int64_t>(size));
+      evictMapPoints(evicted);
+    }
     {
       std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
       if (!m_frames.empty()) {
         for (const auto& frame : m_frames) {
           const int64_t frame_id = frame->id();
           if (map_id == frame_id) {
-            frame->setMapPoints(*pointMapping);
-            return;
+            frame->setMapPoints(buffer);
+            break;
           }
           if (map_id > frame_id) {
             break; // Map points are newer than latest frame
@@ -1082,10 +2714,66 @@ protected:
         }
       }
     }
-    std::lock_guard<decltype(m_mapPointsMutex)> lk(m_mapPointsMutex);
-    m_pointMappingBuffers.emplace_front(std::move(buffer));
-    if (m_pointMappingBuffers.size() > DEFAULT_FRAME_HISTORY_SIZE) {
-      m_pointMappingBuffers.pop_back();
+    detachMapPoints(evicted);
+  }
+
+  static int64_t imageBytes(const std::vector<std::shared_ptr<ImageImplementation>>& images) {
+    int64_t bytes = 0;
+    for (const auto& image : images) {
+      bytes += image->retainedBytes();
+    }
+    return bytes;
+  }
+
+  // The evict functions must be called with the mutex of their category held; the ids of
+  // evicted image pairs and map points are then passed to the detach functions, which take
+  // the frame mutex, so that the retained frames release them too.
+  void evictFrames() {
+    m_frames.evict([this](const std::shared_ptr<FrameImplementation>& frame) {
+      if (m_compactHistorySize > 0) {
+        m_compactFrames.push_front(CompactFrame::encode(frame->trackingEvent()));
+        if (m_compactFrames.size() > static_cast<size_t>(m_compactHistorySize)) {
+          m_compactFrames.pop_back();
+        }
+      }
+    });
+  }
+
+  void evictImages(std::vector<int64_t>& evicted) {
+    m_images.evict([&evicted](const std::vector<std::shared_ptr<ImageImplementation>>& images) {
+      if (!images.empty()) {
+        evicted.push_back(images[0]->sequenceId());
+      }
+    });
+  }
+
+  void evictMapPoints(std::vector<int64_t>& evicted) {
+    m_pointMappingBuffers.evict([&evicted](const std::shared_ptr<uint8_t>& buffer) {
+      evicted.push_back(reinterpret_cast<const LEAP_POINT_MAPPING*>(buffer.get())->frame_id);
+    });
+  }
+
+  void detachImages(const std::vector<int64_t>& evicted) {
+    if (evicted.empty()) {
+      return;
+    }
+    std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+    for (const auto& frame : m_frames) {
+      if (std::find(evicted.begin(), evicted.end(), frame->id()) != evicted.end()) {
+        frame->setImages(std::vector<std::shared_ptr<ImageImplementation>>());
+      }
+    }
+  }
+
+  void detachMapPoints(const std::vector<int64_t>& evicted) {
+    if (evicted.empty()) {
+      return;
+    }
+    std::lock_guard<decltype(m_frameMutex)> lk(m_frameMutex);
+    for (const auto& frame : m_frames) {
+      if (std::find(evicted.begin(), evicted.end(), frame->id()) != evicted.end()) {
+        frame->clearMapPoints();
+      }
     }
   }
 
@@ -1099,7 +2787,7 @@ protected:
   }
 
   void* allocate(uint32_t size) {
-    std::shared_ptr<uint8_t> buffer(new uint8_t[size], std::default_delete<uint8_t[]>());
+    std::shared_ptr<uint8_t> buffer = m_imageBufferPool->acquire(size);
     void* ptr = buffer.get();
     if (ptr) {
       std::lock_guard<decltype(m_memoryMutex)> lk(m_memoryMutex);
@@ -1130,10 +2818,21 @@ protected:
   LEAP_CONNECTION m_connection = nullptr;
   std::thread m_pollingThread;
   std::set<Listener*> m_listeners;
+  struct ImageDelivery {
+    ImageRateLimiter limiter;
+    std::unique_ptr<ImageDispatcher> dispatcher;
+    bool due = false;
+  };
+  // Listeners with a rate limit or latest-only delivery; guarded by m_listenerMutex
+  std::map<Listener*, ImageDelivery> m_imageDeliveries;
   std::map<uint32_t, std::shared_ptr<DeviceImplementation>> m_devices;
-  std::deque<std::shared_ptr<FrameImplementation>> m_frames;
-  std::deque<std::vector<std::shared_ptr<ImageImplementation>>> m_images;
-  std::deque<std::shared_ptr<uint8_t>> m_pointMappingBuffers;
+  std::shared_ptr<const DeviceSnapshot> m_deviceSnapshot = std::make_shared<DeviceSnapshot>();
+  std::atomic<uint64_t> m_deviceGeneration{ 0 };
+  RetentionQueue<std::shared_ptr<FrameImplementation>> m_frames{DEFAULT_FRAME_HISTORY_SIZE};
+  std::deque<CompactFrame> m_compactFrames;
+  int m_compactHistorySize = 0;
+  RetentionQueue<std::vector<std::shared_ptr<ImageImplementation>>> m_images{DEFAULT_FRAME_HISTORY_SIZE};
+  RetentionQueue<std::shared_ptr<uint8_t>> m_pointMappingBuffers{DEFAULT_FRAME_HISTORY_SIZE};
   std::mutex m_listenerMutex;
   std::mutex m_deviceMutex;
   std::mutex m_frameMutex;
@@ -1143,7 +2842,30 @@ protected:
   std::mutex m_configPromiseMutex;
   std::map<uint32_t, std::promise<Leap::Config::Value>> m_configPromises;
   std::unordered_map<void*, std::shared_ptr<uint8_t>> m_memory;
-  uint32_t m_policyFlags = 0;
+  std::shared_ptr<ImageBufferPool> m_imageBufferPool = std::make_shared<ImageBufferPool>();
+  std::shared_ptr<DistortionMapCache> m_distortionMapCache = std::make_shared<DistortionMapCache>();
+  // Policies implemented by this library rather than by the service
+  static const uint32_t CLIENT_POLICY_FLAGS = Controller::POLICY_EAGER_DERIVED_DATA |
+                                              Controller::POLICY_JOINT_KINEMATICS |
+                                              Controller::POLICY_IMAGE_PYRAMIDS |
+                                              Controller::POLICY_LAZY_IMAGE_RETENTION;
+
+  // Set from user threads and merged with service updates on the polling thread
+  std::atomic<uint64_t> m_policyFlags{ 0 };
+
+  // Tracking stages; only touched from the polling thread
+  HandSlotTable<JointKinematicsState> m_kinematicsSlots;
+  std::atomic<float> m_velocityTimeConstant{0.02f};
+  std::atomic<float> m_accelerationTimeConstant{0.05f};
+  HandSlotTable<JointSmoothingState> m_smoothingSlots;
+  std::vector<HandPresence> m_previousHands;
+  std::vector<HandPresence> m_currentHands;
+  std::vector<HandTransition> m_handTransitions;
+  GestureEngine m_gestureEngine;
+  WindowAggregator m_windowAggregator;
+  std::vector<GestureEvent> m_gestureEvents;
+  SmoothingParameters m_smoothingParameters;
+  std::mutex m_smoothingMutex;
   std::atomic<bool> m_isRunning{ false };
   bool m_isServiceConnected = false;
 
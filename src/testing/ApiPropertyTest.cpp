@@ -117,3 +117,15 @@ TEST(ApiPropertyTest, TimestampTest) {
   const auto now = controller.now();
   EXPECT_TRUE(now > 0);
 }
+
+TEST(ApiPropertyTest, DeviceSnapshotTest) {
+  Leap::Controller controller;
+  EXPECT_EQ(0u, controller.deviceGeneration());
+  EXPECT_TRUE(controller.isPaused());
+  EXPECT_TRUE(controller.failedDevices().isEmpty());
+
+  Leap::DeviceList devices = controller.devices();
+  EXPECT_TRUE(devices.isEmpty());
+  devices.append(Leap::DeviceList());
+  EXPECT_TRUE(controller.devices().isEmpty()) << "Appending to a returned list must not modify the controller snapshot";
+}
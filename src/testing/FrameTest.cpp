@@ -0,0 +1,1543 @@
+#include "LeapC++.h"
+#include "LeapImplementationC++.h"
+#include "LeapC.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+LEAP_HAND makeHand(uint32_t id, eLeapHandType type) {
+  LEAP_HAND hand;
+  std::memset(&hand, 0, sizeof(hand));
+  hand.id = id;
+  hand.type = type;
+  for (int d = 0; d < 5; d++) {
+    hand.digits[d].finger_id = d;
+    for (int b = 0; b < 4; b++) {
+      LEAP_BONE& bone = hand.digits[d].bones[b];
+      bone.prev_joint.x = 20.0f*d; bone.prev_joint.y = 200.0f; bone.prev_joint.z = -10.0f*b;
+      bone.next_joint.x = 20.0f*d; bone.next_joint.y = 200.0f; bone.next_joint.z = -10.0f*(b + 1);
+      bone.rotation.w = 1.0f;
+    }
+  }
+  return hand;
+}
+
+Leap::Frame makeFrame(int64_t frameId, std::vector<LEAP_HAND> hands, bool eagerDerivedData = false) {
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = frameId;
+  event.nHands = static_cast<uint32_t>(hands.size());
+  event.pHands = hands.empty() ? nullptr : &hands[0];
+  auto impl = std::make_shared<Leap::FrameImplementation>(event);
+  if (eagerDerivedData) {
+    impl->computeDerivedData();
+  }
+  return Leap::Frame(impl.get());
+}
+
+void expectMatrixEq(const Leap::Matrix& expected, const Leap::Matrix& actual) {
+  EXPECT_EQ(expected.xBasis, actual.xBasis);
+  EXPECT_EQ(expected.yBasis, actual.yBasis);
+  EXPECT_EQ(expected.zBasis, actual.zBasis);
+}
+
+// A directory of its own for a test, removed with the files named through file() when the
+// test ends, whether or not it passes
+class TemporaryDirectory {
+public:
+  TemporaryDirectory() {
+#ifdef _WIN32
+    char name[] = "LeapCppTestXXXXXX";
+    if (_mktemp_s(name, sizeof(name)) == 0 && _mkdir(name) == 0) {
+      m_path = name;
+    }
+#else
+    const char* base = std::getenv("TMPDIR");
+    std::string name = std::string(base && *base ? base : "/tmp") + "/LeapCppTestXXXXXX";
+    if (mkdtemp(&name[0])) {
+      m_path = name;
+    }
+#endif
+  }
+
+  ~TemporaryDirectory() {
+    for (const auto& file : m_files) {
+      std::remove(file.c_str());
+    }
+    if (!m_path.empty()) {
+#ifdef _WIN32
+      _rmdir(m_path.c_str());
+#else
+      rmdir(m_path.c_str());
+#endif
+    }
+  }
+
+  const std::string& path() const { return m_path; }
+
+  std::string file(const std::string& name) {
+    m_files.push_back(m_path + "/" + name);
+    return m_files.back();
+  }
+
+private:
+  std::string m_path;
+  std::vector<std::string> m_files;
+};
+
+// Exposes the event handlers of a controller, so that tests can feed it events without a service
+class EventController : public Leap::ControllerImplementation {
+public:
+  explicit EventController(const Leap::Controller& controller) : ControllerImplementation(controller) {}
+  using ControllerImplementation::onTracking;
+  using ControllerImplementation::onConnectionLost;
+  using ControllerImplementation::onImage;
+  using ControllerImplementation::allocate;
+  using ControllerImplementation::deallocate;
+};
+
+void trackFrame(EventController& controller, int64_t frameId) {
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = frameId;
+  event.info.timestamp = frameId*10000;
+  controller.onTracking(&event);
+}
+
+// Delivers a pair of 8x8 images that share the pixels at data
+void deliverImages(EventController& controller, int64_t frameId, int64_t timestamp, void* data) {
+  LEAP_IMAGE_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = frameId;
+  event.info.timestamp = timestamp;
+  for (int i = 0; i < 2; i++) {
+    event.image[i].properties.type = eLeapImageType_Default;
+    event.image[i].properties.width = 8;
+    event.image[i].properties.height = 8;
+    event.image[i].properties.bpp = 1;
+    event.image[i].data = data;
+  }
+  controller.onImage(&event);
+}
+
+}
+
+TEST(FrameTest, HandAndFingerById) {
+  Leap::Frame frame = makeFrame(1, { makeHand(3, eLeapHandType_Left), makeHand(7, eLeapHandType_Right) });
+
+  Leap::Hand hand = frame.hand(7);
+  ASSERT_TRUE(hand.isValid());
+  EXPECT_EQ(7, hand.id());
+  EXPECT_TRUE(hand.isRight());
+  EXPECT_FALSE(frame.hand(5).isValid());
+
+  Leap::Finger finger = frame.finger(72);
+  ASSERT_TRUE(finger.isValid());
+  EXPECT_EQ(72, finger.id());
+  EXPECT_EQ(Leap::Finger::TYPE_MIDDLE, finger.type());
+  EXPECT_EQ(hand.finger(72), finger) << "Lookups by id must resolve to the same cached finger";
+  EXPECT_EQ(frame.hand(3).finger(34), frame.finger(34));
+  EXPECT_FALSE(frame.finger(75).isValid());
+  EXPECT_FALSE(frame.finger(-1).isValid());
+  EXPECT_FALSE(hand.finger(34).isValid());
+
+  EXPECT_EQ(2, frame.hands().count());
+  EXPECT_EQ(10, frame.fingers().count());
+}
+
+TEST(FrameTest, EagerDerivedDataMatchesLazy) {
+  LEAP_HAND raw = makeHand(4, eLeapHandType_Left);
+  raw.palm.normal = {{{0.0f, -1.0f, 0.0f}}};
+  raw.palm.direction = {{{0.0f, 0.0f, -2.0f}}};
+  raw.arm.prev_joint = {{{0.0f, 100.0f, 250.0f}}};
+  raw.arm.next_joint = {{{0.0f, 150.0f, 50.0f}}};
+  raw.arm.rotation = {{{0.0f, 0.38268343f, 0.0f, 0.92387953f}}};
+  raw.digits[2].bones[1].rotation = {{{0.5f, 0.5f, 0.5f, 0.5f}}};
+
+  const Leap::Frame lazyFrame = makeFrame(1, { raw });
+  const Leap::Frame eagerFrame = makeFrame(1, { raw }, true);
+  Leap::Hand lazy = lazyFrame.hand(4);
+  Leap::Hand eager = eagerFrame.hand(4);
+  ASSERT_TRUE(lazy.isValid());
+  ASSERT_TRUE(eager.isValid());
+
+  EXPECT_EQ(lazy.direction(), eager.direction());
+  EXPECT_EQ(Leap::Vector(0, 0, -1), eager.direction());
+  expectMatrixEq(lazy.basis(), eager.basis());
+  EXPECT_EQ(lazy.arm().direction(), eager.arm().direction());
+  expectMatrixEq(lazy.arm().basis(), eager.arm().basis());
+
+  for (int f = 0; f < 5; f++) {
+    const Leap::Finger lazyFinger = lazy.finger(40 + f);
+    const Leap::Finger eagerFinger = eager.finger(40 + f);
+    for (int b = 0; b < 4; b++) {
+      const Leap::Bone::Type type = static_cast<Leap::Bone::Type>(b);
+      const Leap::Bone lazyBone = lazyFinger.bone(type);
+      const Leap::Bone eagerBone = eagerFinger.bone(type);
+      EXPECT_EQ(lazyBone.direction(), eagerBone.direction());
+      EXPECT_EQ(lazyBone.length(), eagerBone.length());
+      expectMatrixEq(lazyBone.basis(), eagerBone.basis());
+      EXPECT_EQ(lazyBone, lazyFinger.bone(type)) << "Bones must be cached by their finger";
+    }
+  }
+  EXPECT_FLOAT_EQ(10.0f, eager.finger(42).bone(Leap::Bone::TYPE_PROXIMAL).length());
+}
+
+TEST(FrameTest, JointKinematics) {
+  LEAP_HAND raw = makeHand(5, eLeapHandType_Right);
+  Leap::HandSlotTable<Leap::JointKinematicsState> slots;
+
+  // The index tip moves 1mm and then 3mm along x over two 10ms intervals
+  const float tipX[] = { 0.0f, 1.0f, 4.0f };
+  for (int64_t i = 0; i < 3; i++) {
+    raw.digits[1].distal.next_joint.x = tipX[i];
+    Leap::JointKinematicsState* state = slots.update(5, i);
+    ASSERT_NE(nullptr, state);
+    state->update(raw, 10000*i, 0.0f, 0.0f);
+    slots.releaseStale(i);
+  }
+  const Leap::JointKinematicsState* state = slots.find(5);
+  ASSERT_NE(nullptr, state);
+  const int tip = Leap::HandJoints::index(1, Leap::Finger::JOINT_TIP);
+  EXPECT_NEAR(300.0f, state->estimate.velocity[tip].x, 1e-2f);
+  EXPECT_NEAR(20000.0f, state->estimate.acceleration[tip].x, 1.0f);
+  EXPECT_EQ(Leap::Vector::zero(), state->estimate.velocity[Leap::HandJoints::PALM]);
+
+  // The estimates are published through the frame
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 3;
+  event.nHands = 1;
+  event.pHands = &raw;
+  auto impl = std::make_shared<Leap::FrameImplementation>(event);
+  impl->setKinematics(std::make_shared<std::vector<Leap::JointKinematics>>(1, state->estimate));
+  const Leap::Frame frame(impl.get());
+  const Leap::Finger finger = frame.finger(51);
+  EXPECT_EQ(state->estimate.velocity[tip], finger.tipVelocity());
+  EXPECT_EQ(state->estimate.acceleration[tip], finger.jointAcceleration(Leap::Finger::JOINT_TIP));
+  EXPECT_EQ(Leap::Vector::zero(), frame.finger(21).tipVelocity());
+
+  // A frame without the hand releases its slot
+  slots.releaseStale(3);
+  EXPECT_EQ(nullptr, slots.find(5));
+}
+
+TEST(FrameTest, JointSmoothing) {
+  LEAP_HAND raw = makeHand(6, eLeapHandType_Right);
+  Leap::SmoothingParameters params;
+  Leap::SmoothedJoints smoothed;
+  const int tip = Leap::HandJoints::index(1, Leap::Finger::JOINT_TIP);
+
+  // One-Euro: a step is followed partially, never overshot
+  params.filter = Leap::Controller::SMOOTHING_ONE_EURO;
+  Leap::JointSmoothingState oneEuro = Leap::JointSmoothingState();
+  oneEuro.update(raw, 0, params, smoothed);
+  EXPECT_EQ(Leap::Vector(20.0f, 200.0f, -40.0f), smoothed.position[tip]);
+  raw.digits[1].distal.next_joint.x = 30.0f;
+  oneEuro.update(raw, 10000, params, smoothed);
+  EXPECT_GT(smoothed.position[tip].x, 20.0f);
+  EXPECT_LT(smoothed.position[tip].x, 30.0f);
+  EXPECT_FLOAT_EQ(200.0f, smoothed.position[tip].y);
+
+  // Kalman: a joint moving at a constant velocity is tracked without lag once converged
+  params.filter = Leap::Controller::SMOOTHING_KALMAN;
+  Leap::JointSmoothingState kalman = Leap::JointSmoothingState();
+  for (int64_t i = 0; i < 200; i++) {
+    raw.palm.position.x = 0.5f*static_cast<float>(i); // 50 mm/s at 100 Hz
+    kalman.update(raw, 10000*i, params, smoothed);
+  }
+  EXPECT_NEAR(99.5f, smoothed.position[Leap::HandJoints::PALM].x, 0.05f);
+  EXPECT_NEAR(50.0f, kalman.derivative[Leap::HandJoints::PALM*3], 0.5f);
+
+  // Switching filters restarts at the measurement
+  params.filter = Leap::Controller::SMOOTHING_ONE_EURO;
+  raw.palm.position.x = -100.0f;
+  kalman.update(raw, 2000000, params, smoothed);
+  EXPECT_EQ(-100.0f, smoothed.position[Leap::HandJoints::PALM].x);
+}
+
+TEST(FrameTest, PredictFrame) {
+  LEAP_HAND h0 = makeHand(8, eLeapHandType_Right);
+  LEAP_HAND h1 = h0;
+  h0.palm.orientation.w = 1.0f;
+  h1.palm.orientation.w = 1.0f;
+  h1.palm.position.x = 10.0f; // 10mm over 10ms
+  h1.digits[1].distal.next_joint.z = h0.digits[1].distal.next_joint.z - 5.0f;
+  // The index intermediate bone turns 10 degrees about y between the frames
+  const float half = 5.0f*Leap::DEG_TO_RAD;
+  h1.digits[1].intermediate.rotation.y = std::sin(half);
+  h1.digits[1].intermediate.rotation.w = std::cos(half);
+
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 1;
+  event.info.timestamp = 1000000;
+  event.nHands = 1;
+  event.pHands = &h0;
+  auto previous = std::make_shared<Leap::FrameImplementation>(event);
+  event.info.frame_id = 2;
+  event.info.timestamp = 1010000;
+  event.pHands = &h1;
+  auto latest = std::make_shared<Leap::FrameImplementation>(event);
+
+  const auto prediction = latest->predict(previous.get(), 1015000);
+  const Leap::Frame predicted(prediction.get());
+  EXPECT_EQ(2, predicted.id());
+  EXPECT_EQ(1015000, predicted.timestamp());
+  const Leap::Hand hand = predicted.hand(8);
+  ASSERT_TRUE(hand.isValid());
+  EXPECT_NEAR(15.0f, hand.palmPosition().x, 1e-4f);
+  EXPECT_NEAR(-47.5f, predicted.finger(81).tipPosition().z, 1e-4f);
+  const Leap::Matrix basis = predicted.finger(81).bone(Leap::Bone::TYPE_INTERMEDIATE).basis();
+  EXPECT_NEAR(std::cos(15.0f*Leap::DEG_TO_RAD), basis.xBasis.x, 1e-5f);
+  // The collision bounds follow the predicted hand
+  const Leap::AxisAlignedBox bounds = Leap::HandCapsules::bounds(*prediction->rawHand(8));
+  EXPECT_EQ(bounds.min.z, prediction->handBounds()[0].min.z);
+  EXPECT_NE(latest->handBounds()[0].min.z, prediction->handBounds()[0].min.z);
+
+  // Prediction is capped at 100ms; a hand without history moves with its palm velocity
+  h1.palm.velocity.y = 100.0f;
+  event.pHands = &h1;
+  auto alone = std::make_shared<Leap::FrameImplementation>(event);
+  const Leap::Frame capped(alone->predict(nullptr, 5000000).get());
+  EXPECT_EQ(1110000, capped.timestamp());
+  EXPECT_NEAR(10.0f, capped.hand(8).palmPosition().y, 1e-4f);
+
+  // Predicting into the same frame again reuses its hand storage
+  Leap::FrameImplementation reused;
+  latest->predictInto(previous.get(), 1015000, reused);
+  const LEAP_HAND* storage = reused.rawHand(8);
+  ASSERT_NE(nullptr, storage);
+  latest->predictInto(previous.get(), 1020000, reused);
+  EXPECT_EQ(storage, reused.rawHand(8));
+  EXPECT_EQ(1020000, reused.timestamp());
+  EXPECT_NEAR(20.0f, storage->palm.position.x, 1e-4f);
+}
+
+TEST(FrameTest, PredictIntoFrame) {
+  Leap::Controller placeholder;
+  auto impl = std::make_shared<EventController>(placeholder);
+  Leap::Controller controller(impl.get());
+  Leap::Frame into;
+  EXPECT_FALSE(controller.predictFrame(1000, into));
+
+  LEAP_HAND hand = makeHand(8, eLeapHandType_Right);
+  hand.palm.orientation.w = 1.0f;
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.nHands = 1;
+  event.pHands = &hand;
+  for (int64_t id = 1; id <= 2; id++) {
+    event.info.frame_id = id;
+    event.info.timestamp = id*10000;
+    hand.palm.position.x = 10.0f*id;
+    impl->onTracking(&event);
+  }
+  ASSERT_TRUE(controller.predictFrame(25000, into));
+  EXPECT_EQ(25000, into.timestamp());
+  EXPECT_NEAR(25.0f, into.hand(8).palmPosition().x, 1e-4f);
+
+  // A frame shared with another Frame object is replaced rather than refilled
+  const Leap::Frame held = into;
+  ASSERT_TRUE(controller.predictFrame(30000, into));
+  EXPECT_TRUE(into != held);
+  EXPECT_EQ(25000, held.timestamp());
+  EXPECT_NEAR(30.0f, into.hand(8).palmPosition().x, 1e-4f);
+}
+
+TEST(GestureEngineTest, PinchAndSwipe) {
+  Leap::GestureEngine engine;
+  const int32_t pinch = engine.add(Leap::GestureDefinition::pinch());
+  const int32_t swipe = engine.add(Leap::GestureDefinition::swipe(Leap::GestureDefinition::SIGNAL_PALM_VELOCITY_X, -800.0f));
+
+  LEAP_HAND hand = makeHand(2, eLeapHandType_Right);
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.nHands = 1;
+  event.pHands = &hand;
+  std::vector<Leap::GestureEvent> events;
+  auto step = [&](int64_t frameId, float pinchStrength, float velocityX) {
+    hand.pinch_strength = pinchStrength;
+    hand.palm.velocity.x = velocityX;
+    event.info.frame_id = frameId;
+    event.info.timestamp = frameId*10000;
+    events.clear();
+    engine.update(event, nullptr, events);
+  };
+
+  step(1, 0.5f, 0.0f);
+  EXPECT_TRUE(events.empty());
+  step(2, 0.85f, 0.0f);
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ(pinch, events[0].gestureId);
+  EXPECT_EQ(2, events[0].handId);
+  EXPECT_EQ(Leap::GestureEvent::STATE_START, events[0].state);
+  step(3, 0.7f, 0.0f); // Inside the hysteresis band
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ(Leap::GestureEvent::STATE_UPDATE, events[0].state);
+  step(4, 0.5f, 0.0f);
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ(Leap::GestureEvent::STATE_STOP, events[0].state);
+  EXPECT_EQ(20000, events[0].duration);
+
+  // A discrete swipe reports once, when it completes within its time limits
+  step(5, 0.0f, -1000.0f);
+  step(6, 0.0f, -900.0f);
+  step(7, 0.0f, -900.0f);
+  EXPECT_TRUE(events.empty());
+  step(8, 0.0f, -100.0f);
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ(swipe, events[0].gestureId);
+  EXPECT_EQ(Leap::GestureEvent::STATE_STOP, events[0].state);
+
+  // A swipe released after its time limit does not report, even if no frame saw it held that long
+  step(9, 0.0f, -1000.0f);
+  step(70, 0.0f, -100.0f);
+  EXPECT_TRUE(events.empty());
+
+  // Losing the hand stops a gesture in progress
+  step(71, 0.9f, 0.0f);
+  ASSERT_EQ(1u, events.size());
+  event.nHands = 0;
+  step(72, 0.9f, 0.0f);
+  ASSERT_EQ(1u, events.size());
+  EXPECT_EQ(Leap::GestureEvent::STATE_STOP, events[0].state);
+  EXPECT_EQ(2, events[0].handId);
+
+  EXPECT_TRUE(engine.remove(swipe));
+  EXPECT_FALSE(engine.remove(swipe));
+}
+
+TEST(FrameTest, HandTransitions) {
+  std::vector<LEAP_HAND> hands = { makeHand(9, eLeapHandType_Right), makeHand(4, eLeapHandType_Left) };
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.nHands = 2;
+  event.pHands = &hands[0];
+
+  std::vector<Leap::HandPresence> previous, current;
+  std::vector<Leap::HandTransition> transitions;
+  Leap::HandPresence::collect(event, previous);
+  ASSERT_EQ(2u, previous.size());
+  EXPECT_EQ(4, previous[0].id);
+
+  // Hand 4 leaves, hand 6 arrives and hand 9 extends its index finger
+  hands[1] = makeHand(6, eLeapHandType_Left);
+  hands[0].digits[1].is_extended = 1;
+  Leap::HandPresence::collect(event, current);
+  Leap::HandPresence::diff(previous, current, transitions);
+  ASSERT_EQ(3u, transitions.size());
+  EXPECT_EQ(4, transitions[0].handId);
+  EXPECT_EQ(Leap::HandTransition::TYPE_LOST, transitions[0].type);
+  EXPECT_EQ(6, transitions[1].handId);
+  EXPECT_EQ(Leap::HandTransition::TYPE_FOUND, transitions[1].type);
+  EXPECT_EQ(9, transitions[2].handId);
+  EXPECT_EQ(Leap::HandTransition::TYPE_CHANGED, transitions[2].type);
+  EXPECT_EQ(0x2, transitions[2].extendedFingers);
+  EXPECT_EQ(0x0, transitions[2].previousExtendedFingers);
+
+  Leap::HandPresence::diff(current, current, transitions);
+  EXPECT_TRUE(transitions.empty());
+
+  // After a lost connection, the hands of the first frame are found again
+  Leap::Controller placeholder;
+  auto impl = std::make_shared<EventController>(placeholder);
+  Leap::Controller controller(impl.get());
+  event.nHands = 1;
+  for (int64_t id = 1; id <= 3; id++) {
+    if (id == 3) {
+      impl->onConnectionLost(nullptr);
+    }
+    event.info.frame_id = id;
+    impl->onTracking(&event);
+    const Leap::HandTransitionList found = controller.frame().handTransitions();
+    ASSERT_EQ(id == 2 ? 0 : 1, found.count());
+    if (id != 2) {
+      EXPECT_EQ(Leap::HandTransition::TYPE_FOUND, found[0].type);
+    }
+  }
+}
+
+TEST(FrameTest, WindowAggregates) {
+  Leap::WindowAggregator aggregator;
+  const int32_t maxSpeed = aggregator.add(Leap::WindowAggregate{Leap::GestureDefinition::SIGNAL_PALM_SPEED, Leap::WindowAggregate::KIND_MAX, 50000, 0.0f});
+  const int32_t minSpeed = aggregator.add(Leap::WindowAggregate{Leap::GestureDefinition::SIGNAL_PALM_SPEED, Leap::WindowAggregate::KIND_MIN, 50000, 0.0f});
+  const int32_t meanConfidence = aggregator.add(Leap::WindowAggregate{Leap::GestureDefinition::SIGNAL_CONFIDENCE, Leap::WindowAggregate::KIND_MEAN, 20000, 0.0f});
+  const int32_t pinchHeld = aggregator.add(Leap::WindowAggregate{Leap::GestureDefinition::SIGNAL_PINCH_STRENGTH, Leap::WindowAggregate::KIND_HELD_DURATION, 0, 0.8f});
+
+  LEAP_HAND hand = makeHand(3, eLeapHandType_Left);
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.nHands = 1;
+  event.pHands = &hand;
+
+  // Frames every 10ms; window contents are the samples within the last 50ms (or 20ms)
+  const float speeds[] = { 100.0f, 400.0f, 200.0f, 300.0f, 50.0f, 250.0f, 150.0f, 120.0f };
+  const float confidence[] = { 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f };
+  const float pinch[] = { 0.0f, 0.0f, 0.0f, 0.9f, 0.9f, 0.95f, 0.85f, 0.9f };
+  for (int i = 0; i < 8; i++) {
+    hand.palm.velocity.x = speeds[i];
+    hand.confidence = confidence[i];
+    hand.pinch_strength = pinch[i];
+    event.info.frame_id = i;
+    event.info.timestamp = 10000*i;
+    aggregator.update(event, nullptr);
+  }
+  // Window for frame 7 (t = 70ms) covers t = 20..70ms, i.e. samples 2..7
+  EXPECT_FLOAT_EQ(300.0f, aggregator.value(maxSpeed, 3));
+  EXPECT_FLOAT_EQ(50.0f, aggregator.value(minSpeed, 3));
+  EXPECT_NEAR(0.7f, aggregator.value(meanConfidence, 3), 1e-6f);
+  EXPECT_NEAR(0.04f, aggregator.value(pinchHeld, 3), 1e-6f);
+  EXPECT_EQ(0.0f, aggregator.value(maxSpeed, 4));
+
+  // Removing an aggregate keeps the ids of the later ones
+  EXPECT_TRUE(aggregator.remove(minSpeed));
+  EXPECT_FALSE(aggregator.remove(minSpeed));
+  EXPECT_EQ(0.0f, aggregator.value(minSpeed, 3));
+  EXPECT_FLOAT_EQ(300.0f, aggregator.value(maxSpeed, 3));
+  EXPECT_NEAR(0.7f, aggregator.value(meanConfidence, 3), 1e-6f);
+  EXPECT_NEAR(0.04f, aggregator.value(pinchHeld, 3), 1e-6f);
+
+  // Aggregates restart when the hand is lost
+  event.nHands = 0;
+  event.info.frame_id = 8;
+  aggregator.update(event, nullptr);
+  EXPECT_EQ(0.0f, aggregator.value(maxSpeed, 3));
+}
+
+TEST(FrameTest, MotionSince) {
+  const Leap::Matrix rotation(Leap::Vector(1, 2, 3).normalized(), 0.4f);
+  const Leap::Vector translation(5.0f, -3.0f, 12.0f);
+  const float scale = 1.1f;
+  auto moved = [&](LEAP_HAND hand) {
+    auto apply = [&](LEAP_VECTOR& p) {
+      const Leap::Vector q = rotation.transformDirection(Leap::Vector(p.v))*scale + translation;
+      p.x = q.x; p.y = q.y; p.z = q.z;
+    };
+    for (int d = 0; d < 5; d++) {
+      for (int b = 0; b < 4; b++) {
+        apply(hand.digits[d].bones[b].prev_joint);
+        apply(hand.digits[d].bones[b].next_joint);
+      }
+    }
+    apply(hand.palm.position);
+    apply(hand.arm.next_joint);
+    return hand;
+  };
+  LEAP_HAND left = makeHand(3, eLeapHandType_Left);
+  left.palm.position = {{{40.0f, 180.0f, 20.0f}}};
+  left.arm.next_joint = {{{40.0f, 170.0f, 80.0f}}};
+  LEAP_HAND right = makeHand(7, eLeapHandType_Right);
+
+  const Leap::Frame before = makeFrame(1, { left, right });
+  const Leap::Frame after = makeFrame(2, { moved(left), makeHand(9, eLeapHandType_Right) });
+
+  const Leap::RigidMotion handMotion = after.hand(3).motionSince(before.hand(3));
+  ASSERT_TRUE(handMotion.valid);
+  EXPECT_NEAR(scale, handMotion.scale, 1e-4f);
+  EXPECT_NEAR(0.0f, handMotion.rmsError, 1e-2f);
+  EXPECT_NEAR(0.0f, (handMotion.rotation.xBasis - rotation.xBasis).magnitude(), 1e-4f);
+  EXPECT_NEAR(0.0f, (handMotion.rotation.yBasis - rotation.yBasis).magnitude(), 1e-4f);
+  EXPECT_NEAR(0.0f, (handMotion.rotation.zBasis - rotation.zBasis).magnitude(), 1e-4f);
+  EXPECT_NEAR(0.0f, (handMotion.translation - translation).magnitude(), 1e-2f);
+  const Leap::Vector joint = before.hand(3).fingers()[2].jointPosition(Leap::Finger::JOINT_TIP);
+  EXPECT_NEAR(0.0f, (handMotion.toMatrix().transformPoint(joint) -
+                     after.hand(3).fingers()[2].jointPosition(Leap::Finger::JOINT_TIP)).magnitude(), 1e-2f);
+
+  // Only hand 3 is in both frames, so the frame motion is that of hand 3
+  const Leap::RigidMotion frameMotion = after.motionSince(before);
+  ASSERT_TRUE(frameMotion.valid);
+  EXPECT_NEAR(handMotion.scale, frameMotion.scale, 1e-5f);
+  EXPECT_NEAR(0.0f, (frameMotion.translation - translation).magnitude(), 1e-2f);
+
+  EXPECT_FALSE(after.motionSince(makeFrame(3, {})).valid);
+  EXPECT_FALSE(after.hand(9).motionSince(before.hand(9)).valid);
+}
+
+TEST(FrameTest, BoneInstances) {
+  LEAP_HAND raw = makeHand(4, eLeapHandType_Left);
+  raw.digits[2].bones[1].rotation = {{{0.5f, 0.5f, 0.5f, 0.5f}}};
+  raw.digits[2].bones[1].width = 16.0f;
+  raw.arm.prev_joint = {{{0.0f, 100.0f, 250.0f}}};
+  raw.arm.next_joint = {{{0.0f, 150.0f, 50.0f}}};
+  raw.arm.rotation.w = 1.0f;
+  const Leap::Frame frame = makeFrame(1, { makeHand(2, eLeapHandType_Right), raw });
+  const int flags = Leap::Frame::BONE_INSTANCE_PALM_AND_ARM;
+  ASSERT_EQ(44u, frame.boneInstanceCount(flags));
+  ASSERT_EQ(64u, Leap::Frame::boneInstanceStride(flags));
+
+  std::vector<float> buffer(16*44);
+  ASSERT_EQ(44u, frame.writeBoneInstances(buffer.data(), buffer.size()*sizeof(float), flags));
+  const Leap::Bone bone = frame.hand(4).fingers()[2].bone(Leap::Bone::TYPE_PROXIMAL);
+  const float* instance = &buffer[16*(22 + 9)];
+  const Leap::Matrix basis = bone.basis();
+  EXPECT_EQ(basis.xBasis, Leap::Vector(instance[0], instance[4], instance[8]));
+  EXPECT_EQ(basis.yBasis, Leap::Vector(instance[1], instance[5], instance[9]));
+  EXPECT_EQ(basis.zBasis, Leap::Vector(instance[2], instance[6], instance[10]));
+  EXPECT_EQ(bone.center(), Leap::Vector(instance[3], instance[7], instance[11]));
+  EXPECT_EQ(8.0f, instance[12]);
+  EXPECT_EQ(bone.length(), instance[13]);
+  EXPECT_EQ(9.0f, instance[14]);
+  EXPECT_EQ(1.0f, instance[15]);
+  const float* arm = &buffer[16*43];
+  EXPECT_EQ(frame.hand(4).arm().center(), Leap::Vector(arm[3], arm[7], arm[11]));
+  EXPECT_FLOAT_EQ(frame.hand(4).arm().elbowPosition().distanceTo(frame.hand(4).arm().wristPosition()), arm[13]);
+  EXPECT_EQ(21.0f, arm[14]);
+
+  // Only whole hands are written
+  EXPECT_EQ(22u, frame.writeBoneInstances(buffer.data(), 64*30, flags));
+  EXPECT_EQ(0u, frame.writeBoneInstances(nullptr, 0, flags));
+
+  const int halfFlags = flags | Leap::Frame::BONE_INSTANCE_HALF_FLOAT;
+  std::vector<uint16_t> halves(16*44);
+  ASSERT_EQ(32u, Leap::Frame::boneInstanceStride(halfFlags));
+  ASSERT_EQ(44u, frame.writeBoneInstances(halves.data(), halves.size()*sizeof(uint16_t), halfFlags));
+  EXPECT_EQ(0x4800, halves[16*(22 + 9) + 12]); // 8.0
+  EXPECT_EQ(0x4880, halves[16*(22 + 9) + 14]); // 9.0
+  EXPECT_EQ(0x3c00, halves[16*(22 + 9) + 15]); // 1.0
+  EXPECT_EQ(0x5a40, halves[16*(22 + 9) + 7]);  // 200.0
+}
+
+TEST(CollisionSceneTest, Contacts) {
+  LEAP_HAND raw = makeHand(5, eLeapHandType_Right);
+  for (int d = 0; d < 5; d++) {
+    for (int b = 0; b < 4; b++) {
+      raw.digits[d].bones[b].width = 8.0f;
+    }
+  }
+  const Leap::Frame frame = makeFrame(1, { raw });
+
+  Leap::CollisionScene scene;
+  // Distant clutter that the broadphase must reject
+  std::vector<Leap::Collider> colliders;
+  for (int i = 0; i < 2000; i++) {
+    colliders.push_back(Leap::Collider::sphere(Leap::Vector(500.0f + 3.0f*(i % 40), 50.0f*(i/40), -300.0f), 1.0f, 1000 + i));
+  }
+  scene.setColliders(colliders.data(), colliders.size());
+  scene.addCollider(Leap::Collider::sphere(Leap::Vector(40.0f, 210.0f, -15.0f), 7.0f, 1));
+  scene.addCollider(Leap::Collider::box(Leap::Vector(85.0f, 205.0f, -35.0f), Leap::Vector(75.0f, 195.0f, -45.0f), 2));
+  scene.addCollider(Leap::Collider::triangle(Leap::Vector(10.0f, 197.0f, -5.0f), Leap::Vector(30.0f, 197.0f, -5.0f),
+                                             Leap::Vector(20.0f, 197.0f, -15.0f), 3));
+  EXPECT_EQ(2003u, scene.count());
+
+  const Leap::ContactList contacts = scene.contacts(frame);
+  ASSERT_EQ(4, contacts.count());
+  for (const Leap::Contact& contact : contacts) {
+    EXPECT_EQ(5, contact.handId);
+    EXPECT_NEAR(1.0f, contact.normal.magnitude(), 1e-5f);
+  }
+
+  EXPECT_EQ(3, contacts[0].colliderId);
+  EXPECT_EQ(4, contacts[0].part);
+  EXPECT_EQ(Leap::Vector(0.0f, 1.0f, 0.0f), contacts[0].normal);
+  EXPECT_NEAR(1.0f, contacts[0].depth, 1e-4f);
+  EXPECT_EQ(3, contacts[1].colliderId);
+  EXPECT_EQ(5, contacts[1].part);
+
+  EXPECT_EQ(1, contacts[2].colliderId);
+  EXPECT_EQ(9, contacts[2].part);
+  EXPECT_EQ(Leap::Vector(0.0f, -1.0f, 0.0f), contacts[2].normal);
+  EXPECT_NEAR(1.0f, contacts[2].depth, 1e-4f);
+  EXPECT_NEAR(0.0f, contacts[2].position.distanceTo(Leap::Vector(40.0f, 203.0f, -15.0f)), 1e-4f);
+
+  EXPECT_EQ(2, contacts[3].colliderId);
+  EXPECT_EQ(19, contacts[3].part);
+  EXPECT_GT(contacts[3].depth, 4.0f);
+
+  scene.clear();
+  EXPECT_TRUE(scene.contacts(frame).isEmpty());
+}
+
+TEST(PoseIndexTest, FeaturesAndNearest) {
+  // Features do not depend on the position, orientation or size of the hand
+  LEAP_HAND raw = makeHand(1, eLeapHandType_Right);
+  raw.palm.normal = {{{0.0f, -1.0f, 0.0f}}};
+  raw.palm.direction = {{{0.0f, 0.0f, -1.0f}}};
+  raw.arm.next_joint = {{{40.0f, 200.0f, 60.0f}}};
+  raw.digits[1].bones[3].next_joint.y = 180.0f;
+  const Leap::Matrix rotation(Leap::Vector::up(), 0.7f, Leap::Vector(10.0f, -20.0f, 30.0f));
+  LEAP_HAND moved = raw;
+  auto apply = [&](LEAP_VECTOR& p, bool isPoint) {
+    const Leap::Vector q = isPoint ? rotation.transformPoint(Leap::Vector(p.v)*1.3f) : rotation.transformDirection(Leap::Vector(p.v));
+    p.x = q.x; p.y = q.y; p.z = q.z;
+  };
+  for (int d = 0; d < 5; d++) {
+    for (int b = 0; b < 4; b++) {
+      apply(moved.digits[d].bones[b].next_joint, true);
+    }
+  }
+  apply(moved.arm.next_joint, true);
+  apply(moved.palm.normal, false);
+  apply(moved.palm.direction, false);
+  const Leap::Frame frame = makeFrame(1, { raw, makeHand(2, eLeapHandType_Left) });
+  const Leap::Frame movedFrame = makeFrame(2, { moved });
+  const Leap::PoseFeatures features = frame.hand(1).poseFeatures();
+  const Leap::PoseFeatures movedFeatures = movedFrame.hand(1).poseFeatures();
+  ASSERT_TRUE(features.valid);
+  ASSERT_TRUE(movedFeatures.valid);
+  EXPECT_NEAR(0.0f, features.distanceTo(movedFeatures), 1e-4f);
+  EXPECT_FALSE(frame.hand(2).poseFeatures().valid) << "A hand without a palm basis has no features";
+
+  // The tree finds the same neighbors as a linear scan
+  uint32_t seed = 12345;
+  auto random = [&seed]() { seed = seed*1664525u + 1013904223u; return static_cast<float>(seed >> 8)/16777216.0f; };
+  std::vector<Leap::PoseFeatures> library(3000);
+  Leap::PoseIndex index;
+  for (size_t i = 0; i < library.size(); i++) {
+    for (float& value : library[i].values) {
+      value = random();
+    }
+    library[i].valid = true;
+    index.add(library[i], static_cast<int32_t>(i));
+  }
+  ASSERT_EQ(3000u, index.count());
+
+  const std::string path = "PoseIndexTest.bin";
+  ASSERT_TRUE(index.save(path.c_str()));
+  Leap::PoseIndex loaded;
+  ASSERT_TRUE(loaded.load(path.c_str()));
+  EXPECT_EQ(3000u, loaded.count());
+  std::remove(path.c_str());
+
+  for (int q = 0; q < 20; q++) {
+    Leap::PoseFeatures query;
+    for (float& value : query.values) {
+      value = random();
+    }
+    query.valid = true;
+    std::vector<std::pair<float, int32_t>> expected;
+    for (size_t i = 0; i < library.size(); i++) {
+      expected.emplace_back(query.distanceTo(library[i]), static_cast<int32_t>(i));
+    }
+    std::sort(expected.begin(), expected.end());
+
+    Leap::PoseMatch matches[5];
+    ASSERT_EQ(5, index.nearest(query, 5, matches));
+    for (int i = 0; i < 5; i++) {
+      EXPECT_EQ(expected[i].second, matches[i].label);
+      EXPECT_NEAR(expected[i].first, matches[i].distance, 1e-4f);
+    }
+    EXPECT_EQ(expected[0].second, loaded.nearestLabel(query));
+  }
+  EXPECT_FALSE(loaded.load("/nonexistent/pose_index.bin"));
+  EXPECT_EQ(3000u, loaded.count());
+}
+
+TEST(FrameTest, CompactFrameRoundTrip) {
+  LEAP_HAND raw = makeHand(6, eLeapHandType_Left);
+  raw.palm.position = {{{-12.3f, 180.7f, 25.1f}}};
+  raw.palm.stabilized_position = {{{-11.0f, 181.0f, 24.0f}}};
+  raw.palm.velocity = {{{150.0f, -20.0f, 3.0f}}};
+  raw.palm.normal = {{{0.0f, -0.8f, 0.6f}}};
+  raw.palm.direction = {{{0.0f, 0.6f, 0.8f}}};
+  raw.palm.orientation = {{{0.1f, 0.2f, -0.3f, 0.927362f}}};
+  raw.palm.width = 85.5f;
+  raw.arm.prev_joint = {{{0.0f, 100.0f, 250.0f}}};
+  raw.arm.next_joint = {{{0.0f, 150.0f, 50.0f}}};
+  raw.arm.rotation = {{{0.0f, 0.38268343f, 0.0f, -0.92387953f}}};
+  raw.digits[3].bones[2].rotation = {{{0.5f, -0.5f, 0.5f, 0.5f}}};
+  raw.digits[1].is_extended = 1;
+  raw.confidence = 0.8f;
+  raw.pinch_distance = 42.25f;
+  raw.grab_angle = 1.5f;
+
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 77;
+  event.info.timestamp = 123456789;
+  event.framerate = 110.0f;
+  event.nHands = 1;
+  event.pHands = &raw;
+  const Leap::Frame original(std::make_shared<Leap::FrameImplementation>(event).get());
+  const Leap::Frame decoded(Leap::CompactFrame::encode(event).decode().get());
+
+  EXPECT_EQ(77, decoded.id());
+  EXPECT_EQ(123456789, decoded.timestamp());
+  EXPECT_EQ(110.0f, decoded.currentFramesPerSecond());
+  const Leap::Hand a = original.hand(6), b = decoded.hand(6);
+  ASSERT_TRUE(b.isValid());
+  EXPECT_TRUE(b.isLeft());
+  EXPECT_EQ(a.palmPosition(), b.palmPosition());
+  EXPECT_NEAR(0.0f, a.stabilizedPalmPosition().distanceTo(b.stabilizedPalmPosition()), 0.05f);
+  EXPECT_NEAR(0.0f, a.palmVelocity().distanceTo(b.palmVelocity()), 1.0f);
+  EXPECT_NEAR(a.palmWidth(), b.palmWidth(), 0.25f);
+  EXPECT_NEAR(a.confidence(), b.confidence(), 0.5f/255);
+  EXPECT_NEAR(a.pinchDistance(), b.pinchDistance(), 0.01f);
+  EXPECT_NEAR(a.grabAngle(), b.grabAngle(), 1e-4f);
+  EXPECT_NEAR(0.0f, a.basis().xBasis.distanceTo(b.basis().xBasis), 1e-3f);
+  EXPECT_NEAR(0.0f, a.basis().zBasis.distanceTo(b.basis().zBasis), 1e-3f);
+  EXPECT_NEAR(0.0f, a.arm().elbowPosition().distanceTo(b.arm().elbowPosition()), 0.05f);
+  for (int d = 0; d < 5; d++) {
+    const Leap::Finger fa = a.fingers()[d], fb = b.fingers()[d];
+    EXPECT_EQ(fa.isExtended(), fb.isExtended());
+    for (int t = 0; t < 4; t++) {
+      const Leap::Bone ba = fa.bone(static_cast<Leap::Bone::Type>(t)), bb = fb.bone(static_cast<Leap::Bone::Type>(t));
+      EXPECT_NEAR(0.0f, ba.prevJoint().distanceTo(bb.prevJoint()), 0.05f);
+      EXPECT_NEAR(0.0f, ba.nextJoint().distanceTo(bb.nextJoint()), 0.05f);
+      EXPECT_NEAR(0.0f, ba.basis().xBasis.distanceTo(bb.basis().xBasis), 5e-3f);
+      EXPECT_NEAR(0.0f, ba.basis().zBasis.distanceTo(bb.basis().zBasis), 5e-3f);
+    }
+  }
+  EXPECT_NEAR(0.0f, a.arm().basis().yBasis.distanceTo(b.arm().basis().yBasis), 5e-3f);
+}
+
+TEST(FrameTest, CompactHistory) {
+  Leap::Controller placeholder;
+  auto impl = std::make_shared<EventController>(placeholder);
+  Leap::Controller controller(impl.get());
+  controller.setRetentionLimits(Leap::Controller::RETENTION_FRAMES, 1);
+  controller.setCompactHistorySize(5);
+  for (int64_t id = 1; id <= 3; id++) {
+    trackFrame(*impl, id);
+  }
+  // Older frames are decoded from the compact tier
+  EXPECT_EQ(3, controller.frame(0).id());
+  EXPECT_EQ(2, controller.frame(1).id());
+  EXPECT_EQ(10000, controller.frame(2).timestamp());
+  EXPECT_FALSE(controller.frame(3).isValid());
+  EXPECT_FALSE(controller.frame(-1).isValid());
+}
+
+TEST(FrameTest, MapPointsView) {
+  const uint32_t count = 3;
+  std::shared_ptr<uint8_t> buffer(new uint8_t[sizeof(LEAP_POINT_MAPPING) + count*(sizeof(LEAP_VECTOR) + sizeof(uint32_t))],
+                                  std::default_delete<uint8_t[]>());
+  LEAP_POINT_MAPPING* pointMapping = reinterpret_cast<LEAP_POINT_MAPPING*>(buffer.get());
+  pointMapping->frame_id = 9;
+  pointMapping->nPoints = count;
+  pointMapping->pPoints = reinterpret_cast<LEAP_VECTOR*>(pointMapping + 1);
+  pointMapping->pIDs = reinterpret_cast<uint32_t*>(pointMapping->pPoints + count);
+  for (uint32_t i = 0; i < count; i++) {
+    pointMapping->pPoints[i] = {{{1.0f*i, 2.0f*i, 3.0f*i}}};
+    pointMapping->pIDs[i] = 100 + i;
+  }
+
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 9;
+  auto impl = std::make_shared<Leap::FrameImplementation>(event);
+  impl->setMapPoints(buffer);
+  const Leap::Frame frame(impl.get());
+
+  Leap::MapPointList points = frame.mapPoints();
+  buffer.reset();
+  impl.reset();
+  ASSERT_EQ(3, points.count());
+  EXPECT_EQ(reinterpret_cast<const Leap::Vector*>(pointMapping->pPoints), points.points()) << "The list must not copy the points";
+  EXPECT_EQ(pointMapping->pIDs, points.ids());
+  EXPECT_EQ(101u, points[1].id);
+  EXPECT_EQ(Leap::Vector(2.0f, 4.0f, 6.0f), points[-1].point);
+  EXPECT_EQ(0u, points[3].id);
+
+  points.append(frame.mapPoints());
+  ASSERT_EQ(6, points.count());
+  EXPECT_EQ(102u, points.ids()[5]);
+  EXPECT_EQ(Leap::Vector(1.0f, 2.0f, 3.0f), points.points()[4]);
+  EXPECT_EQ(3, frame.mapPoints().count());
+
+  EXPECT_EQ(nullptr, Leap::MapPointList().points());
+}
+
+TEST(MapPointStoreTest, UpdateQueryAndAge) {
+  uint32_t seed = 777;
+  auto random = [&seed]() { seed = seed*1664525u + 1013904223u; return static_cast<float>(seed >> 8)/16777216.0f; };
+  std::vector<Leap::Vector> points;
+  std::vector<uint32_t> ids;
+  for (uint32_t i = 0; i < 1000; i++) {
+    points.emplace_back(400.0f*random() - 200.0f, 400.0f*random(), 400.0f*random() - 200.0f);
+    ids.push_back(i);
+  }
+  Leap::MapPointStore store(25.0f, 1000);
+  store.update(Leap::MapPointList(std::make_shared<Leap::MapPointListImplementation>(points, ids)), 0);
+  ASSERT_EQ(1000, store.count());
+
+  const Leap::Vector center(10.0f, 150.0f, -20.0f);
+  std::vector<std::pair<float, uint32_t>> expected;
+  for (uint32_t i = 0; i < 1000; i++) {
+    expected.emplace_back(points[i].distanceTo(center), i);
+  }
+  std::sort(expected.begin(), expected.end());
+  const Leap::MapPointList nearest = store.nearest(center, 8);
+  ASSERT_EQ(8, nearest.count());
+  for (int i = 0; i < 8; i++) {
+    EXPECT_EQ(expected[i].second, nearest[i].id);
+  }
+  const Leap::MapPointList within = store.within(center, 60.0f);
+  const auto inside = std::count_if(expected.begin(), expected.end(), [](const std::pair<float, uint32_t>& p) { return p.first <= 60.0f; });
+  EXPECT_EQ(inside, within.count());
+  for (const Leap::MapPoint& point : within) {
+    EXPECT_LE(point.point.distanceTo(center), 60.0f);
+  }
+  // A box larger than the occupied region scans the occupied voxels instead of every cell
+  EXPECT_EQ(1000, store.within(center, 5000.0f).count());
+
+  // Repeated observations are averaged, and may move the point to another voxel
+  const std::vector<Leap::Vector> moved = { points[5] + Leap::Vector(100.0f, 0.0f, 0.0f) };
+  store.update(Leap::MapPointList(std::make_shared<Leap::MapPointListImplementation>(moved, std::vector<uint32_t>{5})), 500);
+  EXPECT_EQ(points[5] + Leap::Vector(50.0f, 0.0f, 0.0f), store.point(5).point);
+  EXPECT_EQ(5u, store.nearest(points[5] + Leap::Vector(50.0f, 0.0f, 0.0f), 1)[0].id);
+
+  // Ids not observed within the maximum age are dropped
+  store.update(Leap::MapPointList(), 1200);
+  EXPECT_EQ(1, store.count());
+  EXPECT_EQ(0u, store.point(6).id);
+  const Leap::MapPointList remaining = store.within(center, 5000.0f);
+  ASSERT_EQ(1, remaining.count());
+  EXPECT_EQ(5u, remaining[0].id);
+  store.clear();
+  EXPECT_TRUE(store.nearest(center, 3).isEmpty());
+}
+
+TEST(FrameTest, RetentionQueueBudgets) {
+  Leap::RetentionQueue<int> queue(5);
+  std::vector<int> evicted;
+  auto collect = [&evicted](int item) { evicted.push_back(item); };
+  for (int i = 0; i < 8; i++) {
+    queue.push_front(i, 100*(i + 1));
+    queue.evict(collect);
+  }
+  ASSERT_EQ(5u, queue.size());
+  EXPECT_EQ(7, queue.front());
+  EXPECT_EQ(3, queue[4]);
+  EXPECT_EQ(400 + 500 + 600 + 700 + 800, queue.bytes());
+  EXPECT_EQ((std::vector<int>{0, 1, 2}), evicted);
+
+  // The byte budget drops the oldest entries first but always keeps the newest
+  queue.setLimits(5, 1600);
+  queue.evict(collect);
+  EXPECT_EQ(2u, queue.size());
+  EXPECT_EQ(1500, queue.bytes());
+  queue.push_front(8, 5000);
+  queue.evict(collect);
+  ASSERT_EQ(1u, queue.size());
+  EXPECT_EQ(8, queue.front());
+  EXPECT_EQ(5000, queue.bytes());
+
+  queue.setLimits(0, 0);
+  queue.evict(collect);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(0, queue.bytes());
+  EXPECT_EQ(9u, evicted.size());
+
+  // Tracking bytes grow with the hands of a frame
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  LEAP_HAND hands[2] = { makeHand(1, eLeapHandType_Left), makeHand(2, eLeapHandType_Right) };
+  event.pHands = hands;
+  event.nHands = 1;
+  const int64_t oneHand = Leap::FrameImplementation(event).trackingBytes();
+  event.nHands = 2;
+  EXPECT_LE(oneHand + static_cast<int64_t>(sizeof(LEAP_HAND)), Leap::FrameImplementation(event).trackingBytes());
+
+  // Collision bounds are only computed, and counted, once queried
+  const Leap::FrameImplementation frame(event);
+  const int64_t unbounded = frame.trackingBytes();
+  ASSERT_EQ(2u, frame.handBounds().size());
+  EXPECT_EQ(unbounded + 2*static_cast<int64_t>(sizeof(Leap::AxisAlignedBox)), frame.trackingBytes());
+}
+
+TEST(FrameTest, RetentionLimitsDetachImages) {
+  Leap::Controller placeholder;
+  auto impl = std::make_shared<EventController>(placeholder);
+  Leap::Controller controller(impl.get());
+  uint8_t pixels[64] = {};
+  for (int64_t id = 1; id <= 3; id++) {
+    trackFrame(*impl, id);
+    deliverImages(*impl, id, id*10000, pixels);
+  }
+  const Leap::Frame oldest = controller.frame(2);
+  ASSERT_EQ(1, oldest.id());
+  EXPECT_EQ(2, oldest.images().count());
+  EXPECT_EQ(3, controller.retainedCount(Leap::Controller::RETENTION_IMAGES));
+
+  // Evicted image pairs are released by the frames that are still held too
+  controller.setRetentionLimits(Leap::Controller::RETENTION_IMAGES, 1);
+  EXPECT_EQ(1, controller.retainedCount(Leap::Controller::RETENTION_IMAGES));
+  EXPECT_TRUE(oldest.images().isEmpty());
+  EXPECT_TRUE(controller.frame(1).images().isEmpty());
+  EXPECT_EQ(2, controller.frame(0).images().count());
+
+  // A byte budget below one pair still keeps the newest pair
+  controller.setRetentionLimits(Leap::Controller::RETENTION_IMAGES, 8, 1);
+  deliverImages(*impl, 4, 40000, pixels);
+  trackFrame(*impl, 4);
+  EXPECT_EQ(1, controller.retainedCount(Leap::Controller::RETENTION_IMAGES));
+  EXPECT_TRUE(controller.frame(1).images().isEmpty());
+  EXPECT_EQ(2, controller.frame(0).images().count());
+}
+
+TEST(FrameTest, RetentionBudgetCountsPyramids) {
+  Leap::Controller placeholder;
+  auto impl = std::make_shared<EventController>(placeholder);
+  Leap::Controller controller(impl.get());
+  uint8_t pixels[64] = {};
+  deliverImages(*impl, 1, 10000, pixels);
+  const int64_t plain = controller.retainedBytes(Leap::Controller::RETENTION_IMAGES);
+
+  // Images too small for a second pyramid level still get an integral image of 9x9 sums each
+  controller.setPolicy(Leap::Controller::POLICY_IMAGE_PYRAMIDS);
+  deliverImages(*impl, 2, 20000, pixels);
+  const int64_t integrals = 2*9*9*static_cast<int64_t>(sizeof(uint32_t));
+  EXPECT_EQ(2*plain + integrals, controller.retainedBytes(Leap::Controller::RETENTION_IMAGES));
+
+  // A budget for two plain pairs no longer fits a pair with its derived buffers
+  controller.setRetentionLimits(Leap::Controller::RETENTION_IMAGES, 8, 2*plain);
+  EXPECT_EQ(1, controller.retainedCount(Leap::Controller::RETENTION_IMAGES));
+  EXPECT_EQ(plain + integrals, controller.retainedBytes(Leap::Controller::RETENTION_IMAGES));
+}
+
+TEST(ImageTest, ConvertAndPackStereo) {
+  const int width = 70, height = 12;
+  std::vector<uint8_t> pixels(2*width*height);
+  uint32_t seed = 99;
+  for (auto& pixel : pixels) {
+    seed = seed*1664525u + 1013904223u;
+    pixel = static_cast<uint8_t>(seed >> 24);
+  }
+  LEAP_IMAGE_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 5;
+  for (int i = 0; i < 2; i++) {
+    event.image[i].properties.width = width;
+    event.image[i].properties.height = height;
+    event.image[i].properties.bpp = 1;
+    event.image[i].data = pixels.data();
+    event.image[i].offset = i*width*height;
+  }
+  const Leap::Image left(std::make_shared<Leap::ImageImplementation>(nullptr, event, 0).get());
+  const Leap::Image right(std::make_shared<Leap::ImageImplementation>(nullptr, event, 1).get());
+
+  std::vector<float> floats(width*height);
+  ASSERT_EQ(floats.size()*sizeof(float), left.convert(floats.data(), floats.size()*sizeof(float), Leap::Image::OUTPUT_FLOAT32, 1, 2.0f, -1.0f));
+  std::vector<uint8_t> rgba(4*width*height);
+  ASSERT_EQ(rgba.size(), left.convert(rgba.data(), rgba.size(), Leap::Image::OUTPUT_RGBA8));
+  std::vector<uint16_t> halfs(width*height);
+  ASSERT_EQ(halfs.size()*2, left.convert(halfs.data(), halfs.size()*2, Leap::Image::OUTPUT_FLOAT16));
+  for (int i = 0; i < width*height; i++) {
+    EXPECT_EQ(pixels[i]*2.0f - 1.0f, floats[i]);
+    EXPECT_EQ(pixels[i], rgba[4*i + 1]);
+    EXPECT_EQ(255, rgba[4*i + 3]);
+  }
+  EXPECT_EQ(0x3c00, halfs[std::find(pixels.begin(), pixels.end(), 255) - pixels.begin()]);
+  EXPECT_EQ(0u, left.convert(floats.data(), 16, Leap::Image::OUTPUT_FLOAT32));
+  EXPECT_EQ(0u, left.convertedSize(Leap::Image::OUTPUT_GRAY8, 3));
+
+  // Area average with rounding; the last 2 columns are dropped at 4x
+  for (int downscale = 2; downscale <= 4; downscale *= 2) {
+    const int w = width/downscale, h = height/downscale;
+    std::vector<uint8_t> pair(2*w*h);
+    ASSERT_EQ(pair.size(), Leap::Image::packStereo(left, right, pair.data(), pair.size(), Leap::Image::OUTPUT_GRAY8, downscale));
+    for (int side = 0; side < 2; side++) {
+      for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+          int sum = 0;
+          for (int dy = 0; dy < downscale; dy++) {
+            for (int dx = 0; dx < downscale; dx++) {
+              sum += pixels[side*width*height + (y*downscale + dy)*width + x*downscale + dx];
+            }
+          }
+          EXPECT_EQ((sum + downscale*downscale/2)/(downscale*downscale), pair[y*2*w + side*w + x]);
+        }
+      }
+    }
+  }
+
+  // The same image on both sides still makes a pair
+  std::vector<uint8_t> twice(2*width*height);
+  ASSERT_EQ(twice.size(), Leap::Image::packStereo(left, left, twice.data(), twice.size(), Leap::Image::OUTPUT_GRAY8));
+  EXPECT_TRUE(std::equal(pixels.begin(), pixels.begin() + width, twice.begin()));
+  EXPECT_TRUE(std::equal(pixels.begin(), pixels.begin() + width, twice.begin() + width));
+}
+
+TEST(ImageTest, PyramidAndIntegralImage) {
+  const int width = 100, height = 68;
+  std::vector<uint8_t> pixels(width*height);
+  uint32_t seed = 5;
+  for (auto& pixel : pixels) {
+    seed = seed*1664525u + 1013904223u;
+    pixel = static_cast<uint8_t>(seed >> 24);
+  }
+  LEAP_IMAGE_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 3;
+  event.image[0].properties.width = width;
+  event.image[0].properties.height = height;
+  event.image[0].properties.bpp = 1;
+  event.image[0].data = pixels.data();
+  const Leap::Image image(std::make_shared<Leap::ImageImplementation>(nullptr, event, 0).get());
+
+  ASSERT_EQ(3, image.pyramidLevelCount());
+  EXPECT_EQ(image.data(), image.pyramidLevel(0));
+  EXPECT_EQ(25, image.pyramidWidth(2));
+  EXPECT_EQ(17, image.pyramidHeight(2));
+  EXPECT_EQ(nullptr, image.pyramidLevel(3));
+  const int taps[5] = { 1, 4, 6, 4, 1 };
+  const uint8_t* level = image.pyramidLevel(1);
+  for (int y = 0; y < height/2; y++) {
+    for (int x = 0; x < width/2; x++) {
+      int sum = 0;
+      for (int j = 0; j < 5; j++) {
+        for (int i = 0; i < 5; i++) {
+          const int sx = std::min(std::max(2*x + i - 2, 0), width - 1);
+          const int sy = std::min(std::max(2*y + j - 2, 0), height - 1);
+          sum += taps[i]*taps[j]*pixels[sy*width + sx];
+        }
+      }
+      EXPECT_EQ((sum + 128) >> 8, level[y*width/2 + x]);
+    }
+  }
+  // Copies share the cached pyramid
+  EXPECT_EQ(level, Leap::Image(image).pyramidLevel(1));
+
+  uint32_t expected = 0;
+  for (int y = 10; y < 30; y++) {
+    for (int x = 5; x < 60; x++) {
+      expected += pixels[y*width + x];
+    }
+  }
+  EXPECT_EQ(expected, image.integralSum(5, 10, 55, 20));
+  EXPECT_EQ(0u, image.integralImage()[width + 1]);
+  EXPECT_EQ(image.integralSum(0, 0, width, height), image.integralSum(-10, -10, 1000, 1000));
+
+  // Released buffers are reused
+  auto pool = std::make_shared<Leap::ImageBufferPool>();
+  std::shared_ptr<uint8_t> buffer = pool->acquire(4096);
+  const uint8_t* storage = buffer.get();
+  buffer.reset();
+  EXPECT_EQ(1u, pool->freeCount(4096));
+  EXPECT_EQ(storage, pool->acquire(4096).get());
+}
+
+TEST(StereoDepthTest, RectifyAndMatch) {
+  // A pinhole pair whose distortion maps send slopes [-1, 1] linearly across the image, with
+  // the right image shifted by 10 pixels
+  const int width = 200, height = 120, shift = 10;
+  std::vector<uint8_t> pixels(2*width*height);
+  uint32_t seed = 1234;
+  std::vector<uint8_t> texture((width + shift)*height);
+  for (auto& pixel : texture) {
+    seed = seed*1664525u + 1013904223u;
+    pixel = static_cast<uint8_t>(seed >> 24);
+  }
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      pixels[y*width + x] = texture[y*(width + shift) + x];
+      pixels[width*height + y*width + x] = texture[y*(width + shift) + x + shift];
+    }
+  }
+  LEAP_IMAGE_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 9;
+  static LEAP_DISTORTION_MATRIX distortion;
+  for (int j = 0; j < LEAP_DISTORTION_MATRIX_N; j++) {
+    for (int i = 0; i < LEAP_DISTORTION_MATRIX_N; i++) {
+      const float slopeX = (i/63.0f - 0.5f)*8.0f, slopeY = (j/63.0f - 0.5f)*8.0f;
+      distortion.matrix[j][i].x = 0.5f*slopeX + 0.5f;
+      distortion.matrix[j][i].y = 0.5f*slopeY + 0.5f;
+    }
+  }
+  for (int i = 0; i < 2; i++) {
+    event.image[i].properties.width = width;
+    event.image[i].properties.height = height;
+    event.image[i].properties.bpp = 1;
+    event.image[i].data = pixels.data();
+    event.image[i].offset = i*width*height;
+    event.image[i].distortion_matrix = &distortion;
+  }
+  const Leap::Image left(std::make_shared<Leap::ImageImplementation>(nullptr, event, 0).get());
+  const Leap::Image right(std::make_shared<Leap::ImageImplementation>(nullptr, event, 1).get());
+
+  Leap::StereoDepth stereo(width, height, 1.0f);
+  EXPECT_EQ(nullptr, stereo.rectifiedImage(0));
+  ASSERT_TRUE(stereo.update(left, right, 40.0f));
+  EXPECT_TRUE(std::equal(pixels.begin(), pixels.begin() + width*height, stereo.rectifiedImage(0)));
+
+  // The focal length is 100 pixels per unit of slope, so the depth is 40*100/10 mm
+  const Leap::StereoRegion region = {60, 30, 80, 60, 300.0f, 600.0f};
+  std::vector<float> depth(region.width*region.height, -1.0f);
+  const int valid = stereo.computeDepth(region, depth.data());
+  EXPECT_GT(valid, region.width*region.height*9/10);
+  for (float z : depth) {
+    if (z != 0.0f) {
+      EXPECT_NEAR(400.0f, z, 4.0f); // 0.1 pixel of disparity
+    }
+  }
+
+  // A hand above the device maps to a region with the depth range of its joints
+  LEAP_HAND raw = makeHand(4, eLeapHandType_Right);
+  raw.palm.position.y = 200.0f;
+  raw.arm.next_joint.y = 200.0f;
+  const Leap::Frame frame = makeFrame(9, {raw});
+  const Leap::StereoRegion handRegion = stereo.handRegion(frame.hand(4));
+  EXPECT_FALSE(handRegion.isEmpty());
+  EXPECT_FLOAT_EQ(160.0f, handRegion.minDepth);
+  EXPECT_FLOAT_EQ(240.0f, handRegion.maxDepth);
+}
+
+TEST(FrameTest, HandCrops) {
+  // Both cameras see slopes [-1, 1] across a 200x200 image whose brightness is the column
+  const int size = 200;
+  std::vector<uint8_t> pixels(size*size);
+  for (int i = 0; i < size*size; i++) {
+    pixels[i] = static_cast<uint8_t>(i % size);
+  }
+  static LEAP_DISTORTION_MATRIX distortion;
+  for (int j = 0; j < LEAP_DISTORTION_MATRIX_N; j++) {
+    for (int i = 0; i < LEAP_DISTORTION_MATRIX_N; i++) {
+      distortion.matrix[j][i].x = 0.5f*(i/63.0f - 0.5f)*8.0f + 0.5f;
+      distortion.matrix[j][i].y = 0.5f*(j/63.0f - 0.5f)*8.0f + 0.5f;
+    }
+  }
+  LEAP_IMAGE_EVENT imageEvent;
+  std::memset(&imageEvent, 0, sizeof(imageEvent));
+  imageEvent.info.frame_id = 12;
+  for (int i = 0; i < 2; i++) {
+    imageEvent.image[i].properties.width = size;
+    imageEvent.image[i].properties.height = size;
+    imageEvent.image[i].properties.bpp = 1;
+    imageEvent.image[i].properties.type = eLeapImageType_Default;
+    imageEvent.image[i].data = pixels.data();
+    imageEvent.image[i].distortion_matrix = &distortion;
+  }
+
+  // The joints span x 0..80 and z -40..0 at a height of 200
+  LEAP_HAND raw = makeHand(3, eLeapHandType_Right);
+  raw.palm.position.y = 200.0f;
+  LEAP_TRACKING_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 12;
+  event.nHands = 1;
+  event.pHands = &raw;
+  auto impl = std::make_shared<Leap::FrameImplementation>(event);
+  const Leap::Frame frame(impl.get());
+  EXPECT_EQ(0u, frame.handCropCount());
+  // Crops are only taken from default images
+  LEAP_IMAGE_EVENT rawEvent = imageEvent;
+  rawEvent.image[0].properties.type = eLeapImageType_Raw;
+  rawEvent.image[1].properties.type = eLeapImageType_Raw;
+  impl->setImages({std::make_shared<Leap::ImageImplementation>(nullptr, rawEvent, 0),
+                   std::make_shared<Leap::ImageImplementation>(nullptr, rawEvent, 1)});
+  EXPECT_EQ(0u, frame.handCropCount());
+  impl->setImages({std::make_shared<Leap::ImageImplementation>(nullptr, imageEvent, 0),
+                   std::make_shared<Leap::ImageImplementation>(nullptr, imageEvent, 1)});
+  ASSERT_EQ(2u, frame.handCropCount());
+
+  const int cropSize = 26;
+  std::vector<float> batch(2*cropSize*cropSize);
+  Leap::HandCrop crops[2];
+  EXPECT_EQ(0u, frame.writeHandCrops(batch.data(), batch.size()*sizeof(float) - 1, cropSize, crops));
+  ASSERT_EQ(2u, frame.writeHandCrops(batch.data(), batch.size()*sizeof(float), cropSize, crops, 40.0f, 0.15f, 1.0f, 0.0f));
+  // Left camera: columns 70..110 and rows 80..100, padded to a 52 pixel square
+  EXPECT_EQ(3, crops[0].handId);
+  EXPECT_EQ(1, crops[1].camera);
+  EXPECT_NEAR(52.0f, crops[0].size, 1e-3f);
+  EXPECT_NEAR(64.0f, crops[0].x, 1e-3f);
+  EXPECT_NEAR(64.0f, crops[0].y, 1e-3f);
+  EXPECT_NEAR(44.0f, crops[1].x, 1e-3f);
+  // Sampled from the first pyramid level, where the ramp is preserved
+  for (int j = 0; j < cropSize; j++) {
+    for (int i = 0; i < cropSize; i++) {
+      EXPECT_NEAR(64.5f + 2*i, batch[j*cropSize + i], 0.01f);
+      EXPECT_NEAR(44.5f + 2*i, batch[cropSize*cropSize + j*cropSize + i], 0.01f);
+    }
+  }
+}
+
+TEST(ImageCodecTest, RoundTrip) {
+  // 37 pixel rows do not split into whole blocks; the right image is the left one shifted by 3
+  const int width = 37, height = 11, frames = 5;
+  std::vector<std::vector<unsigned char>> pairs(2*frames, std::vector<unsigned char>(width*height));
+  unsigned int seed = 7;
+  for (int f = 0; f < frames; f++) {
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        seed = seed*1103515245u + 12345u;
+        const int noise = static_cast<int>((seed >> 16) % 5) - 2;
+        pairs[2*f][y*width + x] = static_cast<unsigned char>(std::max(0, 60 + 4*x + 3*y + f + noise));
+        pairs[2*f + 1][y*width + x] = static_cast<unsigned char>(std::max(0, 60 + 4*(x + 3) + 3*y + f + noise));
+      }
+    }
+  }
+  pairs[0][0] = 255; // A residual that needs all 8 bits
+
+  Leap::ImageCodec encoder(3), decoder;
+  const size_t maxSize = Leap::ImageCodec::maxEncodedSize(width, height);
+  std::vector<std::vector<unsigned char>> encoded(frames, std::vector<unsigned char>(maxSize));
+  std::vector<unsigned char> left(width*height), right(width*height);
+  EXPECT_EQ(0u, encoder.encode(pairs[0].data(), pairs[1].data(), width, height, encoded[0].data(), 40));
+  for (int f = 0; f < frames; f++) {
+    const size_t size = encoder.encode(pairs[2*f].data(), pairs[2*f + 1].data(), width, height, encoded[f].data(), maxSize);
+    ASSERT_GT(size, 0u);
+    ASSERT_LT(size, maxSize);
+    encoded[f].resize(size);
+    int decodedWidth = 0, decodedHeight = 0;
+    bool keyframe = false;
+    ASSERT_TRUE(Leap::ImageCodec::frameInfo(encoded[f].data(), size, &decodedWidth, &decodedHeight, &keyframe));
+    EXPECT_EQ(width, decodedWidth);
+    EXPECT_EQ(height, decodedHeight);
+    EXPECT_EQ(f % 3 == 0, keyframe);
+    ASSERT_TRUE(decoder.decode(encoded[f].data(), size, left.data(), right.data()));
+    EXPECT_TRUE(left == pairs[2*f]);
+    EXPECT_TRUE(right == pairs[2*f + 1]);
+  }
+  // Delta frames only decode in sequence
+  EXPECT_LT(encoded[2].size(), encoded[0].size());
+  decoder.reset();
+  EXPECT_FALSE(decoder.decode(encoded[3].data(), encoded[3].size() - 1, left.data(), right.data()));
+  EXPECT_FALSE(decoder.decode(encoded[4].data(), encoded[4].size(), left.data(), right.data()));
+  EXPECT_TRUE(decoder.decode(encoded[3].data(), encoded[3].size(), left.data(), right.data()));
+  EXPECT_TRUE(decoder.decode(encoded[4].data(), encoded[4].size(), left.data(), right.data()));
+  EXPECT_TRUE(right == pairs[9]);
+}
+
+TEST(ImageTest, UndistortionMapCache) {
+  // Slopes [-1, 1] span a 64x32 image
+  static LEAP_DISTORTION_MATRIX distortion, recalibrated;
+  for (int j = 0; j < LEAP_DISTORTION_MATRIX_N; j++) {
+    for (int i = 0; i < LEAP_DISTORTION_MATRIX_N; i++) {
+      distortion.matrix[j][i].x = 0.5f*(i/63.0f - 0.5f)*8.0f + 0.5f;
+      distortion.matrix[j][i].y = 0.5f*(j/63.0f - 0.5f)*8.0f + 0.5f;
+    }
+  }
+  recalibrated = distortion;
+  recalibrated.matrix[10][20].x += 0.001f;
+  std::vector<uint8_t> pixels(64*32);
+  LEAP_IMAGE_EVENT event;
+  std::memset(&event, 0, sizeof(event));
+  event.info.frame_id = 3;
+  for (int i = 0; i < 2; i++) {
+    event.image[i].properties.width = 64;
+    event.image[i].properties.height = 32;
+    event.image[i].properties.bpp = 1;
+    event.image[i].data = pixels.data();
+    event.image[i].distortion_matrix = i == 0 ? &distortion : &recalibrated;
+  }
+  const auto left = std::make_shared<Leap::ImageImplementation>(nullptr, event, 0);
+  const auto right = std::make_shared<Leap::ImageImplementation>(nullptr, event, 1);
+  const auto nextLeft = std::make_shared<Leap::ImageImplementation>(nullptr, event, 0);
+  EXPECT_NE(0u, left->calibrationHash());
+  EXPECT_EQ(left->calibrationHash(), nextLeft->calibrationHash());
+  EXPECT_NE(left->calibrationHash(), right->calibrationHash());
+
+  // Pixel centers of the 8x8 grid at slopes -0.875, -0.625, ...
+  const Leap::Image image(left.get());
+  const float* map = image.undistortionMap(8, 8);
+  ASSERT_NE(nullptr, map);
+  EXPECT_EQ(map, image.undistortionMap(8, 8));
+  EXPECT_NEAR(3.5f, map[0], 1e-3f);
+  EXPECT_NEAR(1.5f, map[1], 1e-3f);
+  EXPECT_NEAR(35.5f, map[2*(3*8 + 4)], 1e-3f);
+  EXPECT_NEAR(13.5f, map[2*(3*8 + 4) + 1], 1e-3f);
+  EXPECT_FLOAT_EQ(-1.0f, image.undistortionMap(8, 8, 8.0f)[0]);
+  EXPECT_EQ(nullptr, Leap::Image().undistortionMap(8, 8));
+
+  // Built once per calibration and grid
+  Leap::DistortionMapCache cache;
+  const auto shared = cache.acquire(*left, "", 8, 8, 1.0f);
+  EXPECT_EQ(shared, cache.acquire(*nextLeft, "", 8, 8, 1.0f));
+  EXPECT_EQ(1u, cache.buildCount());
+  EXPECT_NE(shared, cache.acquire(*right, "", 8, 8, 1.0f));
+  EXPECT_NE(shared, cache.acquire(*left, "", 16, 8, 1.0f));
+  EXPECT_EQ(3u, cache.buildCount());
+  EXPECT_TRUE(std::equal(shared->begin(), shared->end(), map));
+
+  // Saved per device serial and loaded by the next run
+  TemporaryDirectory directory;
+  ASSERT_FALSE(directory.path().empty());
+  directory.file("LP_7-0-8x6-1000.undistortion");
+  directory.file("LP_7-0-8x6-1000.undistortion.tmp");
+  directory.file("LP_7-1-8x6-1000.undistortion");
+  directory.file("LP_7-1-8x6-1000.undistortion.tmp");
+  cache.setDirectory(directory.path());
+  const auto saved = cache.acquire(*left, "LP-7", 8, 6, 1.0f);
+  EXPECT_EQ(4u, cache.buildCount());
+  Leap::DistortionMapCache restarted;
+  restarted.setDirectory(directory.path());
+  const auto loaded = restarted.acquire(*nextLeft, "LP-7", 8, 6, 1.0f);
+  EXPECT_EQ(0u, restarted.buildCount());
+  ASSERT_TRUE(loaded && saved);
+  EXPECT_TRUE(*loaded == *saved);
+  restarted.acquire(*right, "LP-7", 8, 6, 1.0f);
+  EXPECT_EQ(1u, restarted.buildCount());
+}
+
+namespace {
+
+// Counts onImages() calls and blocks in each until released
+struct BlockingListener : public Leap::Listener {
+  void onImages(const Leap::Controller&) override {
+    std::unique_lock<std::mutex> lk(mutex);
+    calls++;
+    changed.notify_all();
+    changed.wait(lk, [this] { return released; });
+  }
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  int calls = 0;
+  bool released = false;
+};
+
+}
+
+TEST(ImageDeliveryTest, RateLimitAndLatestOnly) {
+  // A second of 90 Hz image timestamps delivered at 30 Hz
+  Leap::ImageRateLimiter limiter;
+  limiter.setRate(30.0f);
+  int delivered = 0;
+  for (int i = 0; i < 90; i++) {
+    delivered += limiter.accept(i*11111) ? 1 : 0;
+  }
+  EXPECT_EQ(30, delivered);
+  EXPECT_TRUE(limiter.accept(10000000)); // Restarts after a gap
+  EXPECT_FALSE(limiter.accept(10011111));
+  limiter.setRate(0.0f);
+  EXPECT_TRUE(limiter.accept(10011112));
+
+  // Posts made during a call leave a single call pending
+  Leap::Controller controller;
+  BlockingListener listener;
+  {
+    Leap::ImageDispatcher dispatcher(listener, controller);
+    EXPECT_TRUE(dispatcher.post());
+    std::unique_lock<std::mutex> lk(listener.mutex);
+    listener.changed.wait(lk, [&listener] { return listener.calls == 1; });
+    lk.unlock();
+    EXPECT_TRUE(dispatcher.post());
+    EXPECT_FALSE(dispatcher.post());
+    EXPECT_FALSE(dispatcher.post());
+    lk.lock();
+    listener.released = true;
+    listener.changed.notify_all();
+    listener.changed.wait(lk, [&listener] { return listener.calls == 2; });
+  }
+  EXPECT_EQ(2, listener.calls);
+
+  EXPECT_FALSE(controller.setImageDelivery(listener, 15.0f, true));
+  EXPECT_TRUE(controller.addListener(listener));
+  EXPECT_TRUE(controller.setImageDelivery(listener, 15.0f, true));
+  EXPECT_TRUE(controller.setImageDelivery(listener, 0.0f));
+  EXPECT_TRUE(controller.setImageDelivery(listener, 15.0f, true));
+  EXPECT_TRUE(controller.removeListener(listener));
+  EXPECT_FALSE(controller.setImageDelivery(listener, 15.0f));
+}
+
+namespace {
+
+struct CountingListener : public Leap::Listener {
+  void onImages(const Leap::Controller&) override { calls++; }
+  int calls = 0;
+};
+
+}
+
+TEST(ImageDeliveryTest, LazyRetention) {
+  Leap::Controller placeholder;
+  auto impl = std::make_shared<EventController>(placeholder);
+  Leap::Controller controller(impl.get());
+  CountingListener listener;
+  controller.addListener(listener);
+  ASSERT_TRUE(controller.setImageDelivery(listener, 30.0f));
+  const auto retained = [&controller] { return controller.retainedCount(Leap::Controller::RETENTION_IMAGES); };
+
+  // 90 Hz pairs reach the listener at 30 Hz, but are all retained by default
+  const uint32_t size = 64;
+  void* buffer = impl->allocate(size);
+  for (int64_t id = 1; id <= 6; id++) {
+    deliverImages(*impl, id, id*11111, buffer);
+  }
+  EXPECT_EQ(2, listener.calls);
+  EXPECT_EQ(6, retained());
+  EXPECT_EQ(6, controller.images()[0].sequenceId());
+
+  // With lazy retention, the buffers of skipped pairs return to the pool as soon as LeapC
+  // releases them, and are reused for the next pair
+  controller.setPolicy(Leap::Controller::POLICY_LAZY_IMAGE_RETENTION);
+  impl->deallocate(buffer);
+  for (int64_t id = 7; id <= 12; id++) {
+    buffer = impl->allocate(size);
+    deliverImages(*impl, id, id*11111, buffer);
+    impl->deallocate(buffer);
+    const bool delivered = id == 7 || id == 10;
+    EXPECT_EQ(delivered ? 0u : 1u, impl->imageBufferPool()->freeCount(size));
+  }
+  EXPECT_EQ(4, listener.calls);
+  EXPECT_EQ(8, retained());
+  EXPECT_EQ(10, controller.images()[0].sequenceId());
+
+  // Without listeners, every pair is retained
+  controller.removeListener(listener);
+  deliverImages(*impl, 13, 13*11111, nullptr);
+  EXPECT_EQ(9, retained());
+
+  controller.clearPolicy(Leap::Controller::POLICY_LAZY_IMAGE_RETENTION);
+  controller.addListener(listener);
+  ASSERT_TRUE(controller.setImageDelivery(listener, 30.0f));
+  deliverImages(*impl, 14, 14*11111, nullptr);
+  deliverImages(*impl, 15, 15*11111, nullptr);
+  EXPECT_EQ(5, listener.calls);
+  EXPECT_EQ(11, retained());
+}
+
+namespace {
+
+// A device with a view volume but no connection, for the boundary kernels
+class BoundaryDevice : public Leap::DeviceImplementation {
+public:
+  BoundaryDevice() {
+    m_device = reinterpret_cast<LEAP_DEVICE>(&m_info);
+    m_info.h_fov = 140.0f*Leap::DEG_TO_RAD;
+    m_info.v_fov = 120.0f*Leap::DEG_TO_RAD;
+    m_info.range = 600000;
+    updateBoundaryGeometry();
+  }
+  ~BoundaryDevice() { m_device = nullptr; }
+};
+
+}
+
+TEST(DeviceTest, BoundaryBatches) {
+  // 11 points run 2 SIMD batches and a scalar tail of 3
+  const BoundaryDevice device;
+  std::vector<Leap::Vector> points;
+  uint32_t seed = 11;
+  auto next = [&seed](float scale) {
+    seed = seed*1664525u + 1013904223u;
+    return ((seed >> 8)/16777216.0f - 0.5f)*2.0f*scale;
+  };
+  for (int i = 0; i < 11; i++) {
+    points.emplace_back(next(400.0f), 350.0f + next(350.0f), next(400.0f));
+  }
+  points[2] = Leap::Vector(0.0f, 900.0f, 0.0f); // Beyond the range, in a SIMD batch
+  points[9] = Leap::Vector(0.0f, -10.0f, 0.0f); // Below the device, in the tail
+
+  std::vector<float> distances(points.size());
+  device.distanceToBoundary(points.data(), distances.data(), points.size());
+  bool contained[11];
+  const size_t count = device.containedInBoundary(points.data(), contained, points.size());
+  size_t expectedCount = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    // The single-point query runs the scalar reference
+    EXPECT_NEAR(device.distanceToBoundary(points[i]), distances[i], 1e-3f) << i;
+    const Leap::Vector& p = points[i];
+    const bool inside = p.y >= 0.0f && std::fabs(p.x) <= p.y*std::tan(70.0f*Leap::DEG_TO_RAD) &&
+                        std::fabs(p.z) <= p.y*std::tan(60.0f*Leap::DEG_TO_RAD) && p.magnitude() <= 600.0f;
+    EXPECT_EQ(inside, contained[i]) << i;
+    bool single;
+    EXPECT_EQ(inside ? 1u : 0u, device.containedInBoundary(&p, &single, 1));
+    expectedCount += inside ? 1 : 0;
+  }
+  EXPECT_EQ(expectedCount, count);
+  EXPECT_FLOAT_EQ(0.0f, distances[2]);
+  EXPECT_LT(0u, count);
+  EXPECT_GT(points.size(), count);
+}